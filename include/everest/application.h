@@ -5,24 +5,41 @@
 
 #include <string>
 #include <memory>
+#include <map>
 #include <set>
 
 #include <everest/properties.h>
+#include <everest/thread_group.h>
 
 namespace everest
 {
     class Application;
     class ApplicationContext;   
     
+    /**
+     * 应用上下文
+     * thread_group(name)按命令行参数--<name>-threads=N、--<name>-cpus=0-7创建命名线程组，
+     * 同名只创建一次，随上下文析构时等待线程结束。未指定线程数时取cpu列表的个数，
+     * 都未指定时I/O和工作线程组取available_cpus()(受cgroup配额限制)，其它线程组为1个线程。
+     */
     class ApplicationContext
     {
     public:
         static const int RSIG_STOP = 1;    // 收到停止信号
         
+        static const char * const Group_IO;          // proactor线程
+        static const char * const Group_Worker;      // handler工作线程
+        static const char * const Group_Background;  // 后台任务线程
+        
     private:
         int        m_result;      // 程序运行结果值
         int        m_rsignals;    // 收到的信号
         Properties m_props;
+        std::map<String, Thread_Group *> m_thread_groups;
+        
+    private:
+        ApplicationContext(const ApplicationContext&) = delete;
+        ApplicationContext& operator=(const ApplicationContext&) = delete;
         
     public:
         ApplicationContext();
@@ -35,6 +52,9 @@ namespace everest
         void result(int ret) { m_result = ret; }
         
         bool signal_stop() const  { return m_rsignals & RSIG_STOP; }   // 是否收到停止信号
+        
+        // 取得或按参数创建命名线程组，cpu列表格式错误时忽略并记录错误
+        Thread_Group & thread_group(const char * name);
     }; // end of ApplicationContext
     
     class Application
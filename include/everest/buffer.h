@@ -8,6 +8,7 @@
 
 #include <list>
 #include <stdexcept>
+#include <everest/log.h>
 
 namespace everest 
 {
@@ -30,7 +31,7 @@ namespace everest
             : m_buffer(data), m_capacity(capacity)
             , m_limit(capacity), m_size(0), m_pos(0)
         {
-            printf("[TRACE] Basic_Mutable_Buffer init\n");
+            EVEREST_LOG_TRACE("Basic_Mutable_Buffer init");
         }
         
         void detach() {
@@ -54,7 +55,7 @@ namespace everest
         size_t size() const { return m_size; }
         
         bool   size(size_t newsize) {
-            printf("[TRACE] Mutable_Buffer::size(s), new %ld, old %ld\n", newsize, m_size);
+            EVEREST_LOG_TRACE("Mutable_Buffer::size(s), new %ld, old %ld", newsize, m_size);
             if ( newsize <= m_limit ) {
                 m_size = newsize;
                 return true; 
@@ -163,7 +164,7 @@ namespace everest
                 size_t limit = m_it_cursor->limit();
                 size_t size  = m_it_cursor->size();
                 size_t len = limit - size;
-                printf("[TRACE] Buffer_Sequence::write_submit, %ld, %ld, %ld, %ld\n", n, len, limit, size);
+                EVEREST_LOG_TRACE("Buffer_Sequence::write_submit, %ld, %ld, %ld, %ld", n, len, limit, size);
                 if ( n < len ) {
                     m_it_cursor->size( size + n ); 
                     n = 0;
@@ -178,6 +179,7 @@ namespace everest
                     }
                 }
             }
+            return true;
         }
     }; // end of class Basic_Buffer_Sequence
     
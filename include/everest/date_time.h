@@ -6,6 +6,7 @@
 #include <stdint.h>
 #include <assert.h>
 #include <sys/time.h>
+#include <time.h>
 
 namespace everest
 {
@@ -18,6 +19,14 @@ namespace everest
             assert(ret == 0);
             return (int64_t)(tv.tv_sec * 1000000LL + tv.tv_usec);
         } // end of get_timestamp
+        
+        // 单调时钟(us)，不受系统时间调整影响，用于定时器等只比较先后和间隔的场合
+        static int64_t get_monotonic_timestamp() {
+            struct timespec ts;
+            int ret = ::clock_gettime(CLOCK_MONOTONIC, &ts);
+            assert(ret == 0);
+            return (int64_t)(ts.tv_sec * 1000000LL + ts.tv_nsec / 1000);
+        } // end of get_monotonic_timestamp
     }; // end of DateTime 
     
 } // end of namespace everest 
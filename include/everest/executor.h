@@ -0,0 +1,343 @@
+#ifndef INCLUDE_EVEREST_EXECUTOR_H
+#define INCLUDE_EVEREST_EXECUTOR_H
+
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <everest/log.h>
+#include <everest/thread_group.h>
+
+namespace everest
+{
+    /**
+     * 工作窃取双端队列(Chase-Lev)，元素为指针
+     * push/take只能由所属线程调用，在底端进出；steal可在任意线程调用，从顶端取走。
+     * 扩容后旧数组可能仍被窃取线程读取，保留到析构时释放。
+     */
+    template<class T>
+    class Work_Stealing_Deque final
+    {
+    private:
+        class Array
+        {
+        private:
+            int64_t           m_capacity;   // 2的幂
+            std::atomic<T*> * m_slots;
+
+        public:
+            explicit Array(int64_t capacity)
+                : m_capacity(capacity), m_slots(new std::atomic<T*>[capacity]) {}
+
+            ~Array() { delete[] m_slots; }
+
+            int64_t capacity() const { return m_capacity; }
+
+            T * get(int64_t i) const { return m_slots[i & (m_capacity - 1)].load(std::memory_order_relaxed); }
+
+            void put(int64_t i, T * p) { m_slots[i & (m_capacity - 1)].store(p, std::memory_order_relaxed); }
+
+            Array * grow(int64_t bottom, int64_t top) const {
+                Array * p = new Array(m_capacity * 2);
+                for(int64_t i = top; i < bottom; ++i ) p->put(i, this->get(i));
+                return p;
+            }
+        }; // end of class Array
+
+        std::atomic<int64_t> m_top;
+        std::atomic<int64_t> m_bottom;
+        std::atomic<Array *> m_array;
+        std::vector<Array *> m_retired;    // 扩容替换下的数组
+
+    private:
+        Work_Stealing_Deque(const Work_Stealing_Deque&) = delete;
+        Work_Stealing_Deque& operator=(const Work_Stealing_Deque&) = delete;
+
+    public:
+        explicit Work_Stealing_Deque(int64_t capacity = 256)
+            : m_top(0), m_bottom(0), m_array(new Array(capacity)) {}
+
+        ~Work_Stealing_Deque() {
+            delete m_array.load(std::memory_order_relaxed);
+            for(size_t i = 0; i < m_retired.size(); ++i ) delete m_retired[i];
+        }
+
+        // 所属线程在底端放入
+        void push(T * p) {
+            int64_t b = m_bottom.load(std::memory_order_relaxed);
+            int64_t t = m_top.load(std::memory_order_acquire);
+            Array * a = m_array.load(std::memory_order_relaxed);
+            if ( b - t > a->capacity() - 1 ) {
+                m_retired.push_back(a);
+                a = a->grow(b, t);
+                m_array.store(a, std::memory_order_release);
+            }
+            a->put(b, p);
+            std::atomic_thread_fence(std::memory_order_release);
+            m_bottom.store(b + 1, std::memory_order_relaxed);
+        }
+
+        // 所属线程从底端取出，队列为空或最后一个元素被窃取时返回nullptr
+        T * take() {
+            int64_t b = m_bottom.load(std::memory_order_relaxed) - 1;
+            Array * a = m_array.load(std::memory_order_relaxed);
+            m_bottom.store(b, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            int64_t t = m_top.load(std::memory_order_relaxed);
+
+            T * p = nullptr;
+            if ( t <= b ) {
+                p = a->get(b);
+                if ( t == b ) {
+                    // 只剩一个元素，与窃取线程竞争
+                    if ( !m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed) ) {
+                        p = nullptr;
+                    }
+                    m_bottom.store(b + 1, std::memory_order_relaxed);
+                }
+            } else {
+                m_bottom.store(b + 1, std::memory_order_relaxed);
+            }
+            return p;
+        }
+
+        // 任意线程从顶端取走，队列为空或与其它线程竞争失败时返回nullptr
+        T * steal() {
+            int64_t t = m_top.load(std::memory_order_acquire);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            int64_t b = m_bottom.load(std::memory_order_acquire);
+            if ( t >= b ) return nullptr;
+
+            Array * a = m_array.load(std::memory_order_acquire);
+            T * p = a->get(t);
+            if ( !m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed) ) {
+                return nullptr;
+            }
+            return p;
+        }
+
+        bool empty() const {
+            int64_t b = m_bottom.load(std::memory_order_relaxed);
+            int64_t t = m_top.load(std::memory_order_relaxed);
+            return b <= t;
+        }
+    }; // end of class Work_Stealing_Deque
+
+    /**
+     * 固定线程数的工作窃取执行器
+     * 工作线程中提交的任务放入本线程的双端队列，无锁；其它线程(如proactor线程)提交的任务
+     * 放入共享的注入队列。工作线程依次从本线程队列底端、注入队列、其它线程队列顶端取任务，
+     * 都没有任务时在条件变量上等待。一个任务执行时间很长时，其余任务由别的线程取走执行。
+     */
+    class Work_Stealing_Executor final
+    {
+    public:
+        typedef std::function<void ()> Task;
+
+    private:
+        struct Worker
+        {
+            Work_Stealing_Executor *  p_executor;
+            size_t                    index;
+            Work_Stealing_Deque<Task> deque;
+            std::thread               thread;
+        };
+
+        std::vector<Worker *>   m_workers;
+        std::mutex              m_mutex;          // 保护注入队列和等待
+        std::condition_variable m_cond;
+        std::deque<Task *>      m_inject;         // 非工作线程提交的任务
+        std::atomic<size_t>     m_idle;           // 正在等待的工作线程数
+        std::atomic<bool>       m_stopping;
+        std::atomic<uint64_t>   m_executed;
+        std::atomic<uint64_t>   m_steals;
+        const Thread_Group *    m_p_threads;      // 线程命名和cpu绑定，可以为空
+
+    private:
+        Work_Stealing_Executor(const Work_Stealing_Executor&) = delete;
+        Work_Stealing_Executor& operator=(const Work_Stealing_Executor&) = delete;
+
+        static Worker *& current_worker() {
+            static thread_local Worker * p_worker = nullptr;
+            return p_worker;
+        }
+
+        void run(Worker * p_worker);
+        Task * find_task(Worker * p_worker);
+        Task * steal_task(Worker * p_worker);
+        void wake_one();
+        void start(size_t threads);
+
+    public:
+        // threads为0时使用available_cpus()
+        explicit Work_Stealing_Executor(size_t threads = 0);
+
+        // 工作线程数取线程组的大小，按线程组命名并绑定cpu；线程组需在执行器之后析构
+        explicit Work_Stealing_Executor(const Thread_Group &threads);
+        ~Work_Stealing_Executor();
+
+        // 任意线程调用，stop之后其它线程提交返回false
+        bool submit(const Task &task);
+
+        // 执行完已提交的任务(包括这些任务提交的子任务)后结束全部工作线程
+        void stop();
+
+        size_t   size() const { return m_workers.size(); }
+
+        // 当前线程是否为本执行器的工作线程
+        bool     in_worker() const {
+            Worker * p = current_worker();
+            return p != nullptr && p->p_executor == this;
+        }
+
+        uint64_t executed() const { return m_executed.load(); }
+        uint64_t steals() const { return m_steals.load(); }
+    }; // end of class Work_Stealing_Executor
+
+    inline Work_Stealing_Executor::Work_Stealing_Executor(size_t threads)
+        : m_idle(0), m_stopping(false), m_executed(0), m_steals(0), m_p_threads(nullptr)
+    {
+        this->start(threads == 0 ? available_cpus() : threads);
+    }
+
+    inline Work_Stealing_Executor::Work_Stealing_Executor(const Thread_Group &threads)
+        : m_idle(0), m_stopping(false), m_executed(0), m_steals(0), m_p_threads(&threads)
+    {
+        this->start(threads.size());
+    }
+
+    inline void Work_Stealing_Executor::start(size_t threads)
+    {
+        // 先创建全部worker，线程启动后即可互相窃取
+        m_workers.reserve(threads);
+        for(size_t i = 0; i < threads; ++i ) {
+            Worker * p_worker = new Worker();
+            p_worker->p_executor = this;
+            p_worker->index = i;
+            m_workers.push_back(p_worker);
+        }
+        for(size_t i = 0; i < threads; ++i ) {
+            m_workers[i]->thread = std::thread(&Work_Stealing_Executor::run, this, m_workers[i]);
+        }
+    }
+
+    inline Work_Stealing_Executor::~Work_Stealing_Executor()
+    {
+        this->stop();
+        for(size_t i = 0; i < m_workers.size(); ++i ) delete m_workers[i];
+        m_workers.clear();
+    }
+
+    inline bool Work_Stealing_Executor::submit(const Task &task)
+    {
+        // 停止过程中工作线程仍可提交，由本线程在退出前执行完
+        Worker * p_worker = current_worker();
+        if ( p_worker != nullptr && p_worker->p_executor == this ) {
+            p_worker->deque.push(new Task(task));
+            if ( m_idle.load() > 0 ) this->wake_one();    // 让等待的线程来窃取
+            return true;
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if ( m_stopping.load() ) {
+            EVEREST_LOG_WARN("Work_Stealing_Executor::submit, executor stopped");
+            return false;
+        }
+        m_inject.push_back(new Task(task));
+        if ( m_idle.load() > 0 ) m_cond.notify_one();
+        return true;
+    }
+
+    inline void Work_Stealing_Executor::wake_one()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_cond.notify_one();
+    }
+
+    inline void Work_Stealing_Executor::stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stopping.store(true);
+            m_cond.notify_all();
+        }
+        for(size_t i = 0; i < m_workers.size(); ++i ) {
+            if ( m_workers[i]->thread.joinable() ) m_workers[i]->thread.join();
+        }
+    }
+
+    // 从其它线程队列顶端窃取，从下一个线程开始轮流尝试
+    inline Work_Stealing_Executor::Task * Work_Stealing_Executor::steal_task(Worker * p_worker)
+    {
+        size_t n = m_workers.size();
+        for(size_t i = 1; i < n; ++i ) {
+            Worker * p_victim = m_workers[(p_worker->index + i) % n];
+            Task * p_task = p_victim->deque.steal();
+            if ( p_task ) {
+                m_steals.fetch_add(1, std::memory_order_relaxed);
+                return p_task;
+            }
+        }
+        return nullptr;
+    }
+
+    inline Work_Stealing_Executor::Task * Work_Stealing_Executor::find_task(Worker * p_worker)
+    {
+        Task * p_task = p_worker->deque.take();
+        if ( p_task ) return p_task;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if ( !m_inject.empty() ) {
+                p_task = m_inject.front();
+                m_inject.pop_front();
+                return p_task;
+            }
+        }
+        return this->steal_task(p_worker);
+    }
+
+    inline void Work_Stealing_Executor::run(Worker * p_worker)
+    {
+        current_worker() = p_worker;
+        if ( m_p_threads ) m_p_threads->bind(p_worker->index);
+        for(;;) {
+            Task * p_task = this->find_task(p_worker);
+            if ( p_task == nullptr ) {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                // 先登记为等待再检查一次，与submit中读取m_idle配对，避免错过唤醒
+                m_idle.fetch_add(1);
+                if ( m_inject.empty() ) {
+                    p_task = this->steal_task(p_worker);
+                    if ( p_task == nullptr ) {
+                        if ( m_stopping.load() ) {
+                            m_idle.fetch_sub(1);
+                            break;
+                        }
+                        m_cond.wait(lock);
+                    }
+                }
+                m_idle.fetch_sub(1);
+                if ( p_task == nullptr ) continue;
+            }
+
+            try {
+                (*p_task)();
+            } catch (const std::exception &e) {
+                EVEREST_LOG_ERROR("Work_Stealing_Executor::run, task exception, %s", e.what());
+            }
+            delete p_task;
+            m_executed.fetch_add(1, std::memory_order_relaxed);
+        }
+        current_worker() = nullptr;
+    } // end of Work_Stealing_Executor::run
+
+} // end of namespace everest
+
+#endif // INCLUDE_EVEREST_EXECUTOR_H
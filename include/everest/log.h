@@ -0,0 +1,339 @@
+#ifndef INCLUDE_EVEREST_LOG_H
+#define INCLUDE_EVEREST_LOG_H
+
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * 日志级别在编译期过滤，低于EVEREST_LOG_LEVEL的日志宏展开为空语句，参数不会被求值。
+ * 未指定时，定义了NDEBUG的发布版本为INFO，否则为TRACE。
+ * 定义EVEREST_LOG_SYNC时直接同步写出，否则写入本线程的无锁环形缓冲，由后台线程输出。
+ */
+#define EVEREST_LOG_LEVEL_TRACE  0
+#define EVEREST_LOG_LEVEL_DEBUG  1
+#define EVEREST_LOG_LEVEL_INFO   2
+#define EVEREST_LOG_LEVEL_WARN   3
+#define EVEREST_LOG_LEVEL_ERROR  4
+#define EVEREST_LOG_LEVEL_OFF    5
+
+#ifndef EVEREST_LOG_LEVEL
+#  ifdef NDEBUG
+#    define EVEREST_LOG_LEVEL EVEREST_LOG_LEVEL_INFO
+#  else
+#    define EVEREST_LOG_LEVEL EVEREST_LOG_LEVEL_TRACE
+#  endif
+#endif
+
+#if EVEREST_LOG_LEVEL <= EVEREST_LOG_LEVEL_TRACE
+#  define EVEREST_LOG_TRACE(...) ::everest::Logger::write(EVEREST_LOG_LEVEL_TRACE, __VA_ARGS__)
+#else
+#  define EVEREST_LOG_TRACE(...) ((void)0)
+#endif
+
+#if EVEREST_LOG_LEVEL <= EVEREST_LOG_LEVEL_DEBUG
+#  define EVEREST_LOG_DEBUG(...) ::everest::Logger::write(EVEREST_LOG_LEVEL_DEBUG, __VA_ARGS__)
+#else
+#  define EVEREST_LOG_DEBUG(...) ((void)0)
+#endif
+
+#if EVEREST_LOG_LEVEL <= EVEREST_LOG_LEVEL_INFO
+#  define EVEREST_LOG_INFO(...)  ::everest::Logger::write(EVEREST_LOG_LEVEL_INFO, __VA_ARGS__)
+#else
+#  define EVEREST_LOG_INFO(...)  ((void)0)
+#endif
+
+#if EVEREST_LOG_LEVEL <= EVEREST_LOG_LEVEL_WARN
+#  define EVEREST_LOG_WARN(...)  ::everest::Logger::write(EVEREST_LOG_LEVEL_WARN, __VA_ARGS__)
+#else
+#  define EVEREST_LOG_WARN(...)  ((void)0)
+#endif
+
+#if EVEREST_LOG_LEVEL <= EVEREST_LOG_LEVEL_ERROR
+#  define EVEREST_LOG_ERROR(...) ::everest::Logger::write(EVEREST_LOG_LEVEL_ERROR, __VA_ARGS__)
+#else
+#  define EVEREST_LOG_ERROR(...) ((void)0)
+#endif
+
+namespace everest
+{
+    /**
+     * 异步日志
+     * 每个线程第一次写日志时注册一个单生产者单消费者的环形缓冲，写日志只做格式化和
+     * 一次release store，不加锁；后台线程取出所有缓冲并批量写出，没有日志时休眠，
+     * 休眠后第一条日志唤醒它。缓冲满时TRACE~INFO丢弃并计数，WARN及以上先同步写出
+     * 所有缓冲中的日志再同步写出本条，不丢失、同一线程内不乱序。
+     */
+    class Logger final
+    {
+    public:
+        static const size_t Record_Size  = 256;     // 单条日志最大长度(含记录头)
+        static const size_t Ring_Records = 1024;    // 每线程缓冲的记录数
+        static const int    Idle_Wait_Ms = 50;      // 后台线程休眠的最长时间，兜底错过的唤醒
+
+        struct Record
+        {
+            int  level;
+            int  length;
+            char text[Record_Size - 2 * sizeof(int)];
+        };
+
+        class Ring
+        {
+        private:
+            Record              m_records[Ring_Records];
+            std::atomic<size_t> m_head;     // 生产者写入位置
+            std::atomic<size_t> m_tail;     // 消费者读取位置
+            std::atomic<bool>   m_closed;   // 所属线程已退出
+
+        public:
+            Ring() : m_head(0), m_tail(0), m_closed(false) {}
+
+            Record * acquire() {
+                size_t head = m_head.load(std::memory_order_relaxed);
+                if ( head - m_tail.load(std::memory_order_acquire) >= Ring_Records ) return nullptr;
+                return &m_records[head % Ring_Records];
+            }
+
+            void commit() {
+                m_head.store(m_head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+            }
+
+            void close() { m_closed.store(true, std::memory_order_release); }
+
+            bool closed() const { return m_closed.load(std::memory_order_acquire); }
+
+            bool empty() const {
+                return m_head.load(std::memory_order_acquire) == m_tail.load(std::memory_order_relaxed);
+            }
+
+            // 取出所有记录写入out，返回记录数
+            size_t drain(FILE * out);
+        }; // end of class Ring
+
+    private:
+        std::mutex            m_mutex;       // 保护m_rings
+        std::vector<Ring *>   m_rings;
+        std::thread           m_thread;
+        std::atomic<bool>     m_running;
+        std::atomic<bool>     m_sync;        // 后台线程停止后改为同步写出
+        std::atomic<uint64_t> m_dropped;
+        FILE *                m_output;
+        std::mutex            m_wake_mutex;
+        std::condition_variable m_wake;
+        std::atomic<bool>     m_waiting;     // 后台线程正在休眠，写日志时唤醒
+
+    private:
+        Logger();
+        ~Logger() {}
+        Logger(const Logger&) = delete;
+        Logger& operator=(const Logger&) = delete;
+
+    public:
+        // 进程内唯一实例，不析构，进程退出时由atexit输出剩余日志
+        static Logger & instance() {
+            static Logger * p_logger = new Logger();
+            return *p_logger;
+        }
+
+        static void write(int level, const char * fmt, ...) __attribute__((format(printf, 2, 3)));
+
+        static const char * level_name(int level) {
+            static const char * const names[] = { "TRACE", "DEBUG", "INFO", "WARN", "ERROR" };
+            return (level >= 0 && level < EVEREST_LOG_LEVEL_OFF) ? names[level] : "LOG";
+        }
+
+        void     set_output(FILE * out) { m_output = out; }
+        uint64_t dropped() const { return m_dropped.load(std::memory_order_relaxed); }
+
+        // 同步输出所有线程缓冲中的日志
+        void     flush();
+
+    private:
+        struct Ring_Holder
+        {
+            Ring * p_ring;
+            ~Ring_Holder() { if ( p_ring ) p_ring->close(); }
+        };
+
+        static Ring * local_ring() {
+            static thread_local Ring_Holder holder = { nullptr };
+            if ( holder.p_ring == nullptr ) holder.p_ring = instance().add_ring();
+            return holder.p_ring;
+        }
+
+        static void on_exit();
+
+        Ring * add_ring();
+        size_t drain_all();
+        bool   pending();
+        void   wake();
+        void   run();
+        void   vwrite_sync(int level, const char * fmt, va_list args);
+        void   vwrite_overflow(int level, const char * fmt, va_list args);
+    }; // end of class Logger
+
+    inline size_t Logger::Ring::drain(FILE * out)
+    {
+        size_t tail = m_tail.load(std::memory_order_relaxed);
+        size_t head = m_head.load(std::memory_order_acquire);
+        for(size_t i = tail; i != head; ++i ) {
+            const Record & r = m_records[i % Ring_Records];
+            fprintf(out, "[%s] %.*s\n", Logger::level_name(r.level), r.length, r.text);
+        }
+        m_tail.store(head, std::memory_order_release);
+        return head - tail;
+    }
+
+    inline Logger::Logger()
+        : m_running(true), m_sync(false), m_dropped(0), m_output(stdout), m_waiting(false)
+    {
+        m_thread = std::thread(&Logger::run, this);
+        ::atexit(&Logger::on_exit);
+    }
+
+    inline void Logger::write(int level, const char * fmt, ...)
+    {
+        va_list args;
+        va_start(args, fmt);
+#ifdef EVEREST_LOG_SYNC
+        instance().vwrite_sync(level, fmt, args);
+#else
+        Logger & logger = instance();
+        if ( logger.m_sync.load(std::memory_order_relaxed) ) {
+            logger.vwrite_sync(level, fmt, args);
+        } else {
+            Ring * p_ring = local_ring();
+            Record * p_record = p_ring->acquire();
+            if ( p_record ) {
+                int len = vsnprintf(p_record->text, sizeof(p_record->text), fmt, args);
+                if ( len < 0 ) len = 0;
+                if ( len >= (int)sizeof(p_record->text) ) len = (int)sizeof(p_record->text) - 1;
+                p_record->level  = level;
+                p_record->length = len;
+                p_ring->commit();
+                logger.wake();
+            } else if ( level >= EVEREST_LOG_LEVEL_WARN ) {
+                logger.vwrite_overflow(level, fmt, args);
+            } else {
+                logger.m_dropped.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+#endif
+        va_end(args);
+    }
+
+    inline void Logger::vwrite_sync(int level, const char * fmt, va_list args)
+    {
+        char text[sizeof(((Record *)0)->text)];
+        int len = vsnprintf(text, sizeof(text), fmt, args);
+        if ( len < 0 ) len = 0;
+        if ( len >= (int)sizeof(text) ) len = (int)sizeof(text) - 1;
+        fprintf(m_output, "[%s] %.*s\n", level_name(level), len, text);
+    }
+
+    // 缓冲满时的WARN/ERROR: 持有m_mutex先取出所有缓冲(包括本线程之前的日志)再写出本条
+    inline void Logger::vwrite_overflow(int level, const char * fmt, va_list args)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for(size_t i = 0; i < m_rings.size(); ++i ) m_rings[i]->drain(m_output);
+        this->vwrite_sync(level, fmt, args);
+        fflush(m_output);
+    }
+
+    inline void Logger::wake()
+    {
+        // 只有第一个看到休眠标志的线程通知，其它线程不加锁
+        if ( !m_waiting.load(std::memory_order_relaxed) || !m_waiting.exchange(false) ) return;
+        std::lock_guard<std::mutex> lock(m_wake_mutex);
+        m_wake.notify_one();
+    }
+
+    inline Logger::Ring * Logger::add_ring()
+    {
+        Ring * p_ring = new Ring();
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_rings.push_back(p_ring);
+        return p_ring;
+    }
+
+    inline size_t Logger::drain_all()
+    {
+        size_t count = 0;
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for(size_t i = 0; i < m_rings.size(); ) {
+            Ring * p_ring = m_rings[i];
+            bool closed = p_ring->closed();   // 先读关闭标志，保证关闭前写入的日志都已取出
+            count += p_ring->drain(m_output);
+            if ( closed ) {
+                delete p_ring;
+                m_rings[i] = m_rings.back();
+                m_rings.pop_back();
+            } else {
+                ++i;
+            }
+        }
+        if ( count > 0 ) fflush(m_output);
+        return count;
+    }
+
+    inline void Logger::flush()
+    {
+        this->drain_all();
+    }
+
+    inline bool Logger::pending()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for(size_t i = 0; i < m_rings.size(); ++i ) {
+            if ( !m_rings[i]->empty() || m_rings[i]->closed() ) return true;
+        }
+        return false;
+    }
+
+    inline void Logger::run()
+    {
+        while ( m_running.load(std::memory_order_acquire) ) {
+            if ( this->drain_all() > 0 ) continue;
+            
+            // 先设置休眠标志再检查一次，标志之前写入的日志不会被错过；
+            // 标志与写入之间的竞争由等待超时兜底
+            std::unique_lock<std::mutex> lock(m_wake_mutex);
+            m_waiting.store(true);
+            if ( m_running.load(std::memory_order_acquire) && !this->pending() ) {
+                int wait_ms = Idle_Wait_Ms;     // 复制一份，避免ODR使用未在类外定义的常量
+                m_wake.wait_for(lock, std::chrono::milliseconds(wait_ms));
+            }
+            m_waiting.store(false);
+        }
+    }
+
+    inline void Logger::on_exit()
+    {
+        Logger & logger = instance();
+        logger.m_running.store(false, std::memory_order_release);
+        {
+            std::lock_guard<std::mutex> lock(logger.m_wake_mutex);
+            logger.m_wake.notify_one();
+        }
+        if ( logger.m_thread.joinable() ) logger.m_thread.join();
+        logger.m_sync.store(true);
+        logger.drain_all();
+        uint64_t dropped = logger.dropped();
+        if ( dropped > 0 ) fprintf(logger.m_output, "[WARN] Logger, %lu records dropped\n", (unsigned long)dropped);
+        fflush(logger.m_output);
+    }
+
+} // end of namespace everest
+
+#endif // INCLUDE_EVEREST_LOG_H
@@ -0,0 +1,75 @@
+#ifndef INCLUDE_EVEREST_MPSC_QUEUE_H
+#define INCLUDE_EVEREST_MPSC_QUEUE_H
+
+#pragma once
+
+#include <atomic>
+#include <utility>
+
+namespace everest
+{
+    /**
+     * 无锁多生产者单消费者队列
+     * push可在任意线程调用，pop只能由唯一的消费者线程调用。
+     * 队列始终保留一个哑节点，消费者取出元素后该元素所在节点成为新的哑节点。
+     */
+    template<class T>
+    class MPSC_Queue final
+    {
+    private:
+        struct Node
+        {
+            std::atomic<Node *> next;
+            T                   value;
+
+            Node() : next(nullptr) {}
+            explicit Node(const T &v) : next(nullptr), value(v) {}
+        };
+
+        std::atomic<Node *> m_head;    // 生产者写入端
+        Node *              m_tail;    // 消费者读取端(哑节点)
+
+    private:
+        MPSC_Queue(const MPSC_Queue&) = delete;
+        MPSC_Queue& operator=(const MPSC_Queue&) = delete;
+
+    public:
+        MPSC_Queue() {
+            Node * stub = new Node();
+            m_head.store(stub, std::memory_order_relaxed);
+            m_tail = stub;
+        }
+
+        ~MPSC_Queue() {
+            Node * p = m_tail;
+            while ( p ) {
+                Node * next = p->next.load(std::memory_order_relaxed);
+                delete p;
+                p = next;
+            }
+        }
+
+        void push(const T &value) {
+            Node * node = new Node(value);
+            Node * prev = m_head.exchange(node, std::memory_order_acq_rel);
+            prev->next.store(node, std::memory_order_release);
+        }
+
+        // 队列为空，或者生产者尚未完成链接时返回false
+        bool pop(T &value) {
+            Node * next = m_tail->next.load(std::memory_order_acquire);
+            if ( next == nullptr ) return false;
+            value = std::move(next->value);
+            delete m_tail;
+            m_tail = next;
+            return true;
+        }
+
+        bool empty() const {
+            return m_tail->next.load(std::memory_order_acquire) == nullptr;
+        }
+    }; // end of class MPSC_Queue
+
+} // end of namespace everest
+
+#endif // INCLUDE_EVEREST_MPSC_QUEUE_H
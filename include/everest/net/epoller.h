@@ -5,18 +5,29 @@
 
 #include <sys/types.h>
 #include <sys/epoll.h>
+#include <stdint.h>
 #include <assert.h>
+#include <everest/log.h>
 
 namespace everest
 {
 namespace net 
 {
-    class EPoller final 
+    /**
+     * epoll封装
+     * EdgeTriggered为true时所有注册都带EPOLLET，只在状态变化时通知一次，
+     * 使用者需读写到EAGAIN为止，并自行记录socket是否仍可读写。
+     */
+    template<bool EdgeTriggered>
+    class Basic_EPoller final 
     {
     public:
-        static const int Event_None = 0;
-        static const int Event_Read = EPOLLIN;
+        static const bool Edge_Triggered = EdgeTriggered;
+        
+        static const int Event_None  = 0;
+        static const int Event_Read  = EPOLLIN;
         static const int Event_Write = EPOLLOUT;
+        static const int Event_Error = EPOLLERR | EPOLLHUP;
         
         static const int Step_Size = 1024;
         
@@ -32,7 +43,7 @@ namespace net
             
             void * data() { return m_pevent->data.ptr; }
             
-            int fd () const { m_pevent->data.fd; }
+            int fd () const { return m_pevent->data.fd; }
         }; // end of Event 
         
         class Iterator 
@@ -45,7 +56,7 @@ namespace net
             Iterator(epoll_event * const pevents, int count)
                 : m_pevents(pevents), m_count(count), m_cursor(0)
             {
-                printf("[TRACE] EPoller::Iterator(), events count %d\n", count);
+                EVEREST_LOG_TRACE("EPoller::Iterator(), events count %d", count);
             }
         
             bool has_next() const { return m_cursor < m_count; }
@@ -62,14 +73,15 @@ namespace net
         int           m_eventcount;
         epoll_event * m_pevents;
         int           m_count;
+        uint64_t      m_syscalls;     // epoll_ctl/epoll_wait调用次数
         
     private:
-        EPoller(const EPoller& ) = delete;
-        EPoller& operator=(const EPoller&) = delete;
+        Basic_EPoller(const Basic_EPoller& ) = delete;
+        Basic_EPoller& operator=(const Basic_EPoller&) = delete;
         
     public:
-        EPoller();
-        ~EPoller();
+        Basic_EPoller();
+        ~Basic_EPoller();
         
         bool add(int fd, int events, void * pdata);
         bool remove(int fd);
@@ -79,21 +91,28 @@ namespace net
         Iterator events() {
             return Iterator(m_pevents, m_count);
         }
-    }; // end of class EPoller
+        
+        uint64_t syscalls() const { return m_syscalls; }
+    }; // end of class Basic_EPoller
+    
+    typedef Basic_EPoller<false> EPoller;       // 水平触发
+    typedef Basic_EPoller<true>  EPoller_ET;    // 边沿触发
     
     
-    inline EPoller::EPoller() : m_maxevents(0), m_eventcount(0)
+    template<bool EdgeTriggered>
+    inline Basic_EPoller<EdgeTriggered>::Basic_EPoller() : m_maxevents(0), m_eventcount(0), m_count(0), m_syscalls(0)
     {
         m_epfd = ::epoll_create1(EPOLL_CLOEXEC);
         if ( m_epfd < 0 ) {
-            printf("[ERROR] EPoller::EPoller, epoll_create1 failed, %d, %s\n", errno, strerror(errno));
+            EVEREST_LOG_ERROR("EPoller::EPoller, epoll_create1 failed, %d, %s", errno, strerror(errno));
         }
         m_pevents = (epoll_event *)malloc(Step_Size * sizeof(epoll_event));
         m_maxevents = Step_Size;
         assert(m_pevents);
     }
     
-    inline EPoller::~EPoller()
+    template<bool EdgeTriggered>
+    inline Basic_EPoller<EdgeTriggered>::~Basic_EPoller()
     {
         if ( m_epfd >= 0 ) {
             ::close(m_epfd);
@@ -105,14 +124,16 @@ namespace net
         m_maxevents = 0;
     }
     
-    inline bool EPoller::add(int fd, int events, void *pdata)
+    template<bool EdgeTriggered>
+    inline bool Basic_EPoller<EdgeTriggered>::add(int fd, int events, void *pdata)
     {
         epoll_event e;
-        e.events = events;
+        e.events = EdgeTriggered ? (events | EPOLLET) : events;
         e.data.ptr = pdata;
         int ret = ::epoll_ctl(m_epfd, EPOLL_CTL_ADD, fd, &e);
+        ++m_syscalls;
         if ( ret < 0 ) {
-            printf("[ERROR] EPoller::add, epoll_ctl failed, %d, %s\n", errno, strerror(errno));
+            EVEREST_LOG_ERROR("EPoller::add, epoll_ctl failed, %d, %s", errno, strerror(errno));
             return false;
         }
         m_eventcount += 1;
@@ -125,34 +146,40 @@ namespace net
         return true;
     }
     
-    inline bool EPoller::set(int fd, int events, void *pdata)
+    template<bool EdgeTriggered>
+    inline bool Basic_EPoller<EdgeTriggered>::set(int fd, int events, void *pdata)
     {
         epoll_event e;
-        e.events = events;
+        e.events = EdgeTriggered ? (events | EPOLLET) : events;
         e.data.ptr = pdata;
         int ret = ::epoll_ctl(m_epfd, EPOLL_CTL_MOD, fd, &e);
+        ++m_syscalls;
         if ( ret < 0 ) {
-            printf("[ERROR] EPoller::set, epoll_ctl failed, %d, %s\n", errno, strerror(errno));
+            EVEREST_LOG_ERROR("EPoller::set, epoll_ctl failed, %d, %s", errno, strerror(errno));
             return false;
         }
         return true;
     }
     
-    inline bool EPoller::remove(int fd) 
+    template<bool EdgeTriggered>
+    inline bool Basic_EPoller<EdgeTriggered>::remove(int fd) 
     {
         int ret = ::epoll_ctl(m_epfd, EPOLL_CTL_DEL, fd, nullptr);
+        ++m_syscalls;
         if ( ret < 0 ) {
-            printf("[ERROR] EPoller::remove, epoll_ctl failed, %d, %s\n", errno, strerror(errno));
+            EVEREST_LOG_ERROR("EPoller::remove, epoll_ctl failed, %d, %s", errno, strerror(errno));
             return false;
         }
         return true;
     }
     
-    inline int EPoller::wait(int timeout) 
+    template<bool EdgeTriggered>
+    inline int Basic_EPoller<EdgeTriggered>::wait(int timeout) 
     {
         int ret = ::epoll_wait(m_epfd, m_pevents, m_maxevents, timeout);
+        ++m_syscalls;
         if ( ret < 0 ) {
-            printf("[ERROR] EPoller::wait, epoll_wait fail, %d, %s\n", errno, strerror(errno));
+            EVEREST_LOG_ERROR("EPoller::wait, epoll_wait fail, %d, %s", errno, strerror(errno));
             m_count = 0;
             return false;
         }
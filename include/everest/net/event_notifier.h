@@ -0,0 +1,80 @@
+#ifndef INCLUDE_EVEREST_NET_EVENT_NOTIFIER_H
+#define INCLUDE_EVEREST_NET_EVENT_NOTIFIER_H
+
+#pragma once
+
+#include <sys/eventfd.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <everest/log.h>
+
+namespace everest
+{
+namespace net
+{
+    /**
+     * 基于eventfd的唤醒通知，注册到poller后用于从其它线程唤醒等待中的poller
+     */
+    class EventNotifier final
+    {
+    private:
+        int m_fd;
+
+    private:
+        EventNotifier(const EventNotifier&) = delete;
+        EventNotifier& operator=(const EventNotifier&) = delete;
+
+    public:
+        EventNotifier();
+        ~EventNotifier();
+
+        int  handle() const { return m_fd; }
+        bool notify();
+        bool reset();
+    }; // end of class EventNotifier
+
+    inline EventNotifier::EventNotifier()
+    {
+        m_fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if ( m_fd < 0 ) {
+            EVEREST_LOG_ERROR("EventNotifier::EventNotifier, eventfd failed, %d, %s", errno, strerror(errno));
+        }
+    }
+
+    inline EventNotifier::~EventNotifier()
+    {
+        if ( m_fd >= 0 ) {
+            ::close(m_fd);
+            m_fd = -1;
+        }
+    }
+
+    inline bool EventNotifier::notify()
+    {
+        uint64_t val = 1;
+        ssize_t ret = ::write(m_fd, &val, sizeof(val));
+        if ( ret < 0 && errno != EAGAIN ) {   // 计数器溢出时说明已有未处理的通知
+            EVEREST_LOG_ERROR("EventNotifier::notify, write failed, %d, %s", errno, strerror(errno));
+            return false;
+        }
+        return true;
+    }
+
+    inline bool EventNotifier::reset()
+    {
+        uint64_t val = 0;
+        ssize_t ret = ::read(m_fd, &val, sizeof(val));
+        if ( ret < 0 && errno != EAGAIN ) {
+            EVEREST_LOG_ERROR("EventNotifier::reset, read failed, %d, %s", errno, strerror(errno));
+            return false;
+        }
+        return true;
+    }
+
+} // end of namespace net
+} // end of namespace everest
+
+#endif // INCLUDE_EVEREST_NET_EVENT_NOTIFIER_H
@@ -0,0 +1,388 @@
+#ifndef INCLUDE_EVEREST_NET_IO_URING_POLLER_H
+#define INCLUDE_EVEREST_NET_IO_URING_POLLER_H
+
+#pragma once
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <everest/log.h>
+
+#if defined(__linux__) && defined(__has_include)
+#  if __has_include(<linux/io_uring.h>)
+#    define EVEREST_HAS_IO_URING 1
+#  endif
+#endif
+
+#ifdef EVEREST_HAS_IO_URING
+#  include <sys/mman.h>
+#  include <sys/syscall.h>
+#  include <signal.h>
+#  include <linux/io_uring.h>
+#endif
+
+namespace everest
+{
+namespace net
+{
+    /**
+     * 基于io_uring的异步IO提交/完成队列，直接使用系统调用，不依赖liburing。
+     * prep_xxx只写入提交队列，wait时一次io_uring_enter提交全部请求并等待完成事件。
+     * 内核不支持io_uring(或不支持IORING_FEAT_EXT_ARG带超时等待)时supported()返回false。
+     */
+    class IoUringPoller final
+    {
+    public:
+        static const unsigned Queue_Depth = 256;
+
+        // 一个完成事件，取出时已从完成队列复制
+        class Event
+        {
+        private:
+            uint64_t m_data;
+            int32_t  m_res;
+            uint32_t m_flags;
+
+        public:
+            Event(uint64_t data, int32_t res, uint32_t flags)
+                : m_data(data), m_res(res), m_flags(flags) {}
+
+            void * data() const { return (void *)(uintptr_t)m_data; }
+
+            int    res() const { return m_res; }
+
+            // multishot请求仍然有效，后续还会有完成事件
+            bool   more() const;
+        }; // end of class Event
+
+        class Iterator
+        {
+        private:
+            IoUringPoller * m_poller;
+
+        public:
+            Iterator(IoUringPoller * poller) : m_poller(poller) {}
+
+            bool  has_next() const { return m_poller->ready() > 0; }
+
+            Event next() { return m_poller->pop_event(); }
+        }; // end of class Iterator
+
+    private:
+        int        m_fd;
+        unsigned   m_sq_entries;
+        unsigned   m_cq_entries;
+        unsigned   m_sq_pending;      // 已写入尚未提交的请求数
+        unsigned   m_sq_tail;         // 本地提交队列尾
+        uint64_t   m_syscalls;
+
+        void     * m_sq_ptr;
+        size_t     m_sq_size;
+        void     * m_cq_ptr;
+        size_t     m_cq_size;
+        void     * m_sqes;            // struct io_uring_sqe数组
+
+        unsigned * m_sq_khead;
+        unsigned * m_sq_ktail;
+        unsigned * m_sq_kmask;
+        unsigned * m_sq_array;
+        unsigned * m_cq_khead;
+        unsigned * m_cq_ktail;
+        unsigned * m_cq_kmask;
+        void     * m_cqes;            // struct io_uring_cqe数组
+
+    private:
+        IoUringPoller(const IoUringPoller&) = delete;
+        IoUringPoller& operator=(const IoUringPoller&) = delete;
+
+    public:
+        IoUringPoller();
+        ~IoUringPoller();
+
+        // 当前内核是否可用，结果缓存
+        static bool supported();
+
+        bool     valid() const { return m_fd >= 0; }
+
+        bool     prep_recvmsg(int fd, struct msghdr * msg, void * data);
+        bool     prep_sendmsg(int fd, const struct msghdr * msg, void * data);
+        bool     prep_accept(int fd, bool multishot, void * data);
+        bool     prep_poll(int fd, int events, void * data);
+        bool     prep_cancel(void * target, void * data);
+
+        // 只提交不等待，用于取消请求需要立即生效的场合
+        bool     submit();
+
+        // 提交全部请求，等待至少一个完成事件或超时(ms)，返回可取出的完成事件数，出错返回-1
+        int      wait(int timeout);
+
+        Iterator events() { return Iterator(this); }
+
+        // io_uring_setup/io_uring_enter调用次数
+        uint64_t syscalls() const { return m_syscalls; }
+
+    private:
+        unsigned ready() const;
+        Event    pop_event();
+        void   * get_sqe();
+        int      enter(unsigned to_submit, unsigned min_complete, unsigned flags, void * arg, size_t argsz);
+    }; // end of class IoUringPoller
+
+#ifdef EVEREST_HAS_IO_URING
+
+    inline bool IoUringPoller::Event::more() const { return (m_flags & IORING_CQE_F_MORE) != 0; }
+
+    inline bool IoUringPoller::supported()
+    {
+        static int s_supported = -1;
+        if ( s_supported < 0 ) {
+            struct io_uring_params params;
+            memset(&params, 0, sizeof(params));
+            int fd = (int)::syscall(__NR_io_uring_setup, 4, &params);
+            if ( fd < 0 ) {
+                EVEREST_LOG_WARN("IoUringPoller::supported, io_uring_setup failed, %d, %s", errno, strerror(errno));
+                s_supported = 0;
+            } else {
+                s_supported = (params.features & IORING_FEAT_EXT_ARG) ? 1 : 0;
+                if ( !s_supported ) EVEREST_LOG_WARN("IoUringPoller::supported, no IORING_FEAT_EXT_ARG");
+                ::close(fd);
+            }
+        }
+        return s_supported == 1;
+    }
+
+    inline IoUringPoller::IoUringPoller()
+        : m_fd(-1), m_sq_entries(0), m_cq_entries(0), m_sq_pending(0), m_sq_tail(0), m_syscalls(0)
+        , m_sq_ptr(MAP_FAILED), m_sq_size(0), m_cq_ptr(MAP_FAILED), m_cq_size(0), m_sqes(MAP_FAILED)
+    {
+        if ( !supported() ) return;     // 不可用的原因已在supported中记录
+
+        struct io_uring_params params;
+        memset(&params, 0, sizeof(params));
+        m_fd = (int)::syscall(__NR_io_uring_setup, Queue_Depth, &params);
+        ++m_syscalls;
+        if ( m_fd < 0 ) {
+            EVEREST_LOG_ERROR("IoUringPoller::IoUringPoller, io_uring_setup failed, %d, %s", errno, strerror(errno));
+            return;
+        }
+        m_sq_entries = params.sq_entries;
+        m_cq_entries = params.cq_entries;
+
+        m_sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        m_cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+        bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if ( single_mmap && m_cq_size > m_sq_size ) m_sq_size = m_cq_size;
+
+        m_sq_ptr = ::mmap(nullptr, m_sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQ_RING);
+        if ( single_mmap ) {
+            m_cq_ptr = m_sq_ptr;
+            m_cq_size = 0;      // 与提交队列共用映射
+        } else {
+            m_cq_ptr = ::mmap(nullptr, m_cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_CQ_RING);
+        }
+        m_sqes = ::mmap(nullptr, params.sq_entries * sizeof(struct io_uring_sqe),
+            PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQES);
+        if ( m_sq_ptr == MAP_FAILED || m_cq_ptr == MAP_FAILED || m_sqes == MAP_FAILED ) {
+            EVEREST_LOG_ERROR("IoUringPoller::IoUringPoller, mmap failed, %d, %s", errno, strerror(errno));
+            ::close(m_fd);
+            m_fd = -1;
+            return;
+        }
+
+        char * sq = (char *)m_sq_ptr;
+        m_sq_khead = (unsigned *)(sq + params.sq_off.head);
+        m_sq_ktail = (unsigned *)(sq + params.sq_off.tail);
+        m_sq_kmask = (unsigned *)(sq + params.sq_off.ring_mask);
+        m_sq_array = (unsigned *)(sq + params.sq_off.array);
+        m_sq_tail  = *m_sq_ktail;
+
+        char * cq = (char *)m_cq_ptr;
+        m_cq_khead = (unsigned *)(cq + params.cq_off.head);
+        m_cq_ktail = (unsigned *)(cq + params.cq_off.tail);
+        m_cq_kmask = (unsigned *)(cq + params.cq_off.ring_mask);
+        m_cqes     = cq + params.cq_off.cqes;
+    }
+
+    inline IoUringPoller::~IoUringPoller()
+    {
+        if ( m_sqes != MAP_FAILED ) ::munmap(m_sqes, m_sq_entries * sizeof(struct io_uring_sqe));
+        if ( m_cq_ptr != MAP_FAILED && m_cq_ptr != m_sq_ptr ) ::munmap(m_cq_ptr, m_cq_size);
+        if ( m_sq_ptr != MAP_FAILED ) ::munmap(m_sq_ptr, m_sq_size);
+        if ( m_fd >= 0 ) {
+            ::close(m_fd);
+            m_fd = -1;
+        }
+    }
+
+    inline int IoUringPoller::enter(unsigned to_submit, unsigned min_complete, unsigned flags, void * arg, size_t argsz)
+    {
+        ++m_syscalls;
+        return (int)::syscall(__NR_io_uring_enter, m_fd, to_submit, min_complete, flags, arg, argsz);
+    }
+
+    inline void * IoUringPoller::get_sqe()
+    {
+        unsigned head = __atomic_load_n(m_sq_khead, __ATOMIC_ACQUIRE);
+        if ( m_sq_tail - head >= m_sq_entries ) {
+            // 提交队列已满，先提交不等待
+            if ( !this->submit() ) return nullptr;
+            head = __atomic_load_n(m_sq_khead, __ATOMIC_ACQUIRE);
+            if ( m_sq_tail - head >= m_sq_entries ) return nullptr;
+        }
+        unsigned idx = m_sq_tail & *m_sq_kmask;
+        struct io_uring_sqe * sqe = (struct io_uring_sqe *)m_sqes + idx;
+        memset(sqe, 0, sizeof(*sqe));
+        m_sq_array[idx] = idx;
+        ++m_sq_tail;
+        ++m_sq_pending;
+        return sqe;
+    }
+
+    inline bool IoUringPoller::prep_recvmsg(int fd, struct msghdr * msg, void * data)
+    {
+        struct io_uring_sqe * sqe = (struct io_uring_sqe *)this->get_sqe();
+        if ( !sqe ) return false;
+        sqe->opcode    = IORING_OP_RECVMSG;
+        sqe->fd        = fd;
+        sqe->addr      = (uint64_t)(uintptr_t)msg;
+        sqe->len       = 1;
+        sqe->user_data = (uint64_t)(uintptr_t)data;
+        return true;
+    }
+
+    inline bool IoUringPoller::prep_sendmsg(int fd, const struct msghdr * msg, void * data)
+    {
+        struct io_uring_sqe * sqe = (struct io_uring_sqe *)this->get_sqe();
+        if ( !sqe ) return false;
+        sqe->opcode    = IORING_OP_SENDMSG;
+        sqe->fd        = fd;
+        sqe->addr      = (uint64_t)(uintptr_t)msg;
+        sqe->len       = 1;
+        sqe->msg_flags = MSG_NOSIGNAL;
+        sqe->user_data = (uint64_t)(uintptr_t)data;
+        return true;
+    }
+
+    inline bool IoUringPoller::prep_accept(int fd, bool multishot, void * data)
+    {
+        struct io_uring_sqe * sqe = (struct io_uring_sqe *)this->get_sqe();
+        if ( !sqe ) return false;
+        sqe->opcode       = IORING_OP_ACCEPT;
+        sqe->fd           = fd;
+        sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+        if ( multishot ) sqe->ioprio |= IORING_ACCEPT_MULTISHOT;
+        sqe->user_data    = (uint64_t)(uintptr_t)data;
+        return true;
+    }
+
+    inline bool IoUringPoller::prep_poll(int fd, int events, void * data)
+    {
+        struct io_uring_sqe * sqe = (struct io_uring_sqe *)this->get_sqe();
+        if ( !sqe ) return false;
+        sqe->opcode        = IORING_OP_POLL_ADD;
+        sqe->fd            = fd;
+        sqe->poll32_events = (uint32_t)events;
+        sqe->user_data     = (uint64_t)(uintptr_t)data;
+        return true;
+    }
+
+    inline bool IoUringPoller::prep_cancel(void * target, void * data)
+    {
+        struct io_uring_sqe * sqe = (struct io_uring_sqe *)this->get_sqe();
+        if ( !sqe ) return false;
+        sqe->opcode    = IORING_OP_ASYNC_CANCEL;
+        sqe->fd        = -1;
+        sqe->addr      = (uint64_t)(uintptr_t)target;
+        sqe->user_data = (uint64_t)(uintptr_t)data;
+        return true;
+    }
+
+    inline bool IoUringPoller::submit()
+    {
+        if ( m_sq_pending == 0 ) return true;
+        __atomic_store_n(m_sq_ktail, m_sq_tail, __ATOMIC_RELEASE);
+        int ret = this->enter(m_sq_pending, 0, 0, nullptr, 0);
+        if ( ret < 0 ) {
+            EVEREST_LOG_ERROR("IoUringPoller::submit, io_uring_enter failed, %d, %s", errno, strerror(errno));
+            return false;
+        }
+        m_sq_pending -= ((unsigned)ret > m_sq_pending) ? m_sq_pending : (unsigned)ret;
+        return true;
+    }
+
+    inline int IoUringPoller::wait(int timeout)
+    {
+        unsigned count = this->ready();
+        if ( m_sq_pending == 0 && count > 0 ) return (int)count;   // 已有完成事件，无需系统调用
+
+        __atomic_store_n(m_sq_ktail, m_sq_tail, __ATOMIC_RELEASE);
+        int ret;
+        if ( count > 0 || timeout == 0 ) {
+            ret = this->enter(m_sq_pending, 0, 0, nullptr, 0);   // 只提交
+        } else {
+            struct __kernel_timespec ts;
+            struct io_uring_getevents_arg arg;
+            memset(&arg, 0, sizeof(arg));
+            arg.sigmask_sz = _NSIG / 8;
+            if ( timeout > 0 ) {
+                ts.tv_sec  = timeout / 1000;
+                ts.tv_nsec = (timeout % 1000) * 1000000LL;
+                arg.ts = (uint64_t)(uintptr_t)&ts;
+            }
+            ret = this->enter(m_sq_pending, 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+        }
+        if ( ret < 0 ) {
+            if ( errno != ETIME && errno != EINTR && errno != EBUSY && errno != EAGAIN ) {
+                EVEREST_LOG_ERROR("IoUringPoller::wait, io_uring_enter failed, %d, %s", errno, strerror(errno));
+                return -1;
+            }
+        } else {
+            m_sq_pending -= ((unsigned)ret > m_sq_pending) ? m_sq_pending : (unsigned)ret;
+        }
+        return (int)this->ready();
+    }
+
+    inline unsigned IoUringPoller::ready() const
+    {
+        return __atomic_load_n(m_cq_ktail, __ATOMIC_ACQUIRE) - *m_cq_khead;
+    }
+
+    inline IoUringPoller::Event IoUringPoller::pop_event()
+    {
+        unsigned head = *m_cq_khead;
+        const struct io_uring_cqe * cqe = (const struct io_uring_cqe *)m_cqes + (head & *m_cq_kmask);
+        Event e(cqe->user_data, cqe->res, cqe->flags);
+        __atomic_store_n(m_cq_khead, head + 1, __ATOMIC_RELEASE);
+        return e;
+    }
+
+#else // EVEREST_HAS_IO_URING
+
+    // 没有io_uring头文件的平台，supported()总是返回false，由proactor回退到EPoller
+    inline bool IoUringPoller::Event::more() const { return false; }
+    inline bool IoUringPoller::supported() { return false; }
+    inline IoUringPoller::IoUringPoller()
+        : m_fd(-1), m_sq_entries(0), m_cq_entries(0), m_sq_pending(0), m_sq_tail(0), m_syscalls(0) {}
+    inline IoUringPoller::~IoUringPoller() {}
+    inline bool IoUringPoller::prep_recvmsg(int, struct msghdr *, void *) { return false; }
+    inline bool IoUringPoller::prep_sendmsg(int, const struct msghdr *, void *) { return false; }
+    inline bool IoUringPoller::prep_accept(int, bool, void *) { return false; }
+    inline bool IoUringPoller::prep_poll(int, int, void *) { return false; }
+    inline bool IoUringPoller::prep_cancel(void *, void *) { return false; }
+    inline bool IoUringPoller::submit() { return false; }
+    inline int  IoUringPoller::wait(int) { return -1; }
+    inline unsigned IoUringPoller::ready() const { return 0; }
+    inline IoUringPoller::Event IoUringPoller::pop_event() { return Event(0, 0, 0); }
+    inline void * IoUringPoller::get_sqe() { return nullptr; }
+    inline int  IoUringPoller::enter(unsigned, unsigned, unsigned, void *, size_t) { return -1; }
+
+#endif // EVEREST_HAS_IO_URING
+
+} // end of namespace net
+} // end of namespace everest
+
+#endif // INCLUDE_EVEREST_NET_IO_URING_POLLER_H
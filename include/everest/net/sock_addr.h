@@ -15,6 +15,7 @@
 #include <netinet/tcp.h>
 #include <arpa/inet.h>
 #include <sys/epoll.h>
+#include <everest/log.h>
 
 namespace everest
 {
@@ -97,7 +98,7 @@ namespace net
         char * p = strchr(addr, ':');
         if ( p == nullptr ) {
             free(addr);
-            printf("[ERROR] InetAdderssAdapter::from_string, bad endpoint, %s\n", endpoint);
+            EVEREST_LOG_ERROR("InetAdderssAdapter::from_string, bad endpoint, %s", endpoint);
             return false;
         }
         *p = '\0'; p += 1;
@@ -105,7 +106,7 @@ namespace net
         
         int ret = inet_aton(addr, &pinaddr->sin_addr);
         if ( ret == 0) {
-            printf("[ERROR] InetAdderssAdapter::from_string, AF_INET, bad addr, %s", addr);
+            EVEREST_LOG_ERROR("InetAdderssAdapter::from_string, AF_INET, bad addr, %s", addr);
             return false;
         }
         pinaddr->sin_port = htons(port);
@@ -4,7 +4,9 @@
 #pragma once 
 #include <everest/net/sock_addr.h>
 #include <fcntl.h>
+#include <linux/filter.h>
 #include <vector>
+#include <everest/log.h>
 
 namespace everest
 {
@@ -58,20 +60,31 @@ namespace net
         bool bind(const SocketAddress& addr);
         bool listen();
         bool connect(const SocketAddress& addr);
-        bool accept(Socket &sock, SocketAddress &addr);
+        bool accept(Socket &sock, SocketAddress &addr, int flags = 0);   // flagsͬaccept4SOCK_NONBLOCK
         
-        ssize_t send(std::vector<struct iovec> &buffers);
+        ssize_t send(std::vector<struct iovec> &buffers, int flags = 0);
         ssize_t receive(std::vector<struct iovec> &buffers);
         
         bool set_block_mode(bool blocked);
         bool set_reuse_addr(bool reuse);
+        bool set_reuse_port(bool reuse);
+        bool set_no_delay(bool nodelay);
+        bool set_notsent_lowat(int bytes);
+        bool set_busy_poll(int usec);
+        
+        // SO_REUSEPORTϹCBPF: յӵcpuΪcpus[i]ʱڵisocket
+        // cpucpu % cpus.size()Ϊsocketbind˳
+        bool set_reuseport_cpu_steering(const std::vector<int> &cpus);
+        
+        // ں˴ӱĵcpu(SO_INCOMING_CPU)ʧܷ-1
+        int  incoming_cpu() const;
     }; // end of class Socket
 
     Socket::Socket(const Protocol &proto) 
     {
         m_fd = ::socket(proto.domain(), proto.type(), proto.protocol());
         if ( m_fd < 0 ) {
-            printf("[ERROR] Socket::Socket, failed to create socket, %d, %s\n",
+            EVEREST_LOG_ERROR("Socket::Socket, failed to create socket, %d, %s",
                 errno, strerror(errno));
         }
     }
@@ -81,7 +94,7 @@ namespace net
         if ( create ) {
             m_fd = ::socket(proto.domain(), proto.type(), proto.protocol());
             if ( m_fd < 0 ) {
-                printf("[ERROR] Socket::Socket, failed to create socket, %d, %s\n",
+                EVEREST_LOG_ERROR("Socket::Socket, failed to create socket, %d, %s",
                     errno, strerror(errno));
             }
         } else {
@@ -101,7 +114,7 @@ namespace net
     {
         int ret = ::bind(m_fd, &(const sockaddr&)addr, addr.length());
         if ( ret < 0 ) {
-            printf("[ERROR] Socket::bind, bind failed %d, %s\n", errno, strerror(errno));
+            EVEREST_LOG_ERROR("Socket::bind, bind failed %d, %s", errno, strerror(errno));
             return false;
         }
         
@@ -112,7 +125,7 @@ namespace net
     {
         int ret = ::listen(m_fd, SOMAXCONN);
         if ( ret < 0 ) {
-            printf("[ERROR] Socket::listen, listen failed %d, %s\n", errno, strerror(errno));
+            EVEREST_LOG_ERROR("Socket::listen, listen failed %d, %s", errno, strerror(errno));
             return false;
         }
         return true;
@@ -124,20 +137,22 @@ namespace net
         if ( ret == 0 ) return true;
         else if ( ret < 0 ) {
             if ( errno == EINPROGRESS ) {
-                printf("[INFO] Socket::connect, conn in progress\n");
+                EVEREST_LOG_INFO("Socket::connect, conn in progress");
                 return true;
             } else {
-                printf("[ERROR] Socket::connect, conn ok, %d, %s\n", errno, strerror(errno));
+                EVEREST_LOG_ERROR("Socket::connect, conn ok, %d, %s", errno, strerror(errno));
                 return false;
             }
         }
+        return false;
     }
     
-    bool Socket::accept(Socket &sock, SocketAddress &addr)
+    bool Socket::accept(Socket &sock, SocketAddress &addr, int flags)
     {
-        int fd = ::accept(m_fd, &(sockaddr &)addr, &addr.length());
+        int fd = ::accept4(m_fd, &(sockaddr &)addr, &addr.length(), flags);
         if ( fd < 0 ) {
-            printf("[ERROR] Socket::accept, %d, %s\n", errno, strerror(errno));
+            if ( errno == EAGAIN || errno == EWOULDBLOCK ) return false;
+            EVEREST_LOG_ERROR("Socket::accept, %d, %s", errno, strerror(errno));
             return false;
         }
         sock.attach(fd);
@@ -148,7 +163,7 @@ namespace net
     {
         int flags = ::fcntl(m_fd, F_GETFL);
         if ( flags == -1 ) {
-            printf("[ERROR] Socket::set_block_mode, GETFL, %d, %s\n", errno, strerror(errno));
+            EVEREST_LOG_ERROR("Socket::set_block_mode, GETFL, %d, %s", errno, strerror(errno));
             return false;
         }
         
@@ -158,7 +173,7 @@ namespace net
           
         flags = ::fcntl(m_fd, F_SETFL, (flags ^= O_NONBLOCK));  // NONBLOCKλ01,10
         if ( flags == -1 ) {
-            printf("[ERROR] Socket::set_block_mode, SETFL, %d, %s\n", errno, strerror(errno));
+            EVEREST_LOG_ERROR("Socket::set_block_mode, SETFL, %d, %s", errno, strerror(errno));
             return false;
         }
         return true;        
@@ -169,13 +184,95 @@ namespace net
         int val = reuse;
         int ret = ::setsockopt(m_fd, SOL_SOCKET, SO_REUSEADDR, &val, sizeof(int));
         if ( ret < 0 ) {
-            printf("[ERROR] Socket::set_resue_addr, %d, %s\n", errno, strerror(errno));
+            EVEREST_LOG_ERROR("Socket::set_resue_addr, %d, %s", errno, strerror(errno));
+            return false;
+        }
+        return true;
+    }
+    
+    bool Socket::set_reuse_port(bool reuse)
+    {
+        int val = reuse;
+        int ret = ::setsockopt(m_fd, SOL_SOCKET, SO_REUSEPORT, &val, sizeof(int));
+        if ( ret < 0 ) {
+            EVEREST_LOG_ERROR("Socket::set_reuse_port, %d, %s", errno, strerror(errno));
+            return false;
+        }
+        return true;
+    }
+    
+    bool Socket::set_no_delay(bool nodelay)
+    {
+        int val = nodelay;
+        int ret = ::setsockopt(m_fd, IPPROTO_TCP, TCP_NODELAY, &val, sizeof(int));
+        if ( ret < 0 ) {
+            EVEREST_LOG_ERROR("Socket::set_no_delay, %d, %s", errno, strerror(errno));
+            return false;
+        }
+        return true;
+    }
+    
+    bool Socket::set_notsent_lowat(int bytes)
+    {
+        int ret = ::setsockopt(m_fd, IPPROTO_TCP, TCP_NOTSENT_LOWAT, &bytes, sizeof(int));
+        if ( ret < 0 ) {
+            EVEREST_LOG_ERROR("Socket::set_notsent_lowat, %d, %s", errno, strerror(errno));
+            return false;
+        }
+        return true;
+    }
+    
+    bool Socket::set_busy_poll(int usec)
+    {
+        int ret = ::setsockopt(m_fd, SOL_SOCKET, SO_BUSY_POLL, &usec, sizeof(int));
+        if ( ret < 0 ) {
+            EVEREST_LOG_ERROR("Socket::set_busy_poll, %d, %s", errno, strerror(errno));
+            return false;
+        }
+        return true;
+    }
+    
+    bool Socket::set_reuseport_cpu_steering(const std::vector<int> &cpus)
+    {
+        if ( cpus.empty() ) return false;
+        std::vector<struct sock_filter> code;
+        struct sock_filter load_cpu = BPF_STMT(BPF_LD | BPF_W | BPF_ABS, (__u32)(SKF_AD_OFF + SKF_AD_CPU));
+        code.push_back(load_cpu);
+        for(size_t i = 0; i < cpus.size(); ++i ) {
+            struct sock_filter match = BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, (__u32)cpus[i], 0, 1);
+            struct sock_filter ret   = BPF_STMT(BPF_RET | BPF_K, (__u32)i);
+            code.push_back(match);
+            code.push_back(ret);
+        }
+        struct sock_filter mod = BPF_STMT(BPF_ALU | BPF_MOD | BPF_K, (__u32)cpus.size());
+        struct sock_filter ret = BPF_STMT(BPF_RET | BPF_A, 0);
+        code.push_back(mod);
+        code.push_back(ret);
+        
+        struct sock_fprog prog;
+        prog.len = (unsigned short)code.size();
+        prog.filter = &code[0];
+        int ret_val = ::setsockopt(m_fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog));
+        if ( ret_val < 0 ) {
+            EVEREST_LOG_ERROR("Socket::set_reuseport_cpu_steering, %d, %s", errno, strerror(errno));
             return false;
         }
         return true;
     }
     
-    ssize_t Socket::send(std::vector<struct iovec> &buffers)
+    int Socket::incoming_cpu() const
+    {
+        int cpu = -1;
+        socklen_t len = sizeof(cpu);
+        int ret = ::getsockopt(m_fd, SOL_SOCKET, SO_INCOMING_CPU, &cpu, &len);
+        if ( ret < 0 ) {
+            EVEREST_LOG_ERROR("Socket::incoming_cpu, %d, %s", errno, strerror(errno));
+            return -1;
+        }
+        return cpu;
+    }
+    
+    ssize_t Socket::send(std::vector<struct iovec> &buffers, int flags)
     {
         struct msghdr msg;
         msg.msg_name = nullptr;
@@ -186,8 +283,8 @@ namespace net
         msg.msg_controllen = 0;
         msg.msg_flags = 0;
     
-        ssize_t ret = ::sendmsg(m_fd, &msg, 0);
-        printf("[TRACE] Socket::send, iovec\n");
+        ssize_t ret = ::sendmsg(m_fd, &msg, flags | MSG_NOSIGNAL);
+        EVEREST_LOG_TRACE("Socket::send, iovec");
         return ret;
     }
     
@@ -203,7 +300,7 @@ namespace net
         msg.msg_flags = 0;
     
         ssize_t ret = ::recvmsg(m_fd, &msg, 0);
-        printf("[TRACE] Socket::receive, iovec\n");
+        EVEREST_LOG_TRACE("Socket::receive, iovec");
         return ret;
     }
     
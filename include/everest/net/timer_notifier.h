@@ -0,0 +1,95 @@
+#ifndef INCLUDE_EVEREST_NET_TIMER_NOTIFIER_H
+#define INCLUDE_EVEREST_NET_TIMER_NOTIFIER_H
+
+#pragma once
+
+#include <sys/timerfd.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <everest/log.h>
+
+namespace everest
+{
+namespace net
+{
+    /**
+     * 基于timerfd的定时唤醒，注册到poller后在设置的时刻可读，精度不受poller毫秒超时的限制。
+     * 时间为绝对时间戳(us)，与DateTime::get_monotonic_timestamp()同为CLOCK_MONOTONIC，不受系统时间调整影响
+     */
+    class TimerNotifier final
+    {
+    public:
+        static const int64_t Not_Armed = INT64_MAX;
+
+    private:
+        int     m_fd;
+        int64_t m_armed;    // 已设置的触发时间，Not_Armed为未设置
+
+    private:
+        TimerNotifier(const TimerNotifier&) = delete;
+        TimerNotifier& operator=(const TimerNotifier&) = delete;
+
+    public:
+        TimerNotifier();
+        ~TimerNotifier();
+
+        int     handle() const { return m_fd; }
+        int64_t armed() const { return m_armed; }
+
+        // 在expire时刻可读，覆盖之前的设置；已过去的时刻立即可读
+        bool    arm(int64_t expire);
+
+        // 读出到期次数，之后需重新arm
+        bool    reset();
+    }; // end of class TimerNotifier
+
+    inline TimerNotifier::TimerNotifier() : m_armed(Not_Armed)
+    {
+        m_fd = ::timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if ( m_fd < 0 ) {
+            EVEREST_LOG_ERROR("TimerNotifier::TimerNotifier, timerfd_create failed, %d, %s", errno, strerror(errno));
+        }
+    }
+
+    inline TimerNotifier::~TimerNotifier()
+    {
+        if ( m_fd >= 0 ) {
+            ::close(m_fd);
+            m_fd = -1;
+        }
+    }
+
+    inline bool TimerNotifier::arm(int64_t expire)
+    {
+        struct itimerspec spec;
+        memset(&spec, 0, sizeof(spec));
+        if ( expire <= 0 ) expire = 1;    // it_value全为0表示取消
+        spec.it_value.tv_sec  = expire / 1000000;
+        spec.it_value.tv_nsec = (expire % 1000000) * 1000;
+        if ( ::timerfd_settime(m_fd, TFD_TIMER_ABSTIME, &spec, nullptr) < 0 ) {
+            EVEREST_LOG_ERROR("TimerNotifier::arm, timerfd_settime failed, %d, %s", errno, strerror(errno));
+            return false;
+        }
+        m_armed = expire;
+        return true;
+    }
+
+    inline bool TimerNotifier::reset()
+    {
+        m_armed = Not_Armed;
+        uint64_t val = 0;
+        ssize_t ret = ::read(m_fd, &val, sizeof(val));
+        if ( ret < 0 && errno != EAGAIN ) {
+            EVEREST_LOG_ERROR("TimerNotifier::reset, read failed, %d, %s", errno, strerror(errno));
+            return false;
+        }
+        return true;
+    }
+
+} // end of namespace net
+} // end of namespace everest
+
+#endif // INCLUDE_EVEREST_NET_TIMER_NOTIFIER_H
@@ -0,0 +1,144 @@
+#ifndef INCLUDE_EVEREST_OPEN_HASH_MAP_H
+#define INCLUDE_EVEREST_OPEN_HASH_MAP_H
+
+#pragma once
+
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+namespace everest
+{
+    /**
+     * 以uint64_t为键的开放寻址哈希表，线性探测，删除时后移后续元素而不留墓碑。
+     * 键0保留为空槽标记不能使用。元素直接存放在槽数组中，插入和删除都可能移动元素，
+     * find返回的指针在下一次插入或删除前有效。
+     */
+    template<class V>
+    class Open_Hash_Map final
+    {
+    private:
+        struct Slot
+        {
+            uint64_t key;      // 0为空槽
+            V        value;
+
+            Slot() : key(0), value() {}
+        };
+
+        std::vector<Slot> m_slots;    // 容量为2的幂
+        size_t            m_size;
+        size_t            m_mask;
+        int               m_shift;    // 64 - log2(容量)
+
+    public:
+        explicit Open_Hash_Map(size_t capacity = 16) : m_size(0) {
+            size_t n = 8;
+            while ( n < capacity ) n <<= 1;
+            this->reset(n);
+        }
+
+        size_t size() const { return m_size; }
+        bool   empty() const { return m_size == 0; }
+        size_t capacity() const { return m_slots.size(); }
+
+        V * find(uint64_t key) {
+            for(size_t i = this->home(key); m_slots[i].key != 0; i = (i + 1) & m_mask ) {
+                if ( m_slots[i].key == key ) return &m_slots[i].value;
+            }
+            return nullptr;
+        }
+
+        // 键已存在时不插入，返回false
+        bool insert(uint64_t key, V value) {
+            if ( (m_size + 1) * 4 > m_slots.size() * 3 ) this->rehash(m_slots.size() * 2);   // 负载不超过3/4
+            size_t i = this->home(key);
+            for(; m_slots[i].key != 0; i = (i + 1) & m_mask ) {
+                if ( m_slots[i].key == key ) return false;
+            }
+            m_slots[i].key = key;
+            m_slots[i].value = std::move(value);
+            ++m_size;
+            return true;
+        }
+
+        // 取出并删除，键不存在时返回false
+        bool take(uint64_t key, V &value) {
+            size_t i = this->home(key);
+            for(; m_slots[i].key != key; i = (i + 1) & m_mask ) {
+                if ( m_slots[i].key == 0 ) return false;
+            }
+            value = std::move(m_slots[i].value);
+            this->remove_at(i);
+            return true;
+        }
+
+        bool erase(uint64_t key) {
+            V value;
+            return this->take(key, value);
+        }
+
+        // 遍历全部元素，handler(key, value)
+        template<class Handler>
+        void for_each(Handler &handler) {
+            for(size_t i = 0; i < m_slots.size(); ++i ) {
+                if ( m_slots[i].key != 0 ) handler(m_slots[i].key, m_slots[i].value);
+            }
+        }
+
+        void clear() {
+            for(size_t i = 0; i < m_slots.size(); ++i ) {
+                m_slots[i].key = 0;
+                m_slots[i].value = V();
+            }
+            m_size = 0;
+        }
+
+    private:
+        // Fibonacci哈希，取乘积的高位，连续的键分散到不同的槽
+        size_t home(uint64_t key) const { return (size_t)((key * 0x9E3779B97F4A7C15ULL) >> m_shift); }
+
+        void reset(size_t n) {
+            m_slots.clear();
+            m_slots.resize(n);
+            m_mask = n - 1;
+            m_shift = 64;
+            while ( n > 1 ) { n >>= 1; --m_shift; }
+        }
+
+        void rehash(size_t n) {
+            std::vector<Slot> old;
+            old.swap(m_slots);
+            this->reset(n);
+            for(size_t i = 0; i < old.size(); ++i ) {
+                if ( old[i].key == 0 ) continue;
+                size_t j = this->home(old[i].key);
+                while ( m_slots[j].key != 0 ) j = (j + 1) & m_mask;
+                m_slots[j].key = old[i].key;
+                m_slots[j].value = std::move(old[i].value);
+            }
+        }
+
+        // 删除槽i，之后探测链上可以前移的元素依次前移，保持查找不中断
+        void remove_at(size_t i) {
+            size_t j = i;
+            for(;;) {
+                j = (j + 1) & m_mask;
+                if ( m_slots[j].key == 0 ) break;
+                size_t h = this->home(m_slots[j].key);
+                // h在(i, j]之间(循环意义)时元素j不能移到i
+                bool stay = (i <= j) ? (i < h && h <= j) : (i < h || h <= j);
+                if ( stay ) continue;
+                m_slots[i].key = m_slots[j].key;
+                m_slots[i].value = std::move(m_slots[j].value);
+                i = j;
+            }
+            m_slots[i].key = 0;
+            m_slots[i].value = V();
+            --m_size;
+        }
+    }; // end of class Open_Hash_Map
+
+} // end of namespace everest
+
+#endif // INCLUDE_EVEREST_OPEN_HASH_MAP_H
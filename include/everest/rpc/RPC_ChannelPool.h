@@ -0,0 +1,274 @@
+#ifndef INCLUDE_EVEREST_RPC_RPC_CHANNEL_POOL_H
+#define INCLUDE_EVEREST_RPC_RPC_CHANNEL_POOL_H
+
+#pragma once
+
+#include <everest/rpc/RPC_Client.h>
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace everest
+{
+namespace rpc
+{
+    /**
+     * 客户端连接池: 每个endpoint保持N个预先建立的channel，调用时选择未完成调用最少的channel，
+     * 请求路径上没有建立连接的延迟，负载分散到各个连接。
+     * 接管service的connect handler，内部的RPC_Client接管recv/send handler。
+     * channel连接失败或收发出错时关闭，按退避时间重新连接。池在service上注册一个周期定时器调用
+     * maintain，没有调用时也会重连并检查调用超时；call和select也会检查。
+     * 构造、析构和全部方法(包括add_endpoint)都应在proactor线程调用(handler、定时器回调中或run之前)，
+     * on_connected等回调在proactor线程读取的endpoint表不加锁。
+     */
+    template<class Impl = RPC_TcpSocketService_Impl>
+    class RPC_ChannelPool
+    {
+    public:
+        typedef RPC_Client<Impl>                  ClientType;
+        typedef typename ClientType::ServiceType  ServiceType;
+        typedef typename ClientType::ChannelPtr   ChannelPtr;
+        typedef typename ClientType::MessageType  MessageType;
+        typedef typename ClientType::Callback     Callback;
+
+        static const int64_t Retry_Min_Time = 10 * 1000;       // 第一次重连前等待(us)，之后每次加倍
+        static const int64_t Retry_Max_Time = 2 * 1000 * 1000;
+        static const int64_t Maintain_Period = 10 * 1000;      // maintain定时器的周期(us)
+
+    private:
+        static const int Slot_Idle       = 0;    // 等待重连
+        static const int Slot_Connecting = 1;
+        static const int Slot_Ready      = 2;
+
+        struct Slot
+        {
+            ChannelPtr p_channel;
+            int        state;
+            int        failures;      // 连续失败次数，连接成功后清零
+            int64_t    retry_time;    // Slot_Idle时的重连时间
+
+            Slot() : p_channel(nullptr), state(Slot_Idle), failures(0), retry_time(0) {}
+        };
+
+        struct Endpoint_Pool
+        {
+            std::string       endpoint;
+            std::vector<Slot> slots;
+            size_t            next;    // 未完成调用数相同时从此处开始选择，轮流使用
+        };
+
+        typedef std::pair<size_t, size_t> Slot_Index;    // (endpoint编号, slot编号)
+
+        ServiceType &                              m_service;
+        ClientType                                 m_client;
+        std::vector<Endpoint_Pool>                 m_pools;
+        std::unordered_map<ChannelPtr, Slot_Index> m_slot_of;
+        int                                        m_connect_timeout;
+        int64_t                                    m_next_retry;    // 最早的重连时间
+        uint64_t                                   m_reconnects;
+        uint64_t                                   m_maintain_timer;
+
+    private:
+        RPC_ChannelPool(const RPC_ChannelPool&) = delete;
+        RPC_ChannelPool& operator=(const RPC_ChannelPool&) = delete;
+
+        void connect(size_t pool, size_t slot);
+        void on_connected(ChannelPtr p_channel, int ec);
+        void on_failed(ChannelPtr p_channel);
+        void schedule_retry(Slot &s);
+
+    public:
+        // connect_timeout为每次连接的超时毫秒数
+        explicit RPC_ChannelPool(ServiceType &service, int connect_timeout = 3000);
+        ~RPC_ChannelPool();
+
+        ClientType & client() { return m_client; }
+
+        // 增加endpoint并立即发起size个连接，返回endpoint编号
+        int        add_endpoint(const char * endpoint, size_t size);
+
+        // 已连接channel中未完成调用最少的一个，没有可用channel时返回nullptr
+        ChannelPtr select(int endpoint);
+
+        // 在选出的channel上发起调用，参数和返回值同RPC_Client::call，没有可用channel时返回0
+        uint64_t   call(int endpoint, MessageType request, const Callback &callback, int timeout = -1);
+
+        // 重连到期的channel并检查调用超时，由定时器每Maintain_Period调用
+        void       maintain(int64_t now);
+
+        // endpoint已连接的channel数
+        size_t     ready(int endpoint) const;
+
+        // 连接失败或出错后重新发起连接的次数
+        uint64_t   reconnects() const { return m_reconnects; }
+    }; // end of class RPC_ChannelPool
+
+    template<class Impl>
+    RPC_ChannelPool<Impl>::RPC_ChannelPool(ServiceType &service, int connect_timeout)
+        : m_service(service), m_client(service), m_connect_timeout(connect_timeout)
+        , m_next_retry(RPC_Constants::Max_Expire_Time), m_reconnects(0)
+    {
+        m_maintain_timer = m_service.schedule_every(Maintain_Period, [this]() {
+            this->maintain(DateTime::get_timestamp());
+        });
+        m_service.set_conn_handler([this](ChannelPtr p_channel, int ec) {
+            this->on_connected(p_channel, ec);
+            return RPC_Constants::Ok;
+        });
+        m_client.set_error_handler([this](ChannelPtr p_channel, int) {
+            this->on_failed(p_channel);
+        });
+    }
+
+    template<class Impl>
+    RPC_ChannelPool<Impl>::~RPC_ChannelPool()
+    {
+        m_service.cancel_timer(m_maintain_timer);
+    }
+
+    template<class Impl>
+    int RPC_ChannelPool<Impl>::add_endpoint(const char * endpoint, size_t size)
+    {
+        m_pools.push_back(Endpoint_Pool());
+        Endpoint_Pool & pool = m_pools.back();
+        pool.endpoint = endpoint;
+        pool.slots.resize(size);
+        pool.next = 0;
+        for(size_t i = 0; i < size; ++i ) this->connect(m_pools.size() - 1, i);
+        return (int)m_pools.size() - 1;
+    }
+
+    template<class Impl>
+    void RPC_ChannelPool<Impl>::connect(size_t pool, size_t slot)
+    {
+        Slot & s = m_pools[pool].slots[slot];
+        ChannelPtr p_channel = m_service.open_channel(m_pools[pool].endpoint.c_str(), m_connect_timeout);
+        if ( p_channel == nullptr ) {
+            this->schedule_retry(s);   // 同步失败(如地址错误)，按退避时间再试
+            return;
+        }
+        s.p_channel = p_channel;
+        s.state = Slot_Connecting;
+        m_slot_of[p_channel] = Slot_Index(pool, slot);
+    }
+
+    template<class Impl>
+    void RPC_ChannelPool<Impl>::on_connected(ChannelPtr p_channel, int ec)
+    {
+        auto it = m_slot_of.find(p_channel);
+        if ( it == m_slot_of.end() ) {
+            EVEREST_LOG_ERROR("RPC_ChannelPool::on_connected, unknown channel");
+            return;
+        }
+        if ( ec != RPC_Constants::Ok || !m_client.attach(p_channel) ) {
+            EVEREST_LOG_WARN("RPC_ChannelPool::on_connected, connect %s failed, %d",
+                m_pools[it->second.first].endpoint.c_str(), ec);
+            this->on_failed(p_channel);
+            return;
+        }
+        Slot & s = m_pools[it->second.first].slots[it->second.second];
+        s.state = Slot_Ready;
+        s.failures = 0;
+    }
+
+    // 关闭channel，到期后由maintain重新连接
+    template<class Impl>
+    void RPC_ChannelPool<Impl>::on_failed(ChannelPtr p_channel)
+    {
+        auto it = m_slot_of.find(p_channel);
+        if ( it == m_slot_of.end() ) return;
+        Slot & s = m_pools[it->second.first].slots[it->second.second];
+        m_slot_of.erase(it);
+        m_client.detach(p_channel);
+        m_service.close_channel(p_channel);
+
+        s.p_channel = nullptr;
+        this->schedule_retry(s);
+    }
+
+    template<class Impl>
+    void RPC_ChannelPool<Impl>::schedule_retry(Slot &s)
+    {
+        int64_t delay = Retry_Min_Time << (s.failures < 16 ? s.failures : 16);
+        if ( delay > Retry_Max_Time ) delay = Retry_Max_Time;
+        ++s.failures;
+        s.state = Slot_Idle;
+        s.retry_time = DateTime::get_timestamp() + delay;
+        if ( s.retry_time < m_next_retry ) m_next_retry = s.retry_time;
+    }
+
+    template<class Impl>
+    void RPC_ChannelPool<Impl>::maintain(int64_t now)
+    {
+        m_client.expire(now);
+        if ( now < m_next_retry ) return;
+
+        m_next_retry = RPC_Constants::Max_Expire_Time;
+        for(size_t p = 0; p < m_pools.size(); ++p ) {
+            for(size_t i = 0; i < m_pools[p].slots.size(); ++i ) {
+                Slot & s = m_pools[p].slots[i];
+                if ( s.state != Slot_Idle ) continue;
+                if ( s.retry_time > now ) {
+                    if ( s.retry_time < m_next_retry ) m_next_retry = s.retry_time;
+                    continue;
+                }
+                EVEREST_LOG_INFO("RPC_ChannelPool::maintain, reconnect %s", m_pools[p].endpoint.c_str());
+                ++m_reconnects;
+                this->connect(p, i);
+            }
+        }
+    }
+
+    template<class Impl>
+    typename RPC_ChannelPool<Impl>::ChannelPtr RPC_ChannelPool<Impl>::select(int endpoint)
+    {
+        this->maintain(DateTime::get_timestamp());
+
+        Endpoint_Pool & pool = m_pools[endpoint];
+        size_t n = pool.slots.size();
+        ChannelPtr p_best = nullptr;
+        size_t best_pending = 0;
+        size_t best_index = 0;
+        for(size_t k = 0; k < n; ++k ) {
+            size_t i = (pool.next + k) % n;
+            Slot & s = pool.slots[i];
+            if ( s.state != Slot_Ready ) continue;
+            size_t pending = m_client.pending(s.p_channel);
+            if ( p_best == nullptr || pending < best_pending ) {
+                p_best = s.p_channel;
+                best_pending = pending;
+                best_index = i;
+                if ( pending == 0 ) break;
+            }
+        }
+        if ( p_best != nullptr ) pool.next = (best_index + 1) % n;
+        return p_best;
+    } // end of RPC_ChannelPool<Impl>::select
+
+    template<class Impl>
+    uint64_t RPC_ChannelPool<Impl>::call(int endpoint, MessageType request, const Callback &callback, int timeout)
+    {
+        ChannelPtr p_channel = this->select(endpoint);
+        if ( p_channel == nullptr ) {
+            EVEREST_LOG_WARN("RPC_ChannelPool::call, no channel ready, %s", m_pools[endpoint].endpoint.c_str());
+            return 0;
+        }
+        return m_client.call(p_channel, request, callback, timeout);
+    }
+
+    template<class Impl>
+    size_t RPC_ChannelPool<Impl>::ready(int endpoint) const
+    {
+        const Endpoint_Pool & pool = m_pools[endpoint];
+        size_t n = 0;
+        for(size_t i = 0; i < pool.slots.size(); ++i ) {
+            if ( pool.slots[i].state == Slot_Ready ) ++n;
+        }
+        return n;
+    }
+
+} // end of namespace rpc
+} // end of namespace everest
+
+#endif // INCLUDE_EVEREST_RPC_RPC_CHANNEL_POOL_H
@@ -0,0 +1,309 @@
+#ifndef INCLUDE_EVEREST_RPC_RPC_CLIENT_H
+#define INCLUDE_EVEREST_RPC_RPC_CLIENT_H
+
+#pragma once
+
+#include <everest/rpc/RPC_Server.h>
+#include <everest/open_hash_map.h>
+
+#include <functional>
+#include <queue>
+#include <unordered_map>
+#include <vector>
+
+namespace everest
+{
+namespace rpc
+{
+    /**
+     * 请求多路复用客户端: 一个channel上同时有多个未完成的调用，以消息头中的请求ID对应应答，
+     * 服务端可以按任意顺序应答(应答复制请求的request_id)。
+     * 接管service的recv/send handler，connect handler仍由使用者设置，连接完成后调用attach。
+     * 每个channel持续接收应答，按ID在开放寻址的调用表中找到调用者并回调。
+     * call/attach/detach/expire都应在proactor线程调用(handler中或run之前)。
+     * 调用超时在发起调用、收到应答或调用expire时检查。
+     */
+    template<class Impl = RPC_TcpSocketService_Impl>
+    class RPC_Client
+    {
+    public:
+        typedef RPC_Service<Impl>                 ServiceType;
+        typedef typename ServiceType::ChannelPtr  ChannelPtr;
+        typedef typename ServiceType::MessageType MessageType;
+
+        // 调用完成回调，ec为Ok时reply为应答，缓存只在回调期间有效
+        typedef std::function<void (int ec, MessageType &reply)> Callback;
+
+    private:
+        struct Pending_Call
+        {
+            Callback callback;
+            int64_t  expire_time;
+        };
+
+        struct Channel_State
+        {
+            Open_Hash_Map<Pending_Call>      calls;        // 未完成的调用，以请求ID为键
+            uint64_t                         next_id;
+            char                             header[RPC_Message::Header_Length];
+            std::vector<char>                body;         // 应答消息体，按最大应答增长后复用
+            everest::Mutable_Buffer_Sequence recv_seq;
+
+            Channel_State() : next_id(1) {}
+        };
+
+        struct Deadline
+        {
+            int64_t    expire_time;
+            ChannelPtr p_channel;
+            uint64_t   id;
+
+            bool operator>(const Deadline &other) const { return expire_time > other.expire_time; }
+        };
+
+        ServiceType &                                 m_service;
+        std::unordered_map<ChannelPtr, Channel_State *> m_channels;
+        std::priority_queue<Deadline, std::vector<Deadline>, std::greater<Deadline> > m_deadlines;   // 已完成的调用延迟删除
+        uint64_t                                      m_late_replies;
+        std::function<void (ChannelPtr, int)>         m_error_handler;
+
+    private:
+        RPC_Client(const RPC_Client&) = delete;
+        RPC_Client& operator=(const RPC_Client&) = delete;
+
+        bool post_header(ChannelPtr p_channel, Channel_State * p_state);
+        void fail_all(ChannelPtr p_channel, int ec);
+        void complete(ChannelPtr p_channel, uint64_t id, int ec, MessageType &reply);
+        void on_error(ChannelPtr p_channel, int ec);
+
+        int  on_receive(ChannelPtr p_channel, MessageType &msg, int ec);
+        int  on_send(ChannelPtr p_channel, MessageType &msg, int ec);
+
+    public:
+        explicit RPC_Client(ServiceType &service);
+        ~RPC_Client();
+
+        ServiceType & service() { return m_service; }
+
+        // channel接收出错、未完成的调用已全部失败并自动detach后回调handler(channel, ec)，
+        // 可在其中close_channel并重新连接
+        template<class ErrorHandler>
+        void     set_error_handler(const ErrorHandler &handler) { m_error_handler = handler; }
+
+        // 已连接的channel开始接收应答
+        bool     attach(ChannelPtr p_channel);
+
+        // 未完成的调用以Fail回调，不再接收该channel的应答
+        void     detach(ChannelPtr p_channel);
+
+        /**
+         * 发起调用: 设置请求ID和类型后发送，request的缓存在发送完成前保持有效。
+         * timeout为毫秒，负数不超时。返回请求ID，投递失败(未attach、超过发送高水位)时返回0且不回调。
+         */
+        uint64_t call(ChannelPtr p_channel, MessageType request, const Callback &callback, int timeout = -1);
+
+        // 以Timeout回调到期的调用，返回个数
+        size_t   expire(int64_t now);
+
+        // channel上未完成的调用数
+        size_t   pending(ChannelPtr p_channel) const {
+            auto it = m_channels.find(p_channel);
+            return it == m_channels.end() ? 0 : it->second->calls.size();
+        }
+
+        // 找不到调用者(已超时或已失败)而丢弃的应答数
+        uint64_t late_replies() const { return m_late_replies; }
+    }; // end of class RPC_Client
+
+    template<class Impl>
+    RPC_Client<Impl>::RPC_Client(ServiceType &service) : m_service(service), m_late_replies(0)
+    {
+        m_service.set_recv_handler([this](ChannelPtr p_channel, MessageType &msg, int ec) {
+            return this->on_receive(p_channel, msg, ec);
+        });
+        m_service.set_send_handler([this](ChannelPtr p_channel, MessageType &msg, int ec) {
+            return this->on_send(p_channel, msg, ec);
+        });
+    }
+
+    template<class Impl>
+    RPC_Client<Impl>::~RPC_Client()
+    {
+        for(auto it = m_channels.begin(); it != m_channels.end(); ++it ) delete it->second;
+    }
+
+    template<class Impl>
+    bool RPC_Client<Impl>::attach(ChannelPtr p_channel)
+    {
+        if ( m_channels.count(p_channel) ) return true;
+        Channel_State * p_state = new Channel_State();
+        m_channels[p_channel] = p_state;
+        if ( !this->post_header(p_channel, p_state) ) {
+            m_channels.erase(p_channel);
+            delete p_state;
+            return false;
+        }
+        return true;
+    }
+
+    template<class Impl>
+    void RPC_Client<Impl>::detach(ChannelPtr p_channel)
+    {
+        this->fail_all(p_channel, RPC_Constants::Fail);
+    }
+
+    // 接收下一个应答的消息头
+    template<class Impl>
+    bool RPC_Client<Impl>::post_header(ChannelPtr p_channel, Channel_State * p_state)
+    {
+        p_state->recv_seq.clear();
+        p_state->recv_seq.push_back(everest::Mutable_Byte_Buffer(p_state->header, RPC_Message::Header_Length));
+        return m_service.post_receive(p_channel, MessageType(p_state->recv_seq), -1);
+    }
+
+    template<class Impl>
+    uint64_t RPC_Client<Impl>::call(ChannelPtr p_channel, MessageType request, const Callback &callback, int timeout)
+    {
+        auto it = m_channels.find(p_channel);
+        if ( it == m_channels.end() ) {
+            EVEREST_LOG_ERROR("RPC_Client::call, channel not attached");
+            return 0;
+        }
+        Channel_State * p_state = it->second;
+
+        int64_t now = DateTime::get_timestamp();
+        this->expire(now);
+
+        uint64_t id = p_state->next_id++;
+        request.request_id(id);
+        request.type(RPC_Message::Type_Request);
+
+        Pending_Call pending;
+        pending.callback = callback;
+        pending.expire_time = timeout < 0 ? RPC_Constants::Max_Expire_Time : now + (int64_t)timeout * 1000;
+        p_state->calls.insert(id, std::move(pending));
+        if ( !m_service.post_send(p_channel, request, -1) ) {
+            p_state->calls.erase(id);
+            return 0;
+        }
+        if ( timeout >= 0 ) m_deadlines.push(Deadline{now + (int64_t)timeout * 1000, p_channel, id});
+        return id;
+    } // end of RPC_Client<Impl>::call
+
+    // 取出调用后回调，回调中可以再次call
+    template<class Impl>
+    void RPC_Client<Impl>::complete(ChannelPtr p_channel, uint64_t id, int ec, MessageType &reply)
+    {
+        auto it = m_channels.find(p_channel);
+        Pending_Call pending;
+        if ( it == m_channels.end() || !it->second->calls.take(id, pending) ) {
+            ++m_late_replies;
+            EVEREST_LOG_DEBUG("RPC_Client::complete, no caller for request %lu", id);
+            return;
+        }
+        pending.callback(ec, reply);
+    }
+
+    template<class Impl>
+    void RPC_Client<Impl>::fail_all(ChannelPtr p_channel, int ec)
+    {
+        auto it = m_channels.find(p_channel);
+        if ( it == m_channels.end() ) return;
+        Channel_State * p_state = it->second;
+        m_channels.erase(it);
+
+        std::vector<Callback> callbacks;
+        callbacks.reserve(p_state->calls.size());
+        auto collect = [&callbacks](uint64_t, Pending_Call &pending) { callbacks.push_back(std::move(pending.callback)); };
+        p_state->calls.for_each(collect);
+        delete p_state;
+
+        MessageType none;
+        for(size_t i = 0; i < callbacks.size(); ++i ) callbacks[i](ec, none);
+    }
+
+    template<class Impl>
+    void RPC_Client<Impl>::on_error(ChannelPtr p_channel, int ec)
+    {
+        this->fail_all(p_channel, ec);
+        if ( m_error_handler ) m_error_handler(p_channel, ec);
+    }
+
+    template<class Impl>
+    size_t RPC_Client<Impl>::expire(int64_t now)
+    {
+        size_t n = 0;
+        while ( !m_deadlines.empty() && m_deadlines.top().expire_time <= now ) {
+            Deadline d = m_deadlines.top();
+            m_deadlines.pop();
+            auto it = m_channels.find(d.p_channel);
+            if ( it == m_channels.end() ) continue;
+            Pending_Call * p_call = it->second->calls.find(d.id);
+            if ( p_call == nullptr || p_call->expire_time != d.expire_time ) continue;   // 已完成
+
+            EVEREST_LOG_WARN("RPC_Client::expire, request %lu timeout", d.id);
+            MessageType none;
+            this->complete(d.p_channel, d.id, RPC_Constants::Timeout, none);
+            ++n;
+        }
+        return n;
+    }
+
+    template<class Impl>
+    int RPC_Client<Impl>::on_receive(ChannelPtr p_channel, MessageType &msg, int ec)
+    {
+        auto it = m_channels.find(p_channel);
+        if ( it == m_channels.end() ) {
+            EVEREST_LOG_ERROR("RPC_Client::on_receive, channel not attached");
+            return RPC_Constants::Fail;
+        }
+        if ( ec != RPC_Constants::Ok ) {
+            EVEREST_LOG_ERROR("RPC_Client::on_receive, channel error %d", ec);
+            this->on_error(p_channel, ec);
+            return RPC_Constants::Fail;
+        }
+
+        // 消息头收完，按长度追加消息体缓存；长度不足消息头或收完消息体后长度不符时流已错位，channel失败
+        Channel_State * p_state = it->second;
+        everest::Mutable_Buffer_Sequence & buffers = msg.buffers();
+        size_t buf_size = buffers.size();
+        size_t msg_size = msg.size();
+        if ( msg_size < RPC_Message::Header_Length || (buf_size < msg_size && buf_size != RPC_Message::Header_Length) ) {
+            EVEREST_LOG_ERROR("RPC_Client::on_receive, malformed reply, length %lu, received %lu", msg_size, buf_size);
+            this->on_error(p_channel, RPC_Constants::Fail);
+            return RPC_Constants::Fail;
+        }
+        if ( buf_size < msg_size ) {
+            size_t body_size = msg_size - RPC_Message::Header_Length;
+            if ( p_state->body.size() < body_size ) p_state->body.resize(body_size);
+            buffers.push_back(everest::Mutable_Byte_Buffer(&p_state->body[0], body_size));
+            return RPC_Constants::Continue;
+        }
+
+        this->complete(p_channel, msg.request_id(), RPC_Constants::Ok, msg);
+        this->expire(DateTime::get_timestamp());
+
+        // 回调中可能已detach
+        it = m_channels.find(p_channel);
+        if ( it == m_channels.end() ) return RPC_Constants::Ok;
+        if ( !this->post_header(p_channel, it->second) ) {
+            this->on_error(p_channel, RPC_Constants::Fail);
+        }
+        return RPC_Constants::Ok;
+    } // end of RPC_Client<Impl>::on_receive
+
+    // 请求发送失败时以请求ID找到调用并回调
+    template<class Impl>
+    int RPC_Client<Impl>::on_send(ChannelPtr p_channel, MessageType &msg, int ec)
+    {
+        if ( ec == RPC_Constants::Ok ) return RPC_Constants::Ok;
+        EVEREST_LOG_ERROR("RPC_Client::on_send, request %lu send failed", msg.request_id());
+        MessageType none;
+        this->complete(p_channel, msg.request_id(), ec, none);
+        return RPC_Constants::Ok;
+    }
+
+} // end of namespace rpc
+} // end of namespace everest
+
+#endif // INCLUDE_EVEREST_RPC_RPC_CLIENT_H
@@ -0,0 +1,418 @@
+#ifndef INCLUDE_EVEREST_RPC_RPC_COROUTINE_H
+#define INCLUDE_EVEREST_RPC_RPC_COROUTINE_H
+
+#pragma once
+
+#include <everest/rpc/RPC_Server.h>
+
+// 协程接口需要C++20(-std=c++20)，低版本编译时本文件为空
+#if defined(__cpp_impl_coroutine) && __cpp_impl_coroutine >= 201902L
+
+#include <algorithm>
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <new>
+#include <unordered_map>
+#include <vector>
+
+namespace everest
+{
+namespace rpc
+{
+    /**
+     * 协程帧内存池: 按Grain字节分级的线程局部空闲链表，释放的帧留给同一线程下次分配；
+     * 超过Max_Size的帧直接使用全局new/delete
+     */
+    class RPC_FramePool final
+    {
+    public:
+        static const size_t Grain    = 64;
+        static const size_t Max_Size = 4096;
+        static const size_t Max_Free = 256;    // 每级最多缓存的帧数
+
+    private:
+        static const size_t Classes = Max_Size / Grain;
+
+        struct Node { Node * next; };
+
+        struct Lists
+        {
+            Node *   heads[Classes];
+            size_t   counts[Classes];
+            uint64_t allocated;
+            uint64_t reused;
+
+            Lists() : allocated(0), reused(0) {
+                for(size_t i = 0; i < Classes; ++i ) { heads[i] = nullptr; counts[i] = 0; }
+            }
+
+            ~Lists() {
+                for(size_t i = 0; i < Classes; ++i ) {
+                    while ( heads[i] ) {
+                        Node * p = heads[i];
+                        heads[i] = p->next;
+                        ::operator delete(p);
+                    }
+                }
+            }
+        }; // end of struct Lists
+
+        static Lists & lists() {
+            static thread_local Lists s_lists;
+            return s_lists;
+        }
+
+    public:
+        static void * allocate(size_t n) {
+            if ( n > Max_Size ) return ::operator new(n);
+            size_t idx = (n + Grain - 1) / Grain - 1;
+            Lists & l = lists();
+            ++l.allocated;
+            Node * p = l.heads[idx];
+            if ( p ) {
+                l.heads[idx] = p->next;
+                --l.counts[idx];
+                ++l.reused;
+                return p;
+            }
+            return ::operator new((idx + 1) * Grain);
+        }
+
+        static void deallocate(void * p, size_t n) {
+            if ( n > Max_Size ) { ::operator delete(p); return; }
+            size_t idx = (n + Grain - 1) / Grain - 1;
+            Lists & l = lists();
+            if ( l.counts[idx] >= Max_Free ) { ::operator delete(p); return; }
+            Node * node = (Node *)p;
+            node->next = l.heads[idx];
+            l.heads[idx] = node;
+            ++l.counts[idx];
+        }
+
+        // 当前线程从池中分配的帧数和其中复用空闲帧的次数
+        static uint64_t allocated() { return lists().allocated; }
+        static uint64_t reused() { return lists().reused; }
+    }; // end of class RPC_FramePool
+
+    /**
+     * 分离执行的协程返回类型: 调用后立即执行到第一个co_await，结束时释放协程帧。
+     * 帧从RPC_FramePool分配；未捕获的异常记录日志后结束协程。
+     */
+    class RPC_Coroutine
+    {
+    public:
+        struct promise_type
+        {
+            RPC_Coroutine       get_return_object() { return RPC_Coroutine(); }
+            std::suspend_never  initial_suspend() noexcept { return {}; }
+            std::suspend_never  final_suspend() noexcept { return {}; }
+            void                return_void() {}
+
+            void unhandled_exception() {
+                try {
+                    throw;
+                } catch (const std::exception &e) {
+                    EVEREST_LOG_ERROR("RPC_Coroutine, unhandled exception, %s", e.what());
+                } catch (...) {
+                    EVEREST_LOG_ERROR("RPC_Coroutine, unhandled exception");
+                }
+            }
+
+            static void * operator new(size_t n) { return RPC_FramePool::allocate(n); }
+            static void   operator delete(void * p, size_t n) { RPC_FramePool::deallocate(p, n); }
+        }; // end of struct promise_type
+    }; // end of class RPC_Coroutine
+
+    /**
+     * RPC_Service的协程接口，接管service的accept/recv/send handler(connect handler不变)。
+     * 等待的协程在proactor线程的完成回调中直接恢复执行，协程内的co_await都应在proactor线程发起。
+     *   co_await accept(listener)             接受连接并加入service，返回Accept_Result
+     *   co_await receive(channel, msg, tmo)   接收消息，返回错误码；只收到消息头而消息更长时返回
+     *                                         Continue，追加消息体缓存后对同一消息再次co_await receive
+     *   co_await send(channel, msg, tmo)      发送完成后返回错误码，超过发送高水位时立即返回Fail
+     * 每个channel同时只能有一个receive，send可以有多个。不再使用channel时调用release。
+     */
+    template<class Impl = RPC_TcpSocketService_Impl>
+    class RPC_CoService
+    {
+    public:
+        typedef RPC_Service<Impl>                ServiceType;
+        typedef typename ServiceType::ChannelPtr  ChannelPtr;
+        typedef typename ServiceType::ListenerPtr ListenerPtr;
+        typedef typename ServiceType::MessageType MessageType;
+
+        struct Accept_Result
+        {
+            int        ec;
+            ChannelPtr channel;
+        };
+
+        class Accept_Awaiter
+        {
+            friend class RPC_CoService;
+            RPC_CoService *         m_service;
+            ListenerPtr             m_listener;
+            Accept_Result           m_result;
+            std::coroutine_handle<> m_handle;
+        public:
+            Accept_Awaiter(RPC_CoService * service, ListenerPtr listener)
+                : m_service(service), m_listener(listener), m_result{RPC_Constants::Fail, nullptr} {}
+
+            bool          await_ready() const noexcept { return false; }
+            bool          await_suspend(std::coroutine_handle<> h) { return m_service->start_accept(this, h); }
+            Accept_Result await_resume() const noexcept { return m_result; }
+        }; // end of class Accept_Awaiter
+
+        class Recv_Awaiter
+        {
+            friend class RPC_CoService;
+            RPC_CoService *         m_service;
+            ChannelPtr              m_channel;
+            MessageType             m_message;
+            int                     m_timeout;
+            int                     m_result;
+            std::coroutine_handle<> m_handle;
+        public:
+            Recv_Awaiter(RPC_CoService * service, ChannelPtr channel, const MessageType &msg, int timeout)
+                : m_service(service), m_channel(channel), m_message(msg), m_timeout(timeout), m_result(RPC_Constants::Fail) {}
+
+            bool await_ready() const noexcept { return false; }
+            bool await_suspend(std::coroutine_handle<> h) { return m_service->start_receive(this, h); }
+            int  await_resume() const noexcept { return m_result; }
+        }; // end of class Recv_Awaiter
+
+        class Send_Awaiter
+        {
+            friend class RPC_CoService;
+            RPC_CoService *         m_service;
+            ChannelPtr              m_channel;
+            MessageType             m_message;
+            int                     m_timeout;
+            int                     m_result;
+            std::coroutine_handle<> m_handle;
+        public:
+            Send_Awaiter(RPC_CoService * service, ChannelPtr channel, const MessageType &msg, int timeout)
+                : m_service(service), m_channel(channel), m_message(msg), m_timeout(timeout), m_result(RPC_Constants::Fail) {}
+
+            bool await_ready() const noexcept { return false; }
+            bool await_suspend(std::coroutine_handle<> h) { return m_service->start_send(this, h); }
+            int  await_resume() const noexcept { return m_result; }
+        }; // end of class Send_Awaiter
+
+    private:
+        struct Channel_State
+        {
+            Recv_Awaiter *              p_recv;        // 等待接收的协程
+            bool                        in_recv;       // 正在接收回调中恢复协程，消息尚未收完
+            bool                        recv_more;     // 协程在回调中对同一消息再次receive
+            std::vector<Send_Awaiter *> sends;         // 等待发送完成的协程，按消息缓存匹配
+
+            Channel_State() : p_recv(nullptr), in_recv(false), recv_more(false) {}
+        };
+
+        struct Listener_State
+        {
+            bool                   armed;         // 已投递accept任务，之后持续接受
+            Accept_Awaiter *       p_accept;
+            std::deque<ChannelPtr> backlog;       // 没有协程等待时接受的连接
+
+            Listener_State() : armed(false), p_accept(nullptr) {}
+        };
+
+        ServiceType &                                  m_service;
+        std::unordered_map<ChannelPtr, Channel_State>  m_channels;
+        std::unordered_map<ListenerPtr, Listener_State> m_listeners;
+
+    private:
+        RPC_CoService(const RPC_CoService&) = delete;
+        RPC_CoService& operator=(const RPC_CoService&) = delete;
+
+        bool start_accept(Accept_Awaiter * p_awaiter, std::coroutine_handle<> h);
+        bool start_receive(Recv_Awaiter * p_awaiter, std::coroutine_handle<> h);
+        bool start_send(Send_Awaiter * p_awaiter, std::coroutine_handle<> h);
+
+        int  on_accept(ListenerPtr p_listener, ChannelPtr p_channel, int ec);
+        int  on_receive(ChannelPtr p_channel, MessageType &msg, int ec);
+        int  on_send(ChannelPtr p_channel, MessageType &msg, int ec);
+
+    public:
+        explicit RPC_CoService(ServiceType &service);
+
+        ServiceType &  service() { return m_service; }
+
+        Accept_Awaiter accept(ListenerPtr listener) { return Accept_Awaiter(this, listener); }
+
+        Recv_Awaiter   receive(ChannelPtr channel, const MessageType &msg, int timeout = -1) {
+            return Recv_Awaiter(this, channel, msg, timeout);
+        }
+
+        Send_Awaiter   send(ChannelPtr channel, const MessageType &msg, int timeout = -1) {
+            return Send_Awaiter(this, channel, msg, timeout);
+        }
+
+        // 删除channel的等待状态，之后该channel的完成回调不再恢复协程
+        void           release(ChannelPtr channel) { m_channels.erase(channel); }
+    }; // end of class RPC_CoService
+
+    template<class Impl>
+    RPC_CoService<Impl>::RPC_CoService(ServiceType &service) : m_service(service)
+    {
+        m_service.set_accept_handler([this](ListenerPtr p_listener, ChannelPtr p_channel, int ec) {
+            return this->on_accept(p_listener, p_channel, ec);
+        });
+        m_service.set_recv_handler([this](ChannelPtr p_channel, MessageType &msg, int ec) {
+            return this->on_receive(p_channel, msg, ec);
+        });
+        m_service.set_send_handler([this](ChannelPtr p_channel, MessageType &msg, int ec) {
+            return this->on_send(p_channel, msg, ec);
+        });
+    }
+
+    // 返回false时不挂起，结果已写入awaiter
+    template<class Impl>
+    bool RPC_CoService<Impl>::start_accept(Accept_Awaiter * p_awaiter, std::coroutine_handle<> h)
+    {
+        Listener_State & state = m_listeners[p_awaiter->m_listener];
+        if ( !state.backlog.empty() ) {
+            p_awaiter->m_result = Accept_Result{RPC_Constants::Ok, state.backlog.front()};
+            state.backlog.pop_front();
+            return false;
+        }
+        if ( state.p_accept != nullptr ) {
+            EVEREST_LOG_ERROR("RPC_CoService::start_accept, accept already pending");
+            return false;
+        }
+
+        p_awaiter->m_handle = h;
+        state.p_accept = p_awaiter;
+        if ( !state.armed ) {
+            state.armed = true;
+            if ( !m_service.post_accept(p_awaiter->m_listener, -1) ) {
+                EVEREST_LOG_ERROR("RPC_CoService::start_accept, post accept failed");
+                state.armed = false;
+                state.p_accept = nullptr;
+                return false;
+            }
+        }
+        return true;
+    } // end of RPC_CoService<Impl>::start_accept
+
+    template<class Impl>
+    bool RPC_CoService<Impl>::start_receive(Recv_Awaiter * p_awaiter, std::coroutine_handle<> h)
+    {
+        Channel_State & state = m_channels[p_awaiter->m_channel];
+        if ( state.p_recv != nullptr ) {
+            EVEREST_LOG_ERROR("RPC_CoService::start_receive, receive already pending, %d",
+                p_awaiter->m_channel->get_socket().handle());
+            return false;
+        }
+
+        // 先登记再投递，完成回调可能在投递返回前发生
+        p_awaiter->m_handle = h;
+        state.p_recv = p_awaiter;
+        if ( state.in_recv ) {
+            state.recv_more = true;     // 回调返回Continue，继续接收同一消息
+            return true;
+        }
+        if ( !m_service.post_receive(p_awaiter->m_channel, p_awaiter->m_message, p_awaiter->m_timeout) ) {
+            state.p_recv = nullptr;
+            return false;
+        }
+        return true;
+    } // end of RPC_CoService<Impl>::start_receive
+
+    template<class Impl>
+    bool RPC_CoService<Impl>::start_send(Send_Awaiter * p_awaiter, std::coroutine_handle<> h)
+    {
+        ChannelPtr p_channel = p_awaiter->m_channel;
+        std::vector<Send_Awaiter *> & sends = m_channels[p_channel].sends;
+        p_awaiter->m_handle = h;
+        sends.push_back(p_awaiter);
+        if ( !m_service.post_send(p_channel, p_awaiter->m_message, p_awaiter->m_timeout) ) {
+            std::vector<Send_Awaiter *> & pending = m_channels[p_channel].sends;
+            auto it = std::find(pending.begin(), pending.end(), p_awaiter);
+            if ( it != pending.end() ) pending.erase(it);
+            return false;
+        }
+        return true;
+    } // end of RPC_CoService<Impl>::start_send
+
+    template<class Impl>
+    int RPC_CoService<Impl>::on_accept(ListenerPtr p_listener, ChannelPtr p_channel, int ec)
+    {
+        Listener_State & state = m_listeners[p_listener];
+        if ( ec == RPC_Constants::Ok && !m_service.add_channel(p_channel) ) {
+            EVEREST_LOG_ERROR("RPC_CoService::on_accept, add channel failed");
+            return RPC_Constants::Fail;
+        }
+
+        Accept_Awaiter * p_awaiter = state.p_accept;
+        if ( p_awaiter == nullptr ) {
+            if ( ec == RPC_Constants::Ok ) state.backlog.push_back(p_channel);
+            return RPC_Constants::Ok;
+        }
+        state.p_accept = nullptr;
+        p_awaiter->m_result = Accept_Result{ec, ec == RPC_Constants::Ok ? p_channel : nullptr};
+        p_awaiter->m_handle.resume();
+        return RPC_Constants::Ok;
+    } // end of RPC_CoService<Impl>::on_accept
+
+    template<class Impl>
+    int RPC_CoService<Impl>::on_receive(ChannelPtr p_channel, MessageType &msg, int ec)
+    {
+        auto it = m_channels.find(p_channel);
+        if ( it == m_channels.end() || it->second.p_recv == nullptr ) {
+            EVEREST_LOG_ERROR("RPC_CoService::on_receive, no waiting coroutine, %d", p_channel->get_socket().handle());
+            return RPC_Constants::Fail;
+        }
+
+        int result = ec;
+        if ( ec == RPC_Constants::Ok ) {
+            size_t buf_size = msg.buffers().size();
+            if ( buf_size >= RPC_Message::Header_Length && msg.size() > buf_size ) result = RPC_Constants::Continue;
+        }
+
+        Recv_Awaiter * p_awaiter = it->second.p_recv;
+        it->second.p_recv = nullptr;
+        it->second.in_recv = (result == RPC_Constants::Continue);
+        it->second.recv_more = false;
+        p_awaiter->m_result = result;
+        p_awaiter->m_handle.resume();
+
+        // 协程可能已release该channel
+        it = m_channels.find(p_channel);
+        if ( it == m_channels.end() ) return result == RPC_Constants::Continue ? RPC_Constants::Fail : RPC_Constants::Ok;
+        it->second.in_recv = false;
+        if ( result == RPC_Constants::Continue && it->second.recv_more ) return RPC_Constants::Continue;
+        if ( result == RPC_Constants::Continue ) {
+            // 没有继续接收，未收完的消息作为完成，之后的数据不再属于该消息
+            EVEREST_LOG_WARN("RPC_CoService::on_receive, partial message abandoned, %d", p_channel->get_socket().handle());
+        }
+        return RPC_Constants::Ok;
+    } // end of RPC_CoService<Impl>::on_receive
+
+    template<class Impl>
+    int RPC_CoService<Impl>::on_send(ChannelPtr p_channel, MessageType &msg, int ec)
+    {
+        auto it = m_channels.find(p_channel);
+        if ( it == m_channels.end() ) return RPC_Constants::Ok;      // 不是协程发送的消息
+
+        std::vector<Send_Awaiter *> & sends = it->second.sends;
+        for(size_t i = 0; i < sends.size(); ++i ) {
+            Send_Awaiter * p_awaiter = sends[i];
+            if ( &p_awaiter->m_message.buffers() != &msg.buffers() ) continue;
+            sends.erase(sends.begin() + i);
+            p_awaiter->m_result = ec;
+            p_awaiter->m_handle.resume();
+            break;
+        }
+        return RPC_Constants::Ok;
+    } // end of RPC_CoService<Impl>::on_send
+
+} // end of namespace rpc
+} // end of namespace everest
+
+#endif // __cpp_impl_coroutine
+
+#endif // INCLUDE_EVEREST_RPC_RPC_COROUTINE_H
@@ -4,6 +4,7 @@
 #pragma once 
 
 #include <everest/buffer.h>
+#include <everest/log.h>
 
 namespace everest 
 {
@@ -16,9 +17,12 @@ namespace rpc
         
         // Message Type
         static const char   Type_Request  = 0;
+        static const char   Type_Reply    = 1;
         
         // Message field index
-        static const size_t Idx_Length = 8;
+        static const size_t Idx_Type       = 7;
+        static const size_t Idx_Length     = 8;
+        static const size_t Idx_Request_Id = 12;   // uint64ͬһchannelϵӦԴ˶Ӧ0Ϊʹ
         
         // byte endian
         static const char   Little_Endian = 0;
@@ -46,6 +50,12 @@ namespace rpc
         
         size_t size() const ;  // ȡϢ
         
+        char     type() const { return m_buffer_seq->front()[Idx_Type]; }
+        void     type(char t) { m_buffer_seq->front()[Idx_Type] = t; }
+        
+        uint64_t request_id() const { return m_buffer_seq->front().data<uint64_t>(Idx_Request_Id); }
+        void     request_id(uint64_t id) { m_buffer_seq->front().data<uint64_t>(Idx_Request_Id) = id; }
+        
         Buffer_Sequence * detach_buffers();
         Buffer_Sequence &buffers() { return *m_buffer_seq; }
     }; // end of class RPC_Message 
@@ -61,11 +71,11 @@ namespace rpc
     {
         Buffer_Sequence::Iterator it = m_buffer_seq->begin();
         if ( it == m_buffer_seq->end() ) {
-            printf("[ERROR] RPC_Message::size, no buffer\n");
+            EVEREST_LOG_ERROR("RPC_Message::size, no buffer");
             throw std::runtime_error("RPC_Message::size, no buffer");
         }
         if ( it->size() < Header_Length) {
-            printf("[ERROR] RPC_Message::size, message is too short\n");
+            EVEREST_LOG_ERROR("RPC_Message::size, message is too short");
             throw std::runtime_error("RPC_Message::size, message is too short");
         }
         return (size_t)it->data<uint32_t>(Idx_Length);
@@ -79,6 +89,7 @@ namespace rpc
             total_len += it->size();
         }
         m_buffer_seq->front().data<uint32_t>(Idx_Length) = total_len;
+        return true;
     }
     
     bool RPC_Message::add_buffer(Mutable_Byte_Buffer & buf) {
@@ -89,13 +100,13 @@ namespace rpc
     bool RPC_Message::init_header() {
         Buffer_Sequence::Iterator it = m_buffer_seq->begin();
         if ( it == m_buffer_seq->end() ) {
-            printf("[ERROR] RPC_Message::init_header, no buffer\n");
+            EVEREST_LOG_ERROR("RPC_Message::init_header, no buffer");
             return false;
         }
         Mutable_Byte_Buffer &buf = *it;
         bool isok = buf.size(Header_Length);
         if ( !isok ) {
-            printf("[ERROR] RPC_Message::init_header, no enough space\n");
+            EVEREST_LOG_ERROR("RPC_Message::init_header, no enough space");
             return false;
         }
         
@@ -107,6 +118,9 @@ namespace rpc
         buf[6] = Little_Endian; buf[7] = Type_Request;
         // length
         buf.data<uint32_t>(8) = 0;
+        // request id and reserved
+        buf.data<uint64_t>(Idx_Request_Id) = 0;
+        buf.data<uint32_t>(20) = 0;
         
         return true;
     } // end of RPC_Message::init_header
@@ -0,0 +1,305 @@
+#ifndef INCLUDE_EVEREST_RPC_RPC_PARTITION_H
+#define INCLUDE_EVEREST_RPC_RPC_PARTITION_H
+
+#pragma once
+
+#include <everest/rpc/RPC_ServiceGroup.h>
+#include <everest/spsc_queue.h>
+
+#include <stdint.h>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <vector>
+#include <everest/log.h>
+
+namespace everest
+{
+namespace rpc
+{
+    /**
+     * 按key分区的服务组(thread-per-core)
+     * 服务组的第i个线程独占第i个分片，key % size()相同的请求总在同一个线程处理，
+     * 分片的状态不需要加锁。recv handler把收到的请求交给route: key属于本线程时直接处理，
+     * 否则经(来源, 目标)线程对的SPSC邮箱转给所属线程，处理后应答经反向邮箱交回收到请求的
+     * 线程，由它post_send。邮箱满时暂存在来源线程自己的溢出队列，目标线程取空邮箱后唤醒来源线程重试。
+     * 同一channel上本地处理和转发的请求应答顺序不保证，由请求ID对应。
+     * 转发的请求在所属线程处理完之前，请求的缓冲区和channel需保持有效。
+     * 分区需在服务组start之前构造、stop之后析构。
+     */
+    template<class Impl = RPC_TcpSocketService_Impl>
+    class RPC_Partition
+    {
+    public:
+        typedef RPC_ServiceGroup<Impl>               GroupType;
+        typedef typename GroupType::ServiceType      ServiceType;
+        typedef typename GroupType::ChannelPtr       ChannelPtr;
+
+        // key函数在收到请求的线程调用；分片处理函数在分片所属线程调用，返回true时发送reply
+        typedef std::function<uint64_t (const RPC_Message&)>                      KeyFunction;
+        typedef std::function<bool (size_t, RPC_Message&, RPC_Message&)>          ShardHandler;
+
+    private:
+        static const int Letter_Request = 1;
+        static const int Letter_Reply   = 2;
+
+        struct Letter
+        {
+            int         kind;
+            ChannelPtr  p_channel;
+            size_t      origin;      // 收到请求的线程
+            RPC_Message request;
+            RPC_Message reply;
+
+            Letter() : kind(0), p_channel(nullptr), origin(0) {}
+        };
+        typedef SPSC_Queue<Letter> Mailbox;
+
+        // 只由对应线程修改，统计值可由其它线程读取
+        struct Shard_State
+        {
+            std::vector<std::deque<Letter> > overflow;   // 按目标线程，邮箱满时暂存
+            size_t                           pending;    // 溢出队列中的消息数
+            std::atomic<uint64_t>            handled;
+            std::atomic<uint64_t>            forwarded;
+            std::atomic<uint64_t>            overflowed;
+            char                             padding[64];
+        };
+
+        // 当前线程所在的分区和序号，每轮run_once由poll设置
+        struct Current
+        {
+            RPC_Partition * p_partition;
+            size_t          idx;
+        };
+
+        GroupType &                      m_group;
+        size_t                           m_size;
+        std::vector<Mailbox *>           m_mailboxes;   // [from * m_size + to]
+        std::vector<std::atomic<bool> >  m_blocked;     // [from * m_size + to]，来源线程有消息暂存
+        std::vector<Shard_State *>       m_shards;
+        KeyFunction                      m_key_function;
+        ShardHandler                     m_shard_handler;
+
+    private:
+        RPC_Partition(const RPC_Partition&) = delete;
+        RPC_Partition& operator=(const RPC_Partition&) = delete;
+
+    public:
+        /**
+         * @param capacity 每对线程之间邮箱的容量，向上取整到2的幂
+         */
+        explicit RPC_Partition(GroupType &group, size_t capacity = 1024);
+        ~RPC_Partition();
+
+        size_t size() const { return m_size; }
+
+        // 默认以请求ID为key
+        template<class Function>
+        void set_key_function(const Function &function) { m_key_function = function; }
+
+        template<class Handler>
+        void set_shard_handler(const Handler &handler) { m_shard_handler = handler; }
+
+        size_t shard_of(const RPC_Message &request) const {
+            uint64_t key = m_key_function ? m_key_function(request) : request.request_id();
+            return (size_t)(key % m_size);
+        }
+
+        // 在服务组线程的recv handler中调用，不在服务组线程时返回false
+        bool route(ChannelPtr p_channel, RPC_Message &request);
+
+        // 分片处理的请求数，转发到其它线程的请求数，因邮箱满暂存过的消息数
+        uint64_t handled() const;
+        uint64_t forwarded() const;
+        uint64_t overflowed() const;
+
+    private:
+        static Current & current() {
+            static thread_local Current cur = { nullptr, 0 };
+            return cur;
+        }
+
+        // 线程idx每轮run_once调用，返回处理的消息数
+        int  poll(size_t idx);
+        void handle(size_t idx, Letter &letter);
+        void deliver(size_t from, size_t to, const Letter &letter);
+        bool flush_overflow(size_t from, size_t to);
+    }; // end of class RPC_Partition
+
+    template<class Impl>
+    RPC_Partition<Impl>::RPC_Partition(GroupType &group, size_t capacity)
+        : m_group(group), m_size(group.size())
+        , m_mailboxes(group.size() * group.size(), nullptr)
+        , m_blocked(group.size() * group.size())
+    {
+        for(size_t i = 0; i < m_mailboxes.size(); ++i ) {
+            m_blocked[i].store(false);
+            if ( i / m_size != i % m_size ) m_mailboxes[i] = new Mailbox(capacity);
+        }
+        m_shards.reserve(m_size);
+        for(size_t i = 0; i < m_size; ++i ) {
+            Shard_State * p_shard = new Shard_State();
+            p_shard->overflow.resize(m_size);
+            p_shard->pending = 0;
+            p_shard->handled.store(0);
+            p_shard->forwarded.store(0);
+            p_shard->overflowed.store(0);
+            m_shards.push_back(p_shard);
+            m_group.service(i).set_loop_handler([this, i]() { return this->poll(i); });
+        }
+    }
+
+    template<class Impl>
+    RPC_Partition<Impl>::~RPC_Partition()
+    {
+        for(size_t i = 0; i < m_size; ++i ) {
+            m_group.service(i).set_loop_handler(std::function<int ()>());
+            delete m_shards[i];
+        }
+        for(size_t i = 0; i < m_mailboxes.size(); ++i ) delete m_mailboxes[i];
+        m_shards.clear();
+        m_mailboxes.clear();
+    }
+
+    template<class Impl>
+    bool RPC_Partition<Impl>::route(ChannelPtr p_channel, RPC_Message &request)
+    {
+        Current &cur = current();
+        if ( cur.p_partition != this ) {
+            EVEREST_LOG_ERROR("RPC_Partition::route, not called in a partition thread");
+            return false;
+        }
+
+        Letter letter;
+        letter.kind = Letter_Request;
+        letter.p_channel = p_channel;
+        letter.origin = cur.idx;
+        letter.request = request;
+
+        size_t shard = this->shard_of(request);
+        if ( shard == cur.idx ) {
+            this->handle(cur.idx, letter);
+            return true;
+        }
+        this->deliver(cur.idx, shard, letter);
+        m_shards[cur.idx]->forwarded.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    template<class Impl>
+    void RPC_Partition<Impl>::handle(size_t idx, Letter &letter)
+    {
+        if ( letter.kind == Letter_Reply ) {
+            m_group.service(idx).post_send(letter.p_channel, letter.reply, -1);
+            return;
+        }
+
+        m_shards[idx]->handled.fetch_add(1, std::memory_order_relaxed);
+        if ( !m_shard_handler || !m_shard_handler(idx, letter.request, letter.reply) ) return;
+        if ( letter.origin == idx ) {
+            m_group.service(idx).post_send(letter.p_channel, letter.reply, -1);
+            return;
+        }
+        letter.kind = Letter_Reply;
+        this->deliver(idx, letter.origin, letter);
+    }
+
+    template<class Impl>
+    void RPC_Partition<Impl>::deliver(size_t from, size_t to, const Letter &letter)
+    {
+        Shard_State * p_shard = m_shards[from];
+        std::deque<Letter> &overflow = p_shard->overflow[to];
+        if ( overflow.empty() && m_mailboxes[from * m_size + to]->push(letter) ) {
+            m_group.service(to).wakeup();
+            return;
+        }
+        // 邮箱满或已有暂存时追加到溢出队列，保持同一线程对之间的顺序
+        overflow.push_back(letter);
+        ++p_shard->pending;
+        p_shard->overflowed.fetch_add(1, std::memory_order_relaxed);
+        this->flush_overflow(from, to);
+    }
+
+    template<class Impl>
+    bool RPC_Partition<Impl>::flush_overflow(size_t from, size_t to)
+    {
+        Shard_State * p_shard = m_shards[from];
+        std::deque<Letter> &overflow = p_shard->overflow[to];
+        Mailbox * p_mailbox = m_mailboxes[from * m_size + to];
+        std::atomic<bool> &blocked = m_blocked[from * m_size + to];
+
+        // 先标记再重试: 目标线程取空邮箱后看到标记会唤醒本线程，或本次重试看到空位
+        blocked.store(true);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        bool pushed = false;
+        while ( !overflow.empty() && p_mailbox->push(overflow.front()) ) {
+            overflow.pop_front();
+            --p_shard->pending;
+            pushed = true;
+        }
+        if ( overflow.empty() ) blocked.store(false);
+        if ( pushed ) m_group.service(to).wakeup();
+        return overflow.empty();
+    }
+
+    template<class Impl>
+    int RPC_Partition<Impl>::poll(size_t idx)
+    {
+        Current &cur = current();
+        cur.p_partition = this;
+        cur.idx = idx;
+
+        int count = 0;
+        for(size_t from = 0; from < m_size; ++from ) {
+            if ( from == idx ) continue;
+            Mailbox * p_mailbox = m_mailboxes[from * m_size + idx];
+            Letter letter;
+            int taken = 0;
+            while ( p_mailbox->pop(letter) ) {
+                this->handle(idx, letter);
+                ++taken;
+            }
+            if ( taken == 0 ) continue;
+            count += taken;
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if ( m_blocked[from * m_size + idx].load() ) m_group.service(from).wakeup();
+        }
+
+        Shard_State * p_shard = m_shards[idx];
+        if ( p_shard->pending > 0 ) {
+            for(size_t to = 0; to < m_size; ++to ) {
+                if ( !p_shard->overflow[to].empty() ) this->flush_overflow(idx, to);
+            }
+        }
+        return count;
+    } // end of RPC_Partition<Impl>::poll
+
+    template<class Impl>
+    uint64_t RPC_Partition<Impl>::handled() const
+    {
+        uint64_t n = 0;
+        for(size_t i = 0; i < m_size; ++i ) n += m_shards[i]->handled.load(std::memory_order_relaxed);
+        return n;
+    }
+
+    template<class Impl>
+    uint64_t RPC_Partition<Impl>::forwarded() const
+    {
+        uint64_t n = 0;
+        for(size_t i = 0; i < m_size; ++i ) n += m_shards[i]->forwarded.load(std::memory_order_relaxed);
+        return n;
+    }
+
+    template<class Impl>
+    uint64_t RPC_Partition<Impl>::overflowed() const
+    {
+        uint64_t n = 0;
+        for(size_t i = 0; i < m_size; ++i ) n += m_shards[i]->overflowed.load(std::memory_order_relaxed);
+        return n;
+    }
+
+} // end of namespace rpc
+} // end of namespace everest
+
+#endif // INCLUDE_EVEREST_RPC_RPC_PARTITION_H
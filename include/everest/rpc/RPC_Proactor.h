@@ -2,39 +2,304 @@
 #define INCLUDE_EVEREST_RPC_RPC_PROACTOR_H
 
 #pragma once 
-#include <queue>
-#include <map>
+#include <limits.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <list>
 #include <unordered_map>
 #include <functional>
+#include <vector>
 
+#include <everest/timer_queue.h>
+#include <everest/open_hash_map.h>
+#include <everest/net/event_notifier.h>
+#include <everest/net/timer_notifier.h>
 #include <everest/rpc/RPC_Message.h>
+#include <everest/log.h>
 
 namespace everest 
 {
 namespace rpc 
 {
+    /**
+     * 预读缓存: 接收时读入的、超出当前读任务的数据，按顺序交给后续的读任务
+     */
+    class RPC_ReadAheadBuffer
+    {
+    private:
+        char * m_data;
+        size_t m_capacity;
+        size_t m_begin;     // 未交付数据的起始位置
+        size_t m_end;       // 未交付数据的结束位置
+        
+        RPC_ReadAheadBuffer(const RPC_ReadAheadBuffer&) = delete;
+        RPC_ReadAheadBuffer& operator=(const RPC_ReadAheadBuffer&) = delete;
+        
+    public:
+        explicit RPC_ReadAheadBuffer(size_t capacity) 
+            : m_data(new char[capacity]), m_capacity(capacity), m_begin(0), m_end(0) {}
+        
+        ~RPC_ReadAheadBuffer() { delete[] m_data; }
+        
+        size_t size() const { return m_end - m_begin; }
+        
+        size_t capacity() const { return m_capacity; }
+        
+        // 取出数据写入缓存序列的剩余空间，返回写入的字节数
+        size_t read_to(Mutable_Buffer_Sequence &bufseq) {
+            size_t copied = 0;
+            Mutable_Buffer_Sequence::Iterator it = bufseq.latest();
+            for(; it != bufseq.end() && m_begin < m_end; ++it ) {
+                size_t s = it->limit() - it->size();
+                size_t n = (s < m_end - m_begin) ? s : m_end - m_begin;
+                memcpy(it->ptr(it->size()), m_data + m_begin, n);
+                m_begin += n;
+                copied += n;
+                if ( n < s ) break;
+            }
+            if ( m_begin == m_end ) m_begin = m_end = 0;
+            if ( copied > 0 ) bufseq.write_submit(copied);
+            return copied;
+        }
+        
+        // 可接收数据的空间，必要时把未交付的数据移到开头
+        iovec space() {
+            if ( m_begin > 0 ) {
+                memmove(m_data, m_data + m_begin, m_end - m_begin);
+                m_end -= m_begin;
+                m_begin = 0;
+            }
+            return iovec{m_data + m_end, m_capacity - m_end};
+        }
+        
+        // 确认接收到space()中的n个字节
+        void commit(size_t n) { m_end += n; }
+    }; // end of class RPC_ReadAheadBuffer
+    
+    /**
+     * 自适应忙轮询: 阻塞等待前先用wait(0)自旋，自旋预算在[0, 上限]之间调整。
+     * 自旋中等到事件，或自旋落空后阻塞等待在上限时间内就有事件时预算加倍；
+     * 否则减半，负载低时逐渐退回到直接阻塞，不长期占用CPU。
+     */
+    class RPC_BusyPoll
+    {
+    private:
+        int64_t  m_max_us;      // 预算上限，0为关闭
+        int64_t  m_budget_us;   // 当前自旋预算
+        uint64_t m_hits;        // 自旋中等到事件的次数
+        uint64_t m_misses;      // 自旋落空后阻塞等待的次数
+        uint64_t m_idle_us;     // 自旋和阻塞等待的累计时间，不包括timeout为0的wait
+        
+        void grow() {
+            int64_t step = (m_max_us >= 8) ? m_max_us / 8 : 1;
+            m_budget_us = (m_budget_us < step) ? step : m_budget_us * 2;
+            if ( m_budget_us > m_max_us ) m_budget_us = m_max_us;
+        }
+        
+        void shrink() {
+            int64_t step = (m_max_us >= 8) ? m_max_us / 8 : 1;
+            m_budget_us /= 2;
+            if ( m_budget_us < step ) m_budget_us = 0;
+        }
+        
+    public:
+        RPC_BusyPoll() : m_max_us(0), m_budget_us(0), m_hits(0), m_misses(0), m_idle_us(0) {}
+        
+        void set_budget(int64_t max_us) {
+            m_max_us = (max_us > 0) ? max_us : 0;
+            m_budget_us = m_max_us;
+        }
+        
+        int64_t  max_budget() const { return m_max_us; }
+        int64_t  budget() const { return m_budget_us; }
+        uint64_t hits() const { return m_hits; }
+        uint64_t misses() const { return m_misses; }
+        uint64_t idle_us() const { return m_idle_us; }
+        
+        // 代替poller.wait(timeout)；timeout为0或未打开时直接调用
+        template<class Poller>
+        int wait(Poller &poller, int timeout) {
+            if ( timeout == 0 ) return poller.wait(0);
+            
+            int64_t start = DateTime::get_timestamp();
+            if ( m_max_us == 0 ) {
+                int ret = poller.wait(timeout);
+                m_idle_us += DateTime::get_timestamp() - start;
+                return ret;
+            }
+            int64_t now = start;
+            while ( now - start < m_budget_us ) {
+                int ret = poller.wait(0);
+                if ( ret != 0 ) {
+                    ++m_hits;
+                    this->grow();
+                    m_idle_us += DateTime::get_timestamp() - start;
+                    return ret;
+                }
+                now = DateTime::get_timestamp();
+            }
+            
+            int spent = (int)((now - start) / 1000);
+            int ret = poller.wait((timeout < 0 || timeout > spent) ? timeout - spent : 0);
+            ++m_misses;
+            now = DateTime::get_timestamp();
+            m_idle_us += now - start;
+            if ( ret > 0 && now - start <= m_max_us ) this->grow();
+            else this->shrink();
+            return ret;
+        }
+    }; // end of class RPC_BusyPoll
+    
+    /**
+     * proactor回调handler的默认策略: 各handler保存在std::function中，可随时用set_*_handler替换。
+     * 自定义策略作为RPC_Proactor/RPC_Service的模板参数Handlers，提供以下成员函数，
+     * 回调在编译期确定，接收路径可以整体内联:
+     *   int on_accept(RPC_SocketListener*, RPC_SocketChannel*, int ec)
+     *   int on_connect(RPC_SocketChannel*, int ec)
+     *   int on_send(RPC_SocketChannel*, RPC_Message &, int ec)
+     *   int on_receive(RPC_SocketChannel*, RPC_Message &, int ec)
+     * 策略对象由proactor默认构造并持有，用handlers()访问。
+     */
+    struct RPC_FunctionHandlers
+    {
+        std::function<int (RPC_SocketListener*, RPC_SocketChannel*, int ec)> accept;
+        std::function<int (RPC_SocketChannel*, int ec)> connect;                  // channel连接成功处理
+        std::function<int (RPC_SocketChannel*, RPC_Message &, int ec)> send;      // 发送成功回调
+        std::function<int (RPC_SocketChannel*, RPC_Message &, int ec)> recv;      // 接收成功回调
+        
+        int on_accept(RPC_SocketListener *pl, RPC_SocketChannel *pch, int ec) { return accept(pl, pch, ec); }
+        int on_connect(RPC_SocketChannel *pch, int ec) { return connect(pch, ec); }
+        int on_send(RPC_SocketChannel *pch, RPC_Message &msg, int ec) { return send(pch, msg, ec); }
+        int on_receive(RPC_SocketChannel *pch, RPC_Message &msg, int ec) { return recv(pch, msg, ec); }
+    }; // end of struct RPC_FunctionHandlers
+    
+    /**
+     * 用户定时器: 在proactor线程回调，到期时间精确到us，为单调时钟(DateTime::get_monotonic_timestamp)，以ID取消。
+     * 时间轮以ms为tick，用户定时器单独放在Multimap_Timer_Queue中，最早的到期时间由proactor用timerfd等待。
+     * 回调中可以增加或取消任意定时器，包括正在回调的自身。
+     * 周期定时器按固定频率触发，回调耗时超过周期时跳过错过的周期，不补发。
+     */
+    class RPC_UserTimerQueue
+    {
+    public:
+        typedef std::function<void ()> Callback;
+        
+    private:
+        struct Entry : public Timer_Node
+        {
+            uint64_t id;
+            int64_t  period;     // 0为一次性
+            Callback callback;
+        };
+        
+        Multimap_Timer_Queue  m_queue;
+        Open_Hash_Map<Entry*> m_entries;      // 以ID为键，包括正在回调的定时器
+        uint64_t              m_next_id;
+        Entry *               m_p_firing;     // 正在回调的定时器
+        bool                  m_firing_cancelled;
+        uint64_t              m_fired;
+        
+        RPC_UserTimerQueue(const RPC_UserTimerQueue&) = delete;
+        RPC_UserTimerQueue& operator=(const RPC_UserTimerQueue&) = delete;
+        
+    public:
+        RPC_UserTimerQueue() : m_next_id(1), m_p_firing(nullptr), m_firing_cancelled(false), m_fired(0) {}
+        
+        ~RPC_UserTimerQueue() {
+            auto release = [](uint64_t, Entry *&p_entry) { delete p_entry; };
+            m_entries.for_each(release);
+        }
+        
+        bool    empty() const { return m_entries.empty(); }
+        size_t  size() const { return m_entries.size(); }
+        
+        // 最早的到期时间，没有定时器时为Max_Expire_Time
+        int64_t next_expire_time() const { return m_queue.next_expire_time(); }
+        
+        // 已触发的回调次数
+        uint64_t fired() const { return m_fired; }
+        
+        // expire时刻回调，period大于0时之后每period微秒回调一次，返回定时器ID
+        uint64_t add(int64_t expire, int64_t period, const Callback &callback) {
+            Entry * p_entry = new Entry();
+            p_entry->id = m_next_id++;
+            p_entry->period = period > 0 ? period : 0;
+            p_entry->callback = callback;
+            p_entry->expire_time(expire);
+            m_entries.insert(p_entry->id, p_entry);
+            m_queue.add(p_entry);
+            return p_entry->id;
+        }
+        
+        // 定时器不存在(一次性定时器已触发或已取消)时返回false
+        bool cancel(uint64_t id) {
+            Entry ** pp_entry = m_entries.find(id);
+            if ( pp_entry == nullptr ) return false;
+            Entry * p_entry = *pp_entry;
+            if ( p_entry == m_p_firing ) {
+                m_firing_cancelled = true;    // 回调返回后删除
+                return true;
+            }
+            m_queue.cancel(p_entry);
+            m_entries.erase(id);
+            delete p_entry;
+            return true;
+        }
+        
+        // 回调全部到期的定时器，返回回调次数
+        size_t expire(int64_t now) {
+            struct FireHandler {
+                RPC_UserTimerQueue * p_queue;
+                int64_t              now;
+                void operator()(Timer_Node * p_node) { p_queue->fire((Entry *)p_node, now); }
+            } handler = { this, now };
+            return m_queue.expire(now, handler);
+        }
+        
+    private:
+        void fire(Entry * p_entry, int64_t now) {
+            m_p_firing = p_entry;
+            m_firing_cancelled = false;
+            ++m_fired;
+            p_entry->callback();
+            m_p_firing = nullptr;
+            
+            if ( m_firing_cancelled || p_entry->period == 0 ) {
+                m_entries.erase(p_entry->id);
+                delete p_entry;
+                return;
+            }
+            int64_t next = p_entry->expire_time() + p_entry->period;
+            if ( next <= now ) next += ((now - next) / p_entry->period + 1) * p_entry->period;
+            p_entry->expire_time(next);
+            m_queue.add(p_entry);
+        }
+    }; // end of class RPC_UserTimerQueue
+    
     /**
      * 超时队列
+     * Timer为定时结构，可选Timing_Wheel(默认)或Multimap_Timer_Queue。
+     * 超时时间为Max_Expire_Time的任务不进入定时结构。
      */
-    class RPC_TaskTimeoutQueue
+    template<class Timer = Timing_Wheel>
+    class RPC_Basic_TaskTimeoutQueue
     {
     public:
+        typedef Timer TimerType;
+        
         class TaskOwner;
     
-        class Task 
+        class Task : public Timer_Node
         {
         private:
             TaskOwner * m_owner_ref;
             int         m_type;
-            int64_t     m_expire_time;
             RPC_Message m_msg;
             
         public:
             Task(TaskOwner *owner, int type, RPC_Message& msg, int64_t exp) 
-                : m_owner_ref(owner), m_type(type), m_expire_time(exp), m_msg(msg) {}
+                : Timer_Node(exp), m_owner_ref(owner), m_type(type), m_msg(msg) {}
         
-            int64_t expire_time() const {  return m_expire_time; }
-            
             int type() const { return m_type; }
             
             TaskOwner * owner() { return m_owner_ref; }
@@ -46,92 +311,189 @@ namespace rpc
         {
         private:
             RPC_SocketObject * m_sock_ref;
-            std::queue<Task> m_wr_queue;  // 读任务队列
-            std::queue<Task> m_rd_queue;  // 写任务队列
+            std::list<Task> m_wr_queue;  // 写任务队列
+            std::list<Task> m_rd_queue;  // 读任务队列
+            bool            m_readable;  // 边沿触发: 上次通知后尚未读到EAGAIN
+            bool            m_writable;  // 边沿触发: 上次通知后尚未写到EAGAIN
+            bool            m_scheduled; // 已在proactor的就绪列表中
+            int             m_armed;     // 水平触发: 当前已注册到poller的事件
+            bool            m_dirty;     // 水平触发: 已在proactor的待提交列表中
+            bool            m_flush_pending; // 已在proactor的待发送列表中
+            bool            m_read_paused;   // 待发送字节数超过高水位，暂停读取
+            int64_t         m_paused_since;  // 暂停开始的时间(us)
+            RPC_ReadAheadBuffer * m_read_ahead;  // 预读模式下第一次接收时创建
+            
+            TaskOwner(const TaskOwner&) = delete;
+            TaskOwner& operator=(const TaskOwner&) = delete;
             
         public:
-            TaskOwner(RPC_SocketObject* p) : m_sock_ref(p) {}
+            TaskOwner(RPC_SocketObject* p) 
+                : m_sock_ref(p), m_readable(false), m_writable(false), m_scheduled(false)
+                , m_armed(0), m_dirty(false), m_flush_pending(false)
+                , m_read_paused(false), m_paused_since(0), m_read_ahead(nullptr) {}
+            
+            ~TaskOwner() { delete m_read_ahead; }
         
             RPC_SocketObject * get_socket() const { return m_sock_ref; }
+            
+            bool readable() const { return m_readable; }
+            void readable(bool r) { m_readable = r; }
+            
+            bool writable() const { return m_writable; }
+            void writable(bool w) { m_writable = w; }
+            
+            bool scheduled() const { return m_scheduled; }
+            void scheduled(bool s) { m_scheduled = s; }
+            
+            int  armed() const { return m_armed; }
+            void armed(int events) { m_armed = events; }
+            
+            bool dirty() const { return m_dirty; }
+            void dirty(bool d) { m_dirty = d; }
+            
+            bool flush_pending() const { return m_flush_pending; }
+            void flush_pending(bool f) { m_flush_pending = f; }
+            
+            bool    read_paused() const { return m_read_paused; }
+            int64_t paused_since() const { return m_paused_since; }
+            void    read_paused(bool p, int64_t now) { m_read_paused = p; m_paused_since = now; }
+            
+            // 任务队列，用于合并发送时遍历
+            std::list<Task> & tasks(int type) {
+                return (type == RPC_Constants::Read) ? m_rd_queue : m_wr_queue;
+            }
+            
+            // 边沿触发时可直接处理，不需要再等待poller通知
+            bool ready() const {
+                return ((m_readable || this->buffered()) && !m_read_paused && !m_rd_queue.empty()) 
+                    || (m_writable && !m_wr_queue.empty());
+            }
+            
+            RPC_ReadAheadBuffer * read_ahead() { return m_read_ahead; }
+            
+            RPC_ReadAheadBuffer * read_ahead(size_t capacity) {
+                if ( m_read_ahead == nullptr ) m_read_ahead = new RPC_ReadAheadBuffer(capacity);
+                return m_read_ahead;
+            }
+            
+            // 迁移时转移预读缓存的所有权
+            RPC_ReadAheadBuffer * release_read_ahead() {
+                RPC_ReadAheadBuffer * p = m_read_ahead;
+                m_read_ahead = nullptr;
+                return p;
+            }
+            
+            void adopt_read_ahead(RPC_ReadAheadBuffer * p) {
+                delete m_read_ahead;
+                m_read_ahead = p;
+            }
+            
+            // 预读缓存中有未交付的数据
+            bool buffered() const { return m_read_ahead != nullptr && m_read_ahead->size() > 0; }
+            
+            bool has_task(int type) const {
+                if ( type == RPC_Constants::Read ) return !m_rd_queue.empty();
+                else if ( type == RPC_Constants::Write ) return !m_wr_queue.empty();
+                else return false;
+            }
         
             Task * get_front_task(int type) 
             {
-                std::queue<Task> * queue = nullptr;
+                std::list<Task> * queue = nullptr;
                 if ( type == RPC_Constants::Read ) queue = &m_rd_queue;
                 else if ( type == RPC_Constants::Write) queue = &m_wr_queue;
                 else {
-                    printf("[WARN] RPC_TaskTimeoutQueue::TaskOwner::get_front_task, wrong type\n");
+                    EVEREST_LOG_WARN("RPC_TaskTimeoutQueue::TaskOwner::get_front_task, wrong type");
                     return nullptr;
                 }
                 
-                printf("[TRACE] RPC_TaskTimeoutQueue::TaskOwner::get_front_task, type %d, empty %s\n", 
+                EVEREST_LOG_TRACE("RPC_TaskTimeoutQueue::TaskOwner::get_front_task, type %d, empty %s", 
                     type, queue->empty()?"true":"false");
                 
                 if ( !queue->empty() ) return &queue->front();
                 else {
-                    printf("[WARN] RPC_TaskTimeoutQueue::TaskOwner::get_front_task, no task\n");
+                    EVEREST_LOG_WARN("RPC_TaskTimeoutQueue::TaskOwner::get_front_task, no task");
                     return nullptr;
                 }
             }
             
             void pop_front_task(int type)
             {
-                std::queue<Task> * queue = nullptr;
+                std::list<Task> * queue = nullptr;
                 if ( type == RPC_Constants::Read ) queue = &m_rd_queue;
                 else if ( type == RPC_Constants::Write) queue = &m_wr_queue;
                 else {
-                    printf("[ERROR] RPC_TaskTimeoutQueue::TaskOwner::pop_front_task, wrong type\n");
+                    EVEREST_LOG_ERROR("RPC_TaskTimeoutQueue::TaskOwner::pop_front_task, wrong type");
+                    return;
                 }
                 
-                printf("[TRACE] RPC_TaskTimeoutQueue::TaskOwner::pop_front_task, type %d, empty %s\n", 
+                EVEREST_LOG_TRACE("RPC_TaskTimeoutQueue::TaskOwner::pop_front_task, type %d, empty %s", 
                     type, queue->empty()?"true":"false");
                 
-                if ( !queue->empty() ) queue->pop();
+                if ( !queue->empty() ) queue->pop_front();
                 else {
-                    printf("[ERROR] RPC_TaskTimeoutQueue::TaskOwner::pop_front_task, no task\n");
+                    EVEREST_LOG_ERROR("RPC_TaskTimeoutQueue::TaskOwner::pop_front_task, no task");
                 }
             }
             
             Task * push_task(const Task &task) 
             {
-                printf("[TRACE] RPC_TaskTimeoutQueue::TaskOwner::push_task, task type %d\n", task.type());
+                EVEREST_LOG_TRACE("RPC_TaskTimeoutQueue::TaskOwner::push_task, task type %d", task.type());
                 int type = task.type();
                 if ( type == RPC_Constants::Read ) {
-                    m_rd_queue.push(task);
+                    m_rd_queue.push_back(task);
                     return &m_rd_queue.back();
                 } else if ( type == RPC_Constants::Write ) {
-                    m_wr_queue.push(task);
+                    m_wr_queue.push_back(task);
                     return &m_wr_queue.back();
                 } else {
-                    printf("[WARN] RPC_TaskTimeoutQueue::TaskOwner::push_task, wrong task type %d\n", type);
+                    EVEREST_LOG_WARN("RPC_TaskTimeoutQueue::TaskOwner::push_task, wrong task type %d", type);
                     return nullptr;
                 }
             } // end of push_task
+            
+            // 删除队列中任意位置的任务，用于超时
+            bool remove_task(Task * p_task)
+            {
+                std::list<Task> & queue = (p_task->type() == RPC_Constants::Read) ? m_rd_queue : m_wr_queue;
+                typename std::list<Task>::iterator it = queue.begin();
+                for(; it != queue.end(); ++it ) {
+                    if ( &*it == p_task ) {
+                        queue.erase(it);
+                        return true;
+                    }
+                }
+                EVEREST_LOG_ERROR("RPC_TaskTimeoutQueue::TaskOwner::remove_task, task not found");
+                return false;
+            } // end of remove_task
         }; // end of class TaskOwner
         
     private:
-        typedef std::multimap<int64_t, Task *>  TimeoutTaskMap;
         typedef std::unordered_map<RPC_SocketObject *, TaskOwner*> TaskOwnerMap;
         
     private:
-        TimeoutTaskMap  m_timeout_map;
+        Timer           m_timer;
         TaskOwnerMap    m_owner_map;
+        size_t          m_task_count;    // 全部未完成任务数，包括无超时的任务
         
     public:
+        RPC_Basic_TaskTimeoutQueue() : m_task_count(0) {}
     
         bool empty() const {
-            return m_timeout_map.empty();
+            return m_task_count == 0;
         }
         
+        size_t size() const { return m_task_count; }
+        
         TaskOwner * add_owner(RPC_SocketObject * p) {
-            TaskOwnerMap::iterator it = m_owner_map.find(p);
+            typename TaskOwnerMap::iterator it = m_owner_map.find(p);
             if ( it == m_owner_map.end() ) {
                 TaskOwner * owner = new TaskOwner(p);
-                std::pair<TaskOwnerMap::iterator, bool > result 
-                    = m_owner_map.insert(TaskOwnerMap::value_type(p, owner));
+                std::pair<typename TaskOwnerMap::iterator, bool > result 
+                    = m_owner_map.insert(typename TaskOwnerMap::value_type(p, owner));
                 if ( result.second ) return owner;
                 else {
-                    printf("[ERROR] RPC_TaskTimeoutQueue::add_owner, add failed\n");
+                    EVEREST_LOG_ERROR("RPC_TaskTimeoutQueue::add_owner, add failed");
                     return nullptr;
                 }
             } else {
@@ -139,138 +501,515 @@ namespace rpc
             }
         }
         
+        bool has_owner(RPC_SocketObject * p) const {
+            return m_owner_map.find(p) != m_owner_map.end();
+        }
+        
+        // 遍历全部owner，handler(TaskOwner*)中不能增删owner
+        template<class Handler>
+        void for_each_owner(Handler &handler) {
+            typename TaskOwnerMap::iterator it = m_owner_map.begin();
+            for(; it != m_owner_map.end(); ++it ) handler(it->second);
+        }
+        
         TaskOwner * find_owner(RPC_SocketObject * p) {
-            TaskOwnerMap::iterator it = m_owner_map.find(p);
+            typename TaskOwnerMap::iterator it = m_owner_map.find(p);
             if ( it != m_owner_map.end() ) {
                 return it->second;
             } else {
-                printf("[ERROR] RPC_TaskTimeoutQueue::find_owner, not found\n");
+                EVEREST_LOG_ERROR("RPC_TaskTimeoutQueue::find_owner, not found");
                 return nullptr;
             }
         }
         
-        Task * push_task(TaskOwner * owner, int type, RPC_Message &msg, int64_t expire) 
+        // 删除owner及其全部未完成任务，任务不回调
+        bool remove_owner(RPC_SocketObject * p) {
+            typename TaskOwnerMap::iterator it = m_owner_map.find(p);
+            if ( it == m_owner_map.end() ) return false;
+            TaskOwner * owner = it->second;
+            m_owner_map.erase(it);
+
+            const int types[2] = { RPC_Constants::Read, RPC_Constants::Write };
+            for(int i = 0; i < 2; ++i ) {
+                std::list<Task> & queue = owner->tasks(types[i]);
+                typename std::list<Task>::iterator t = queue.begin();
+                for(; t != queue.end(); ++t ) {
+                    m_timer.cancel(&*t);
+                    --m_task_count;
+                }
+            }
+            delete owner;
+            return true;
+        }
+
+        Task * push_task(TaskOwner * owner, int type, RPC_Message &msg, int64_t expire)
         {
             // 先写入owner任务队列
             Task * p_task = owner->push_task(Task(owner, type, msg, expire));
             if ( !p_task ) {
-                printf("[ERROR] RPC_TaskTimeoutQueue::push_task, push task fail\n");
+                EVEREST_LOG_ERROR("RPC_TaskTimeoutQueue::push_task, push task fail");
                 return nullptr;
             }
+            ++m_task_count;
             
-            printf("[TRACE] RPC_TaskTimeoutQueue::push_task, insert timeout map\n");
-            // 再写入timeout队列
-            TimeoutTaskMap::iterator it = m_timeout_map.insert(TimeoutTaskMap::value_type(expire, p_task));
-            assert(it != m_timeout_map.end());
-            
+            // 再写入定时结构
+            if ( expire != RPC_Constants::Max_Expire_Time ) {
+                EVEREST_LOG_TRACE("RPC_TaskTimeoutQueue::push_task, insert timer");
+                m_timer.add(p_task);
+            }
             return p_task;
         } // end of push_task
         
-        Task * get_front_timeout() 
+        // 任务完成，从owner队列和定时结构中删除
+        void pop_front_task(TaskOwner * owner, int type) 
         {
-            if ( !m_timeout_map.empty() ) {
-                return m_timeout_map.begin()->second;
-            } else {
-                printf("[ERROR] RPC_TaskTimeoutQueue::get_front_timeout, no front timeout task\n");
-                return nullptr;
-            }
-        }  // end of get_front_timeout
+            Task * p_task = owner->get_front_task(type);
+            if ( !p_task ) return;
+            m_timer.cancel(p_task);
+            owner->pop_front_task(type);
+            --m_task_count;
+        }
         
-        void pop_front_timeout() 
+        // 最近的超时时间，没有需要超时的任务时返回Max_Expire_Time
+        int64_t next_expire_time() const 
         {
-            throw std::runtime_error("RPC_TaskTimeoutQueue::pop_front_timeout not impl");
+            return m_timer.next_expire_time();
         }
-    }; // end of class RPC_TimeoutQueue
+        
+        /**
+         * 批量取出已超时的任务，从owner队列中删除后调用handler(TaskOwner*, int type, RPC_Message&)
+         */
+        template<class Handler>
+        size_t expire(int64_t now, Handler &handler)
+        {
+            struct Expired {
+                RPC_Basic_TaskTimeoutQueue * p_queue;
+                Handler                    * p_handler;
+                
+                void operator()(Timer_Node * p_node) {
+                    Task * p_task = static_cast<Task *>(p_node);
+                    TaskOwner * p_owner = p_task->owner();
+                    int type = p_task->type();
+                    RPC_Message msg = p_task->message();
+                    p_owner->remove_task(p_task);
+                    --p_queue->m_task_count;
+                    (*p_handler)(p_owner, type, msg);
+                }
+            } expired = { this, &handler };
+            return m_timer.expire(now, expired);
+        } // end of expire
+    }; // end of class RPC_Basic_TaskTimeoutQueue
+    
+    typedef RPC_Basic_TaskTimeoutQueue<> RPC_TaskTimeoutQueue;
+    
+    /**
+     * 迁移中的channel: 从原proactor注销时取出的未完成任务和接收状态，由目标proactor按原顺序恢复。
+     * 收发进度记录在消息缓存中，随任务一起转移
+     */
+    struct RPC_ChannelState
+    {
+        struct Pending
+        {
+            RPC_Message message;
+            int64_t     expire_time;
+        };
+        
+        RPC_SocketChannel *   p_channel;
+        std::vector<Pending>  reads;           // 按投递顺序
+        std::vector<Pending>  writes;
+        RPC_ReadAheadBuffer * p_read_ahead;    // 拥有，attach后交给目标owner
+        bool                  read_paused;
+        int64_t               paused_since;
+        
+        RPC_ChannelState() : p_channel(nullptr), p_read_ahead(nullptr), read_paused(false), paused_since(0) {}
+        ~RPC_ChannelState() { delete p_read_ahead; }
+        
+    private:
+        RPC_ChannelState(const RPC_ChannelState&) = delete;
+        RPC_ChannelState& operator=(const RPC_ChannelState&) = delete;
+    }; // end of struct RPC_ChannelState
     
-    template<class Poller = net::EPoller>
+    /**
+     * Poller::Edge_Triggered为true(net::EPoller_ET)时，socket在reg时一次注册IN|OUT，之后不再修改；
+     * 事件只用于设置TaskOwner的可读/可写状态，读、accept和写都执行到EAGAIN为止。
+     * 新任务到达时若owner仍可读写，放入就绪列表，本轮不等待poller直接处理。
+     * 水平触发时TaskOwner记录已注册的事件，任务变化只把owner放入待提交列表，
+     * 每轮wait前统一比较并提交，事件不变的owner不再调用epoll_ctl。
+     * 可写时把channel队列中的多个写任务合并到一次sendmsg，最多IOV_MAX个缓存、
+     * 约Send_Batch_Bytes字节，发送进度记录在缓存的position()，每个消息发送完时回调。
+     * 同一个Buffer_Sequence发送完成前不能重复投递。
+     * flush模式下可写事件和新写任务都只记入待发送列表，由调用者在每轮结束时调用flush()
+     * 统一发送，分批时除最后一批外带MSG_MORE，本轮产生的应答以尽量少的报文段发出。
+     * 预读模式(set_read_ahead)下每个channel有一个预读缓存，接收时把读任务的剩余缓存和
+     * 预读缓存一起交给recvmsg，多读到的后续消息留在预读缓存中，直接交给之后的读任务，
+     * 流水线发送的多个小消息只需一次接收。
+     * 发送背压: channel待发送字节数达到高水位时暂停读该连接(不再关注可读/不再读到EAGAIN)，
+     * 写任务完成、失败或超时后降到低水位时恢复，并回调drain handler通知被拒绝过的发送者。
+     * 设置TCP_NOTSENT_LOWAT后内核只保留少量未发送数据，其余留在写任务队列中参与合并。
+     * 低延迟模式(set_busy_poll)下阻塞等待前先自旋，见RPC_BusyPoll；可同时给channel设置SO_BUSY_POLL。
+     * 监听器可读时用accept4(SOCK_NONBLOCK)连续接受到EAGAIN，每次最多set_accept_budget个，
+     * 一批接受完后再依次回调accept handler。
+     * 用户定时器(schedule)的最早到期时间设置到注册在poller中的timerfd，只在变早时重新设置，
+     * 每轮处理完事件和任务超时后回调到期的定时器。
+     * 接收预算(set_read_budget)限制每个连接每次处理最多接收的字节数和消息数，用完时仍有数据的
+     * 连接放入延后列表，下一轮与其它就绪连接轮流处理(不阻塞等待)，避免大流量连接独占一轮。
+     * 任务超时时若已收发了部分数据，关闭连接并让其全部任务失败(fail_channel)，对端不会收到错位的消息。
+     */
+    template<class Poller = net::EPoller, class Timer = Timing_Wheel, class Handlers = RPC_FunctionHandlers>
     class RPC_Proactor 
     {
+    public:
+        static const size_t Send_Batch_Bytes = 256 * 1024;   // 默认每次sendmsg合并的字节数上限
+        static const size_t Accept_Budget    = 64;           // 默认每次可读事件最多接受的连接数
+        static const int64_t Accept_Backoff  = 100 * 1000;   // 文件描述符用完时暂停接受的时间(us)
+        
+        typedef RPC_Basic_TaskTimeoutQueue<Timer>  TaskTimeoutQueue;
+        typedef typename TaskTimeoutQueue::Task      Task;
+        typedef typename TaskTimeoutQueue::TaskOwner TaskOwner;
+        
     private:
         Poller               m_poller;
-        RPC_TaskTimeoutQueue m_task_timeout_queue;   // 任务超时队列
+        TaskTimeoutQueue     m_task_timeout_queue;   // 任务超时队列
+        net::EventNotifier   m_notifier;             // 跨线程唤醒
+        net::TimerNotifier   m_timer_notifier;       // 用户定时器的精确唤醒
+        RPC_UserTimerQueue   m_user_timers;
         
-        std::function<int (RPC_SocketListener*, RPC_SocketChannel*, int ec)> m_accept_handler;
-        std::function<int (RPC_SocketChannel*, int ec)> m_connect_handler;  // channel连接成功处理
-        std::function<int (RPC_SocketChannel*, RPC_Message &, int ec)> m_send_handler;  // 发送成功回调
-        std::function<int (RPC_SocketChannel*, RPC_Message &, int ec)> m_recv_handler;  // 接收成功回调
+        Handlers             m_handlers;             // 回调策略
         
         std::vector<struct iovec> m_send_iovec;
         std::vector<struct iovec> m_recv_iovec;
+        uint64_t                  m_io_calls;    // accept/收发/通知复位的系统调用次数
+        std::vector<TaskOwner *>  m_ready_list;  // 边沿触发: 有任务且仍可读写的owner
+        std::vector<TaskOwner *>  m_deferred_list;  // 接收预算用完、下一轮继续的owner
+        std::vector<TaskOwner *>  m_dirty_list;  // 水平触发: 任务变化、待提交事件的owner
+        uint64_t                  m_ctl_saved;   // 任务变化但未调用epoll_ctl的次数
+        std::vector<TaskOwner *>  m_flush_list;  // flush模式: 有写任务待发送的owner
+        bool                      m_flush_mode;
+        std::vector<TaskOwner *>  m_sent_list;   // 直接发送完、待回调的owner
+        std::vector<TaskOwner *>  m_sent_batch;  // 本次回调的owner，回调中新加入的留到下一次
+        bool                      m_direct_write;
+        uint64_t                  m_direct_writes;   // 在add_write中直接发送完的消息数
+        size_t                    m_send_batch_bytes;
+        size_t                    m_read_ahead;  // 预读缓存大小，0为不预读
+        int                       m_notsent_lowat;      // 0为使用系统默认
+        uint64_t                  m_backpressure_us;    // 已结束的暂停读取累计时间
+        uint64_t                  m_backpressure_count; // 暂停读取次数
+        std::function<void (RPC_SocketChannel*)> m_drain_handler;  // 降到低水位，可以继续发送
+        RPC_BusyPoll              m_busy_poll;
+        int                       m_socket_busy_poll;   // channel的SO_BUSY_POLL(us)，0为不设置
+        size_t                    m_accept_budget;      // 每次可读事件最多接受的连接数
+        std::vector<RPC_SocketChannel *> m_accepted;    // 本批接受的连接
+        size_t                    m_budget_bytes;       // 每个连接每次处理最多接收的字节数，0为不限
+        size_t                    m_budget_messages;    // 每个连接每次处理最多接收的消息数，0为不限
+        size_t                    m_turn_bytes;         // 当前连接本次已接收的字节数
+        size_t                    m_turn_messages;      // 当前连接本次已接收的消息数
+        TaskOwner *               m_p_turn_owner;       // 正在处理的owner，本次结束时再决定是否放入就绪列表
+        bool                      m_turn_updated;       // 处理中owner的任务发生了变化
+        uint64_t                  m_deferred_count;     // 因预算用完延后的次数
         
     public:
-        RPC_Proactor() {
+        RPC_Proactor() : m_io_calls(0), m_ctl_saved(0), m_flush_mode(false), m_direct_write(true), m_direct_writes(0)
+            , m_send_batch_bytes(Send_Batch_Bytes), m_read_ahead(0)
+            , m_notsent_lowat(0)
+            , m_backpressure_us(0), m_backpressure_count(0), m_socket_busy_poll(0)
+            , m_accept_budget(Accept_Budget)
+            , m_budget_bytes(0), m_budget_messages(0), m_turn_bytes(0), m_turn_messages(0)
+            , m_p_turn_owner(nullptr), m_turn_updated(false)
+            , m_deferred_count(0)
+        {
             m_send_iovec.reserve(16);
             m_recv_iovec.reserve(16);
+            m_ready_list.reserve(16);
+            m_deferred_list.reserve(16);
+            m_dirty_list.reserve(16);
+            m_flush_list.reserve(16);
+            m_sent_list.reserve(16);
+            m_sent_batch.reserve(16);
+            
+            bool isok = m_poller.add(m_notifier.handle(), Poller::Event_Read, &m_notifier);
+            if ( !isok ) {
+                EVEREST_LOG_ERROR("RPC_Proactor::RPC_Proactor, reg notifier error");
+            }
+            isok = m_poller.add(m_timer_notifier.handle(), Poller::Event_Read, &m_timer_notifier);
+            if ( !isok ) {
+                EVEREST_LOG_ERROR("RPC_Proactor::RPC_Proactor, reg timer notifier error");
+            }
         }
         
+        // 回调策略对象，自定义策略通过它设置状态
+        Handlers & handlers() { return m_handlers; }
+        
+        // set_accept/connect/send/recv_handler只用于默认策略
         template<class Handler>
-        void set_accept_handler(const Handler &handler) { m_accept_handler = handler; }
+        void set_accept_handler(const Handler &handler) { m_handlers.accept = handler; }
         
         template<class Handler>
-        void set_connect_handler(const Handler &handler) { m_connect_handler = handler; }
+        void set_connect_handler(const Handler &handler) { m_handlers.connect = handler; }
     
         template<class Handler>
-        void set_send_handler(const Handler &handler) { m_send_handler = handler; }
+        void set_send_handler(const Handler &handler) { m_handlers.send = handler; }
         
         template<class Handler>
-        void set_recv_handler(const Handler &handler) { m_recv_handler = handler; }
+        void set_recv_handler(const Handler &handler) { m_handlers.recv = handler; }
+        
+        template<class Handler>
+        void set_drain_handler(const Handler &handler) { m_drain_handler = handler; }
     
         bool reg(RPC_SocketObject *sockobj) 
         {
             // 任务超时队列中注册socket对象
-            RPC_TaskTimeoutQueue::TaskOwner * p_owner = m_task_timeout_queue.add_owner(sockobj);
+            TaskOwner * p_owner = m_task_timeout_queue.add_owner(sockobj);
             assert(p_owner);
             
-            bool isok = m_poller.add(sockobj->get_socket().handle(), 0, p_owner);
+            if ( m_notsent_lowat > 0 && sockobj->type() == RPC_SocketObject::Type_Channel ) {
+                sockobj->get_socket().set_notsent_lowat(m_notsent_lowat);
+            }
+            if ( m_socket_busy_poll > 0 && sockobj->type() == RPC_SocketObject::Type_Channel ) {
+                sockobj->get_socket().set_busy_poll(m_socket_busy_poll);
+            }
+            
+            // 边沿触发只注册一次，之后不再修改关注的事件
+            int events = Poller::Edge_Triggered ? (Poller::Event_Read | Poller::Event_Write) : Poller::Event_None;
+            bool isok = m_poller.add(sockobj->get_socket().handle(), events, p_owner);
             if ( !isok ) {
-                printf("[ERROR] RPC_Proactor::reg(sockobj) error\n");
+                EVEREST_LOG_ERROR("RPC_Proactor::reg(sockobj) error");
                 return false;
             }
+            p_owner->armed(events);
+            return true;
+        }
+
+        /**
+         * 注销socket对象，未完成的任务直接丢弃，不回调handler。
+         * 不能在处理事件的过程中调用(本轮已返回的事件仍引用owner)，由RPC_Service在取任务时调用。
+         */
+        bool unreg(RPC_SocketObject *sockobj)
+        {
+            if ( !m_task_timeout_queue.has_owner(sockobj) ) return false;
+            TaskOwner * p_owner = m_task_timeout_queue.find_owner(sockobj);
+            this->remove_from(m_ready_list, p_owner);
+            this->remove_from(m_deferred_list, p_owner);
+            this->remove_from(m_dirty_list, p_owner);
+            this->remove_from(m_flush_list, p_owner);
+            this->remove_from(m_sent_list, p_owner);
+
+            bool isok = m_poller.remove(sockobj->get_socket().handle());
+            if ( !isok ) {
+                EVEREST_LOG_ERROR("RPC_Proactor::unreg(sockobj) error");
+            }
+            m_task_timeout_queue.remove_owner(sockobj);
+            return isok;
+        }
+        
+        // 注销channel并按顺序取出其未完成的任务和预读缓存，任务不回调、channel不关闭，用于迁移
+        bool detach(RPC_SocketChannel *pch, RPC_ChannelState &state)
+        {
+            if ( !m_task_timeout_queue.has_owner(pch) ) return false;
+            TaskOwner * p_owner = m_task_timeout_queue.find_owner(pch);
+            const int types[2] = { RPC_Constants::Read, RPC_Constants::Write };
+            for(int i = 0; i < 2; ++i ) {
+                std::vector<RPC_ChannelState::Pending> & pendings = (types[i] == RPC_Constants::Read) ? state.reads : state.writes;
+                std::list<Task> & queue = p_owner->tasks(types[i]);
+                typename std::list<Task>::iterator t = queue.begin();
+                for(; t != queue.end(); ++t ) {
+                    pendings.push_back(RPC_ChannelState::Pending{ t->message(), t->expire_time() });
+                }
+            }
+            state.p_channel = pch;
+            state.p_read_ahead = p_owner->release_read_ahead();
+            state.read_paused = p_owner->read_paused();
+            state.paused_since = p_owner->paused_since();
+            return this->unreg(pch);
+        }
+        
+        // 注册detach取出的channel，恢复预读缓存和暂停状态后按原顺序重新加入任务
+        bool attach(RPC_ChannelState &state)
+        {
+            RPC_SocketChannel * pch = state.p_channel;
+            if ( !this->reg(pch) ) return false;
+            TaskOwner * p_owner = m_task_timeout_queue.find_owner(pch);
+            p_owner->adopt_read_ahead(state.p_read_ahead);
+            state.p_read_ahead = nullptr;
+            p_owner->read_paused(state.read_paused, state.paused_since);
+            
+            bool isok = true;
+            for(size_t i = 0; i < state.reads.size(); ++i ) {
+                isok = this->add_read(pch, state.reads[i].message, state.reads[i].expire_time) && isok;
+            }
+            for(size_t i = 0; i < state.writes.size(); ++i ) {
+                isok = this->add_write(pch, state.writes[i].message, state.writes[i].expire_time) && isok;
+            }
+            this->update_events(p_owner);
+            return isok;
+        }
+        
+        // 关闭channel的收发，已投递的任务回调Fail(见fail_channel)；channel未注册时返回false。
+        // 与unreg相同，不能在处理事件的过程中调用
+        bool abort_channel(RPC_SocketChannel *pch)
+        {
+            if ( !m_task_timeout_queue.has_owner(pch) ) return false;
+            this->fail_channel(m_task_timeout_queue.find_owner(pch), pch);
             return true;
         }
+        
+        // 遍历已注册的channel，handler(RPC_SocketChannel*)中不能注册或注销
+        template<class Handler>
+        void for_each_channel(Handler &handler) {
+            struct Visitor {
+                Handler * p_handler;
+                void operator()(TaskOwner * p_owner) {
+                    RPC_SocketObject * p_sock = p_owner->get_socket();
+                    if ( p_sock->type() == RPC_SocketObject::Type_Channel ) (*p_handler)((RPC_SocketChannel *)p_sock);
+                }
+            } visitor = { &handler };
+            m_task_timeout_queue.for_each_owner(visitor);
+        }
 
+        // 唤醒正在等待的poller，可在任意线程调用
+        bool notify() { return m_notifier.notify(); }
+        
+        // 用户定时器，在proactor线程调用和回调，见RPC_UserTimerQueue
+        uint64_t schedule(int64_t expire, int64_t period, const RPC_UserTimerQueue::Callback &callback) {
+            return m_user_timers.add(expire, period, callback);
+        }
+        
+        bool     cancel_timer(uint64_t id) { return m_user_timers.cancel(id); }
+        size_t   timer_count() const { return m_user_timers.size(); }
+        uint64_t timers_fired() const { return m_user_timers.fired(); }
+        
+        // 每次sendmsg合并的字节数上限，至少包含一个缓存
+        void set_send_batch_bytes(size_t n) { m_send_batch_bytes = n; }
+        
+        bool flush_mode() const { return m_flush_mode; }
+        void set_flush_mode(bool on) { m_flush_mode = on; }
+        
+        // flush模式下发送待发送列表中owner的全部写任务
+        void flush();
+        
+        // 写队列为空、socket可写时add_write直接sendmsg，EAGAIN或部分发送时再等待可写事件；
+        // 发送完的消息在本轮结束前回调send handler，不在add_write中回调。flush模式下不直接发送
+        bool direct_write() const { return m_direct_write; }
+        void set_direct_write(bool on) { m_direct_write = on; }
+        uint64_t direct_writes() const { return m_direct_writes; }
+        
+        // 每个channel的预读缓存大小，0为关闭；只对之后第一次接收的channel生效
+        void set_read_ahead(size_t bytes) { m_read_ahead = bytes; }
+        
+        // 之后注册的channel的TCP_NOTSENT_LOWAT，0为使用系统默认
+        void set_notsent_lowat(size_t bytes) { m_notsent_lowat = (int)bytes; }
+        
+        // 每次可读事件最多接受的连接数，达到后先处理其它事件，至少为1
+        void set_accept_budget(size_t n) { m_accept_budget = n > 0 ? n : 1; }
+        
+        // 每个连接每次处理最多接收的字节数和消息数，0为不限；字节数在一次接收后检查，可能略超
+        void set_read_budget(size_t bytes, size_t messages) {
+            m_budget_bytes = bytes;
+            m_budget_messages = messages;
+        }
+        
+        // 因接收预算用完而延后到下一轮的次数
+        uint64_t deferred_count() const { return m_deferred_count; }
+        
+        // 阻塞等待前最多自旋的时间(us)，0为关闭
+        void set_busy_poll(int64_t spin_us) { m_busy_poll.set_budget(spin_us); }
+        
+        // 之后注册的channel的SO_BUSY_POLL(us)，超过net.core.busy_read时需要CAP_NET_ADMIN
+        void set_socket_busy_poll(int usec) { m_socket_busy_poll = usec; }
+        
+        const RPC_BusyPoll & busy_poll() const { return m_busy_poll; }
+        
+        // 阻塞等待的累计时间(us)，用于计算线程利用率
+        uint64_t idle_time_us() const { return m_busy_poll.idle_us(); }
+        
+        // socket对象是否已注册，注册前投递的任务需经RPC_Service的任务队列
+        bool registered(RPC_SocketObject *sockobj) const { return m_task_timeout_queue.has_owner(sockobj); }
+        
         bool add_read(RPC_SocketObject *sockobj, RPC_Message &msg, int64_t expire);
         
         bool add_write(RPC_SocketObject *sockobj, RPC_Message &msg, int64_t expire);
 
-        int run_once() {
+        /**
+         * max_wait为本轮最多阻塞的毫秒数，负数时为Max_Wait_Time；
+         * 没有任务时max_wait为负数立即返回0，否则等待到有事件、被notify唤醒或超时
+         */
+        int run_once(int max_wait = -1) {
+            this->complete_sent();    // 两轮之间直接发送完的消息，回调后不再需要关注可写
+            this->commit_events();    // 上一轮及两轮之间的任务变化一次提交
+            
             int64_t now = DateTime::get_timestamp();
-            if ( m_task_timeout_queue.empty() ) {
-                printf("[INFO] RPC_Proactor::run, no task \n");
+            if ( m_task_timeout_queue.empty() && m_user_timers.empty() && max_wait < 0 ) {
+                EVEREST_LOG_INFO("RPC_Proactor::run, no task ");
                 return 0;
             }
+            if ( max_wait < 0 || max_wait > RPC_Constants::Max_Wait_Time ) max_wait = RPC_Constants::Max_Wait_Time;
             
-            bool  need_clear_timeout = false;   // 是否在wait后需要清理超时任务
+            // 等待到最近的超时时间(向上取整到ms，避免提前醒来空转)，最长max_wait
+            int64_t wait_us = m_task_timeout_queue.next_expire_time() - now;
+            int timeout = max_wait;
+            if ( wait_us <= 0 ) {
+                timeout = 0;
+            } else if ( wait_us < (int64_t)max_wait * 1000 ) {
+                timeout = (int)((wait_us + 999) / 1000);
+            }
+            if ( !m_deferred_list.empty() ) {
+                // 上一轮预算用完的owner排在本轮事件之后，与新就绪的owner轮流处理
+                m_ready_list.insert(m_ready_list.end(), m_deferred_list.begin(), m_deferred_list.end());
+                m_deferred_list.clear();
+            }
+            if ( !m_ready_list.empty() || !m_sent_list.empty() ) timeout = 0;   // 已有可直接处理的owner，不阻塞
             
-            RPC_TaskTimeoutQueue::Task * p_task = m_task_timeout_queue.get_front_timeout();
-            int timeout = (int)((p_task->expire_time() - now) / 1000);
-            if ( timeout < 0 ) {
-                need_clear_timeout = true;
+            // 用户定时器不按ms取整，由timerfd在到期时刻唤醒
+            int64_t timer_expire = m_user_timers.next_expire_time();
+            if ( timer_expire <= DateTime::get_monotonic_timestamp() ) {
                 timeout = 0;
+            } else if ( timeout != 0 && timer_expire < m_timer_notifier.armed() ) {
+                m_timer_notifier.arm(timer_expire);
+                ++m_io_calls;
             }
-            int ret = m_poller.wait(timeout);
+            
+            int ret = m_busy_poll.wait(m_poller, timeout);
             if ( ret > 0 ) {
                 this->process_events();
-                if ( need_clear_timeout ) this->clear_timeout_task();
             } else if ( ret == 0 ) {
                 // 超时，并没有事件发生
-                printf("[ERROR] RPC_Proactor::run, poller wait timeout %d ms\n", timeout);
-                this->clear_timeout_task();
+                EVEREST_LOG_TRACE("RPC_Proactor::run, poller wait timeout %d ms", timeout);
             } else {
                 // poller wait出现错误
-                printf("[ERROR] RPC_Proactor::run, poller wait error\n");
+                EVEREST_LOG_ERROR("RPC_Proactor::run, poller wait error");
             }
+            if ( ret >= 0 && !m_ready_list.empty() ) {
+                ret += (int)this->process_ready_list();
+            }
+            this->complete_sent();
+            this->clear_timeout_task();
+            size_t fired = m_user_timers.expire(DateTime::get_monotonic_timestamp());
+            if ( ret >= 0 ) ret += (int)fired;
             return ret;
         }
         
+        size_t task_count() const { return m_task_timeout_queue.size(); }
+        
+        // proactor线程发起的系统调用次数，用于比较不同poller
+        uint64_t syscall_count() const { return m_poller.syscalls() + m_io_calls; }
+        
+        // 因事件未变化或合并提交而省去的epoll_ctl次数
+        uint64_t ctl_saved() const { return m_ctl_saved; }
+        
+        // 超过高水位而暂停读取的累计时间(us)和次数，时间只包括已恢复的暂停
+        uint64_t backpressure_time_us() const { return m_backpressure_us; }
+        uint64_t backpressure_count() const { return m_backpressure_count; }
+        
     private:
         size_t prepare_recv_iovec(RPC_Message::Buffer_Sequence & bufseq) 
         {
-            printf("[TRACE] prepare_recv_iovec\n");
+            EVEREST_LOG_TRACE("prepare_recv_iovec");
+            m_recv_iovec.resize(0);
             RPC_Message::Buffer_Sequence::Iterator it = bufseq.latest();
             size_t total_size = 0;
             for( ; it != bufseq.end(); ++it ) {
                 size_t s = it->limit() - it->size();
+                if ( s == 0 ) continue;
+                if ( m_recv_iovec.size() == IOV_MAX ) break;   // 其余缓存在这些收满后再准备
                 total_size += s;
                 m_recv_iovec.push_back(iovec{it->ptr(it->size()) ,s});
             }
@@ -278,73 +1017,333 @@ namespace rpc
             return total_size;
         }
     
+        /**
+         * 一次接受一批连接(最多m_accept_budget个)，全部接受后再依次交给accept handler。
+         * 返回Continue表示已接受到EAGAIN，Ok表示达到数量上限、可能还有连接，Fail表示出错。
+         * 文件描述符用完时暂停接受，见pause_accept
+         */
         int on_acceptable(RPC_SocketListener * plistener) 
         {
-            RPC_SocketChannel * p_channel = plistener->accept();
-            if ( p_channel == nullptr ) {
-                this->m_accept_handler(plistener, p_channel, RPC_Constants::Fail);
-                printf("[ERROR] RPC_Proactor::on_acceptable, listener accept error\n");
-                return RPC_Constants::Fail;
+            m_accepted.clear();
+            int r = plistener->accept(m_accepted, m_accept_budget);
+            int err = errno;
+            m_io_calls += 2 * m_accepted.size() + (r == RPC_Constants::Ok ? 0 : 1);   // accept4和TCP_NODELAY
+            if ( r == RPC_Constants::Fail && (err == EMFILE || err == ENFILE) ) {
+                this->pause_accept(m_task_timeout_queue.find_owner(plistener));
+                r = RPC_Constants::Continue;    // 已接受的连接照常回调，不回调Fail
             }
             
-            printf("[TRACE] RPC_Proactor::on_acceptable, listener %p, channel %p\n", plistener, p_channel);
-            int ret = this->m_accept_handler(plistener, p_channel, RPC_Constants::Ok);
-            if ( ret == RPC_Constants::Fail ) {
-                printf("[ERROR] RPC_Proactor::on_acceptable, call back return fail\n");
-                delete p_channel;
+            for(size_t i = 0; i < m_accepted.size(); ++i ) {
+                RPC_SocketChannel * p_channel = m_accepted[i];
+                EVEREST_LOG_TRACE("RPC_Proactor::on_acceptable, listener %p, channel %p", plistener, p_channel);
+                plistener->note_accepted(p_channel);
+                int ret = this->m_handlers.on_accept(plistener, p_channel, RPC_Constants::Ok);
+                if ( ret == RPC_Constants::Fail ) {
+                    EVEREST_LOG_ERROR("RPC_Proactor::on_acceptable, call back return fail");
+                    delete p_channel;
+                }
             }
-            return ret;
+            if ( r == RPC_Constants::Fail ) {
+                this->m_handlers.on_accept(plistener, nullptr, RPC_Constants::Fail);
+                EVEREST_LOG_ERROR("RPC_Proactor::on_acceptable, listener accept error");
+            }
+            return r;
+        }
+        
+        /**
+         * 文件描述符用完时监听队列中的连接仍可读，水平触发下每轮都会重试失败的accept。
+         * 暂停关注监听器Accept_Backoff后再恢复，每次暂停只记录一次日志
+         */
+        void pause_accept(TaskOwner * p_owner) {
+            if ( p_owner->read_paused() ) return;
+            RPC_SocketObject * p_sock = p_owner->get_socket();
+            EVEREST_LOG_WARN("RPC_Proactor::pause_accept, out of file descriptors, pause %ld us", Accept_Backoff);
+            p_owner->read_paused(true, DateTime::get_timestamp());
+            this->update_events(p_owner);
+            m_user_timers.add(DateTime::get_monotonic_timestamp() + Accept_Backoff, 0, [this, p_sock]() {
+                if ( !m_task_timeout_queue.has_owner(p_sock) ) return;     // 监听器已注销
+                TaskOwner * p_owner = m_task_timeout_queue.find_owner(p_sock);
+                p_owner->read_paused(false, 0);
+                this->update_events(p_owner);
+            });
         }
         
         int on_accept_timeout(RPC_SocketListener * plistener) {
-            printf("[ERROR] RPC_Proactor::on_accept_timeout, poller wait error\n");
-            return RPC_Constants::Ok;
+            EVEREST_LOG_WARN("RPC_Proactor::on_accept_timeout, listener %p", plistener);
+            return this->m_handlers.on_accept(plistener, nullptr, RPC_Constants::Timeout);
+        }
+        
+        int on_readable(RPC_SocketChannel *pchannel, Task *p_task);
+        
+        // 预读模式的接收，依次完成owner的读任务；can_recv为false时只交付预读缓存中的数据
+        int on_readable_ahead(RPC_SocketChannel *pch, TaskOwner *p_owner, bool can_recv);
+        
+        int on_writable(RPC_SocketChannel *pch, TaskOwner *p_owner);
+        
+        // 反复调用on_writable直到队列发完、socket写满或出错，返回最后一次的结果
+        bool write_direct(RPC_SocketChannel *pch, TaskOwner *p_owner, RPC_Message &msg);
+        
+        // 回调直接发送完的消息，同时发送之后加入的写任务
+        void complete_sent() {
+            if ( m_sent_list.empty() ) return;
+            m_sent_batch.swap(m_sent_list);
+            for(size_t i = 0; i < m_sent_batch.size(); ++i ) {
+                TaskOwner * p_owner = m_sent_batch[i];
+                if ( !p_owner->has_task(RPC_Constants::Write) ) continue;   // 边沿触发时可能已由process_owner回调
+                if ( Poller::Edge_Triggered && !p_owner->writable() ) continue;
+                int r = this->write_tasks((RPC_SocketChannel*)p_owner->get_socket(), p_owner);
+                if ( Poller::Edge_Triggered && r == RPC_Constants::Continue ) p_owner->writable(false);
+                this->update_events(p_owner);
+            }
+            m_sent_batch.clear();
+        }
+        
+        int write_tasks(RPC_SocketChannel *pch, TaskOwner *p_owner) {
+            int r = RPC_Constants::Ok;
+            while ( r == RPC_Constants::Ok && p_owner->has_task(RPC_Constants::Write) ) {
+                r = this->on_writable(pch, p_owner);
+            }
+            return r;
+        }
+        
+        // 待发送字节数达到高水位时暂停读取，降到低水位时恢复
+        void check_watermarks(TaskOwner *p_owner, RPC_SocketChannel *pch) {
+            if ( !p_owner->read_paused() ) {
+                if ( !pch->above_high_mark() ) return;
+                EVEREST_LOG_DEBUG("RPC_Proactor::check_watermarks, pause read, queued %lu", pch->queued_bytes());
+                p_owner->read_paused(true, DateTime::get_timestamp());
+                ++m_backpressure_count;
+            } else {
+                if ( pch->queued_bytes() > pch->low_mark() ) return;
+                EVEREST_LOG_DEBUG("RPC_Proactor::check_watermarks, resume read, queued %lu", pch->queued_bytes());
+                m_backpressure_us += DateTime::get_timestamp() - p_owner->paused_since();
+                p_owner->read_paused(false, 0);
+            }
+            this->update_events(p_owner);
+        }
+        
+        // 写任务已离开队列，扣除其字节数
+        void on_send_released(TaskOwner *p_owner, RPC_SocketChannel *pch, size_t bytes) {
+            bool drained = pch->release_send(bytes);
+            this->check_watermarks(p_owner, pch);
+            if ( drained && m_drain_handler ) m_drain_handler(pch);
         }
         
-        int on_readable(RPC_SocketChannel *pchannel, RPC_TaskTimeoutQueue::Task *p_task);
+        static void remove_from(std::vector<TaskOwner *> &list, TaskOwner *p_owner) {
+            for(size_t i = 0; i < list.size(); ) {
+                if ( list[i] == p_owner ) list.erase(list.begin() + i);
+                else ++i;
+            }
+        }
+
+        void schedule_flush(TaskOwner *p_owner) {
+            if ( p_owner->flush_pending() ) return;
+            p_owner->flush_pending(true);
+            m_flush_list.push_back(p_owner);
+        }
         
-        int on_writable(RPC_SocketChannel *pch, RPC_TaskTimeoutQueue::Task *p_task);
+        // owner的任务发生变化。边沿触发时不修改注册，owner仍可读写且有任务时放入就绪列表；
+        // 水平触发时放入待提交列表，由commit_events统一设置poller关注的事件
+        bool update_events(TaskOwner * p_owner) {
+            if ( Poller::Edge_Triggered ) {
+                ++m_ctl_saved;
+            } else if ( p_owner->dirty() ) {
+                ++m_ctl_saved;      // 本轮已待提交，合并
+            } else {
+                p_owner->dirty(true);
+                m_dirty_list.push_back(p_owner);
+            }
+            // 处理中的owner(handler中投递了新任务)由end_turn决定放入就绪列表还是延后
+            if ( p_owner != m_p_turn_owner ) this->schedule_ready(p_owner);
+            else m_turn_updated = true;
+            return true;
+        }
+        
+        // 边沿触发时仍可读写且有任务的owner、水平触发时预读缓存中已有数据的新读任务
+        // (不会再有可读事件)放入就绪列表，本轮不等待poller直接处理
+        void schedule_ready(TaskOwner * p_owner) {
+            if ( p_owner->scheduled() ) return;
+            if ( Poller::Edge_Triggered ? p_owner->ready() 
+                : (p_owner->buffered() && p_owner->has_task(RPC_Constants::Read) && !p_owner->read_paused()) ) {
+                p_owner->scheduled(true);
+                m_ready_list.push_back(p_owner);
+            }
+        }
+        
+        // 根据待提交owner当前的读写任务设置poller关注的事件，与已注册的事件相同时跳过
+        void commit_events() {
+            for(size_t i = 0; i < m_dirty_list.size(); ++i ) {
+                TaskOwner * p_owner = m_dirty_list[i];
+                p_owner->dirty(false);
+                
+                int events = 0;
+                if ( p_owner->has_task(RPC_Constants::Read) && !p_owner->read_paused() ) events |= Poller::Event_Read;
+                if ( p_owner->has_task(RPC_Constants::Write) ) events |= Poller::Event_Write;
+                if ( events == p_owner->armed() ) {
+                    ++m_ctl_saved;
+                    continue;
+                }
+                
+                EVEREST_LOG_TRACE("RPC_Proactor::commit_events, poller set, event %d", events);
+                bool isok = m_poller.set(p_owner->get_socket()->get_socket().handle(), events, p_owner);
+                if ( isok ) {
+                    p_owner->armed(events);
+                } else {
+                    EVEREST_LOG_ERROR("RPC_Proactor::commit_events, poller set error");
+                }
+            }
+            m_dirty_list.clear();
+        }
         
         int on_connected(RPC_SocketChannel *p_ch) {
-            printf("[TRACE] RPC_Proactor::on_connected\n");
-            return this->m_connect_handler(p_ch, RPC_Constants::Ok);
+            EVEREST_LOG_TRACE("RPC_Proactor::on_connected");
+            return this->m_handlers.on_connect(p_ch, RPC_Constants::Ok);
         }
         
+        // 触发所有已超时任务的handler，错误码为RPC_Constants::Timeout
         void clear_timeout_task() {
-            printf("[ERROR] RPC_Proactor::clear_timeout_task, poller wait error\n");
+            struct TimeoutHandler {
+                RPC_Proactor * p_proactor;
+                void operator()(TaskOwner * p_owner, int type, RPC_Message &msg) {
+                    p_proactor->on_task_timeout(p_owner, type, msg);
+                }
+            } handler = { this };
+            
+            int64_t now = DateTime::get_timestamp();
+            size_t n = m_task_timeout_queue.expire(now, handler);
+            if ( n > 0 ) {
+                EVEREST_LOG_TRACE("RPC_Proactor::clear_timeout_task, %lu tasks timeout", n);
+            }
+        }
+        
+        // 任务超时，任务已从owner队列删除。队首任务已收发部分数据时整个连接失败，见fail_channel
+        void on_task_timeout(TaskOwner * p_owner, int type, RPC_Message &msg) {
+            RPC_SocketObject * p_sock = p_owner->get_socket();
+            this->update_events(p_owner);
+            
+            if ( p_sock->type() == RPC_SocketObject::Type_Listener ) {
+                this->on_accept_timeout((RPC_SocketListener*)p_sock);
+            } else if ( type == RPC_Constants::Read ) {
+                EVEREST_LOG_WARN("RPC_Proactor::on_task_timeout, read timeout");
+                bool partial = RPC_Proactor::partial(type, msg);
+                this->m_handlers.on_receive((RPC_SocketChannel*)p_sock, msg, RPC_Constants::Timeout);
+                if ( partial ) this->fail_channel(p_owner, (RPC_SocketChannel*)p_sock);
+            } else {
+                RPC_SocketChannel * p_channel = (RPC_SocketChannel*)p_sock;
+                if ( p_channel->state() == RPC_Constants::State_Connecting ) {
+                    EVEREST_LOG_WARN("RPC_Proactor::on_task_timeout, connect timeout");
+                    this->m_handlers.on_connect(p_channel, RPC_Constants::Timeout);
+                } else {
+                    EVEREST_LOG_WARN("RPC_Proactor::on_task_timeout, write timeout");
+                    size_t bytes = msg.buffers().size();
+                    bool partial = RPC_Proactor::partial(type, msg);
+                    this->m_handlers.on_send(p_channel, msg, RPC_Constants::Timeout);
+                    this->on_send_released(p_owner, p_channel, bytes);
+                    if ( partial ) this->fail_channel(p_owner, p_channel);
+                }
+            }
+        } // end of on_task_timeout
+        
+        // 读任务已收到部分数据，或写任务已发出部分数据(只有队首任务会这样)
+        static bool partial(int type, RPC_Message &msg) {
+            RPC_Message::Buffer_Sequence &r_bufseq = msg.buffers();
+            if ( type == RPC_Constants::Read ) return r_bufseq.size() > 0;
+            size_t sent = 0;
+            Mutable_Buffer_Sequence::Iterator it = r_bufseq.begin();
+            for(; it != r_bufseq.end(); ++it ) sent += it->position();
+            return sent > 0 && sent < r_bufseq.size();
         }
         
+        /**
+         * 收发到一半的任务超时删除后，连接上的消息边界已无法恢复: 关闭socket的收发，对端收到EOF
+         * 而不是错位的数据；已投递的读写任务全部回调Fail，由handler关闭channel。
+         * 回调中再投递的任务留在队列中，因连接已关闭同样以Fail结束
+         */
+        void fail_channel(TaskOwner * p_owner, RPC_SocketChannel * pch) {
+            EVEREST_LOG_ERROR("RPC_Proactor::fail_channel, %d", pch->get_socket().handle());
+            ::shutdown(pch->get_socket().handle(), SHUT_RDWR);
+            p_owner->adopt_read_ahead(nullptr);     // 预读的数据属于已丢弃的消息
+            
+            size_t n = p_owner->tasks(RPC_Constants::Read).size();
+            for(; n > 0 && p_owner->has_task(RPC_Constants::Read); --n ) {
+                RPC_Message msg = p_owner->get_front_task(RPC_Constants::Read)->message();
+                m_task_timeout_queue.pop_front_task(p_owner, RPC_Constants::Read);
+                this->m_handlers.on_receive(pch, msg, RPC_Constants::Fail);
+            }
+            n = p_owner->tasks(RPC_Constants::Write).size();
+            for(; n > 0 && p_owner->has_task(RPC_Constants::Write); --n ) {
+                RPC_Message msg = p_owner->get_front_task(RPC_Constants::Write)->message();
+                size_t bytes = msg.buffers().size();
+                m_task_timeout_queue.pop_front_task(p_owner, RPC_Constants::Write);
+                this->m_handlers.on_send(pch, msg, RPC_Constants::Fail);
+                this->on_send_released(p_owner, pch, bytes);
+            }
+            this->update_events(p_owner);
+        } // end of fail_channel
+        
         void process_events() {
             // 有事件发生
             typename Poller::Iterator iter = m_poller.events();
             while ( iter.has_next() ) {
                 typename Poller::Event e = iter.next();
-                RPC_TaskTimeoutQueue::TaskOwner * p_owner = (RPC_TaskTimeoutQueue::TaskOwner*)e.data();
+                if ( e.data() == &m_notifier ) {
+                    // 其它线程投递了新任务，清除通知即可，任务由RPC_Service在下一轮取出
+                    m_notifier.reset();
+                    ++m_io_calls;
+                    continue;
+                }
+                if ( e.data() == &m_timer_notifier ) {
+                    // 用户定时器到期，在本轮最后回调
+                    m_timer_notifier.reset();
+                    ++m_io_calls;
+                    continue;
+                }
+                TaskOwner * p_owner = (TaskOwner*)e.data();
                 RPC_SocketObject *p_sock = p_owner->get_socket();
+                
+                if ( Poller::Edge_Triggered ) {
+                    // 错误和挂断也按可读写处理，由读写操作返回具体错误
+                    if ( e.events() & (Poller::Event_Read | Poller::Event_Error) ) p_owner->readable(true);
+                    if ( e.events() & (Poller::Event_Write | Poller::Event_Error) ) p_owner->writable(true);
+                    if ( !p_owner->scheduled() ) this->process_owner(p_owner);   // 已在就绪列表的在本轮稍后处理
+                    continue;
+                }
                     
-                if ( e.events() & Poller::Event_Read ) {
-                    printf("[TRACE] RPC_Proactor::process_events, get read event\n");
+                if ( (e.events() & Poller::Event_Read) && !p_owner->read_paused() ) {    // 暂停前已返回的事件忽略
+                    EVEREST_LOG_TRACE("RPC_Proactor::process_events, get read event");
                     if ( p_sock->type() == RPC_SocketObject::Type_Listener ) {
                         int ret = this->on_acceptable((RPC_SocketListener*)p_sock);
                         if ( ret == RPC_Constants::Ok ) {
                             // 接受新连接完成
-                            printf("[INFO] RPC_Proactor::process_events, listener get Finish\n");
+                            EVEREST_LOG_INFO("RPC_Proactor::process_events, listener get Finish");
+                        } else if ( ret == RPC_Constants::Continue ) {
+                            EVEREST_LOG_TRACE("RPC_Proactor::process_events, listener no connection");
                         } else if ( ret == RPC_Constants::Fail ) { 
-                            printf("[ERROR] RPC_Proactor::process_events, listener get Fail\n" );
+                            EVEREST_LOG_ERROR("RPC_Proactor::process_events, listener get Fail" );
                         } else {
                             throw std::runtime_error("RPC_Proactor::run, Listener unknown callback returned value");
                         }
+                    } else if ( p_sock->type() == RPC_SocketObject::Type_Channel && m_read_ahead > 0 ) {
+                        this->begin_turn(p_owner);
+                        this->on_readable_ahead((RPC_SocketChannel*)p_sock, p_owner, true);
+                        this->end_turn(p_owner);
+                        this->update_events(p_owner);
                     } else if ( p_sock->type() == RPC_SocketObject::Type_Channel ) {
                         auto p_task = p_owner->get_front_task(RPC_Constants::Read);
                         if ( p_task ) {
+                            this->begin_turn(p_owner);     // 未收完的消息留给下一次可读事件
                             int r = this->on_readable((RPC_SocketChannel*)p_sock, p_task);
+                            this->end_turn(p_owner);
                             if ( r == RPC_Constants::Ok ) {
-                                // TODO 接下去怎么做
-                                printf("[ERROR] RPC_Proactor::process_events, channel read get Finish\n" );
+                                EVEREST_LOG_TRACE("RPC_Proactor::process_events, channel read get Finish" );
+                                m_task_timeout_queue.pop_front_task(p_owner, RPC_Constants::Read);  // 任务完成，删除
+                                this->update_events(p_owner);
                             } else if ( r == RPC_Constants::Continue) {
-                                printf("[ERROR] RPC_Proactor::process_events, channel read continue\n" );
+                                EVEREST_LOG_TRACE("RPC_Proactor::process_events, channel read continue" );
                             } else if ( r == RPC_Constants::Fail ) {
-                                printf("[ERROR] RPC_Proactor::process_events, channel read fail\n" );
+                                EVEREST_LOG_ERROR("RPC_Proactor::process_events, channel read fail" );
+                                m_task_timeout_queue.pop_front_task(p_owner, RPC_Constants::Read);
+                                this->update_events(p_owner);
                             } else {
                                 char msg[128];
                                 snprintf(msg, 128, "RPC_Proactor::run, Channel unknown callback returned value %d, %d", r, RPC_Constants::Ok  );
@@ -360,27 +1359,31 @@ namespace rpc
                     }
                 }
                 if ( e.events() & Poller::Event_Write ) {
-                    printf("[TRACE] RPC_Proactor::process_events, get write event\n");
+                    EVEREST_LOG_TRACE("RPC_Proactor::process_events, get write event");
                     if ( p_sock->type() == RPC_SocketObject::Type_Channel ) {
                         RPC_SocketChannel *p_channel = (RPC_SocketChannel*)p_sock;
                         auto p_task = p_owner->get_front_task(RPC_Constants::Write);  // 获取队列中一个写任务
                         if ( p_task ) { // 任务存在
                             if ( p_channel->state() == RPC_Constants::State_Connected ) {
-                                int ret = this->on_writable(p_channel, p_task);
-                                if ( ret == RPC_Constants::Ok ) {
-                                    // TODO 接下去怎么做
-                                    printf("[WARN] RPC_Proactor::process_events, channel write finish\n" );
-                                    p_owner->pop_front_task(RPC_Constants::Write); // 任务完成，删除
+                                if ( m_flush_mode ) {
+                                    this->schedule_flush(p_owner);   // 本轮结束时统一发送
+                                    continue;
+                                }
+                                int ret = this->write_tasks(p_channel, p_owner);
+                                if ( ret == RPC_Constants::Continue ) {
+                                    EVEREST_LOG_TRACE("RPC_Proactor::process_events, channel write again" );
                                 } else {
-                                    throw std::runtime_error("RPC_Proactor::run, Channel on writable returns unknown");
+                                    EVEREST_LOG_TRACE("RPC_Proactor::process_events, channel write finish" );
                                 }
+                                this->update_events(p_owner);
                             } else if ( p_channel->state() == RPC_Constants::State_Connecting) {
                                 p_channel->state(RPC_Constants::State_Connected); // 修改状态为已连接
                                 int ret = this->on_connected(p_channel);
                                 if ( ret == RPC_Constants::Ok ) {
                                     // TODO 接下去怎么做
-                                    p_owner->pop_front_task(RPC_Constants::Write); // 任务完成，删除
-                                    printf("[WARN] RPC_Proactor::process_events, channel connected\n" );
+                                    m_task_timeout_queue.pop_front_task(p_owner, RPC_Constants::Write); // 任务完成，删除
+                                    this->update_events(p_owner);
+                                    EVEREST_LOG_TRACE("RPC_Proactor::process_events, channel connected" );
                                 } else {
                                     throw std::runtime_error("RPC_Proactor::run, Channel on connected returns unknwon");
                                 }
@@ -389,22 +1392,120 @@ namespace rpc
                             throw std::runtime_error("RPC_Proactor::run, no write task");
                         }
                     } else {
-                        printf("[ERROR] RPC_Proactor::process_events, unknown write socket object\n");
+                        EVEREST_LOG_ERROR("RPC_Proactor::process_events, unknown write socket object");
                         throw std::runtime_error("RPC_Proactor::process_events, unknown write socket object");
                     }
                 }
             } // end while
-            printf("[TRACE] RPC_Proactor::process_events\n" );
+            EVEREST_LOG_TRACE("RPC_Proactor::process_events" );
         } // end of process_events
         
+        // 边沿触发: 对owner执行accept/读/写，直到EAGAIN或没有任务
+        void process_owner(TaskOwner * p_owner) {
+            RPC_SocketObject * p_sock = p_owner->get_socket();
+            if ( p_sock->type() == RPC_SocketObject::Type_Listener ) {
+                if ( !p_owner->readable() || p_owner->read_paused() || !p_owner->has_task(RPC_Constants::Read) ) return;
+                int ret = this->on_acceptable((RPC_SocketListener*)p_sock);
+                if ( p_owner->read_paused() ) return;     // 暂停接受，恢复后仍可读
+                if ( ret == RPC_Constants::Continue ) {
+                    p_owner->readable(false);
+                } else if ( ret == RPC_Constants::Ok && !p_owner->scheduled() ) {
+                    // 达到数量上限，先处理本轮其它事件，之后在就绪列表中继续接受
+                    p_owner->scheduled(true);
+                    m_ready_list.push_back(p_owner);
+                }
+                return;     // 出错时不在本轮重试
+            }
+            
+            RPC_SocketChannel * p_channel = (RPC_SocketChannel*)p_sock;
+            this->begin_turn(p_owner);
+            if ( m_read_ahead > 0 && !p_owner->read_paused() && p_owner->has_task(RPC_Constants::Read) ) {
+                int r = this->on_readable_ahead(p_channel, p_owner, p_owner->readable());
+                if ( r == RPC_Constants::Continue && !this->budget_exhausted() ) p_owner->readable(false);
+            }
+            while ( m_read_ahead == 0 && p_owner->readable() && !p_owner->read_paused() 
+                && p_owner->has_task(RPC_Constants::Read) && !this->budget_exhausted() ) {
+                int r = this->on_readable(p_channel, p_owner->get_front_task(RPC_Constants::Read));
+                if ( r == RPC_Constants::Continue ) {
+                    // 预算用完时未读到EAGAIN，仍可读
+                    if ( !this->budget_exhausted() ) p_owner->readable(false);   // 已读到EAGAIN，等待下次通知
+                    break;
+                }
+                m_task_timeout_queue.pop_front_task(p_owner, RPC_Constants::Read);
+                if ( r != RPC_Constants::Ok ) break;
+            }
+            if ( p_owner->writable() && p_owner->has_task(RPC_Constants::Write) 
+                && p_channel->state() == RPC_Constants::State_Connecting ) {
+                p_channel->state(RPC_Constants::State_Connected);
+                this->on_connected(p_channel);
+                m_task_timeout_queue.pop_front_task(p_owner, RPC_Constants::Write);
+            }
+            if ( p_owner->writable() && p_owner->has_task(RPC_Constants::Write) ) {
+                if ( m_flush_mode ) {
+                    this->schedule_flush(p_owner);
+                } else if ( this->write_tasks(p_channel, p_owner) == RPC_Constants::Continue ) {
+                    p_owner->writable(false);
+                }
+            }
+            this->end_turn(p_owner);
+        } // end of process_owner
+        
+        // 处理新任务到达时仍可读写或预读缓存中有数据的owner，返回处理的owner数；
+        // 处理中再次加入的owner在本轮一起处理
+        size_t process_ready_list() {
+            size_t i = 0;
+            for(; i < m_ready_list.size(); ++i ) {
+                TaskOwner * p_owner = m_ready_list[i];
+                p_owner->scheduled(false);
+                if ( Poller::Edge_Triggered ) {
+                    this->process_owner(p_owner);
+                } else if ( p_owner->has_task(RPC_Constants::Read) && !p_owner->read_paused() ) {
+                    this->begin_turn(p_owner);
+                    this->on_readable_ahead((RPC_SocketChannel*)p_owner->get_socket(), p_owner, false);
+                    this->end_turn(p_owner);
+                    this->update_events(p_owner);
+                }
+            }
+            m_ready_list.clear();
+            return i;
+        }
+        
+        // 开始处理一个连接，重新计算接收预算
+        void begin_turn(TaskOwner * p_owner) {
+            m_turn_bytes = 0;
+            m_turn_messages = 0;
+            m_p_turn_owner = p_owner;
+            m_turn_updated = false;
+        }
+        
+        // 预算用完且仍有数据的owner放入延后列表，下一轮继续，不在本轮的就绪列表中重复处理；
+        // 否则处理中任务有变化时按任务状态放入就绪列表
+        void end_turn(TaskOwner * p_owner) {
+            m_p_turn_owner = nullptr;
+            if ( this->budget_exhausted() && !p_owner->scheduled() && p_owner->has_task(RPC_Constants::Read) 
+                && !p_owner->read_paused() && (p_owner->buffered() || (Poller::Edge_Triggered && p_owner->readable())) ) {
+                // 水平触发时socket中剩余的数据会再次通知
+                p_owner->scheduled(true);
+                m_deferred_list.push_back(p_owner);
+                ++m_deferred_count;
+                return;
+            }
+            if ( m_turn_updated ) this->schedule_ready(p_owner);
+        }
+        
+        bool budget_exhausted() const {
+            return (m_budget_bytes > 0 && m_turn_bytes >= m_budget_bytes)
+                || (m_budget_messages > 0 && m_turn_messages >= m_budget_messages);
+        }
+        
     }; // class RPC_Proactor
     
-    template<class Poller>
+    template<class Poller, class Timer, class Handlers>
     inline 
-    int RPC_Proactor<Poller>::on_readable(
-        RPC_SocketChannel *pch, RPC_TaskTimeoutQueue::Task *p_task) 
+    int RPC_Proactor<Poller, Timer, Handlers>::on_readable(
+        RPC_SocketChannel *pch, Task *p_task) 
     {
-        printf("[TRACE] RPC_Proactor<Poller>::on_readable\n");
+        EVEREST_LOG_TRACE("RPC_Proactor<Poller>::on_readable");
         RPC_Message &r_msg = p_task->message();
         RPC_Message::Buffer_Sequence &r_bufseq = r_msg.buffers();
         Mutable_Buffer_Sequence::Iterator it = r_bufseq.latest();
@@ -418,45 +1519,61 @@ namespace rpc
         
         while (remain_size) {
             ssize_t ret = pch->get_socket().receive(m_recv_iovec);  // 接收数据
+            ++m_io_calls;
             if ( ret > 0 ) {
                 remain_size -= ret;
+                m_turn_bytes += ret;     // 每次接收后立即计入预算，大消息也不会独占一轮
                 // 成功接收到，提交缓存，
-                printf("[TRACE] RPC_Proactor<Poller>::on_readable, received %ld\n", ret);
+                EVEREST_LOG_TRACE("RPC_Proactor<Poller>::on_readable, received %ld", ret);
                 r_bufseq.write_submit(ret);
+                if ( remain_size == 0 && r_bufseq.latest() != r_bufseq.end() ) {
+                    // 缓存数超过IOV_MAX，继续接收到剩余缓存；预算用完时留给下一次
+                    remain_size = this->prepare_recv_iovec(r_bufseq);
+                    total_size += remain_size;
+                    if ( remain_size > 0 ) {
+                        if ( this->budget_exhausted() ) return RPC_Constants::Continue;
+                        continue;
+                    }
+                }
                 if ( remain_size == 0 ) {
-                    int r = this->m_recv_handler(pch, r_msg, 0);
+                    int r = this->m_handlers.on_receive(pch, r_msg, 0);
                     if ( r == RPC_Constants::Continue ) {  // 继续收
                         // 消息接收未完成，比如只接收到消息头，根据消息头再分配消息体内存后，再继续接收
                         try {
                             remain_size =  this->prepare_recv_iovec(r_bufseq);
                             total_size += remain_size;
-                            printf("[TRACE] RPC_Proactor<Poller>::on_readable, continued %ld, %ld\n", ret, remain_size);
+                            EVEREST_LOG_TRACE("RPC_Proactor<Poller>::on_readable, continued %ld, %ld", ret, remain_size);
                         } catch (const std::exception &e) {
-                            printf("[EXCEPT] on readable coninued\n");
+                            EVEREST_LOG_ERROR("on readable coninued");
                         }
+                        if ( remain_size > 0 && this->budget_exhausted() ) return RPC_Constants::Continue;
                     } else if ( r == RPC_Constants::Ok ) {
                         // 消息接收完成
+                        ++m_turn_messages;
                         return RPC_Constants::Ok;
                     } else if ( r == RPC_Constants::Fail) {
-                        printf("[TRACE] RPC_Proactor<Poller>::on_readable, recv handler returns %d\n", r);
+                        EVEREST_LOG_TRACE("RPC_Proactor<Poller>::on_readable, recv handler returns %d", r);
                         return RPC_Constants::Fail;
                     } else {
                         return r;
                     }
                 } else {
-                    // 没有接收完成，重新准备
+                    // 没有接收完成，预算用完时留给下一次，否则重新准备
+                    if ( this->budget_exhausted() ) return RPC_Constants::Continue;
                     this->prepare_recv_iovec(r_bufseq);
                 }
             } else if ( ret == 0 ) {
                 // 连接断开
-                printf("[ERROR] RPC_Proactor<Poller>::on_readable, connect reset by remote\n");
+                EVEREST_LOG_ERROR("RPC_Proactor<Poller>::on_readable, connect reset by remote");
+                this->m_handlers.on_receive(pch, r_msg, RPC_Constants::Fail);
                 return RPC_Constants::Fail;
             } else {
                 if ( errno == EAGAIN ) {
-                    printf("[TRACE] RPC_Proactor<Poller>::on_readable, no more meessge to recv, wait\n");
+                    EVEREST_LOG_TRACE("RPC_Proactor<Poller>::on_readable, no more meessge to recv, wait");
                     return RPC_Constants::Continue;
                 } else {
-                    printf("[ERROR] RPC_Proactor<Poller>::on_readable, connect reset by remote\n");
+                    EVEREST_LOG_ERROR("RPC_Proactor<Poller>::on_readable, connect reset by remote");
+                    this->m_handlers.on_receive(pch, r_msg, RPC_Constants::Fail);
                     return RPC_Constants::Fail;
                 }
             }
@@ -464,84 +1581,247 @@ namespace rpc
         return RPC_Constants::Ok;
     } // end of RPC_Proactor<Poller>::on_readable
     
-    template<class Poller>
+    template<class Poller, class Timer, class Handlers>
     inline 
-    int RPC_Proactor<Poller>::on_writable(
-        RPC_SocketChannel *pch, RPC_TaskTimeoutQueue::Task *p_task) 
+    int RPC_Proactor<Poller, Timer, Handlers>::on_readable_ahead(
+        RPC_SocketChannel *pch, TaskOwner *p_owner, bool can_recv) 
     {
-        printf("[TRACE] RPC_Proactor<Poller>::on_writable\n");
-        RPC_Message &r_msg = p_task->message();
-        RPC_Message::Buffer_Sequence &r_bufseq = r_msg.buffers();
-        Mutable_Buffer_Sequence::Iterator it = r_bufseq.latest();
-        if ( it == r_bufseq.end() ) {
-            throw std::runtime_error("RPC_Proactor<Poller>::on_writable, no buffer");
+        EVEREST_LOG_TRACE("RPC_Proactor<Poller>::on_readable_ahead");
+        RPC_ReadAheadBuffer * p_ahead = p_owner->read_ahead(m_read_ahead);
+        bool drained = false;    // 上次接收未填满缓存，socket中已没有数据，不必再收到EAGAIN
+        for(;;) {
+            // 先用预读的数据填充读任务，收满的回调
+            while ( p_owner->has_task(RPC_Constants::Read) ) {
+                RPC_Message &r_msg = p_owner->get_front_task(RPC_Constants::Read)->message();
+                RPC_Message::Buffer_Sequence &r_bufseq = r_msg.buffers();
+                if ( r_bufseq.latest() != r_bufseq.end() ) {
+                    p_ahead->read_to(r_bufseq);
+                    if ( r_bufseq.latest() != r_bufseq.end() ) break;    // 预读的数据不够
+                }
+                
+                int r = this->m_handlers.on_receive(pch, r_msg, RPC_Constants::Ok);
+                if ( r == RPC_Constants::Continue ) {                // 按消息头追加了缓存
+                    if ( r_bufseq.latest() == r_bufseq.end() ) {
+                        throw std::runtime_error("RPC_Proactor<Poller>::on_readable_ahead, no buffer");
+                    }
+                    continue;
+                }
+                m_task_timeout_queue.pop_front_task(p_owner, RPC_Constants::Read);
+                if ( r != RPC_Constants::Ok ) return r;
+                ++m_turn_messages;
+                if ( this->budget_exhausted() ) return RPC_Constants::Continue;
+            }
+            if ( !p_owner->has_task(RPC_Constants::Read) ) return RPC_Constants::Ok;  // 剩余数据留给之后的读任务
+            if ( !can_recv || drained || this->budget_exhausted() ) return RPC_Constants::Continue;
+            
+            // 读任务的剩余缓存在前，预读缓存在后，一次接收
+            RPC_Message &r_msg = p_owner->get_front_task(RPC_Constants::Read)->message();
+            RPC_Message::Buffer_Sequence &r_bufseq = r_msg.buffers();
+            size_t task_size = this->prepare_recv_iovec(r_bufseq);
+            iovec ahead_space = p_ahead->space();
+            if ( m_recv_iovec.size() < IOV_MAX ) m_recv_iovec.push_back(ahead_space);
+            else ahead_space.iov_len = 0;
+            
+            ssize_t ret = pch->get_socket().receive(m_recv_iovec);
+            ++m_io_calls;
+            if ( ret > 0 ) {
+                size_t n = ((size_t)ret < task_size) ? (size_t)ret : task_size;
+                EVEREST_LOG_TRACE("RPC_Proactor<Poller>::on_readable_ahead, received %ld, read ahead %ld", ret, ret - n);
+                if ( n > 0 ) r_bufseq.write_submit(n);
+                p_ahead->commit(ret - n);
+                m_turn_bytes += ret;
+                drained = ((size_t)ret < task_size + ahead_space.iov_len);
+            } else if ( ret == 0 ) {
+                EVEREST_LOG_ERROR("RPC_Proactor<Poller>::on_readable_ahead, connect reset by remote");
+                this->m_handlers.on_receive(pch, r_msg, RPC_Constants::Fail);
+                m_task_timeout_queue.pop_front_task(p_owner, RPC_Constants::Read);
+                return RPC_Constants::Fail;
+            } else if ( errno == EAGAIN || errno == EWOULDBLOCK ) {
+                EVEREST_LOG_TRACE("RPC_Proactor<Poller>::on_readable_ahead, no more meessge to recv, wait");
+                return RPC_Constants::Continue;
+            } else {
+                EVEREST_LOG_ERROR("RPC_Proactor<Poller>::on_readable_ahead, %d, %s", errno, strerror(errno));
+                this->m_handlers.on_receive(pch, r_msg, RPC_Constants::Fail);
+                m_task_timeout_queue.pop_front_task(p_owner, RPC_Constants::Read);
+                return RPC_Constants::Fail;
+            }
+        } // end for
+    } // end of RPC_Proactor<Poller>::on_readable_ahead
+    
+    template<class Poller, class Timer, class Handlers>
+    inline 
+    int RPC_Proactor<Poller, Timer, Handlers>::on_writable(
+        RPC_SocketChannel *pch, TaskOwner *p_owner) 
+    {
+        EVEREST_LOG_TRACE("RPC_Proactor<Poller>::on_writable");
+        std::list<Task> & queue = p_owner->tasks(RPC_Constants::Write);
+        
+        // 从队首开始收集各消息未发送的部分，直到IOV_MAX个缓存或字节数上限；
+        // 大消息可能分多次收集，从各缓存的position()继续
+        size_t total_size = 0;
+        m_send_iovec.resize(0);
+        typename std::list<Task>::iterator it_task = queue.begin();
+        for(; it_task != queue.end(); ++it_task ) {
+            RPC_Message::Buffer_Sequence &r_bufseq = it_task->message().buffers();
+            Mutable_Buffer_Sequence::Iterator it = r_bufseq.begin();
+            for(; it != r_bufseq.end(); ++it ) {
+                size_t s = it->size() - it->position();
+                if ( s == 0 ) continue;
+                if ( m_send_iovec.size() == IOV_MAX || total_size >= m_send_batch_bytes ) break;
+                m_send_iovec.push_back(iovec{it->ptr(it->position()), s});
+                total_size += s;
+            }
+            if ( it != r_bufseq.end() ) break;    // 已达上限，本消息只收集了一部分
+            if ( total_size >= m_send_batch_bytes ) {
+                ++it_task;
+                break;
+            }
+        } // end for
+        bool more = (it_task != queue.end());     // 还有消息未收集，本批之后紧接着发送
+        
+        ssize_t ret = 0;
+        if ( total_size > 0 ) {
+            ret = pch->get_socket().send(m_send_iovec, more ? MSG_MORE : 0);
+            ++m_io_calls;
+            if ( ret < 0 ) {
+                if ( errno == EAGAIN || errno == EWOULDBLOCK ) {
+                    EVEREST_LOG_TRACE("RPC_Proactor::on_writable, EAGAIN");
+                    return RPC_Constants::Continue;    // 任务保留，等待可写
+                }
+                EVEREST_LOG_ERROR("RPC_Proactor::on_writable, %d, %s", errno, strerror(errno));
+                size_t bytes = queue.front().message().buffers().size();
+                this->m_handlers.on_send(pch, queue.front().message(), RPC_Constants::Fail);
+                m_task_timeout_queue.pop_front_task(p_owner, RPC_Constants::Write);
+                this->on_send_released(p_owner, pch, bytes);
+                return RPC_Constants::Fail;
+            }
+            EVEREST_LOG_TRACE("RPC_Proactor::on_writable, %ld of %ld bytes sent, %lu iovec", 
+                ret, total_size, m_send_iovec.size());
         }
+        
+        // 按发送字节数推进各缓存的position，发送完的消息复位position后回调并删除
+        size_t left = (size_t)ret;
+        while ( p_owner->has_task(RPC_Constants::Write) ) {
+            Task * p_task = p_owner->get_front_task(RPC_Constants::Write);
+            RPC_Message::Buffer_Sequence &r_bufseq = p_task->message().buffers();
+            bool done = true;
+            Mutable_Buffer_Sequence::Iterator it = r_bufseq.begin();
+            for(; it != r_bufseq.end(); ++it ) {
+                size_t s = it->size() - it->position();
+                if ( s == 0 ) continue;
+                size_t n = (s < left) ? s : left;
+                it->position(it->position() + n);
+                left -= n;
+                if ( n < s ) {
+                    done = false;
+                    break;
+                }
+            }
+            if ( !done ) break;
+            
+            for(it = r_bufseq.begin(); it != r_bufseq.end(); ++it ) it->position(0);
+            size_t bytes = r_bufseq.size();
+            this->m_handlers.on_send(pch, p_task->message(), RPC_Constants::Ok);
+            m_task_timeout_queue.pop_front_task(p_owner, RPC_Constants::Write);
+            this->on_send_released(p_owner, pch, bytes);
+        }
+        
+        // 部分发送说明socket缓存已满
+        return ( (size_t)ret < total_size ) ? RPC_Constants::Continue : RPC_Constants::Ok;
+    } // end of on_writable
+    
+    // 只发送刚加入的一个消息，推进各缓存的position但不回调，也不删除任务:
+    // 发送完的由complete_sent回调，部分发送的由on_writable从position继续，
+    // 出错的由complete_sent重试后回调Fail。交给complete_sent时返回true，不需要再关注可写
+    template<class Poller, class Timer, class Handlers>
+    inline 
+    bool RPC_Proactor<Poller, Timer, Handlers>::write_direct(
+        RPC_SocketChannel *pch, TaskOwner *p_owner, RPC_Message &msg)
+    {
+        RPC_Message::Buffer_Sequence &r_bufseq = msg.buffers();
         size_t total_size = 0;
         m_send_iovec.resize(0);
-        printf("[TRACE] RPC_Proactor<Poller>::on_writable, size %ld, cap %ld\n",
-            m_send_iovec.size(), m_send_iovec.capacity());
-        for(; it != r_bufseq.end(); ++it ) {
+        Mutable_Buffer_Sequence::Iterator it = r_bufseq.begin();
+        for(; it != r_bufseq.end() && m_send_iovec.size() < IOV_MAX; ++it ) {
             size_t s = it->size() - it->position();
             if ( s == 0 ) continue;
-            
-            total_size += s;
-            if ( m_send_iovec.capacity() == m_send_iovec.size() ) {
-                printf("[TRACE] RPC_Proactor<Poller>::on_writable, reserve: size %ld, cap %ld\n",
-                    m_send_iovec.size(), m_send_iovec.capacity());
-                m_send_iovec.reserve(m_send_iovec.capacity() * 2);
-            }
             m_send_iovec.push_back(iovec{it->ptr(it->position()), s});
-        } // end for
+            total_size += s;
+        }
+        bool whole = (it == r_bufseq.end());
         
-        ssize_t ret = pch->get_socket().send(m_send_iovec);
-        if ( ret > 0 ) {
-            printf("[TRACE] RPC_Proactor::on_writable, %ld bytes sent\n", ret);
-            if ( ret >= total_size ) {
-                printf("[TRACE] RPC_Proactor::on_writable send ok\n");
-                int r = this->m_send_handler(pch, r_msg, RPC_Constants::Ok);
-                if ( r == RPC_Constants::Ok ) {
-                    printf("[ERROR] RPC_Proactor::on_writable send ok handler return not impl\n");
-                    // todo: move latest buffer to end
-                }
-                // todo: remove from proactor
-                printf("[ERROR] RPC_Proactor::on_writable remove from proactor not impl\n");
-            } else {
-                printf("[ERROR] RPC_Proactor::on_writable send part not impl\n");
+        ssize_t ret = 0;
+        if ( total_size > 0 ) {
+            ret = pch->get_socket().send(m_send_iovec, 0);
+            ++m_io_calls;
+            if ( ret < 0 ) {
+                if ( errno == EAGAIN || errno == EWOULDBLOCK ) {
+                    EVEREST_LOG_TRACE("RPC_Proactor::write_direct, EAGAIN");
+                    if ( Poller::Edge_Triggered ) p_owner->writable(false);
+                    return false;
+                }
+                m_sent_list.push_back(p_owner);
+                return true;
             }
-        } else if ( ret == 0 ) {
-            printf("[ERROR] RPC_Proactor::on_writable, no byte sent\n");
-        } else { // ret < 0
-            if ( errno == EAGAIN ) {
-                printf("[ERROR] RPC_Proactor::on_writable, EAGAIN\n");
-            } else {
-                printf("[ERROR] RPC_Proactor::on_writable,%d, %s %ld\n", errno, strerror(errno));
-            } 
         }
         
-        printf("[TRACE] RPC_Proactor::on_writable, total size %ld\n", total_size);
-        return RPC_Constants::Ok;
-    }
+        size_t left = (size_t)ret;
+        for(it = r_bufseq.begin(); it != r_bufseq.end() && left > 0; ++it ) {
+            size_t s = it->size() - it->position();
+            size_t n = (s < left) ? s : left;
+            it->position(it->position() + n);
+            left -= n;
+        }
+        EVEREST_LOG_TRACE("RPC_Proactor::write_direct, %ld of %ld bytes sent", ret, total_size);
+        if ( (size_t)ret < total_size ) {
+            if ( Poller::Edge_Triggered ) p_owner->writable(false);   // socket缓存已满，等待可写通知
+            return false;
+        }
+        if ( !whole ) return false;    // 超过IOV_MAX个缓存，其余部分由on_writable继续发送
+        ++m_direct_writes;
+        m_sent_list.push_back(p_owner);
+        return true;
+    } // end of write_direct
     
-    template<class Poller>
+    template<class Poller, class Timer, class Handlers>
     inline 
-    bool RPC_Proactor<Poller>::add_read(RPC_SocketObject *sockobj, RPC_Message& msg, int64_t expire)
+    void RPC_Proactor<Poller, Timer, Handlers>::flush()
     {
-        RPC_TaskTimeoutQueue::TaskOwner * p_owner = m_task_timeout_queue.find_owner(sockobj);
-        assert(p_owner);
+        for(size_t i = 0; i < m_flush_list.size(); ++i ) {
+            TaskOwner * p_owner = m_flush_list[i];
+            p_owner->flush_pending(false);
+            if ( !p_owner->has_task(RPC_Constants::Write) ) continue;
+            if ( Poller::Edge_Triggered && !p_owner->writable() ) continue;   // 等待可写通知
+            
+            RPC_SocketChannel * p_channel = (RPC_SocketChannel*)p_owner->get_socket();
+            if ( p_channel->state() != RPC_Constants::State_Connected ) continue;
+            
+            int r = this->write_tasks(p_channel, p_owner);
+            if ( Poller::Edge_Triggered && r == RPC_Constants::Continue ) p_owner->writable(false);
+            this->update_events(p_owner);
+        }
+        m_flush_list.clear();
+    } // end of flush
+    
+    template<class Poller, class Timer, class Handlers>
+    inline 
+    bool RPC_Proactor<Poller, Timer, Handlers>::add_read(RPC_SocketObject *sockobj, RPC_Message& msg, int64_t expire)
+    {
+        // 投递后已关闭的监听器，其accept任务取出时不再注册
+        if ( !m_task_timeout_queue.has_owner(sockobj) ) {
+            EVEREST_LOG_ERROR("RPC_Proactor::add_read(sockobj), socket not registered");
+            return false;
+        }
+        TaskOwner * p_owner = m_task_timeout_queue.find_owner(sockobj);
         
         bool isok = m_task_timeout_queue.push_task(p_owner, RPC_Constants::Read, msg, expire); 
         assert( isok );
         
-        printf("[TRACE] RPC_Proactor::add_read(sockobj), expire %lld\n", expire);
-        
-        int events = 0;
-        if ( p_owner->get_front_task(RPC_Constants::Read ) != nullptr ) events |= Poller::Event_Read;
-        if ( p_owner->get_front_task(RPC_Constants::Write ) != nullptr ) events |= Poller::Event_Write;
+        EVEREST_LOG_TRACE("RPC_Proactor::add_read(sockobj), expire %ld", expire);
         
-        printf("[TRACE] RPC_Proactor::add_read, poller set, event %d\n", events);
-        isok = m_poller.set(sockobj->get_socket().handle(), events, p_owner);
+        isok = this->update_events(p_owner);
         if ( !isok ) {
-            printf("[ERROR] RPC_Proactor::add_read(sockobj) error\n");
+            EVEREST_LOG_ERROR("RPC_Proactor::add_read(sockobj) error");
             return false;
         }
         
@@ -549,26 +1829,35 @@ namespace rpc
         return isok;
     }
     
-    template<class Poller>
+    template<class Poller, class Timer, class Handlers>
     inline 
-    bool RPC_Proactor<Poller>::add_write(RPC_SocketObject *sockobj, RPC_Message &msg, int64_t expire)
+    bool RPC_Proactor<Poller, Timer, Handlers>::add_write(RPC_SocketObject *sockobj, RPC_Message &msg, int64_t expire)
     {
-        RPC_TaskTimeoutQueue::TaskOwner * p_owner = m_task_timeout_queue.find_owner(sockobj);
+        TaskOwner * p_owner = m_task_timeout_queue.find_owner(sockobj);
         assert(p_owner);
             
         bool isok = m_task_timeout_queue.push_task(p_owner, RPC_Constants::Write, msg, expire); 
         assert( isok );
         
-        printf("[TRACE] RPC_Proactor::add_write(sockobj), expire %lld\n", expire);
-            
-        int events = 0;
-        if ( p_owner->get_front_task(RPC_Constants::Read ) != nullptr ) events |= Poller::Event_Read;
-        if ( p_owner->get_front_task(RPC_Constants::Write ) != nullptr ) events |= Poller::Event_Write;
+        EVEREST_LOG_TRACE("RPC_Proactor::add_write(sockobj), expire %ld", expire);
         
-        printf("[TRACE] RPC_Proactor::add_write, poller set, event %d\n", events);
-        isok = m_poller.set(sockobj->get_socket().handle(), events, p_owner);
+        bool sent = false;
+        if ( m_flush_mode && sockobj->type() == RPC_SocketObject::Type_Channel
+            && ((RPC_SocketChannel*)sockobj)->state() == RPC_Constants::State_Connected ) {
+            this->schedule_flush(p_owner);
+        } else if ( m_direct_write && sockobj->type() == RPC_SocketObject::Type_Channel
+            && ((RPC_SocketChannel*)sockobj)->state() == RPC_Constants::State_Connected
+            && p_owner->tasks(RPC_Constants::Write).size() == 1
+            && (!Poller::Edge_Triggered || p_owner->writable()) ) {
+            sent = this->write_direct((RPC_SocketChannel*)sockobj, p_owner, msg);
+        }
+        if ( sockobj->type() == RPC_SocketObject::Type_Channel ) {
+            this->check_watermarks(p_owner, (RPC_SocketChannel*)sockobj);
+        }
+        if ( sent ) return true;    // 由complete_sent回调后更新事件，不关注可写、不放入就绪列表
+        isok = this->update_events(p_owner);
         if ( !isok ) {
-            printf("[ERROR] RPC_Proactor::add_write(sockobj) error\n");
+            EVEREST_LOG_ERROR("RPC_Proactor::add_write(sockobj) error");
             return false;
         }
         
@@ -6,13 +6,19 @@
 #include <everest/net/sock_addr.h>
 #include <everest/net/socket.h>
 #include <everest/net/epoller.h>
+#include <everest/mpsc_queue.h>
+#include <everest/executor.h>
 #include <everest/rpc/RPC_Socket.h>
 #include <everest/rpc/RPC_Proactor.h>
+#include <everest/rpc/RPC_UringProactor.h>
 
+#include <atomic>
 #include <memory>
 #include <unordered_set>
 #include <sstream>
 #include <stdexcept>
+#include <type_traits>
+#include <everest/log.h>
 
 namespace everest
 {
@@ -24,10 +30,26 @@ namespace rpc
         typedef RPC_SocketChannel      ChannelType;
         typedef RPC_SocketListener     ListenerType;
         typedef RPC_Message            MessageType;
-        typedef RPC_Proactor<>         ProactorType;
+#ifdef EVEREST_RPC_USE_IO_URING
+        typedef net::IoUringPoller     PollerType;   // io_uring不可用时运行时回退到epoll
+#elif defined(EVEREST_RPC_USE_EPOLL_ET)
+        typedef net::EPoller_ET        PollerType;   // 边沿触发，socket只注册一次
+#else
+        typedef net::EPoller           PollerType;
+#endif
+        // 按回调策略选择proactor类型
+        template<class Handlers>
+        struct Proactor { typedef RPC_Proactor<PollerType, Timing_Wheel, Handlers> type; };
+        
+        typedef Proactor<RPC_FunctionHandlers>::type ProactorType;
     }; // end of class RPC_TcpSocketService_Impl
     
-    template<class Impl = RPC_TcpSocketService_Impl>
+    /**
+     * Handlers为回调策略，默认RPC_FunctionHandlers: handler用set_*_handler设置，保存在std::function中，
+     * 支持recv执行器。自定义策略(见RPC_FunctionHandlers的说明)由proactor直接持有并调用，
+     * 不经过std::function，set_*_handler和recv执行器不可用，策略对象的状态通过handlers()设置。
+     */
+    template<class Impl = RPC_TcpSocketService_Impl, class Handlers = RPC_FunctionHandlers>
     class RPC_Service
     {
     public:
@@ -36,39 +58,50 @@ namespace rpc
         typedef typename Impl::ChannelType*   ChannelPtr;
         typedef typename Impl::ListenerType*  ListenerPtr;
         typedef typename Impl::MessageType    MessageType;
-        typedef typename Impl::ProactorType   ProactorType;
+        typedef typename Impl::template Proactor<Handlers>::type ProactorType;
 
         static const int Task_Async_Accept  = 1;
         static const int Task_Async_Write   = 2;
         static const int Task_Async_Read    = 3;
         static const int Task_Async_Add     = 4;   // add channel or listener to proactor service
+        static const int Task_Async_Close   = 5;   // unreg channel from proactor and delete it
+        static const int Task_Async_Migrate = 6;   // detach channel and hand it to p_target
+        static const int Task_Async_Attach  = 7;   // register a migrated channel from p_state
+        static const int Task_Async_Fail    = 8;   // recv handler failed: abort channel, then release a reference
+        static const int Task_Async_Release = 9;   // executor job finished: release its channel reference
         
         struct AsyncTask
         {
-            int          task_type;
-            ChannelPtr   p_channel;
-            ListenerPtr  p_listener;
-            MessageType  message;
-            int64_t      expire_time;
+            int                task_type;
+            ChannelPtr         p_channel;
+            ListenerPtr        p_listener;
+            MessageType        message;
+            int64_t            expire_time;
+            RPC_Service *      p_target;
+            RPC_ChannelState * p_state;
             
             AsyncTask() 
                 : task_type(0), p_channel(nullptr), p_listener(nullptr), expire_time(RPC_Constants::Max_Expire_Time)
+                , p_target(nullptr), p_state(nullptr)
             {}
             
             AsyncTask(int type, ChannelPtr ch) 
                 : task_type( type ) , p_channel(ch), p_listener(nullptr), expire_time(RPC_Constants::Max_Expire_Time)
+                , p_target(nullptr), p_state(nullptr)
             {}
                 
             AsyncTask(int type, ChannelPtr ch, const MessageType &msg, int64_t exp)
                 : task_type(type), p_channel(ch), p_listener(nullptr), message(msg), expire_time(exp)
+                , p_target(nullptr), p_state(nullptr)
             {}
 
             AsyncTask(int type, ListenerPtr listener, const MessageType &msg, int64_t exp)
                 : task_type(type), p_channel(nullptr), p_listener(listener), message(msg), expire_time(exp)
+                , p_target(nullptr), p_state(nullptr)
             {}
 
         };  // end struct AsyncTask 
-        typedef std::queue<AsyncTask>         AsyncTaskQueue;
+        typedef MPSC_Queue<AsyncTask>         AsyncTaskQueue;   // 任意线程投递，proactor线程取出
         
         class AcceptHandler
         {
@@ -81,7 +114,7 @@ namespace rpc
             
             int operator()(ListenerPtr p_listener, ChannelPtr p_channel, int ec) 
             {
-                printf("[TRACE] RPC_Service::AcceptHandler()\n");
+                EVEREST_LOG_TRACE("RPC_Service::AcceptHandler()");
                 return m_rhandler(p_listener, p_channel, ec);
             }
         };
@@ -95,7 +128,7 @@ namespace rpc
                 : m_rhandler(handler) {}
                 
             int operator()(ChannelPtr p_channel, int ec) {
-                printf("[TRACE] RPC_Service::ConnectHandler()\n");
+                EVEREST_LOG_TRACE("RPC_Service::ConnectHandler()");
                 return this->m_rhandler(p_channel, ec);
             }
         };
@@ -108,32 +141,85 @@ namespace rpc
                 : m_rhandler(handler) {}
                 
             int operator()(ChannelPtr p_channel, RPC_Message &msg, int ec) {
-                printf("[TRACE] RPC_Service::SendHandler()\n");
+                EVEREST_LOG_TRACE("RPC_Service::SendHandler()");
+                if ( ec == RPC_Constants::Ok ) p_channel->add_load(1);
                 return this->m_rhandler(p_channel, msg, ec);
             }
         };
         
+        // 设置了执行器时，收完整的消息交给执行器的工作线程处理，proactor线程继续处理其它channel；
+        // 未收完(handler返回Continue追加缓存)和出错的回调仍在proactor线程执行。
+        // 工作线程中的handler持有channel的引用，close_channel推迟到handler结束后删除；
+        // handler对收到的消息返回Fail时，无论在哪个线程执行，都由所属服务在proactor线程abort该channel
         class RecvHandler 
         {
+            RPC_Service *                                       m_p_service;
             std::function<int (ChannelPtr, RPC_Message&, int)> &m_rhandler;
+            std::function<bool (ChannelPtr, RPC_Message&)>     &m_rdispatch;
+            Work_Stealing_Executor *                           &m_rexecutor;
         public:
-            RecvHandler(std::function<int (ChannelPtr, RPC_Message&, int)> &handler)
-                : m_rhandler(handler) {}
+            RecvHandler(RPC_Service * p_service,
+                        std::function<int (ChannelPtr, RPC_Message&, int)> &handler,
+                        std::function<bool (ChannelPtr, RPC_Message&)> &dispatch,
+                        Work_Stealing_Executor * &executor)
+                : m_p_service(p_service), m_rhandler(handler), m_rdispatch(dispatch), m_rexecutor(executor) {}
                 
             int operator()(ChannelPtr p_channel, RPC_Message &msg, int ec) {
-                printf("[TRACE] RPC_Service::RecvHandler()\n");
-                return this->m_rhandler(p_channel, msg, ec);
+                EVEREST_LOG_TRACE("RPC_Service::RecvHandler()");
+                if ( ec == RPC_Constants::Ok ) p_channel->add_load(1);
+                Work_Stealing_Executor * p_executor = m_rexecutor;
+                if ( p_executor == nullptr || ec != RPC_Constants::Ok ) return this->call(p_channel, msg, ec);
+
+                size_t buf_size = msg.buffers().size();
+                if ( buf_size < RPC_Message::Header_Length || buf_size < msg.size() ) return this->call(p_channel, msg, ec);
+                if ( m_rdispatch && !m_rdispatch(p_channel, msg) ) return this->call(p_channel, msg, ec);
+
+                std::function<int (ChannelPtr, RPC_Message&, int)> &handler = m_rhandler;
+                RPC_Service * p_service = m_p_service;
+                p_channel->retain();
+                bool isok = p_executor->submit([&handler, p_service, p_channel, msg]() {
+                    RPC_Message m(msg);
+                    if ( handler(p_channel, m, RPC_Constants::Ok) == RPC_Constants::Fail ) {
+                        EVEREST_LOG_ERROR("RPC_Service::RecvHandler, executor handler failed, %d", p_channel->get_socket().handle());
+                        p_service->push_task(AsyncTask(Task_Async_Fail, p_channel));   // 沿用本任务的引用
+                    } else {
+                        p_service->push_task(AsyncTask(Task_Async_Release, p_channel));
+                    }
+                });
+                if ( !isok ) {      // 执行器已停止
+                    p_channel->release();
+                    return this->call(p_channel, msg, ec);
+                }
+                return RPC_Constants::Ok;
+            }
+            
+        private:
+            int call(ChannelPtr p_channel, RPC_Message &msg, int ec) {
+                int r = this->m_rhandler(p_channel, msg, ec);
+                if ( r == RPC_Constants::Fail && ec == RPC_Constants::Ok ) {
+                    p_channel->retain();
+                    m_p_service->push_task(AsyncTask(Task_Async_Fail, p_channel));
+                }
+                return r;
             }
         };
         
     private:
-        AsyncTaskQueue m_async_task_queue;
-        ProactorType   m_proactor;
+        AsyncTaskQueue    m_async_task_queue;
+        std::atomic<bool> m_wakeup_pending;    // 已通知proactor但任务尚未取出
+        std::atomic<bool> m_stopped;           // stop()后run/run_for返回，restart()清除
+        ProactorType      m_proactor;
+        size_t            m_low_mark;          // 新channel的发送低水位
+        size_t            m_high_mark;         // 新channel的发送高水位，0为不限制
+        std::unordered_map<ChannelPtr, RPC_Service *> m_forward;   // 已迁移出的channel，其任务转给目标服务
         
         std::function<int (ListenerPtr, ChannelPtr, int)>  m_accept_handler;
         std::function<int (ChannelPtr, int)>               m_connect_handler;
         std::function<int (ChannelPtr, RPC_Message&, int)> m_send_handler;
         std::function<int (ChannelPtr, RPC_Message&, int)> m_recv_handler;
+        std::function<bool (ChannelPtr, RPC_Message&)>     m_recv_dispatch;   // 为空时全部交给执行器
+        Work_Stealing_Executor *                           m_recv_executor;   // 不拥有，nullptr为在proactor线程处理
+        std::function<int ()>                              m_loop_handler;    // 每轮取出任务后调用
         
     private:
         RPC_Service(const RPC_Service&) = delete;
@@ -144,30 +230,208 @@ namespace rpc
         ~RPC_Service();
         
         template<class ConnHandler>
-        void        set_conn_handler(const ConnHandler &handler) { m_connect_handler = handler; }
+        void        set_conn_handler(const ConnHandler &handler) {
+            static_assert(std::is_same<Handlers, RPC_FunctionHandlers>::value, "set_conn_handler needs the default handler policy");
+            m_connect_handler = handler;
+        }
         
         template<class RecvHandler>
-        void        set_recv_handler(const RecvHandler &handler) { m_recv_handler = handler; }
+        void        set_recv_handler(const RecvHandler &handler) {
+            static_assert(std::is_same<Handlers, RPC_FunctionHandlers>::value, "set_recv_handler needs the default handler policy");
+            m_recv_handler = handler;
+        }
+        
+        // 收完整的消息在执行器的工作线程中调用recv handler，handler中用post_send/post_receive投递，
+        // 经无锁队列交给proactor线程。同一channel的消息可能被不同工作线程并行处理，应答顺序不保证。
+        // handler返回Fail时与在proactor线程相同，channel被abort。
+        // 执行器需在服务停止前保持有效，nullptr恢复为在proactor线程处理
+        void        set_recv_executor(Work_Stealing_Executor * p_executor) {
+            static_assert(std::is_same<Handlers, RPC_FunctionHandlers>::value, "set_recv_executor needs the default handler policy");
+            m_recv_executor = p_executor;
+        }
+        
+        // 按消息选择是否交给执行器(如只派发耗时的方法)，返回false的消息在proactor线程处理
+        template<class RecvDispatch>
+        void        set_recv_dispatch(const RecvDispatch &dispatch) { m_recv_dispatch = dispatch; }
         
         template<class SendHandler>
-        void        set_send_handler(const SendHandler &handler) { m_send_handler = handler; }
+        void        set_send_handler(const SendHandler &handler) {
+            static_assert(std::is_same<Handlers, RPC_FunctionHandlers>::value, "set_send_handler needs the default handler policy");
+            m_send_handler = handler;
+        }
         
         template<class AcceptHandler>
-        void        set_accept_handler(const AcceptHandler &handler) { m_accept_handler = handler; }
+        void        set_accept_handler(const AcceptHandler &handler) {
+            static_assert(std::is_same<Handlers, RPC_FunctionHandlers>::value, "set_accept_handler needs the default handler policy");
+            m_accept_handler = handler;
+        }
+        
+        // 回调策略对象
+        Handlers &  handlers() { return m_proactor.handlers(); }
         
-        bool        open_channel(const char * endpoint, int timeout);
+        // channel待发送字节数降到低水位、之前有post_send被拒绝时在proactor线程回调
+        template<class DrainHandler>
+        void        set_drain_handler(const DrainHandler &handler) { m_proactor.set_drain_handler(handler); }
+        
+        // 发起连接，连接结果由conn handler回调，失败时返回nullptr
+        ChannelPtr  open_channel(const char * endpoint, int timeout);
+        
+        // 任意线程调用，proactor线程取出后注销并删除channel，未完成的收发任务丢弃、不回调；
+        // 执行器中还有该channel的recv handler时，在最后一个结束后删除。调用后不能再对该channel投递任务
         bool        close_channel(ChannelPtr channel);
         
-        ListenerPtr open_listener(const char * endpoint);
+        // 与open_listener相同，在proactor线程或run之前调用，注销并删除监听器；
+        // 已投递、尚未取出的accept任务在取出时因监听器未注册而丢弃
+        ListenerPtr open_listener(const char * endpoint, bool reuse_port = false);
         bool        close_listener(ListenerPtr listener);
         
         bool        add_channel(ChannelPtr channel);
         
+        /**
+         * 任意线程调用: 把channel连同未完成的收发任务迁移到target，不丢失、不乱序。
+         * 本服务的proactor线程注销channel后交给target注册，之后投递到本服务的该channel任务
+         * 转给target。target的handler需能处理该channel(如服务组中各线程相同的handler)。
+         * io_uring proactor只在回退到epoll时支持
+         */
+        bool        migrate_channel(ChannelPtr channel, RPC_Service &target);
+        
+        // proactor线程调用，遍历已注册的channel，handler(ChannelPtr)
+        template<class Handler>
+        void        for_each_channel(Handler &handler) { m_proactor.for_each_channel(handler); }
+        
         bool        post_accept(ListenerPtr listener, int timeout);
         bool        post_receive(ChannelPtr channel, MessageType cMessage, int timeout);
         bool        post_send(ChannelPtr channel, MessageType  cMessage, int timeout);
         
-        int         run_once();
+        // 处理一轮任务和事件，max_wait含义同proactor的run_once，默认没有任务时立即返回
+        int         run_once(int max_wait = -1);
+        
+        // 循环处理直到stop()，没有任务时阻塞等待，返回处理的事件数
+        int         run() { return this->run_for(-1); }
+        
+        // 每轮run_once取出投递的任务后在proactor线程调用，返回处理的数量，计入run_once的返回值；
+        // 用于处理其它线程经自有队列交来的数据，交付方随后调用wakeup
+        template<class LoopHandler>
+        void        set_loop_handler(const LoopHandler &handler) { m_loop_handler = handler; }
+        
+        // 任意线程调用，唤醒阻塞中的run_once；proactor线程自己调用或本轮已唤醒时不再写eventfd
+        bool        wakeup() {
+            if ( current_loop() == this ) return true;
+            if ( m_wakeup_pending.exchange(true) ) return true;
+            return m_proactor.notify();
+        }
+        
+        // 循环处理ms毫秒或直到stop()，ms为负数时不限时间
+        int         run_for(int ms);
+        
+        /**
+         * 定时器: 在proactor线程回调，时间为微秒，与DateTime::get_monotonic_timestamp()相同，不按ms取整。
+         * 应在proactor线程调用(handler、定时器回调中或run之前)，返回定时器ID，用cancel_timer取消。
+         * schedule_every在period_us后第一次回调，之后按固定频率回调，错过的周期跳过。
+         */
+        typedef RPC_UserTimerQueue::Callback TimerCallback;
+        
+        uint64_t    schedule_at(int64_t time_us, const TimerCallback &callback) {
+            return m_proactor.schedule(time_us, 0, callback);
+        }
+        
+        uint64_t    schedule_after(int64_t delay_us, const TimerCallback &callback) {
+            return m_proactor.schedule(DateTime::get_monotonic_timestamp() + delay_us, 0, callback);
+        }
+        
+        uint64_t    schedule_every(int64_t period_us, const TimerCallback &callback) {
+            return m_proactor.schedule(DateTime::get_monotonic_timestamp() + period_us, period_us, callback);
+        }
+        
+        // 已触发的一次性定时器或已取消的定时器返回false
+        bool        cancel_timer(uint64_t id) { return m_proactor.cancel_timer(id); }
+        size_t      timer_count() const { return m_proactor.timer_count(); }
+        uint64_t    timers_fired() const { return m_proactor.timers_fired(); }
+        
+        // 任意线程调用，唤醒并结束正在执行的run/run_for
+        void        stop() { 
+            m_stopped.store(true); 
+            m_proactor.notify(); 
+        }
+        
+        bool        stopped() const { return m_stopped.load(); }
+        void        restart() { m_stopped.store(false); }
+        
+        // 低延迟模式: 阻塞等待前最多自旋spin_us微秒，按命中情况自适应调整；
+        // socket_us非0时给之后加入的channel设置SO_BUSY_POLL
+        void        set_busy_poll(int spin_us, int socket_us = 0) {
+            m_proactor.set_busy_poll(spin_us);
+            m_proactor.set_socket_busy_poll(socket_us);
+        }
+        
+        // 自旋中等到事件的次数和自旋落空后阻塞的次数
+        uint64_t    busy_poll_hits() const { return m_proactor.busy_poll().hits(); }
+        uint64_t    busy_poll_misses() const { return m_proactor.busy_poll().misses(); }
+        
+        // 每次sendmsg合并发送的字节数上限
+        void        set_send_batch_bytes(size_t n) { m_proactor.set_send_batch_bytes(n); }
+        
+        // 打开后本轮产生的写任务在run_once结束前统一发送
+        void        set_flush_mode(bool on) { m_proactor.set_flush_mode(on); }
+        
+        // 默认打开: proactor线程对已注册、写队列为空的channel post_send时直接sendmsg，
+        // 不经过任务队列和可写事件；send handler仍在本轮结束前回调
+        void        set_direct_write(bool on) { m_proactor.set_direct_write(on); }
+        
+        // 在post_send中直接发送完的消息数
+        uint64_t    direct_writes() const { return m_proactor.direct_writes(); }
+        
+        // 每个channel的预读缓存大小，0为关闭
+        void        set_read_ahead(size_t bytes) { m_proactor.set_read_ahead(bytes); }
+        
+        // 之后加入的channel的发送高低水位(字节)，达到高水位时post_send返回false并暂停读取
+        void        set_send_watermarks(size_t low, size_t high) { m_low_mark = low; m_high_mark = high; }
+        
+        // 监听器每次可读时最多连续接受的连接数，大量连接同时到达时其它连接的事件不被长时间推迟
+        void        set_accept_budget(size_t n) { m_proactor.set_accept_budget(n); }
+        
+        // 每个连接每轮最多接收的字节数和消息数，0为不限；用完的连接下一轮与其它连接轮流继续
+        void        set_read_budget(size_t bytes, size_t messages) { m_proactor.set_read_budget(bytes, messages); }
+        
+        // 因接收预算用完而延后的次数
+        uint64_t    deferred_count() const { return m_proactor.deferred_count(); }
+        
+        // 之后加入的channel的TCP_NOTSENT_LOWAT，0为使用系统默认
+        void        set_notsent_lowat(size_t bytes) { m_proactor.set_notsent_lowat(bytes); }
+        
+        // proactor线程发起的系统调用次数
+        uint64_t    syscall_count() const { return m_proactor.syscall_count(); }
+        
+        // 合并或跳过的epoll_ctl(MOD)次数
+        uint64_t    ctl_saved() const { return m_proactor.ctl_saved(); }
+        
+        // proactor线程阻塞等待的累计时间(us)
+        uint64_t    idle_time_us() const { return m_proactor.idle_time_us(); }
+        
+        // 超过发送高水位而暂停读取的累计时间(us)和次数
+        uint64_t    backpressure_time_us() const { return m_proactor.backpressure_time_us(); }
+        uint64_t    backpressure_count() const { return m_proactor.backpressure_count(); }
+        
+    private:
+        bool        push_task(const AsyncTask &task);
+        void        take_tasks();
+        
+        // 默认策略的proactor回调经过service的handler包装；自定义策略不需要安装
+        void        install_handlers(RPC_FunctionHandlers &handlers) {
+            handlers.accept  = AcceptHandler(m_accept_handler);
+            handlers.connect = ConnectHandler(m_connect_handler);
+            handlers.send    = SendHandler(m_send_handler);
+            handlers.recv    = RecvHandler(this, m_recv_handler, m_recv_dispatch, m_recv_executor);
+        }
+        
+        template<class Custom>
+        void        install_handlers(Custom &) {}
+        
+        // 当前线程正在执行run_once的服务对象
+        static RPC_Service *& current_loop() {
+            static thread_local RPC_Service * p_loop = nullptr;
+            return p_loop;
+        }
     }; // end of class RPC_Service 
     
 } // end of namespace rpc 
@@ -176,33 +440,36 @@ namespace rpc
 namespace everest {
 namespace rpc {
     
-    template<class Impl>
-    RPC_Service<Impl>::RPC_Service() {
-        m_proactor.set_accept_handler(AcceptHandler(m_accept_handler));
-        m_proactor.set_connect_handler(ConnectHandler(m_connect_handler));
-        m_proactor.set_send_handler(SendHandler(m_send_handler));
-        m_proactor.set_recv_handler(RecvHandler(m_recv_handler));
+    template<class Impl, class Handlers>
+    RPC_Service<Impl, Handlers>::RPC_Service() : m_wakeup_pending(false), m_stopped(false), m_low_mark(0), m_high_mark(0), m_recv_executor(nullptr) {
+        this->install_handlers(m_proactor.handlers());
     }
     
-    template<class Impl>
-    RPC_Service<Impl>::~RPC_Service() {}
+    template<class Impl, class Handlers>
+    RPC_Service<Impl, Handlers>::~RPC_Service() {}
     
-    template<class Impl>
-    typename RPC_Service<Impl>::ListenerPtr 
-    RPC_Service<Impl>::open_listener(const char * endpoint)
+    template<class Impl, class Handlers>
+    typename RPC_Service<Impl, Handlers>::ListenerPtr 
+    RPC_Service<Impl, Handlers>::open_listener(const char * endpoint, bool reuse_port)
     {
         // 打开监听器
         ListenerPtr ptrListener(new ListenerType());
+        if ( reuse_port && !ptrListener->get_socket().set_reuse_port(true) ) {
+            EVEREST_LOG_ERROR("RPC_Service::open_listener, set reuse port failed");
+            delete ptrListener;
+            return ListenerPtr(nullptr);
+        }
         bool isok = ptrListener->open(endpoint);
         if ( !isok ) {
-            printf("[ERROR] RPC_Service::open_listener, open listener failed\n");
+            EVEREST_LOG_ERROR("RPC_Service::open_listener, open listener failed");
+            delete ptrListener;
             return ListenerPtr(nullptr);
         }
         
         // 注册到Reactor
         isok = m_proactor.reg(ptrListener);
         if ( !isok ) {
-            printf("[ERROR] RPC_Service::open_listener, failed reg\n");
+            EVEREST_LOG_ERROR("RPC_Service::open_listener, failed reg");
             delete ptrListener;
             return ListenerPtr(nullptr);
         }
@@ -211,8 +478,19 @@ namespace rpc {
         return ptrListener;
     } // end of RPC_Service<Impl>::open_listener
     
-    template<class Impl>
-    bool RPC_Service<Impl>::post_accept(ListenerPtr listener, int timeout)
+    template<class Impl, class Handlers>
+    bool RPC_Service<Impl, Handlers>::close_listener(ListenerPtr listener)
+    {
+        bool isok = m_proactor.unreg(listener);
+        if ( !isok ) {
+            EVEREST_LOG_ERROR("RPC_Service::close_listener, failed unreg");
+        }
+        delete listener;
+        return isok;
+    }
+    
+    template<class Impl, class Handlers>
+    bool RPC_Service<Impl, Handlers>::post_accept(ListenerPtr listener, int timeout)
     {
         int64_t now = DateTime::get_timestamp();
         AsyncTask task;
@@ -222,47 +500,64 @@ namespace rpc {
         if ( timeout < 0 ) task.expire_time = RPC_Constants::Max_Expire_Time;
         else task.expire_time = now + timeout * 1000;
         
-        // todo: make lock
-        m_async_task_queue.push(task);
-        
-        return true;
+        return this->push_task(task);
     }
     
-    template<class Impl>
-    bool RPC_Service<Impl>::open_channel(const char * endpoint, int timeout) 
+    template<class Impl, class Handlers>
+    typename RPC_Service<Impl, Handlers>::ChannelPtr 
+    RPC_Service<Impl, Handlers>::open_channel(const char * endpoint, int timeout) 
     {
         int64_t now = DateTime::get_timestamp();
         ChannelPtr p_channel = new ChannelType;
         
         bool isok = p_channel->open(endpoint);
         if ( !isok ) {
-            printf("[ERROR] RPC_Service<Impl>::open_channel, failed to open channel, %d, %s\n", timeout, endpoint);
-            return false;
+            EVEREST_LOG_ERROR("RPC_Service<Impl>::open_channel, failed to open channel, %d, %s", timeout, endpoint);
+            delete p_channel;
+            return ChannelPtr(nullptr);
         }
+        p_channel->set_send_watermarks(m_low_mark, m_high_mark);
 
         // write任务
         AsyncTask task(Task_Async_Write, p_channel);
         if ( timeout < 0 ) task.expire_time = RPC_Constants::Max_Expire_Time;
         else task.expire_time = now + timeout * 1000;
         
-        // todo: make lock
-        m_async_task_queue.push(AsyncTask(Task_Async_Add, p_channel)); // add任务
-        m_async_task_queue.push(task);  // write任务，仅用于检测
-        printf("[TRACE] RPC_Service<Impl>::open_channel, %s, %d\n", endpoint, timeout);
-        return true;
+        this->push_task(AsyncTask(Task_Async_Add, p_channel)); // add任务
+        this->push_task(task);  // write任务，仅用于检测
+        EVEREST_LOG_TRACE("RPC_Service<Impl>::open_channel, %s, %d", endpoint, timeout);
+        return p_channel;
     }
     
-    template<class Impl>
-    bool RPC_Service<Impl>::add_channel(ChannelPtr channel) 
+    template<class Impl, class Handlers>
+    bool RPC_Service<Impl, Handlers>::close_channel(ChannelPtr channel) 
     {
+        EVEREST_LOG_TRACE("RPC_Service<Impl>::close_channel, %d", channel->get_socket().handle());
+        return this->push_task(AsyncTask(Task_Async_Close, channel));
+    }
+    
+    template<class Impl, class Handlers>
+    bool RPC_Service<Impl, Handlers>::add_channel(ChannelPtr channel) 
+    {
+        // 水位在投递任务前设置，之后的post_send即可检查；已单独设置过的channel不覆盖
+        if ( channel->high_mark() == 0 ) channel->set_send_watermarks(m_low_mark, m_high_mark);
         AsyncTask task(Task_Async_Add, channel);
-        m_async_task_queue.push(task);
-        printf("[TRACE] RPC_Service<Impl>::add_channel, %d\n", channel->get_socket().handle());
+        this->push_task(task);
+        EVEREST_LOG_TRACE("RPC_Service<Impl>::add_channel, %d", channel->get_socket().handle());
         return true;
     }
     
-    template<class Impl>
-    bool RPC_Service<Impl>::post_receive(ChannelPtr channel, MessageType msg, int timeout) 
+    template<class Impl, class Handlers>
+    bool RPC_Service<Impl, Handlers>::migrate_channel(ChannelPtr channel, RPC_Service &target)
+    {
+        if ( &target == this ) return true;
+        AsyncTask task(Task_Async_Migrate, channel);
+        task.p_target = &target;
+        return this->push_task(task);
+    }
+    
+    template<class Impl, class Handlers>
+    bool RPC_Service<Impl, Handlers>::post_receive(ChannelPtr channel, MessageType msg, int timeout) 
     {
         int64_t exp = RPC_Constants::Max_Expire_Time;
         if ( timeout > 0 ) {
@@ -270,14 +565,21 @@ namespace rpc {
             exp = now + timeout * 1000;
         }
         
+        // proactor线程在handler中对已注册的channel投递时直接加入proactor，
+        // 预读缓存中的后续消息可在本次接收中交付
+        if ( current_loop() == this && m_proactor.registered(channel) ) {
+            EVEREST_LOG_TRACE("RPC_Service<Impl>::post_receive, direct %d", channel->get_socket().handle());
+            return m_proactor.add_read(channel, msg, exp);
+        }
+        
         AsyncTask task(Task_Async_Read, channel, msg, exp);
-        m_async_task_queue.push(task);
-        printf("[TRACE] RPC_Service<Impl>::post_receive, %d\n", channel->get_socket().handle());
+        this->push_task(task);
+        EVEREST_LOG_TRACE("RPC_Service<Impl>::post_receive, %d", channel->get_socket().handle());
         return true;
     }
     
-    template<class Impl>
-    bool RPC_Service<Impl>::post_send(ChannelPtr channel, MessageType msg, int timeout) 
+    template<class Impl, class Handlers>
+    bool RPC_Service<Impl, Handlers>::post_send(ChannelPtr channel, MessageType msg, int timeout) 
     {
         int64_t exp = RPC_Constants::Max_Expire_Time;
         if ( timeout > 0 ) {
@@ -285,45 +587,150 @@ namespace rpc {
             exp = now + timeout * 1000;
         }
         
+        // 已达发送高水位，消息不投递，等待drain handler通知
+        if ( !channel->reserve_send(msg.buffers().size()) ) {
+            EVEREST_LOG_DEBUG("RPC_Service<Impl>::post_send, above high mark, %d, queued %lu", 
+                channel->get_socket().handle(), channel->queued_bytes());
+            return false;
+        }
+        
+        // proactor线程对已注册的channel直接加入proactor，写队列为空时立即发送
+        if ( current_loop() == this && m_proactor.registered(channel) ) {
+            EVEREST_LOG_TRACE("RPC_Service<Impl>::post_send, direct %d", channel->get_socket().handle());
+            return m_proactor.add_write(channel, msg, exp);
+        }
+        
         AsyncTask task(Task_Async_Write, channel, msg, exp);
-        m_async_task_queue.push(task);
-        printf("[TRACE] RPC_Service<Impl>::post_send, %d\n", channel->get_socket().handle());
+        this->push_task(task);
+        EVEREST_LOG_TRACE("RPC_Service<Impl>::post_send, %d", channel->get_socket().handle());
         return true;
     }
     
     
-    template<class Impl>
-    int RPC_Service<Impl>::run_once()
+    template<class Impl, class Handlers>
+    bool RPC_Service<Impl, Handlers>::push_task(const AsyncTask &task)
+    {
+        m_async_task_queue.push(task);
+        
+        // proactor线程自己投递的任务在本轮run_once结束前会被取出，无需唤醒；
+        // 其它线程只在第一个未取出的任务上写一次eventfd
+        return this->wakeup();
+    }
+    
+    template<class Impl, class Handlers>
+    int RPC_Service<Impl, Handlers>::run_for(int ms)
     {
-        bool isok;
-        while ( !m_async_task_queue.empty() ) {
-            AsyncTask & task = m_async_task_queue.front();
+        int64_t deadline = RPC_Constants::Max_Expire_Time;
+        if ( ms >= 0 ) deadline = DateTime::get_timestamp() + (int64_t)ms * 1000;
+        
+        int count = 0;
+        while ( !m_stopped.load() ) {
+            int64_t left_us = deadline - DateTime::get_timestamp();
+            if ( left_us <= 0 ) break;
+            
+            // 没有任务时也阻塞等待，由其它线程投递任务或stop()唤醒
+            int max_wait = RPC_Constants::Max_Wait_Time;
+            if ( left_us < (int64_t)max_wait * 1000 ) max_wait = (int)((left_us + 999) / 1000);
+            int ret = this->run_once(max_wait);
+            if ( ret > 0 ) count += ret;
+        }
+        return count;
+    } // end of run_for
+    
+    template<class Impl, class Handlers>
+    int RPC_Service<Impl, Handlers>::run_once(int max_wait)
+    {
+        current_loop() = this;
+        m_wakeup_pending.store(false);
+        
+        this->take_tasks();
+        int handled = m_loop_handler ? m_loop_handler() : 0;
+        if ( m_proactor.flush_mode() ) m_proactor.flush();
+        
+        int ret = m_proactor.run_once(handled > 0 ? 0 : max_wait);    // 交来的数据产生的任务不等待
+        if ( ret < 0 ) {
+            EVEREST_LOG_ERROR("RPC_Service::run, reactor run failed");
+        } else {
+            ret += handled;
+        }
+        
+        // flush模式下立即取出本轮handler投递的任务并发送；
+        // 否则本轮中proactor线程投递、但未被取出的任务在下一轮run_once开始时取出
+        if ( m_proactor.flush_mode() ) {
+            this->take_tasks();
+            m_proactor.flush();
+        }
+        current_loop() = nullptr;
+        return ret;
+    }
+    
+    // 取出投递的全部任务交给proactor
+    template<class Impl, class Handlers>
+    void RPC_Service<Impl, Handlers>::take_tasks()
+    {
+        AsyncTask task;
+        while ( m_async_task_queue.pop(task) ) {
+            
+            // 已迁移出的channel的任务按原顺序转给目标服务
+            if ( !m_forward.empty() && task.p_channel != nullptr ) {
+                auto it = m_forward.find(task.p_channel);
+                if ( it != m_forward.end() ) {
+                    if ( task.task_type == Task_Async_Add || task.task_type == Task_Async_Attach ) {
+                        m_forward.erase(it);      // 地址被新channel复用，或迁移回本服务
+                    } else {
+                        it->second->push_task(task);
+                        if ( task.task_type == Task_Async_Close ) m_forward.erase(it);
+                        continue;
+                    }
+                }
+            }
             
             if ( task.task_type == Task_Async_Accept) {
-                printf("[TRACE] RPC_Service::run, new accept task\n");
+                EVEREST_LOG_TRACE("RPC_Service::run, new accept task");
                 m_proactor.add_read(task.p_listener, task.message, task.expire_time);
             } else if (task.task_type == Task_Async_Read) {
-                printf("[TRACE] RPC_Service::run, new read task\n");
+                EVEREST_LOG_TRACE("RPC_Service::run, new read task");
                 m_proactor.add_read(task.p_channel, task.message, task.expire_time);
             } else if (task.task_type == Task_Async_Write ) {
-                printf("[TRACE] RPC_Service::run, new write task\n");
+                EVEREST_LOG_TRACE("RPC_Service::run, new write task");
                 m_proactor.add_write(task.p_channel, task.message, task.expire_time);
             } else if (task.task_type == Task_Async_Add)  {
-                printf("[TRACE] RPC_Service::run, new add task %d\n", task.task_type);
+                EVEREST_LOG_TRACE("RPC_Service::run, new add task %d", task.task_type);
                 if ( task.p_channel != nullptr ) m_proactor.reg(task.p_channel);
                 if ( task.p_listener != nullptr) m_proactor.reg(task.p_listener);
+            } else if (task.task_type == Task_Async_Close)  {
+                EVEREST_LOG_TRACE("RPC_Service::run, new close task");
+                m_proactor.unreg(task.p_channel);
+                if ( task.p_channel->release() ) delete task.p_channel;   // 执行器中仍有handler时由最后一个释放者删除
+            } else if (task.task_type == Task_Async_Migrate)  {
+                EVEREST_LOG_TRACE("RPC_Service::run, new migrate task");
+                RPC_ChannelState * p_state = new RPC_ChannelState();
+                if ( !m_proactor.detach(task.p_channel, *p_state) ) {
+                    EVEREST_LOG_ERROR("RPC_Service::run, detach channel failed");
+                    delete p_state;
+                    continue;
+                }
+                m_forward[task.p_channel] = task.p_target;
+                AsyncTask attach(Task_Async_Attach, task.p_channel);
+                attach.p_state = p_state;
+                task.p_target->push_task(attach);
+            } else if (task.task_type == Task_Async_Fail)  {
+                EVEREST_LOG_TRACE("RPC_Service::run, new fail task");
+                m_proactor.abort_channel(task.p_channel);     // 已关闭的channel不再注册，不处理
+                if ( task.p_channel->release() ) delete task.p_channel;
+            } else if (task.task_type == Task_Async_Release)  {
+                if ( task.p_channel->release() ) delete task.p_channel;
+            } else if (task.task_type == Task_Async_Attach)  {
+                EVEREST_LOG_TRACE("RPC_Service::run, new attach task");
+                if ( !m_proactor.attach(*task.p_state) ) {
+                    EVEREST_LOG_ERROR("RPC_Service::run, attach channel failed");
+                }
+                delete task.p_state;
             } else {
-                printf("[ERROR] RPC_Service::run, unknown task type %d\n", task.task_type);
+                EVEREST_LOG_ERROR("RPC_Service::run, unknown task type %d", task.task_type);
             }
-            m_async_task_queue.pop();
         }
-        
-        int ret = m_proactor.run_once();
-        if ( ret < 0 ) {
-            printf("[ERROR] RPC_Service::run, reactor run failed\n");
-        }
-        return ret;
-    }
+    } // end of take_tasks
 
 } // end of namespace rpc 
 } // end of namespace everest
@@ -0,0 +1,369 @@
+#ifndef INCLUDE_EVEREST_RPC_RPC_SERVICEGROUP_H
+#define INCLUDE_EVEREST_RPC_RPC_SERVICEGROUP_H
+
+#pragma once
+
+#include <everest/rpc/RPC_Server.h>
+#include <everest/thread_group.h>
+
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <everest/log.h>
+
+namespace everest
+{
+namespace rpc
+{
+    /**
+     * 多Reactor服务组
+     * 每个线程独占一个RPC_Service(即一个RPC_Proactor)，监听器通过SO_REUSEPORT在
+     * 每个线程上各绑定一份，由内核分发新连接。新连接由接受它的线程注册并处理。
+     * 长连接负载不均时可以用migrate把channel迁移到其它线程，或打开均衡器(enable_balancer):
+     * 各线程定期统计自身利用率(非阻塞等待时间的比例)，比最空闲的线程高出drift以上时，
+     * 把迁移后不会使两者反转的、收发回调最多的一个channel迁移到最空闲的线程。
+     * 由Thread_Group构造时线程数取线程组的大小，各proactor线程按线程组命名并绑定cpu。
+     * open_listener打开cpu亲和时在SO_REUSEPORT组上挂CBPF程序，按收到连接的cpu选择
+     * 绑定在该cpu上的线程的监听器，连接的报文处理和proactor在同一个cpu上(要求各线程已绑定cpu)；
+     * 统计接受的连接中在本线程cpu上收到的比例(local_accepts/tracked_accepts)。
+     */
+    template<class Impl = RPC_TcpSocketService_Impl>
+    class RPC_ServiceGroup
+    {
+    public:
+        typedef RPC_Service<Impl>                 ServiceType;
+        typedef typename ServiceType::ChannelPtr  ChannelPtr;
+        typedef typename ServiceType::ListenerPtr ListenerPtr;
+
+    private:
+        std::vector<ServiceType *> m_services;
+        std::vector<std::thread>   m_threads;
+        std::atomic<bool>          m_running;
+        size_t                     m_next_channel;   // open_channel轮转位置
+        const Thread_Group *       m_p_threads;      // 线程命名和cpu绑定，可以为空
+        std::vector<ListenerPtr>   m_listeners;      // 各线程的监听器，用于统计
+
+        struct Balance_State
+        {
+            int64_t  last_time;    // 上次统计的时间，0为尚未统计
+            uint64_t last_idle;    // 上次统计时的累计阻塞时间
+        };
+
+        struct Channel_Load
+        {
+            ChannelPtr p_channel;
+            uint64_t   load;
+
+            bool operator<(const Channel_Load &other) const { return load > other.load; }   // 按负载降序
+        };
+
+        std::vector<Balance_State>     m_balance;        // 只由对应线程访问
+        std::vector<std::atomic<int> > m_utilization;    // 各线程最近一次统计的利用率(千分比)
+        int                            m_drift;          // 千分比
+        std::atomic<uint64_t>          m_migrations;
+
+    private:
+        RPC_ServiceGroup(const RPC_ServiceGroup&) = delete;
+        RPC_ServiceGroup& operator=(const RPC_ServiceGroup&) = delete;
+
+    public:
+        /**
+         * @param threads proactor线程数，0表示取在线cpu数
+         */
+        explicit RPC_ServiceGroup(size_t threads = 0);
+
+        // 线程组需在服务组之后析构
+        explicit RPC_ServiceGroup(const Thread_Group &threads) : RPC_ServiceGroup(threads.size()) {
+            m_p_threads = &threads;
+        }
+
+        ~RPC_ServiceGroup();
+
+        static size_t default_threads();
+
+        size_t        size() const { return m_services.size(); }
+        ServiceType & service(size_t idx) { return *m_services[idx]; }
+        bool          running() const { return m_running.load(); }
+
+        // 各handler按线程分别构造，Handler需可由ServiceType&构造
+        template<class Handler>
+        void set_accept_handler() {
+            for(size_t i = 0; i < m_services.size(); ++i ) m_services[i]->set_accept_handler(Handler(*m_services[i]));
+        }
+
+        template<class Handler>
+        void set_conn_handler() {
+            for(size_t i = 0; i < m_services.size(); ++i ) m_services[i]->set_conn_handler(Handler(*m_services[i]));
+        }
+
+        template<class Handler>
+        void set_send_handler() {
+            for(size_t i = 0; i < m_services.size(); ++i ) m_services[i]->set_send_handler(Handler(*m_services[i]));
+        }
+
+        template<class Handler>
+        void set_recv_handler() {
+            for(size_t i = 0; i < m_services.size(); ++i ) m_services[i]->set_recv_handler(Handler(*m_services[i]));
+        }
+
+        // cpu_affinity为true时第i个线程的监听器接受在线程i所绑定cpu上收到的连接，
+        // 需由每个线程都绑定了cpu的Thread_Group构造，否则线程可能在任意cpu上运行，返回false；
+        // 线程数多于cpu数时Thread_Group循环复用cpu，有线程共用cpu时也返回false
+        bool open_listener(const char * endpoint, int timeout, bool cpu_affinity = false);
+        bool open_channel(const char * endpoint, int timeout);
+
+        // 任意线程调用，把from线程的channel迁移到to线程，见RPC_Service::migrate_channel
+        bool migrate(ChannelPtr channel, size_t from, size_t to) {
+            return m_services[from]->migrate_channel(channel, *m_services[to]);
+        }
+
+        // start前调用，各线程每interval_ms统计一次，drift为触发迁移的利用率差(0~1)
+        void enable_balancer(int interval_ms = 100, double drift = 0.2);
+
+        // 线程最近一次统计的利用率(千分比)和均衡器迁移的channel数
+        int      utilization(size_t idx) const { return m_utilization[idx].load(); }
+        uint64_t migrations() const { return m_migrations.load(); }
+
+        // 打开cpu亲和的监听器接受的连接中，统计到incoming cpu的数量和其中在本线程cpu上收到的数量
+        uint64_t tracked_accepts() const;
+        uint64_t local_accepts() const;
+
+        bool start();
+        void stop();
+
+    private:
+        void run(size_t idx);
+        void balance(size_t idx);
+    }; // end of class RPC_ServiceGroup
+
+    template<class Impl>
+    RPC_ServiceGroup<Impl>::RPC_ServiceGroup(size_t threads)
+        : m_running(false), m_next_channel(0), m_p_threads(nullptr)
+        , m_balance(threads == 0 ? default_threads() : threads)
+        , m_utilization(threads == 0 ? default_threads() : threads)
+        , m_drift(200), m_migrations(0)
+    {
+        if ( threads == 0 ) threads = default_threads();
+        m_services.reserve(threads);
+        for(size_t i = 0; i < threads; ++i ) {
+            m_services.push_back(new ServiceType());
+            m_balance[i].last_time = 0;
+            m_balance[i].last_idle = 0;
+            m_utilization[i].store(0);
+        }
+    }
+
+    template<class Impl>
+    RPC_ServiceGroup<Impl>::~RPC_ServiceGroup()
+    {
+        this->stop();
+        for(size_t i = 0; i < m_services.size(); ++i ) delete m_services[i];
+        m_services.clear();
+    }
+
+    // 按亲和性和cgroup配额计算，容器中不超过分配给进程的cpu数
+    template<class Impl>
+    size_t RPC_ServiceGroup<Impl>::default_threads()
+    {
+        return available_cpus();
+    }
+
+    template<class Impl>
+    bool RPC_ServiceGroup<Impl>::open_listener(const char * endpoint, int timeout, bool cpu_affinity)
+    {
+        if ( m_running.load() ) {
+            EVEREST_LOG_ERROR("RPC_ServiceGroup::open_listener, group already started");
+            return false;
+        }
+
+        // 按cpu选择线程只在线程确实运行在该cpu上时有意义
+        std::vector<int> cpus(m_services.size());
+        for(size_t i = 0; cpu_affinity && i < cpus.size(); ++i ) {
+            cpus[i] = m_p_threads ? m_p_threads->cpu(i) : -1;
+            if ( cpus[i] < 0 ) {
+                EVEREST_LOG_ERROR("RPC_ServiceGroup::open_listener, cpu affinity needs pinned threads, %s, %lu", endpoint, i);
+                return false;
+            }
+            // 过滤程序对同一cpu只返回第一个序号，重复的cpu对应的线程永远收不到连接
+            if ( std::find(cpus.begin(), cpus.begin() + i, cpus[i]) != cpus.begin() + i ) {
+                EVEREST_LOG_ERROR("RPC_ServiceGroup::open_listener, cpu affinity needs distinct cpus, %s, %lu, %d", endpoint, i, cpus[i]);
+                return false;
+            }
+        }
+
+        // 每个线程绑定一个SO_REUSEPORT监听器，按线程顺序bind，组内序号即线程序号；
+        // 任一步失败时关闭已打开的全部监听器，组未启动，可直接在本线程注销
+        std::vector<ListenerPtr> listeners;
+        auto close_all = [this, &listeners]() {
+            for(size_t i = 0; i < listeners.size(); ++i ) m_services[i]->close_listener(listeners[i]);
+        };
+        for(size_t i = 0; i < m_services.size(); ++i ) {
+            ListenerPtr p_listener = m_services[i]->open_listener(endpoint, true);
+            if ( !p_listener ) {
+                EVEREST_LOG_ERROR("RPC_ServiceGroup::open_listener, open failed, %s, %lu", endpoint, i);
+                close_all();
+                return false;
+            }
+            listeners.push_back(p_listener);
+        }
+        if ( cpu_affinity && !listeners[0]->get_socket().set_reuseport_cpu_steering(cpus) ) {
+            EVEREST_LOG_ERROR("RPC_ServiceGroup::open_listener, attach cpu steering failed, %s", endpoint);
+            close_all();
+            return false;
+        }
+        for(size_t i = 0; i < m_services.size(); ++i ) {
+            bool isok = m_services[i]->post_accept(listeners[i], timeout);
+            if ( !isok ) {
+                EVEREST_LOG_ERROR("RPC_ServiceGroup::open_listener, post accept failed, %s, %lu", endpoint, i);
+                close_all();
+                return false;
+            }
+        }
+        for(size_t i = 0; cpu_affinity && i < listeners.size(); ++i ) {
+            listeners[i]->set_track_locality(true);
+            m_listeners.push_back(listeners[i]);
+        }
+        return true;
+    } // end of RPC_ServiceGroup<Impl>::open_listener
+
+    template<class Impl>
+    uint64_t RPC_ServiceGroup<Impl>::tracked_accepts() const
+    {
+        uint64_t n = 0;
+        for(size_t i = 0; i < m_listeners.size(); ++i ) n += m_listeners[i]->tracked_accepts();
+        return n;
+    }
+
+    template<class Impl>
+    uint64_t RPC_ServiceGroup<Impl>::local_accepts() const
+    {
+        uint64_t n = 0;
+        for(size_t i = 0; i < m_listeners.size(); ++i ) n += m_listeners[i]->local_accepts();
+        return n;
+    }
+
+    template<class Impl>
+    bool RPC_ServiceGroup<Impl>::open_channel(const char * endpoint, int timeout)
+    {
+        if ( m_running.load() ) {
+            EVEREST_LOG_ERROR("RPC_ServiceGroup::open_channel, group already started");
+            return false;
+        }
+        size_t idx = m_next_channel++ % m_services.size();
+        return m_services[idx]->open_channel(endpoint, timeout);
+    }
+
+    template<class Impl>
+    void RPC_ServiceGroup<Impl>::enable_balancer(int interval_ms, double drift)
+    {
+        if ( m_running.load() ) {
+            EVEREST_LOG_ERROR("RPC_ServiceGroup::enable_balancer, group already started");
+            return;
+        }
+        m_drift = (int)(drift * 1000);
+        for(size_t i = 0; i < m_services.size(); ++i ) {
+            m_services[i]->schedule_every((int64_t)interval_ms * 1000, [this, i]() { this->balance(i); });
+        }
+    }
+
+    // 在线程idx上由定时器调用
+    template<class Impl>
+    void RPC_ServiceGroup<Impl>::balance(size_t idx)
+    {
+        ServiceType & service = *m_services[idx];
+        Balance_State & state = m_balance[idx];
+        int64_t now = DateTime::get_timestamp();
+        uint64_t idle = service.idle_time_us();
+        int64_t elapsed = now - state.last_time;
+        int64_t busy = elapsed - (int64_t)(idle - state.last_idle);
+        bool first = (state.last_time == 0);
+        state.last_time = now;
+        state.last_idle = idle;
+
+        // 每次都取出channel的负载计数，下次只统计本周期的收发
+        std::vector<Channel_Load> loads;
+        uint64_t total = 0;
+        auto collect = [&loads, &total](ChannelPtr p_channel) {
+            uint64_t load = p_channel->take_load();
+            if ( load == 0 || p_channel->state() != RPC_Constants::State_Connected ) return;
+            loads.push_back(Channel_Load{ p_channel, load });
+            total += load;
+        };
+        service.for_each_channel(collect);
+        if ( first || elapsed <= 0 ) return;
+
+        int util = (int)(busy * 1000 / elapsed);
+        util = util < 0 ? 0 : (util > 1000 ? 1000 : util);
+        m_utilization[idx].store(util);
+
+        size_t target = idx;
+        int min_util = util;
+        for(size_t i = 0; i < m_utilization.size(); ++i ) {
+            int u = m_utilization[i].load();
+            if ( i != idx && u < min_util ) {
+                min_util = u;
+                target = i;
+            }
+        }
+        int gap = util - min_util;
+        if ( target == idx || gap < m_drift || total == 0 ) return;
+
+        // 迁移后两者不反转(util - cost >= min_util + cost)的channel中负载最大的一个
+        std::sort(loads.begin(), loads.end());
+        for(size_t i = 0; i < loads.size(); ++i ) {
+            int cost = (int)((uint64_t)util * loads[i].load / total);
+            if ( cost <= 0 || 2 * cost > gap ) continue;
+            if ( !service.migrate_channel(loads[i].p_channel, *m_services[target]) ) return;
+            EVEREST_LOG_INFO("RPC_ServiceGroup::balance, migrate channel from %lu(%d) to %lu(%d), cost %d",
+                idx, util, target, min_util, cost);
+            // 下次统计前其它线程按迁移后的估计值选择
+            m_utilization[target].fetch_add(cost);
+            m_utilization[idx].fetch_sub(cost);
+            ++m_migrations;
+            return;
+        }
+    } // end of RPC_ServiceGroup<Impl>::balance
+
+    template<class Impl>
+    bool RPC_ServiceGroup<Impl>::start()
+    {
+        bool expected = false;
+        if ( !m_running.compare_exchange_strong(expected, true) ) {
+            EVEREST_LOG_ERROR("RPC_ServiceGroup::start, already started");
+            return false;
+        }
+
+        m_threads.reserve(m_services.size());
+        for(size_t i = 0; i < m_services.size(); ++i ) {
+            m_services[i]->restart();
+            m_threads.push_back(std::thread(&RPC_ServiceGroup::run, this, i));
+        }
+        return true;
+    }
+
+    template<class Impl>
+    void RPC_ServiceGroup<Impl>::stop()
+    {
+        m_running.store(false);
+        for(size_t i = 0; i < m_services.size(); ++i ) m_services[i]->stop();
+        for(size_t i = 0; i < m_threads.size(); ++i ) {
+            if ( m_threads[i].joinable() ) m_threads[i].join();
+        }
+        m_threads.clear();
+    }
+
+    template<class Impl>
+    void RPC_ServiceGroup<Impl>::run(size_t idx)
+    {
+        if ( m_p_threads ) m_p_threads->bind(idx);
+        // 没有任务时阻塞等待，stop()唤醒后返回
+        m_services[idx]->run();
+        EVEREST_LOG_TRACE("RPC_ServiceGroup::run, service %lu exit", idx);
+    } // end of RPC_ServiceGroup<Impl>::run
+
+} // end of namespace rpc
+} // end of namespace everest
+
+#endif // INCLUDE_EVEREST_RPC_RPC_SERVICEGROUP_H
@@ -3,7 +3,11 @@
 
 #pragma once 
 
+#include <sched.h>
+#include <atomic>
 #include <stdexcept>
+#include <vector>
+#include <everest/log.h>
 
 namespace everest
 {
@@ -17,12 +21,14 @@ namespace rpc
         static const int Fail     = -1;
         static const int Ok       = 0;
         static const int Continue = 1;
+        static const int Timeout  = -2;   // 任务超时，作为handler的错误码
         
         static const int Read   = 1;
         static const int Write  = 2;
         static const int Accept = 4;
         
         static const int64_t Max_Expire_Time = INT64_MAX;
+        static const int     Max_Wait_Time   = 100;    // poller单次等待上限(ms)，保证线程能及时响应停止
         
         static const int State_Closed     = 0;
         static const int State_Init       = 1;
@@ -51,12 +57,14 @@ namespace rpc
             m_socket.set_block_mode(false); // 非阻塞模式
         }
         
+        // nonblocking为true表示sock已是非阻塞模式(如accept4带SOCK_NONBLOCK)，不再调用fcntl
         RPC_SocketObject(const net::Protocol& proto, int type, 
-                         net::Socket &sock, net::SocketAddress &addr) 
+                         net::Socket &sock, net::SocketAddress &addr, bool nonblocking = false) 
             : m_proto(proto), m_socket(proto, false), m_type(type), m_addr(addr)
         {
             m_socket.attach(sock.handle());
             sock.detach();
+            if ( !nonblocking ) m_socket.set_block_mode(false); // 接受的连接也用非阻塞模式，读写到EAGAIN为止
         }
 
         net::Socket& get_socket() { return m_socket; }
@@ -67,23 +75,78 @@ namespace rpc
         
     }; // end of class RPC_TcpSocketListener
     
+    /**
+     * 发送高低水位: 已投递、尚未发送完成的字节数达到高水位后post_send拒绝新消息，
+     * proactor暂停读该连接；发送到低水位以下时恢复读取，并通知被拒绝过的发送者。
+     * 计数在投递线程增加、在proactor线程减少，水位需在投递发送前设置。
+     * 引用计数: 所属服务持有一个，执行器中未完成的recv handler和待处理的失败通知各持有一个，
+     * close_channel释放服务的引用，最后一个释放者删除channel。
+     */
     class RPC_SocketChannel : public RPC_SocketObject 
     {
     protected:
-        int   m_state;    // socket channel状态
+        int                 m_state;          // socket channel状态
+        std::atomic<size_t> m_queued_bytes;   // 已投递、尚未完成的发送字节数
+        std::atomic<bool>   m_send_blocked;   // 有post_send因高水位被拒绝
+        size_t              m_low_mark;
+        size_t              m_high_mark;      // 0为不限制
+        uint64_t            m_load;           // 上次take_load后的收发回调数，只在proactor线程访问
+        std::atomic<int>    m_refs;
     public: 
         RPC_SocketChannel()
             : RPC_SocketObject(net::Protocol::tcp4(), Type_Channel)
             , m_state(RPC_Constants::State_Init)
-        {}
+            , m_queued_bytes(0), m_send_blocked(false), m_low_mark(0), m_high_mark(0), m_load(0), m_refs(1)
+        {
+            m_socket.set_no_delay(true);    // 由合并发送和MSG_MORE控制报文段，不依赖Nagle
+        }
         
-        RPC_SocketChannel(net::Socket &sock, net::SocketAddress &addr)
-            : RPC_SocketObject(net::Protocol::tcp4(), Type_Channel, sock, addr)
-            , m_state(RPC_Constants::State_Init)
-        {}
+        RPC_SocketChannel(net::Socket &sock, net::SocketAddress &addr, bool nonblocking = false)
+            : RPC_SocketObject(net::Protocol::tcp4(), Type_Channel, sock, addr, nonblocking)
+            , m_state(RPC_Constants::State_Connected)    // 由listener接受的连接已建立
+            , m_queued_bytes(0), m_send_blocked(false), m_low_mark(0), m_high_mark(0), m_load(0), m_refs(1)
+        {
+            m_socket.set_no_delay(true);
+        }
         
         int  state() const { return m_state; }
         void state(int s) { m_state = s; }
+        
+        void set_send_watermarks(size_t low, size_t high) {
+            m_low_mark  = (low < high) ? low : high;
+            m_high_mark = high;
+        }
+        
+        size_t low_mark() const { return m_low_mark; }
+        size_t high_mark() const { return m_high_mark; }
+        
+        size_t queued_bytes() const { return m_queued_bytes.load(); }
+        
+        bool above_high_mark() const { return m_high_mark > 0 && m_queued_bytes.load() >= m_high_mark; }
+        
+        // 投递发送前计入字节数，已达高水位时返回false并记录，降到低水位时由proactor通知
+        bool reserve_send(size_t bytes) {
+            if ( this->above_high_mark() ) {
+                m_send_blocked.store(true);
+                if ( this->above_high_mark() ) return false;   // 再检查一次，避免与release_send错过通知
+            }
+            m_queued_bytes.fetch_add(bytes);
+            return true;
+        }
+        
+        // 发送完成、失败或超时后扣除，返回true表示降到低水位且有发送者等待通知
+        bool release_send(size_t bytes) {
+            size_t queued = m_queued_bytes.fetch_sub(bytes) - bytes;
+            return queued <= m_low_mark && m_send_blocked.load() && m_send_blocked.exchange(false);
+        }
+        
+        // 负载计数，用于选择迁移的channel
+        void     add_load(uint64_t n) { m_load += n; }
+        uint64_t take_load() { uint64_t n = m_load; m_load = 0; return n; }
+        
+        // 任意线程调用，release返回true时调用者删除channel
+        void     retain() { m_refs.fetch_add(1); }
+        bool     release() { return m_refs.fetch_sub(1) == 1; }
 
         bool open(const char * endpoint);
     };
@@ -93,12 +156,34 @@ namespace rpc
     public:
         RPC_SocketListener() 
             : RPC_SocketObject(net::Protocol::tcp4(), Type_Listener) 
+            , m_track_locality(false), m_tracked_accepts(0), m_local_accepts(0)
         {
             m_socket.set_reuse_addr(true);  // 地址可重复使用
         }
         
         bool                open(const char * endpoint);
         RPC_SocketChannel * accept();
+        
+        // 统计接受的连接是否由本线程当前所在的cpu收到，每个连接多一次getsockopt
+        void     set_track_locality(bool on) { m_track_locality = on; }
+        
+        // proactor在回调accept handler前调用
+        void     note_accepted(RPC_SocketChannel *p_channel);
+        
+        // 统计到incoming cpu的连接数和其中在本线程cpu上收到的连接数，可在其它线程读取
+        uint64_t tracked_accepts() const { return m_tracked_accepts.load(std::memory_order_relaxed); }
+        uint64_t local_accepts() const { return m_local_accepts.load(std::memory_order_relaxed); }
+        
+        /**
+         * 连续接受连接直到没有待接受的连接或已接受budget个，追加到channels。
+         * 返回Continue表示已接受到EAGAIN，Ok表示达到budget、可能还有连接，Fail表示出错(之前接受的仍在channels中)
+         */
+        int                 accept(std::vector<RPC_SocketChannel *> &channels, size_t budget);
+        
+    private:
+        bool                  m_track_locality;
+        std::atomic<uint64_t> m_tracked_accepts;
+        std::atomic<uint64_t> m_local_accepts;
     };
     
     
@@ -112,22 +197,22 @@ namespace rpc
         net::InetAdderssAdapter addr_adapter(cSockaddr);
         bool isok = addr_adapter.from_string(endpoint);
         if ( !isok ) {
-            printf("[ERROR] RPC_TcpSocketListener::open, bad endpoint address, %s\n", endpoint);
+            EVEREST_LOG_ERROR("RPC_TcpSocketListener::open, bad endpoint address, %s", endpoint);
             return false;
         }
         
         isok = m_socket.bind(cSockaddr);
         if ( !isok ) {
-            printf("[ERROR] RPC_TcpSocketListener::open, bind failed, %s\n", endpoint);
+            EVEREST_LOG_ERROR("RPC_TcpSocketListener::open, bind failed, %s", endpoint);
             return false;
         }
         
         isok = m_socket.listen();
         if ( !isok ) {
-            printf("[ERROR] RPC_TcpSocketListener::open, listen failed, %s\n", endpoint);
+            EVEREST_LOG_ERROR("RPC_TcpSocketListener::open, listen failed, %s", endpoint);
             return false;
         }
-        printf("[TRACE] RPC_TcpSocketListener::open, result %s\n", isok?"true":"false");
+        EVEREST_LOG_TRACE("RPC_TcpSocketListener::open, result %s", isok?"true":"false");
         return isok;
         
     } // end of RPC_SocketListener::open
@@ -139,31 +224,58 @@ namespace rpc
         net::InetAdderssAdapter addr_adapter(addr);
         bool isok = addr_adapter.from_string(endpoint);
         if ( !isok ) {
-            printf("[ERROR] RPC_TcpSocketChannel::open, bad endpoint address, %s\n", endpoint);
+            EVEREST_LOG_ERROR("RPC_TcpSocketChannel::open, bad endpoint address, %s", endpoint);
             return false;
         }
         isok = m_socket.connect(addr);
         if ( !isok ) {
-            printf("[ERROR] RPC_TcpSocketChannel::open, connect failed, %s\n", endpoint);
+            EVEREST_LOG_ERROR("RPC_TcpSocketChannel::open, connect failed, %s", endpoint);
             return false;
         }
         this->m_state = RPC_Constants::State_Connecting;
         return true;
     }
     
+    inline 
+    void RPC_SocketListener::note_accepted(RPC_SocketChannel *p_channel)
+    {
+        if ( !m_track_locality ) return;
+        int cpu = p_channel->get_socket().incoming_cpu();
+        if ( cpu < 0 ) return;
+        m_tracked_accepts.fetch_add(1, std::memory_order_relaxed);
+        if ( cpu == ::sched_getcpu() ) m_local_accepts.fetch_add(1, std::memory_order_relaxed);
+    }
+    
     inline 
     RPC_SocketChannel * RPC_SocketListener::accept()
     {
         net::Socket        newsock(m_proto, false);  // 仅仅建一个空的socket
         net::SocketAddress addr;
         
-        bool isok = m_socket.accept(newsock, addr);
+        // 新连接由accept4直接设为非阻塞，不再需要fcntl；构造channel时再设置TCP_NODELAY，
+        // 每个连接共两次系统调用
+        bool isok = m_socket.accept(newsock, addr, SOCK_NONBLOCK | SOCK_CLOEXEC);
         if ( !isok ) {
-            printf("[ERROR] RPC_SocketListener::accept failed\n");
+            if ( errno == EAGAIN || errno == EWOULDBLOCK ) return nullptr;  // 没有待接受的连接
+            EVEREST_LOG_ERROR("RPC_SocketListener::accept failed");
             return nullptr;
         }
-        printf("[TRACE] RPC_SocketListener::accept, new channel accepted, fd %d\n", newsock.handle());
-        return (RPC_SocketChannel *) new RPC_SocketChannel(newsock, addr);
+        EVEREST_LOG_TRACE("RPC_SocketListener::accept, new channel accepted, fd %d", newsock.handle());
+        return (RPC_SocketChannel *) new RPC_SocketChannel(newsock, addr, true);
+    }
+    
+    inline 
+    int RPC_SocketListener::accept(std::vector<RPC_SocketChannel *> &channels, size_t budget)
+    {
+        for(size_t i = 0; i < budget; ++i ) {
+            RPC_SocketChannel * p_channel = this->accept();
+            if ( p_channel == nullptr ) {
+                if ( errno == EAGAIN || errno == EWOULDBLOCK ) return RPC_Constants::Continue;
+                return RPC_Constants::Fail;
+            }
+            channels.push_back(p_channel);
+        }
+        return RPC_Constants::Ok;
     }
     
 } // end of namespace rpc 
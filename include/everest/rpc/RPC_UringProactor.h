@@ -0,0 +1,962 @@
+#ifndef INCLUDE_EVEREST_RPC_RPC_URING_PROACTOR_H
+#define INCLUDE_EVEREST_RPC_RPC_URING_PROACTOR_H
+
+#pragma once
+
+#include <algorithm>
+#include <vector>
+#include <unordered_map>
+#include <everest/net/io_uring_poller.h>
+#include <everest/net/epoller.h>
+#include <everest/rpc/RPC_Proactor.h>
+#include <everest/log.h>
+
+namespace everest
+{
+namespace rpc
+{
+    /**
+     * io_uring版本的proactor
+     * accept/recvmsg/sendmsg作为异步请求提交，一轮run_once只调用一次io_uring_enter，
+     * 代替epoll_wait加每个连接的recvmsg/sendmsg。
+     * 监听器使用multishot accept，内核不支持时退回单次accept。接收直接写入调用者提供的
+     * 消息缓存，因此用单次recvmsg，不使用需要内核缓存池(provided buffers)的multishot recv。
+     * 运行时io_uring不可用时，全部调用转给内部的EPoller版本proactor。
+     * 发送背压与EPoller版本相同，暂停期间当前消息收完后不再提交新的recvmsg。
+     * 忙轮询时自旋调用不等待的io_uring_enter，已有完成事件时不进入内核。
+     * 用户定时器同EPoller版本设置timerfd，在timerfd上保持一个poll请求等待到期。
+     * 任务超时时取消其收发请求，取消完成后才回调；已收发部分数据时与EPoller版本一样让连接失败。
+     */
+    template<class Timer, class Handlers>
+    class RPC_Proactor<net::IoUringPoller, Timer, Handlers>
+    {
+    public:
+        typedef RPC_Basic_TaskTimeoutQueue<Timer>    TaskTimeoutQueue;
+        typedef typename TaskTimeoutQueue::Task      Task;
+        typedef typename TaskTimeoutQueue::TaskOwner TaskOwner;
+        typedef RPC_Proactor<net::EPoller, Timer, Handlers> FallbackType;
+
+    private:
+        static const int Op_Accept  = 1;
+        static const int Op_Recv    = 2;
+        static const int Op_Send    = 3;
+        static const int Op_Connect = 4;
+        static const int Op_Wakeup  = 5;
+        static const int Op_Cancel  = 6;
+        static const int Op_Timer   = 7;
+
+        struct OwnerState;
+
+        // 一个io_uring请求，地址作为user_data，完成前msghdr和iovec必须保持有效
+        struct Operation
+        {
+            int                       kind;
+            OwnerState *              p_state;
+            Task *                    p_task;      // 请求对应的任务，任务超时删除后置空
+            bool                      in_flight;
+            bool                      multishot;
+            bool                      polling;     // 收到EAGAIN，等待poll完成后重新提交
+            bool                      timed_out;   // 任务已超时，请求已取消，等完成事件后回调
+            size_t                    remain;      // 发送剩余字节数
+            size_t                    total;       // 发送总字节数
+            RPC_Message               expired;     // 超时任务的消息
+            struct msghdr             hdr;
+            std::vector<struct iovec> iov;
+
+            Operation() : kind(0), p_state(nullptr), p_task(nullptr)
+                , in_flight(false), multishot(false), polling(false), timed_out(false), remain(0), total(0)
+            {
+                memset(&hdr, 0, sizeof(hdr));
+            }
+        };
+
+        struct OwnerState
+        {
+            TaskOwner * p_owner;
+            Operation   read_op;     // accept或recvmsg
+            Operation   write_op;    // sendmsg或连接完成检测
+        };
+
+        typedef std::unordered_map<RPC_SocketObject *, OwnerState *> StateMap;
+
+    private:
+        net::IoUringPoller   m_poller;
+        FallbackType *       m_fallback;             // io_uring不可用时使用
+        TaskTimeoutQueue     m_task_timeout_queue;
+        net::EventNotifier   m_notifier;
+        Operation            m_wakeup_op;
+        Operation            m_cancel_op;            // 取消请求自身的完成事件，忽略
+        net::TimerNotifier   m_timer_notifier;       // 用户定时器的精确唤醒
+        Operation            m_timer_op;
+        RPC_UserTimerQueue   m_user_timers;
+        StateMap             m_states;
+        std::vector<OwnerState *> m_closing;         // 已注销、仍有请求在内核中的状态
+        bool                 m_multishot_accept;
+        uint64_t             m_io_calls;
+        int                  m_notsent_lowat;
+        uint64_t             m_backpressure_us;
+        uint64_t             m_backpressure_count;
+        std::function<void (RPC_SocketChannel*)> m_drain_handler;
+        RPC_BusyPoll         m_busy_poll;
+        int                  m_socket_busy_poll;
+
+        Handlers             m_handlers;
+
+    private:
+        RPC_Proactor(const RPC_Proactor&) = delete;
+        RPC_Proactor& operator=(const RPC_Proactor&) = delete;
+
+    public:
+        RPC_Proactor() : m_fallback(nullptr), m_multishot_accept(true), m_io_calls(0)
+            , m_notsent_lowat(0), m_backpressure_us(0), m_backpressure_count(0), m_socket_busy_poll(0)
+        {
+            if ( !m_poller.valid() ) {
+                EVEREST_LOG_WARN("RPC_Proactor<IoUringPoller>::RPC_Proactor, io_uring unavailable, use epoll");
+                m_fallback = new FallbackType();
+                return;
+            }
+            m_wakeup_op.kind = Op_Wakeup;
+            m_cancel_op.kind = Op_Cancel;
+            m_timer_op.kind = Op_Timer;
+            this->arm_wakeup();
+            this->arm_timer();
+        }
+
+        ~RPC_Proactor() {
+            delete m_fallback;
+            typename StateMap::iterator it = m_states.begin();
+            for(; it != m_states.end(); ++it ) delete it->second;
+            for(size_t i = 0; i < m_closing.size(); ++i ) delete m_closing[i];
+        }
+
+        // 是否因io_uring不可用而使用epoll
+        bool fallback() const { return m_fallback != nullptr; }
+
+        Handlers & handlers() { return m_fallback ? m_fallback->handlers() : m_handlers; }
+
+        template<class Handler>
+        void set_accept_handler(const Handler &handler) {
+            if ( m_fallback ) m_fallback->set_accept_handler(handler);
+            else m_handlers.accept = handler;
+        }
+
+        template<class Handler>
+        void set_connect_handler(const Handler &handler) {
+            if ( m_fallback ) m_fallback->set_connect_handler(handler);
+            else m_handlers.connect = handler;
+        }
+
+        template<class Handler>
+        void set_send_handler(const Handler &handler) {
+            if ( m_fallback ) m_fallback->set_send_handler(handler);
+            else m_handlers.send = handler;
+        }
+
+        template<class Handler>
+        void set_recv_handler(const Handler &handler) {
+            if ( m_fallback ) m_fallback->set_recv_handler(handler);
+            else m_handlers.recv = handler;
+        }
+
+        template<class Handler>
+        void set_drain_handler(const Handler &handler) {
+            if ( m_fallback ) m_fallback->set_drain_handler(handler);
+            else m_drain_handler = handler;
+        }
+
+        bool reg(RPC_SocketObject *sockobj);
+
+        // 注销后未完成的任务直接丢弃；内核中的请求被取消，状态保留到其完成事件返回
+        bool unreg(RPC_SocketObject *sockobj);
+
+        // 关闭channel的收发，已投递的任务以Fail结束；channel未注册时返回false
+        bool abort_channel(RPC_SocketChannel *pch) {
+            if ( m_fallback ) return m_fallback->abort_channel(pch);
+            if ( !m_task_timeout_queue.has_owner(pch) ) return false;
+            this->fail_channel(pch);
+            return true;
+        }
+
+        bool notify() { return m_fallback ? m_fallback->notify() : m_notifier.notify(); }
+        
+        uint64_t schedule(int64_t expire, int64_t period, const RPC_UserTimerQueue::Callback &callback) {
+            return m_fallback ? m_fallback->schedule(expire, period, callback) : m_user_timers.add(expire, period, callback);
+        }
+        
+        bool     cancel_timer(uint64_t id) { return m_fallback ? m_fallback->cancel_timer(id) : m_user_timers.cancel(id); }
+        size_t   timer_count() const { return m_fallback ? m_fallback->timer_count() : m_user_timers.size(); }
+        uint64_t timers_fired() const { return m_fallback ? m_fallback->timers_fired() : m_user_timers.fired(); }
+
+        // 发送合并和flush模式只在回退到epoll时有效，io_uring每个写任务单独提交sendmsg
+        void set_send_batch_bytes(size_t n) { if ( m_fallback ) m_fallback->set_send_batch_bytes(n); }
+
+        bool flush_mode() const { return m_fallback ? m_fallback->flush_mode() : false; }
+        void set_flush_mode(bool on) { if ( m_fallback ) m_fallback->set_flush_mode(on); }
+
+        void flush() { if ( m_fallback ) m_fallback->flush(); }
+
+        // 直接发送只在回退到epoll时有效，io_uring的写任务在下次提交时发出
+        void     set_direct_write(bool on) { if ( m_fallback ) m_fallback->set_direct_write(on); }
+        uint64_t direct_writes() const { return m_fallback ? m_fallback->direct_writes() : 0; }
+
+        // 预读只在回退到epoll时有效，io_uring直接接收到读任务的缓存
+        void set_read_ahead(size_t bytes) { if ( m_fallback ) m_fallback->set_read_ahead(bytes); }
+
+        // multishot accept每个连接一个完成事件，一次等待可取出多个，数量上限只在回退到epoll时有效
+        void set_accept_budget(size_t n) { if ( m_fallback ) m_fallback->set_accept_budget(n); }
+
+        // 每个读请求一个完成事件，单个连接不会连续占用一轮，接收预算只在回退到epoll时有效
+        void set_read_budget(size_t bytes, size_t messages) {
+            if ( m_fallback ) m_fallback->set_read_budget(bytes, messages);
+        }
+
+        uint64_t deferred_count() const { return m_fallback ? m_fallback->deferred_count() : 0; }
+
+        void set_notsent_lowat(size_t bytes) {
+            if ( m_fallback ) m_fallback->set_notsent_lowat(bytes);
+            m_notsent_lowat = (int)bytes;
+        }
+
+        void set_busy_poll(int64_t spin_us) {
+            if ( m_fallback ) m_fallback->set_busy_poll(spin_us);
+            m_busy_poll.set_budget(spin_us);
+        }
+
+        void set_socket_busy_poll(int usec) {
+            if ( m_fallback ) m_fallback->set_socket_busy_poll(usec);
+            m_socket_busy_poll = usec;
+        }
+
+        const RPC_BusyPoll & busy_poll() const { return m_fallback ? m_fallback->busy_poll() : m_busy_poll; }
+
+        uint64_t idle_time_us() const { return this->busy_poll().idle_us(); }
+
+        // 请求在内核中时不能转移，迁移只在回退到epoll时可用
+        bool detach(RPC_SocketChannel *pch, RPC_ChannelState &state) {
+            if ( m_fallback ) return m_fallback->detach(pch, state);
+            EVEREST_LOG_ERROR("RPC_Proactor<IoUringPoller>::detach, channel migration needs epoll");
+            return false;
+        }
+
+        bool attach(RPC_ChannelState &state) {
+            if ( m_fallback ) return m_fallback->attach(state);
+            EVEREST_LOG_ERROR("RPC_Proactor<IoUringPoller>::attach, channel migration needs epoll");
+            return false;
+        }
+
+        template<class Handler>
+        void for_each_channel(Handler &handler) {
+            if ( m_fallback ) return m_fallback->for_each_channel(handler);
+            typename StateMap::iterator it = m_states.begin();
+            for(; it != m_states.end(); ++it ) {
+                if ( it->first->type() == RPC_SocketObject::Type_Channel ) handler((RPC_SocketChannel *)it->first);
+            }
+        }
+
+        // io_uring在完成处理中不直接接受新任务，总是经过RPC_Service的任务队列
+        bool registered(RPC_SocketObject *sockobj) const {
+            return m_fallback ? m_fallback->registered(sockobj) : false;
+        }
+
+        bool add_read(RPC_SocketObject *sockobj, RPC_Message &msg, int64_t expire);
+
+        bool add_write(RPC_SocketObject *sockobj, RPC_Message &msg, int64_t expire);
+
+        int  run_once(int max_wait = -1);
+
+        size_t task_count() const {
+            return m_fallback ? m_fallback->task_count() : m_task_timeout_queue.size();
+        }
+
+        uint64_t syscall_count() const {
+            return m_fallback ? m_fallback->syscall_count() : m_poller.syscalls() + m_io_calls;
+        }
+
+        // io_uring不使用epoll_ctl，回退到epoll时返回其省去的次数
+        uint64_t ctl_saved() const { return m_fallback ? m_fallback->ctl_saved() : 0; }
+
+        uint64_t backpressure_time_us() const {
+            return m_fallback ? m_fallback->backpressure_time_us() : m_backpressure_us;
+        }
+
+        uint64_t backpressure_count() const {
+            return m_fallback ? m_fallback->backpressure_count() : m_backpressure_count;
+        }
+
+    private:
+        OwnerState * find_state(RPC_SocketObject * p_sock) {
+            typename StateMap::iterator it = m_states.find(p_sock);
+            return (it == m_states.end()) ? nullptr : it->second;
+        }
+
+        static int handle_of(Operation & op) {
+            return op.p_state->p_owner->get_socket()->get_socket().handle();
+        }
+
+        bool   arm_wakeup() { return m_poller.prep_poll(m_notifier.handle(), POLLIN, &m_wakeup_op); }
+        bool   arm_timer() { return m_poller.prep_poll(m_timer_notifier.handle(), POLLIN, &m_timer_op); }
+        bool   arm_read(OwnerState * p_state);
+        bool   arm_write(OwnerState * p_state);
+        bool   resubmit(Operation & op);
+        bool   wait_ready(Operation & op);
+        size_t prepare_recv(Operation & op);
+        size_t prepare_send(Operation & op);
+        void   advance_send(Operation & op, size_t n);
+
+        void   process_events();
+        void   on_closed_complete(Operation & op, const net::IoUringPoller::Event & e);
+        void   on_accept_complete(Operation & op, const net::IoUringPoller::Event & e);
+        void   pause_accept(RPC_SocketListener * p_listener);
+        void   on_recv_complete(Operation & op, int res);
+        void   on_send_complete(Operation & op, int res);
+        void   on_connect_complete(Operation & op, int res);
+        void   finish_read(OwnerState * p_state);
+        void   check_watermarks(OwnerState * p_state, RPC_SocketChannel * pch);
+        void   on_send_released(OwnerState * p_state, RPC_SocketChannel * pch, size_t bytes);
+
+        void   clear_timeout_task();
+        void   on_task_timeout(TaskOwner * p_owner, int type, RPC_Message &msg);
+        void   finish_timeout(Operation & op, int res);
+        void   notify_timeout(OwnerState * p_state, RPC_SocketObject * p_sock, int type, RPC_Message &msg, bool partial);
+        void   fail_channel(RPC_SocketChannel * pch);
+    }; // end of class RPC_Proactor<net::IoUringPoller, Timer, Handlers>
+
+////////////////////////////////////////////////////////////////////////////////
+// IMPLEMENTATION
+
+    template<class Timer, class Handlers>
+    inline bool RPC_Proactor<net::IoUringPoller, Timer, Handlers>::reg(RPC_SocketObject *sockobj)
+    {
+        if ( m_fallback ) return m_fallback->reg(sockobj);
+
+        TaskOwner * p_owner = m_task_timeout_queue.add_owner(sockobj);
+        assert(p_owner);
+        if ( this->find_state(sockobj) ) return true;
+
+        if ( m_notsent_lowat > 0 && sockobj->type() == RPC_SocketObject::Type_Channel ) {
+            sockobj->get_socket().set_notsent_lowat(m_notsent_lowat);
+        }
+        if ( m_socket_busy_poll > 0 && sockobj->type() == RPC_SocketObject::Type_Channel ) {
+            sockobj->get_socket().set_busy_poll(m_socket_busy_poll);
+        }
+
+        OwnerState * p_state = new OwnerState();
+        p_state->p_owner = p_owner;
+        p_state->read_op.kind = (sockobj->type() == RPC_SocketObject::Type_Listener) ? Op_Accept : Op_Recv;
+        p_state->read_op.p_state = p_state;
+        p_state->write_op.kind = Op_Send;
+        p_state->write_op.p_state = p_state;
+        m_states.insert(typename StateMap::value_type(sockobj, p_state));
+        return true;
+    }
+
+    template<class Timer, class Handlers>
+    inline bool RPC_Proactor<net::IoUringPoller, Timer, Handlers>::unreg(RPC_SocketObject *sockobj)
+    {
+        if ( m_fallback ) return m_fallback->unreg(sockobj);
+
+        OwnerState * p_state = this->find_state(sockobj);
+        if ( !p_state ) return false;
+        m_states.erase(sockobj);
+        m_task_timeout_queue.remove_owner(sockobj);
+        p_state->p_owner = nullptr;     // 之后的完成事件只回收状态
+
+        Operation * ops[2] = { &p_state->read_op, &p_state->write_op };
+        bool pending = false;
+        for(int i = 0; i < 2; ++i ) {
+            ops[i]->p_task = nullptr;
+            if ( !ops[i]->in_flight ) continue;
+            m_poller.prep_cancel(ops[i], &m_cancel_op);
+            pending = true;
+        }
+        if ( !pending ) {
+            delete p_state;
+            return true;
+        }
+        m_poller.submit();   // socket和消息缓存随后释放，取消需立即生效
+        m_closing.push_back(p_state);
+        return true;
+    }
+
+    // 已注销owner的请求完成，全部请求结束后释放状态
+    template<class Timer, class Handlers>
+    inline void RPC_Proactor<net::IoUringPoller, Timer, Handlers>::on_closed_complete(
+        Operation & op, const net::IoUringPoller::Event & e)
+    {
+        if ( op.kind == Op_Accept && !op.polling && e.res() >= 0 ) ::close(e.res());
+        if ( op.kind != Op_Accept || !e.more() ) op.in_flight = false;
+        OwnerState * p_state = op.p_state;
+        if ( p_state->read_op.in_flight || p_state->write_op.in_flight ) return;
+
+        typename std::vector<OwnerState *>::iterator it = std::find(m_closing.begin(), m_closing.end(), p_state);
+        if ( it != m_closing.end() ) m_closing.erase(it);
+        delete p_state;
+    }
+
+    template<class Timer, class Handlers>
+    inline bool RPC_Proactor<net::IoUringPoller, Timer, Handlers>::add_read(RPC_SocketObject *sockobj, RPC_Message &msg, int64_t expire)
+    {
+        if ( m_fallback ) return m_fallback->add_read(sockobj, msg, expire);
+
+        OwnerState * p_state = this->find_state(sockobj);
+        if ( !p_state ) {
+            EVEREST_LOG_ERROR("RPC_Proactor<IoUringPoller>::add_read, socket not registered");
+            return false;
+        }
+        if ( !m_task_timeout_queue.push_task(p_state->p_owner, RPC_Constants::Read, msg, expire) ) return false;
+        EVEREST_LOG_TRACE("RPC_Proactor<IoUringPoller>::add_read, expire %ld", expire);
+        return this->arm_read(p_state);
+    }
+
+    template<class Timer, class Handlers>
+    inline bool RPC_Proactor<net::IoUringPoller, Timer, Handlers>::add_write(RPC_SocketObject *sockobj, RPC_Message &msg, int64_t expire)
+    {
+        if ( m_fallback ) return m_fallback->add_write(sockobj, msg, expire);
+
+        OwnerState * p_state = this->find_state(sockobj);
+        if ( !p_state ) {
+            EVEREST_LOG_ERROR("RPC_Proactor<IoUringPoller>::add_write, socket not registered");
+            return false;
+        }
+        if ( !m_task_timeout_queue.push_task(p_state->p_owner, RPC_Constants::Write, msg, expire) ) return false;
+        EVEREST_LOG_TRACE("RPC_Proactor<IoUringPoller>::add_write, expire %ld", expire);
+        this->check_watermarks(p_state, (RPC_SocketChannel *)sockobj);
+        return this->arm_write(p_state);
+    }
+
+    template<class Timer, class Handlers>
+    inline int RPC_Proactor<net::IoUringPoller, Timer, Handlers>::run_once(int max_wait)
+    {
+        if ( m_fallback ) return m_fallback->run_once(max_wait);
+
+        int64_t now = DateTime::get_timestamp();
+        if ( m_task_timeout_queue.empty() && m_user_timers.empty() && max_wait < 0 ) {
+            EVEREST_LOG_INFO("RPC_Proactor<IoUringPoller>::run, no task ");
+            return 0;
+        }
+        if ( max_wait < 0 || max_wait > RPC_Constants::Max_Wait_Time ) max_wait = RPC_Constants::Max_Wait_Time;
+
+        int64_t wait_us = m_task_timeout_queue.next_expire_time() - now;
+        int timeout = max_wait;
+        if ( wait_us <= 0 ) {
+            timeout = 0;
+        } else if ( wait_us < (int64_t)max_wait * 1000 ) {
+            timeout = (int)((wait_us + 999) / 1000);
+        }
+        int64_t timer_expire = m_user_timers.next_expire_time();
+        if ( timer_expire <= DateTime::get_monotonic_timestamp() ) {
+            timeout = 0;
+        } else if ( timeout != 0 && timer_expire < m_timer_notifier.armed() ) {
+            m_timer_notifier.arm(timer_expire);    // timerfd上的poll请求在到期时完成
+            ++m_io_calls;
+        }
+
+        // 提交本轮产生的全部请求并等待完成事件，不自旋时只有一次io_uring_enter
+        int ret = m_busy_poll.wait(m_poller, timeout);
+        if ( ret > 0 ) {
+            this->process_events();
+        } else if ( ret == 0 ) {
+            EVEREST_LOG_TRACE("RPC_Proactor<IoUringPoller>::run, wait timeout %d ms", timeout);
+        } else {
+            EVEREST_LOG_ERROR("RPC_Proactor<IoUringPoller>::run, wait error");
+        }
+        this->clear_timeout_task();
+        size_t fired = m_user_timers.expire(DateTime::get_monotonic_timestamp());
+        if ( ret >= 0 ) ret += (int)fired;
+        return ret;
+    }
+
+    template<class Timer, class Handlers>
+    inline bool RPC_Proactor<net::IoUringPoller, Timer, Handlers>::arm_read(OwnerState * p_state)
+    {
+        Operation & op = p_state->read_op;
+        TaskOwner * p_owner = p_state->p_owner;
+        if ( op.in_flight || !p_owner->has_task(RPC_Constants::Read) ) return true;
+
+        RPC_SocketObject * p_sock = p_owner->get_socket();
+        op.p_task = p_owner->get_front_task(RPC_Constants::Read);
+        if ( p_sock->type() == RPC_SocketObject::Type_Listener ) {
+            op.multishot = m_multishot_accept;
+        } else {
+            // 连接建立前不提交接收，连接完成后再提交；超过发送高水位时恢复后再提交
+            if ( ((RPC_SocketChannel *)p_sock)->state() == RPC_Constants::State_Connecting ) return true;
+            if ( p_owner->read_paused() ) return true;
+            if ( this->prepare_recv(op) == 0 ) {
+                this->finish_read(p_state);   // 没有接收空间，直接交给handler
+                return true;
+            }
+        }
+        return this->resubmit(op);
+    }
+
+    template<class Timer, class Handlers>
+    inline bool RPC_Proactor<net::IoUringPoller, Timer, Handlers>::arm_write(OwnerState * p_state)
+    {
+        Operation & op = p_state->write_op;
+        TaskOwner * p_owner = p_state->p_owner;
+        if ( op.in_flight || !p_owner->has_task(RPC_Constants::Write) ) return true;
+
+        RPC_SocketChannel * p_channel = (RPC_SocketChannel *)p_owner->get_socket();
+        op.p_task = p_owner->get_front_task(RPC_Constants::Write);
+        if ( p_channel->state() == RPC_Constants::State_Connecting ) {
+            op.kind = Op_Connect;
+            op.in_flight = m_poller.prep_poll(p_channel->get_socket().handle(), POLLOUT, &op);
+            return op.in_flight;
+        }
+        op.kind = Op_Send;
+        if ( this->prepare_send(op) == 0 ) {
+            this->on_send_complete(op, 0);   // 空消息直接完成
+            return true;
+        }
+        return this->resubmit(op);
+    }
+
+    // 按op中已准备好的msghdr(重新)提交请求
+    template<class Timer, class Handlers>
+    inline bool RPC_Proactor<net::IoUringPoller, Timer, Handlers>::resubmit(Operation & op)
+    {
+        int fd = handle_of(op);
+        bool isok = false;
+        if ( op.kind == Op_Accept ) isok = m_poller.prep_accept(fd, op.multishot, &op);
+        else if ( op.kind == Op_Recv ) isok = m_poller.prep_recvmsg(fd, &op.hdr, &op);
+        else if ( op.kind == Op_Send ) isok = m_poller.prep_sendmsg(fd, &op.hdr, &op);
+        if ( !isok ) {
+            EVEREST_LOG_ERROR("RPC_Proactor<IoUringPoller>::resubmit, prepare failed, kind %d", op.kind);
+        }
+        op.in_flight = isok;
+        return isok;
+    }
+
+    // 内核返回EAGAIN时先poll，可读写后再重新提交
+    template<class Timer, class Handlers>
+    inline bool RPC_Proactor<net::IoUringPoller, Timer, Handlers>::wait_ready(Operation & op)
+    {
+        int events = (op.kind == Op_Send) ? POLLOUT : POLLIN;
+        op.polling = true;
+        op.in_flight = m_poller.prep_poll(handle_of(op), events, &op);
+        return op.in_flight;
+    }
+
+    template<class Timer, class Handlers>
+    inline size_t RPC_Proactor<net::IoUringPoller, Timer, Handlers>::prepare_recv(Operation & op)
+    {
+        RPC_Message::Buffer_Sequence & bufseq = op.p_task->message().buffers();
+        RPC_Message::Buffer_Sequence::Iterator it = bufseq.latest();
+        size_t total_size = 0;
+        op.iov.resize(0);
+        for( ; it != bufseq.end(); ++it ) {
+            size_t s = it->limit() - it->size();
+            if ( s == 0 ) continue;
+            total_size += s;
+            op.iov.push_back(iovec{it->ptr(it->size()), s});
+        }
+        op.hdr.msg_iov = op.iov.empty() ? nullptr : &op.iov[0];
+        op.hdr.msg_iovlen = op.iov.size();
+        return total_size;
+    }
+
+    template<class Timer, class Handlers>
+    inline size_t RPC_Proactor<net::IoUringPoller, Timer, Handlers>::prepare_send(Operation & op)
+    {
+        // 与epoll实现一致从首个缓存开始，收到的消息(写入游标已在末尾)也可直接发送
+        RPC_Message::Buffer_Sequence & bufseq = op.p_task->message().buffers();
+        RPC_Message::Buffer_Sequence::Iterator it = bufseq.begin();
+        size_t total_size = 0;
+        op.iov.resize(0);
+        for( ; it != bufseq.end(); ++it ) {
+            size_t s = it->size() - it->position();
+            if ( s == 0 ) continue;
+            total_size += s;
+            op.iov.push_back(iovec{it->ptr(it->position()), s});
+        }
+        op.hdr.msg_iov = op.iov.empty() ? nullptr : &op.iov[0];
+        op.hdr.msg_iovlen = op.iov.size();
+        op.remain = total_size;
+        op.total = total_size;
+        return total_size;
+    }
+
+    // 部分发送后跳过已发送的n字节
+    template<class Timer, class Handlers>
+    inline void RPC_Proactor<net::IoUringPoller, Timer, Handlers>::advance_send(Operation & op, size_t n)
+    {
+        size_t idx = 0;
+        while ( n > 0 && idx < op.iov.size() ) {
+            if ( n >= op.iov[idx].iov_len ) {
+                n -= op.iov[idx].iov_len;
+                ++idx;
+            } else {
+                op.iov[idx].iov_base = (char *)op.iov[idx].iov_base + n;
+                op.iov[idx].iov_len -= n;
+                n = 0;
+            }
+        }
+        op.iov.erase(op.iov.begin(), op.iov.begin() + idx);
+        op.hdr.msg_iov = op.iov.empty() ? nullptr : &op.iov[0];
+        op.hdr.msg_iovlen = op.iov.size();
+    }
+
+    template<class Timer, class Handlers>
+    inline void RPC_Proactor<net::IoUringPoller, Timer, Handlers>::process_events()
+    {
+        typename net::IoUringPoller::Iterator iter = m_poller.events();
+        while ( iter.has_next() ) {
+            net::IoUringPoller::Event e = iter.next();
+            Operation * p_op = (Operation *)e.data();
+            if ( p_op == &m_cancel_op ) continue;
+            if ( p_op == &m_wakeup_op ) {
+                // 其它线程投递了新任务，清除通知即可，任务由RPC_Service在下一轮取出
+                m_notifier.reset();
+                ++m_io_calls;
+                this->arm_wakeup();
+                continue;
+            }
+            if ( p_op == &m_timer_op ) {
+                // 用户定时器到期，在本轮最后回调
+                m_timer_notifier.reset();
+                ++m_io_calls;
+                this->arm_timer();
+                continue;
+            }
+
+            Operation & op = *p_op;
+            if ( op.p_state->p_owner == nullptr ) {
+                this->on_closed_complete(op, e);
+                continue;
+            }
+            if ( op.polling ) {
+                // 等待的poll完成，重新提交原请求
+                op.polling = false;
+                op.in_flight = false;
+                if ( op.p_task ) this->resubmit(op);
+                else if ( op.kind == Op_Accept || op.kind == Op_Recv ) this->arm_read(op.p_state);
+                else this->arm_write(op.p_state);
+                continue;
+            }
+
+            if ( op.kind == Op_Accept ) this->on_accept_complete(op, e);
+            else if ( op.kind == Op_Recv ) this->on_recv_complete(op, e.res());
+            else if ( op.kind == Op_Send ) this->on_send_complete(op, e.res());
+            else if ( op.kind == Op_Connect ) this->on_connect_complete(op, e.res());
+            else {
+                EVEREST_LOG_ERROR("RPC_Proactor<IoUringPoller>::process_events, unknown op %d", op.kind);
+            }
+        }
+        EVEREST_LOG_TRACE("RPC_Proactor<IoUringPoller>::process_events");
+    }
+
+    template<class Timer, class Handlers>
+    inline void RPC_Proactor<net::IoUringPoller, Timer, Handlers>::on_accept_complete(
+        Operation & op, const net::IoUringPoller::Event & e)
+    {
+        if ( !e.more() ) op.in_flight = false;
+        int res = e.res();
+        RPC_SocketListener * p_listener = (RPC_SocketListener *)op.p_state->p_owner->get_socket();
+
+        if ( res == -EINVAL && op.multishot ) {
+            // 内核不支持multishot accept，改为每次提交单次accept
+            EVEREST_LOG_WARN("RPC_Proactor<IoUringPoller>::on_accept_complete, multishot accept unsupported");
+            m_multishot_accept = false;
+            op.in_flight = false;
+            this->arm_read(op.p_state);
+            return;
+        }
+        if ( res == -EAGAIN ) {
+            if ( !op.in_flight ) this->wait_ready(op);
+            return;
+        }
+        if ( op.p_task == nullptr ) {
+            // 接受任务已超时删除，请求已取消
+            if ( res >= 0 ) ::close(res);
+            if ( !op.in_flight ) this->arm_read(op.p_state);
+            return;
+        }
+        if ( res == -EMFILE || res == -ENFILE ) {
+            // 文件描述符用完，立即重新提交会一直失败，暂停后再提交
+            if ( !op.in_flight ) this->pause_accept(p_listener);
+            return;
+        }
+
+        if ( res < 0 ) {
+            EVEREST_LOG_ERROR("RPC_Proactor<IoUringPoller>::on_accept_complete, accept failed, %d, %s", -res, strerror(-res));
+            this->m_handlers.on_accept(p_listener, nullptr, RPC_Constants::Fail);
+        } else {
+            net::Socket        newsock(net::Protocol::tcp4(), false);
+            net::SocketAddress addr;
+            newsock.attach(res);
+            RPC_SocketChannel * p_channel = new RPC_SocketChannel(newsock, addr, true);   // accept带SOCK_NONBLOCK
+            ++m_io_calls;       // 构造时设置TCP_NODELAY
+            EVEREST_LOG_TRACE("RPC_Proactor<IoUringPoller>::on_accept_complete, listener %p, channel %p", p_listener, p_channel);
+            p_listener->note_accepted(p_channel);
+            int ret = this->m_handlers.on_accept(p_listener, p_channel, RPC_Constants::Ok);
+            if ( ret == RPC_Constants::Fail ) {
+                EVEREST_LOG_ERROR("RPC_Proactor<IoUringPoller>::on_accept_complete, call back return fail");
+                delete p_channel;
+            }
+        }
+        // 接受任务一直保留到超时，单次accept完成后重新提交
+        if ( !op.in_flight ) this->arm_read(op.p_state);
+    }
+
+    // 同EPoller版本，暂停FallbackType::Accept_Backoff后重新提交accept，每次暂停只记录一次日志
+    template<class Timer, class Handlers>
+    inline void RPC_Proactor<net::IoUringPoller, Timer, Handlers>::pause_accept(RPC_SocketListener * p_listener)
+    {
+        EVEREST_LOG_WARN("RPC_Proactor<IoUringPoller>::pause_accept, out of file descriptors, pause %ld us",
+            FallbackType::Accept_Backoff);
+        RPC_SocketObject * p_sock = p_listener;
+        m_user_timers.add(DateTime::get_monotonic_timestamp() + FallbackType::Accept_Backoff, 0, [this, p_sock]() {
+            OwnerState * p_state = this->find_state(p_sock);
+            if ( p_state ) this->arm_read(p_state);    // 已注销时不再提交
+        });
+    }
+
+    template<class Timer, class Handlers>
+    inline void RPC_Proactor<net::IoUringPoller, Timer, Handlers>::on_recv_complete(Operation & op, int res)
+    {
+        op.in_flight = false;
+        OwnerState * p_state = op.p_state;
+        if ( op.p_task == nullptr ) {
+            if ( op.timed_out ) this->finish_timeout(op, res);
+            this->arm_read(p_state);   // 任务已超时删除，继续下一个任务
+            return;
+        }
+        if ( res == -EAGAIN ) {
+            this->wait_ready(op);
+            return;
+        }
+
+        RPC_SocketChannel * p_channel = (RPC_SocketChannel *)p_state->p_owner->get_socket();
+        RPC_Message & r_msg = op.p_task->message();
+        if ( res <= 0 ) {
+            if ( res == 0 ) EVEREST_LOG_ERROR("RPC_Proactor<IoUringPoller>::on_recv_complete, connect reset by remote");
+            else EVEREST_LOG_ERROR("RPC_Proactor<IoUringPoller>::on_recv_complete, %d, %s", -res, strerror(-res));
+            this->m_handlers.on_receive(p_channel, r_msg, RPC_Constants::Fail);
+            m_task_timeout_queue.pop_front_task(p_state->p_owner, RPC_Constants::Read);
+            op.p_task = nullptr;
+            this->arm_read(p_state);
+            return;
+        }
+
+        EVEREST_LOG_TRACE("RPC_Proactor<IoUringPoller>::on_recv_complete, received %d", res);
+        r_msg.buffers().write_submit(res);
+        if ( this->prepare_recv(op) > 0 ) {
+            this->resubmit(op);     // 缓存未填满，继续接收
+            return;
+        }
+        this->finish_read(p_state);
+    }
+
+    // 接收缓存已填满，调用handler，Continue时按新增的缓存继续接收
+    template<class Timer, class Handlers>
+    inline void RPC_Proactor<net::IoUringPoller, Timer, Handlers>::finish_read(OwnerState * p_state)
+    {
+        Operation & op = p_state->read_op;
+        RPC_SocketChannel * p_channel = (RPC_SocketChannel *)p_state->p_owner->get_socket();
+        int r = this->m_handlers.on_receive(p_channel, op.p_task->message(), RPC_Constants::Ok);
+        if ( r == RPC_Constants::Continue && this->prepare_recv(op) > 0 ) {
+            EVEREST_LOG_TRACE("RPC_Proactor<IoUringPoller>::finish_read, continued");
+            this->resubmit(op);
+            return;
+        }
+        if ( r == RPC_Constants::Fail ) {
+            EVEREST_LOG_ERROR("RPC_Proactor<IoUringPoller>::finish_read, channel read fail");
+        }
+        m_task_timeout_queue.pop_front_task(p_state->p_owner, RPC_Constants::Read);
+        op.p_task = nullptr;
+        this->arm_read(p_state);
+    }
+
+    template<class Timer, class Handlers>
+    inline void RPC_Proactor<net::IoUringPoller, Timer, Handlers>::on_send_complete(Operation & op, int res)
+    {
+        op.in_flight = false;
+        OwnerState * p_state = op.p_state;
+        if ( op.p_task == nullptr ) {
+            if ( op.timed_out ) this->finish_timeout(op, res);
+            this->arm_write(p_state);
+            return;
+        }
+        if ( res == -EAGAIN ) {
+            this->wait_ready(op);
+            return;
+        }
+
+        RPC_SocketChannel * p_channel = (RPC_SocketChannel *)p_state->p_owner->get_socket();
+        RPC_Message & r_msg = op.p_task->message();
+        size_t bytes = r_msg.buffers().size();
+        if ( res < 0 ) {
+            EVEREST_LOG_ERROR("RPC_Proactor<IoUringPoller>::on_send_complete, %d, %s", -res, strerror(-res));
+            this->m_handlers.on_send(p_channel, r_msg, RPC_Constants::Fail);
+        } else if ( (size_t)res < op.remain ) {
+            EVEREST_LOG_TRACE("RPC_Proactor<IoUringPoller>::on_send_complete, part sent %d, remain %lu", res, op.remain);
+            op.remain -= res;
+            this->advance_send(op, res);
+            this->resubmit(op);
+            return;
+        } else {
+            EVEREST_LOG_TRACE("RPC_Proactor<IoUringPoller>::on_send_complete, %d bytes sent", res);
+            this->m_handlers.on_send(p_channel, r_msg, RPC_Constants::Ok);
+        }
+        m_task_timeout_queue.pop_front_task(p_state->p_owner, RPC_Constants::Write);
+        op.p_task = nullptr;
+        this->on_send_released(p_state, p_channel, bytes);
+        this->arm_write(p_state);
+    }
+
+    template<class Timer, class Handlers>
+    inline void RPC_Proactor<net::IoUringPoller, Timer, Handlers>::check_watermarks(OwnerState * p_state, RPC_SocketChannel * pch)
+    {
+        TaskOwner * p_owner = p_state->p_owner;
+        if ( !p_owner->read_paused() ) {
+            if ( !pch->above_high_mark() ) return;
+            EVEREST_LOG_DEBUG("RPC_Proactor<IoUringPoller>::check_watermarks, pause read, queued %lu", pch->queued_bytes());
+            p_owner->read_paused(true, DateTime::get_timestamp());
+            ++m_backpressure_count;
+        } else if ( pch->queued_bytes() <= pch->low_mark() ) {
+            EVEREST_LOG_DEBUG("RPC_Proactor<IoUringPoller>::check_watermarks, resume read, queued %lu", pch->queued_bytes());
+            m_backpressure_us += DateTime::get_timestamp() - p_owner->paused_since();
+            p_owner->read_paused(false, 0);
+            this->arm_read(p_state);
+        }
+    }
+
+    // 写任务已离开队列，扣除其字节数
+    template<class Timer, class Handlers>
+    inline void RPC_Proactor<net::IoUringPoller, Timer, Handlers>::on_send_released(OwnerState * p_state, RPC_SocketChannel * pch, size_t bytes)
+    {
+        bool drained = pch->release_send(bytes);
+        this->check_watermarks(p_state, pch);
+        if ( drained && m_drain_handler ) m_drain_handler(pch);
+    }
+
+    template<class Timer, class Handlers>
+    inline void RPC_Proactor<net::IoUringPoller, Timer, Handlers>::on_connect_complete(Operation & op, int res)
+    {
+        op.in_flight = false;
+        OwnerState * p_state = op.p_state;
+        if ( op.p_task == nullptr ) {
+            this->arm_write(p_state);
+            return;
+        }
+
+        RPC_SocketChannel * p_channel = (RPC_SocketChannel *)p_state->p_owner->get_socket();
+        if ( res < 0 || (res & (POLLERR | POLLHUP)) ) {
+            EVEREST_LOG_ERROR("RPC_Proactor<IoUringPoller>::on_connect_complete, connect failed, %d", res);
+            this->m_handlers.on_connect(p_channel, RPC_Constants::Fail);
+        } else {
+            p_channel->state(RPC_Constants::State_Connected);
+            EVEREST_LOG_TRACE("RPC_Proactor<IoUringPoller>::on_connect_complete, connected");
+            this->m_handlers.on_connect(p_channel, RPC_Constants::Ok);
+        }
+        m_task_timeout_queue.pop_front_task(p_state->p_owner, RPC_Constants::Write);
+        op.p_task = nullptr;
+        this->arm_write(p_state);
+        this->arm_read(p_state);    // 连接前投递的接收任务
+    }
+
+    template<class Timer, class Handlers>
+    inline void RPC_Proactor<net::IoUringPoller, Timer, Handlers>::clear_timeout_task()
+    {
+        struct TimeoutHandler {
+            RPC_Proactor * p_proactor;
+            void operator()(TaskOwner * p_owner, int type, RPC_Message &msg) {
+                p_proactor->on_task_timeout(p_owner, type, msg);
+            }
+        } handler = { this };
+
+        int64_t now = DateTime::get_timestamp();
+        size_t n = m_task_timeout_queue.expire(now, handler);
+        if ( n > 0 ) {
+            EVEREST_LOG_TRACE("RPC_Proactor<IoUringPoller>::clear_timeout_task, %lu tasks timeout", n);
+        }
+    }
+
+    // 任务超时，任务已从owner队列删除。该任务的收发请求仍在内核中时先取消，内核可能还在访问
+    // 消息缓存，等原请求的完成事件返回后再由finish_timeout回调handler
+    template<class Timer, class Handlers>
+    inline void RPC_Proactor<net::IoUringPoller, Timer, Handlers>::on_task_timeout(TaskOwner * p_owner, int type, RPC_Message &msg)
+    {
+        RPC_SocketObject * p_sock = p_owner->get_socket();
+        OwnerState * p_state = this->find_state(p_sock);
+        bool partial = false;
+        if ( p_state ) {
+            Operation & op = (type == RPC_Constants::Read) ? p_state->read_op : p_state->write_op;
+            Task * p_front = p_owner->has_task(type) ? p_owner->get_front_task(type) : nullptr;
+            if ( op.p_task != nullptr && op.p_task != p_front ) {     // 请求属于超时的任务
+                op.p_task = nullptr;
+                partial = (op.kind == Op_Send && op.remain < op.total);
+                if ( op.in_flight ) {
+                    m_poller.prep_cancel(&op, &m_cancel_op);
+                    if ( !op.polling && (op.kind == Op_Recv || op.kind == Op_Send) ) {
+                        op.timed_out = true;
+                        op.expired = msg;
+                        return;
+                    }
+                }
+            }
+        }
+        if ( type == RPC_Constants::Read && p_sock->type() == RPC_SocketObject::Type_Channel ) {
+            partial = msg.buffers().size() > 0;
+        }
+        this->notify_timeout(p_state, p_sock, type, msg, partial);
+    } // end of on_task_timeout
+
+    // 超时任务的请求已完成(已取消或已收发)，内核不再访问消息缓存。
+    // 已收到数据，或只发出了部分数据时，连接上的消息边界已无法恢复
+    template<class Timer, class Handlers>
+    inline void RPC_Proactor<net::IoUringPoller, Timer, Handlers>::finish_timeout(Operation & op, int res)
+    {
+        op.timed_out = false;
+        RPC_Message msg = op.expired;
+        op.expired = RPC_Message();
+        int  type = RPC_Constants::Write;
+        bool partial = false;
+        if ( op.kind == Op_Recv ) {
+            type = RPC_Constants::Read;
+            partial = msg.buffers().size() > 0 || res > 0;
+        } else {
+            size_t sent = op.total - op.remain + (res > 0 ? (size_t)res : 0);
+            partial = sent > 0 && sent < op.total;
+        }
+        this->notify_timeout(op.p_state, op.p_state->p_owner->get_socket(), type, msg, partial);
+    }
+
+    template<class Timer, class Handlers>
+    inline void RPC_Proactor<net::IoUringPoller, Timer, Handlers>::notify_timeout(
+        OwnerState * p_state, RPC_SocketObject * p_sock, int type, RPC_Message &msg, bool partial)
+    {
+        if ( p_sock->type() == RPC_SocketObject::Type_Listener ) {
+            EVEREST_LOG_WARN("RPC_Proactor<IoUringPoller>::on_task_timeout, accept timeout");
+            this->m_handlers.on_accept((RPC_SocketListener *)p_sock, nullptr, RPC_Constants::Timeout);
+            return;
+        }
+        RPC_SocketChannel * p_channel = (RPC_SocketChannel *)p_sock;
+        if ( type == RPC_Constants::Read ) {
+            EVEREST_LOG_WARN("RPC_Proactor<IoUringPoller>::on_task_timeout, read timeout");
+            this->m_handlers.on_receive(p_channel, msg, RPC_Constants::Timeout);
+        } else if ( p_channel->state() == RPC_Constants::State_Connecting ) {
+            EVEREST_LOG_WARN("RPC_Proactor<IoUringPoller>::on_task_timeout, connect timeout");
+            this->m_handlers.on_connect(p_channel, RPC_Constants::Timeout);
+        } else {
+            EVEREST_LOG_WARN("RPC_Proactor<IoUringPoller>::on_task_timeout, write timeout");
+            size_t bytes = msg.buffers().size();
+            this->m_handlers.on_send(p_channel, msg, RPC_Constants::Timeout);
+            if ( p_state ) this->on_send_released(p_state, p_channel, bytes);
+        }
+        if ( partial ) this->fail_channel(p_channel);
+    } // end of notify_timeout
+
+    // 关闭socket的收发，对端收到EOF而不是错位的消息；已投递的任务在各自的请求完成时
+    // (EOF/EPIPE)以Fail结束，由handler关闭channel
+    template<class Timer, class Handlers>
+    inline void RPC_Proactor<net::IoUringPoller, Timer, Handlers>::fail_channel(RPC_SocketChannel * pch)
+    {
+        EVEREST_LOG_ERROR("RPC_Proactor<IoUringPoller>::fail_channel, %d", pch->get_socket().handle());
+        ::shutdown(pch->get_socket().handle(), SHUT_RDWR);
+    }
+
+} // end of namespace rpc
+} // end of namespace everest
+
+#endif // INCLUDE_EVEREST_RPC_RPC_URING_PROACTOR_H
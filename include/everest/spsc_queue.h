@@ -0,0 +1,83 @@
+#ifndef INCLUDE_EVEREST_SPSC_QUEUE_H
+#define INCLUDE_EVEREST_SPSC_QUEUE_H
+
+#pragma once
+
+#include <stddef.h>
+#include <atomic>
+#include <utility>
+
+namespace everest
+{
+    /**
+     * 有界无锁单生产者单消费者环形队列
+     * push只能由唯一的生产者线程调用，pop只能由唯一的消费者线程调用。
+     * 容量向上取整到2的幂；两端各缓存对方的位置，只在看似满/空时才读取对方的原子变量。
+     * 两端的位置之间用整个缓存行填充隔开，不依赖对象的对齐，可直接new或放在栈上。
+     */
+    template<class T>
+    class SPSC_Queue final
+    {
+    private:
+        static const size_t Cache_Line = 64;
+
+        T *                 m_slots;
+        size_t              m_mask;
+        char                m_pad0[Cache_Line];
+        std::atomic<size_t> m_head;             // 消费者读取位置
+        size_t              m_cached_tail;      // 消费者缓存的写入位置
+        char                m_pad1[Cache_Line];
+        std::atomic<size_t> m_tail;             // 生产者写入位置
+        size_t              m_cached_head;      // 生产者缓存的读取位置
+        char                m_pad2[Cache_Line];
+
+    private:
+        SPSC_Queue(const SPSC_Queue&) = delete;
+        SPSC_Queue& operator=(const SPSC_Queue&) = delete;
+
+    public:
+        explicit SPSC_Queue(size_t capacity)
+            : m_head(0), m_cached_tail(0), m_tail(0), m_cached_head(0)
+        {
+            size_t n = 2;
+            while ( n < capacity ) n <<= 1;
+            m_slots = new T[n];
+            m_mask = n - 1;
+        }
+
+        ~SPSC_Queue() { delete[] m_slots; }
+
+        size_t capacity() const { return m_mask + 1; }
+
+        // 队列满时返回false
+        bool push(const T &value) {
+            size_t tail = m_tail.load(std::memory_order_relaxed);
+            if ( tail - m_cached_head > m_mask ) {
+                m_cached_head = m_head.load(std::memory_order_acquire);
+                if ( tail - m_cached_head > m_mask ) return false;
+            }
+            m_slots[tail & m_mask] = value;
+            m_tail.store(tail + 1, std::memory_order_release);
+            return true;
+        }
+
+        // 队列为空时返回false
+        bool pop(T &value) {
+            size_t head = m_head.load(std::memory_order_relaxed);
+            if ( head == m_cached_tail ) {
+                m_cached_tail = m_tail.load(std::memory_order_acquire);
+                if ( head == m_cached_tail ) return false;
+            }
+            value = std::move(m_slots[head & m_mask]);
+            m_head.store(head + 1, std::memory_order_release);
+            return true;
+        }
+
+        bool empty() const {
+            return m_head.load(std::memory_order_acquire) == m_tail.load(std::memory_order_acquire);
+        }
+    }; // end of class SPSC_Queue
+
+} // end of namespace everest
+
+#endif // INCLUDE_EVEREST_SPSC_QUEUE_H
@@ -0,0 +1,241 @@
+#ifndef INCLUDE_EVEREST_THREAD_GROUP_H
+#define INCLUDE_EVEREST_THREAD_GROUP_H
+
+#pragma once
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <everest/log.h>
+
+namespace everest
+{
+    /**
+     * 解析cpu列表，如"0-3,8,10-11"，结果按出现顺序追加到cpus；格式错误返回false
+     */
+    inline bool parse_cpu_list(const char * text, std::vector<int> &cpus)
+    {
+        const char * p = text;
+        while ( *p ) {
+            char * end = nullptr;
+            long first = strtol(p, &end, 10);
+            if ( end == p || first < 0 ) return false;
+            long last = first;
+            p = end;
+            if ( *p == '-' ) {
+                ++p;
+                last = strtol(p, &end, 10);
+                if ( end == p || last < first ) return false;
+                p = end;
+            }
+            for(long cpu = first; cpu <= last; ++cpu ) cpus.push_back((int)cpu);
+            if ( *p == ',' ) ++p;
+            else if ( *p != '\0' ) return false;
+        }
+        return true;
+    }
+
+    namespace detail
+    {
+        // 读取文件第一行的两个数，"max"按-1处理，返回读到的个数
+        inline int read_cgroup_values(const std::string &path, long &v1, long &v2)
+        {
+            FILE * fp = fopen(path.c_str(), "r");
+            if ( fp == nullptr ) return 0;
+            char buf[128] = { 0 };
+            char * line = fgets(buf, sizeof(buf), fp);
+            fclose(fp);
+            if ( line == nullptr ) return 0;
+            char first[64] = { 0 };
+            int n = sscanf(buf, "%63s %ld", first, &v2);
+            if ( n < 1 ) return 0;
+            v1 = (strcmp(first, "max") == 0) ? -1 : atol(first);
+            return n;
+        }
+
+        // /proc/self/cgroup中controller所在的路径，cgroup v2的controller为空串
+        inline std::string cgroup_path(const char * controller)
+        {
+            FILE * fp = fopen("/proc/self/cgroup", "r");
+            if ( fp == nullptr ) return std::string();
+            std::string path;
+            char line[512];
+            while ( fgets(line, sizeof(line), fp) != nullptr ) {
+                char * names = strchr(line, ':');
+                if ( names == nullptr ) continue;
+                char * rel = strchr(++names, ':');
+                if ( rel == nullptr ) continue;
+                *rel++ = '\0';
+                rel[strcspn(rel, "\n")] = '\0';
+                bool match = (controller[0] == '\0') ? (names[0] == '\0') : false;
+                char * save = nullptr;
+                for(char * name = strtok_r(names, ",", &save); !match && name != nullptr; name = strtok_r(nullptr, ",", &save) ) {
+                    match = (strcmp(name, controller) == 0);
+                }
+                if ( match ) {
+                    path = (strcmp(rel, "/") == 0) ? std::string() : std::string(rel);
+                    break;
+                }
+            }
+            fclose(fp);
+            return path;
+        }
+    } // end of namespace detail
+
+    /**
+     * 进程所在cgroup的cpu配额(可用的cpu数，可以是小数)，没有限制时返回0。
+     * 先查cgroup v2的cpu.max，再查v1的cpu.cfs_quota_us/cpu.cfs_period_us；
+     * 容器内cgroup命名空间的路径为"/"，也查挂载点根目录
+     */
+    inline double cgroup_cpu_quota()
+    {
+        long quota = 0, period = 0;
+        std::string v2 = detail::cgroup_path("");
+        if ( detail::read_cgroup_values("/sys/fs/cgroup" + v2 + "/cpu.max", quota, period) == 2
+            || detail::read_cgroup_values("/sys/fs/cgroup/cpu.max", quota, period) == 2 ) {
+            return (quota > 0 && period > 0) ? (double)quota / period : 0;
+        }
+        std::string v1 = detail::cgroup_path("cpu");
+        const char * dirs[2] = { "/sys/fs/cgroup/cpu", "/sys/fs/cgroup/cpu,cpuacct" };
+        for(int i = 0; i < 2; ++i ) {
+            std::string base[2] = { std::string(dirs[i]) + v1, std::string(dirs[i]) };
+            for(int j = 0; j < 2; ++j ) {
+                long unused = 0;
+                if ( detail::read_cgroup_values(base[j] + "/cpu.cfs_quota_us", quota, unused) >= 1
+                    && detail::read_cgroup_values(base[j] + "/cpu.cfs_period_us", period, unused) >= 1 ) {
+                    return (quota > 0 && period > 0) ? (double)quota / period : 0;
+                }
+            }
+        }
+        return 0;
+    }
+
+    /**
+     * 进程实际可用的cpu数: 亲和性掩码中的cpu数，再受cgroup配额限制(向上取整)，至少为1。
+     * 用于默认的线程数，容器中不按宿主机的cpu数创建线程
+     */
+    inline size_t available_cpus()
+    {
+        size_t n = 0;
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        if ( ::sched_getaffinity(0, sizeof(set), &set) == 0 ) n = CPU_COUNT(&set);
+        if ( n == 0 ) {
+            long online = ::sysconf(_SC_NPROCESSORS_ONLN);
+            n = online > 0 ? (size_t)online : 1;
+        }
+        double quota = cgroup_cpu_quota();
+        if ( quota > 0 ) {
+            size_t limit = (size_t)quota;
+            if ( (double)limit < quota ) ++limit;
+            if ( limit < n ) n = limit;
+        }
+        return n > 0 ? n : 1;
+    }
+
+    /**
+     * 命名线程组
+     * 第i个线程命名为"name-i"(超过15字节截断)，cpus非空时绑定到cpus[i % cpus.size()]。
+     * 可以用start直接启动线程，也可以把线程组交给RPC_ServiceGroup、Work_Stealing_Executor，
+     * 由它们在自己的线程中调用bind(i)
+     */
+    class Thread_Group final
+    {
+    public:
+        typedef std::function<void (size_t)> Procedure;
+
+    private:
+        std::string              m_name;
+        size_t                   m_size;
+        std::vector<int>         m_cpus;
+        std::vector<std::thread> m_threads;
+
+    private:
+        Thread_Group(const Thread_Group&) = delete;
+        Thread_Group& operator=(const Thread_Group&) = delete;
+
+    public:
+        // threads为0时取cpus的个数，cpus也为空时取available_cpus()
+        explicit Thread_Group(const std::string &name, size_t threads = 0, const std::vector<int> &cpus = std::vector<int>())
+            : m_name(name), m_size(threads), m_cpus(cpus)
+        {
+            if ( m_size == 0 ) m_size = m_cpus.empty() ? available_cpus() : m_cpus.size();
+        }
+
+        ~Thread_Group() { this->join(); }
+
+        const std::string &      name() const { return m_name; }
+        size_t                   size() const { return m_size; }
+        const std::vector<int> & cpus() const { return m_cpus; }
+
+        // 第idx个线程绑定的cpu，-1为不绑定
+        int cpu(size_t idx) const { return m_cpus.empty() ? -1 : m_cpus[idx % m_cpus.size()]; }
+
+        // 在第idx个线程中调用，设置线程名和cpu亲和性
+        bool bind(size_t idx) const;
+
+        // 启动size()个线程，各自bind后执行proc(i)；已启动时返回false
+        bool start(const Procedure &proc);
+
+        bool started() const { return !m_threads.empty(); }
+
+        void join() {
+            for(size_t i = 0; i < m_threads.size(); ++i ) {
+                if ( m_threads[i].joinable() ) m_threads[i].join();
+            }
+            m_threads.clear();
+        }
+    }; // end of class Thread_Group
+
+    inline bool Thread_Group::bind(size_t idx) const
+    {
+        char name[16];
+        snprintf(name, sizeof(name), "%s-%lu", m_name.c_str(), idx);
+        bool isok = true;
+        int ret = ::pthread_setname_np(::pthread_self(), name);
+        if ( ret != 0 ) {
+            EVEREST_LOG_WARN("Thread_Group::bind, set name %s failed, %d", name, ret);
+            isok = false;
+        }
+
+        int cpu = this->cpu(idx);
+        if ( cpu >= 0 ) {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(cpu, &set);
+            ret = ::pthread_setaffinity_np(::pthread_self(), sizeof(set), &set);
+            if ( ret != 0 ) {
+                EVEREST_LOG_ERROR("Thread_Group::bind, %s bind cpu %d failed, %d, %s", name, cpu, ret, strerror(ret));
+                isok = false;
+            }
+        }
+        return isok;
+    }
+
+    inline bool Thread_Group::start(const Procedure &proc)
+    {
+        if ( !m_threads.empty() ) {
+            EVEREST_LOG_ERROR("Thread_Group::start, %s already started", m_name.c_str());
+            return false;
+        }
+        m_threads.reserve(m_size);
+        for(size_t i = 0; i < m_size; ++i ) {
+            m_threads.push_back(std::thread([this, proc, i]() {
+                this->bind(i);
+                proc(i);
+            }));
+        }
+        return true;
+    }
+
+} // end of namespace everest
+
+#endif // INCLUDE_EVEREST_THREAD_GROUP_H
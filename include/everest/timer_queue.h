@@ -0,0 +1,376 @@
+#ifndef INCLUDE_EVEREST_TIMER_QUEUE_H
+#define INCLUDE_EVEREST_TIMER_QUEUE_H
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <map>
+
+#include <everest/date_time.h>
+
+namespace everest
+{
+    /**
+     * 定时节点，嵌入到需要超时管理的对象中，由定时队列以侵入方式链接
+     */
+    class Timer_Node
+    {
+        friend class Multimap_Timer_Queue;
+        friend class Timing_Wheel;
+
+    public:
+        static const int64_t Max_Expire_Time = INT64_MAX;
+
+    protected:
+        int64_t      m_expire_time;   // 超时时间戳(us)
+        Timer_Node * m_prev;
+        Timer_Node * m_next;
+        int          m_slot;          // 所在的时间轮槽位，Slot_None表示未加入队列
+
+        static const int Slot_None    = -1;
+        static const int Slot_Linked  = -2;    // 已加入multimap或待触发链表
+
+    public:
+        explicit Timer_Node(int64_t exp = Max_Expire_Time)
+            : m_expire_time(exp), m_prev(nullptr), m_next(nullptr), m_slot(Slot_None) {}
+
+        // 复制时仅复制超时时间，链接关系不复制
+        Timer_Node(const Timer_Node &other)
+            : m_expire_time(other.m_expire_time), m_prev(nullptr), m_next(nullptr), m_slot(Slot_None) {}
+
+        Timer_Node & operator=(const Timer_Node &other) {
+            m_expire_time = other.m_expire_time;
+            return *this;
+        }
+
+        int64_t expire_time() const { return m_expire_time; }
+        void    expire_time(int64_t exp) { m_expire_time = exp; }
+
+        bool    linked() const { return m_slot != Slot_None; }
+    }; // end of class Timer_Node
+
+    /**
+     * 基于std::multimap的定时队列，插入和取消为O(log n)
+     */
+    class Multimap_Timer_Queue
+    {
+    private:
+        typedef std::multimap<int64_t, Timer_Node *> TimerMap;
+
+        TimerMap m_map;
+
+    private:
+        Multimap_Timer_Queue(const Multimap_Timer_Queue&) = delete;
+        Multimap_Timer_Queue& operator=(const Multimap_Timer_Queue&) = delete;
+
+    public:
+        // 参数与Timing_Wheel的构造函数一致，便于作为模板参数互换，不使用
+        explicit Multimap_Timer_Queue(int64_t = DateTime::get_timestamp()) {}
+
+        bool   empty() const { return m_map.empty(); }
+        size_t size() const { return m_map.size(); }
+
+        void add(Timer_Node * p_node) {
+            m_map.insert(TimerMap::value_type(p_node->m_expire_time, p_node));
+            p_node->m_slot = Timer_Node::Slot_Linked;
+        }
+
+        void cancel(Timer_Node * p_node) {
+            if ( !p_node->linked() ) return;
+            std::pair<TimerMap::iterator, TimerMap::iterator> range = m_map.equal_range(p_node->m_expire_time);
+            for(TimerMap::iterator it = range.first; it != range.second; ++it ) {
+                if ( it->second == p_node ) {
+                    m_map.erase(it);
+                    break;
+                }
+            }
+            p_node->m_slot = Timer_Node::Slot_None;
+        }
+
+        // 最早的超时时间，队列为空时返回Max_Expire_Time
+        int64_t next_expire_time() const {
+            if ( m_map.empty() ) return Timer_Node::Max_Expire_Time;
+            return m_map.begin()->first;
+        }
+
+        // 取出所有已超时的节点并逐个调用handler(Timer_Node*)，返回触发数量
+        template<class Handler>
+        size_t expire(int64_t now, Handler &handler) {
+            size_t count = 0;
+            while ( !m_map.empty() && m_map.begin()->first <= now ) {
+                Timer_Node * p_node = m_map.begin()->second;
+                m_map.erase(m_map.begin());
+                p_node->m_slot = Timer_Node::Slot_None;
+                handler(p_node);
+                ++count;
+            }
+            return count;
+        }
+    }; // end of class Multimap_Timer_Queue
+
+    /**
+     * 分层时间轮
+     * 4层，每层256个槽，第0层每槽一个tick(默认1ms)，可覆盖2^32个tick，更远的超时
+     * 先放在最高层，到期时按实际超时时间重新插入。插入和取消为O(1)，推进时按位图
+     * 跳过空槽，同一tick到期的节点批量触发。
+     */
+    class Timing_Wheel
+    {
+    public:
+        static const int Level_Bits  = 8;
+        static const int Level_Slots = 1 << Level_Bits;
+        static const int Levels      = 4;
+
+    private:
+        static const int Slot_Mask   = Level_Slots - 1;
+        static const int Bitmap_Words = Level_Slots / 64;
+
+        Timer_Node m_slots[Levels][Level_Slots];        // 各槽链表的哨兵节点
+        uint64_t   m_bitmap[Levels][Bitmap_Words];      // 非空槽位图
+        Timer_Node m_due;                               // 插入时已到期的节点
+        int64_t    m_tick_us;
+        int64_t    m_current;                           // 已处理到的tick
+        size_t     m_count;
+
+    private:
+        Timing_Wheel(const Timing_Wheel&) = delete;
+        Timing_Wheel& operator=(const Timing_Wheel&) = delete;
+
+    public:
+        explicit Timing_Wheel(int64_t now = DateTime::get_timestamp(), int64_t tick_us = 1000);
+
+        bool    empty() const { return m_count == 0; }
+        size_t  size() const { return m_count; }
+        int64_t tick() const { return m_tick_us; }
+
+        void    add(Timer_Node * p_node);
+        void    cancel(Timer_Node * p_node);
+
+        // 下一个可能有节点到期的时间，可能早于实际最早超时，但不会晚于
+        int64_t next_expire_time() const;
+
+        template<class Handler>
+        size_t  expire(int64_t now, Handler &handler);
+
+    private:
+        static void list_init(Timer_Node * p_head) {
+            p_head->m_prev = p_head;
+            p_head->m_next = p_head;
+        }
+
+        static bool list_empty(const Timer_Node * p_head) { return p_head->m_next == p_head; }
+
+        static void list_push(Timer_Node * p_head, Timer_Node * p_node) {
+            p_node->m_prev = p_head->m_prev;
+            p_node->m_next = p_head;
+            p_head->m_prev->m_next = p_node;
+            p_head->m_prev = p_node;
+        }
+
+        static void list_unlink(Timer_Node * p_node) {
+            p_node->m_prev->m_next = p_node->m_next;
+            p_node->m_next->m_prev = p_node->m_prev;
+            p_node->m_prev = nullptr;
+            p_node->m_next = nullptr;
+        }
+
+        // 把p_from链表整体移到p_to(p_to须为空)
+        static void list_splice(Timer_Node * p_from, Timer_Node * p_to) {
+            if ( list_empty(p_from) ) return;
+            p_to->m_next = p_from->m_next;
+            p_to->m_prev = p_from->m_prev;
+            p_to->m_next->m_prev = p_to;
+            p_to->m_prev->m_next = p_to;
+            list_init(p_from);
+        }
+
+        int64_t to_tick(int64_t t) const {
+            if ( t >= Timer_Node::Max_Expire_Time - m_tick_us ) return Timer_Node::Max_Expire_Time / m_tick_us;
+            return (t + m_tick_us - 1) / m_tick_us;   // 向上取整，保证不提前触发
+        }
+
+        void set_bit(int level, int idx)   { m_bitmap[level][idx >> 6] |= (1ULL << (idx & 63)); }
+        void clear_bit(int level, int idx) { m_bitmap[level][idx >> 6] &= ~(1ULL << (idx & 63)); }
+
+        // level层中[from, Level_Slots)范围内第一个非空槽，没有返回-1
+        int  find_slot(int level, int from) const;
+
+        void place(Timer_Node * p_node);
+        void cascade(int level);
+
+        template<class Handler>
+        size_t fire(Timer_Node * p_head, int64_t now, Handler &handler);
+    }; // end of class Timing_Wheel
+
+    inline Timing_Wheel::Timing_Wheel(int64_t now, int64_t tick_us)
+        : m_tick_us(tick_us > 0 ? tick_us : 1000), m_count(0)
+    {
+        for(int l = 0; l < Levels; ++l ) {
+            for(int i = 0; i < Level_Slots; ++i ) {
+                list_init(&m_slots[l][i]);
+                m_slots[l][i].m_slot = l * Level_Slots + i;
+            }
+            for(int w = 0; w < Bitmap_Words; ++w ) m_bitmap[l][w] = 0;
+        }
+        list_init(&m_due);
+        m_current = now / m_tick_us;
+    }
+
+    inline void Timing_Wheel::add(Timer_Node * p_node)
+    {
+        if ( p_node->linked() ) this->cancel(p_node);
+        this->place(p_node);
+        ++m_count;
+    }
+
+    inline void Timing_Wheel::place(Timer_Node * p_node)
+    {
+        int64_t expire = this->to_tick(p_node->m_expire_time);
+        int64_t delta  = expire - m_current;
+        if ( delta <= 0 ) {
+            list_push(&m_due, p_node);
+            p_node->m_slot = Timer_Node::Slot_Linked;
+            return;
+        }
+
+        int level = 0;
+        if ( delta >= (1LL << (Level_Bits * Levels)) ) {
+            // 超出时间轮范围，放在最高层最远处，到期后重新放置
+            expire = m_current + (1LL << (Level_Bits * Levels)) - 1;
+            level = Levels - 1;
+        } else {
+            while ( delta >= (1LL << (Level_Bits * (level + 1))) ) ++level;
+        }
+
+        int idx = (int)((expire >> (Level_Bits * level)) & Slot_Mask);
+        list_push(&m_slots[level][idx], p_node);
+        p_node->m_slot = level * Level_Slots + idx;
+        this->set_bit(level, idx);
+    }
+
+    inline void Timing_Wheel::cancel(Timer_Node * p_node)
+    {
+        int slot = p_node->m_slot;
+        if ( slot == Timer_Node::Slot_None ) return;
+
+        list_unlink(p_node);
+        p_node->m_slot = Timer_Node::Slot_None;
+        --m_count;
+
+        if ( slot >= 0 ) {
+            int level = slot / Level_Slots;
+            int idx   = slot % Level_Slots;
+            if ( list_empty(&m_slots[level][idx]) ) this->clear_bit(level, idx);
+        }
+    }
+
+    inline int Timing_Wheel::find_slot(int level, int from) const
+    {
+        for(int w = from >> 6; w < Bitmap_Words; ++w ) {
+            uint64_t bits = m_bitmap[level][w];
+            if ( w == (from >> 6) ) bits &= (~0ULL << (from & 63));
+            if ( bits ) return (w << 6) + __builtin_ctzll(bits);
+        }
+        return -1;
+    }
+
+    inline int64_t Timing_Wheel::next_expire_time() const
+    {
+        if ( m_count == 0 ) return Timer_Node::Max_Expire_Time;
+        if ( !list_empty(&m_due) ) return m_current * m_tick_us;
+
+        // 本轮第0层中的下一个非空槽，否则为下一次层间迁移的时刻
+        int64_t boundary = (m_current | Slot_Mask) + 1;
+        int from = (int)((m_current + 1) & Slot_Mask);
+        int idx = (from == 0) ? -1 : this->find_slot(0, from);
+        if ( idx >= 0 ) return (boundary - Level_Slots + idx) * m_tick_us;
+        return boundary * m_tick_us;
+    }
+
+    inline void Timing_Wheel::cascade(int level)
+    {
+        int idx = (int)((m_current >> (Level_Bits * level)) & Slot_Mask);
+        Timer_Node head;
+        list_init(&head);
+        list_splice(&m_slots[level][idx], &head);
+        this->clear_bit(level, idx);
+
+        while ( !list_empty(&head) ) {
+            Timer_Node * p_node = head.m_next;
+            list_unlink(p_node);
+            this->place(p_node);
+        }
+    }
+
+    template<class Handler>
+    inline size_t Timing_Wheel::fire(Timer_Node * p_head, int64_t now, Handler &handler)
+    {
+        // 先摘到局部链表再逐个触发，handler中可以安全地增删其它节点
+        Timer_Node pending;
+        list_init(&pending);
+        list_splice(p_head, &pending);
+
+        size_t count = 0;
+        while ( !list_empty(&pending) ) {
+            Timer_Node * p_node = pending.m_next;
+            list_unlink(p_node);
+            if ( p_node->m_expire_time > now ) {
+                // 超出时间轮范围的节点，重新放置
+                p_node->m_slot = Timer_Node::Slot_None;
+                this->place(p_node);
+                continue;
+            }
+            p_node->m_slot = Timer_Node::Slot_None;
+            --m_count;
+            handler(p_node);
+            ++count;
+        }
+        return count;
+    }
+
+    template<class Handler>
+    inline size_t Timing_Wheel::expire(int64_t now, Handler &handler)
+    {
+        int64_t target = now / m_tick_us;
+        size_t  count = 0;
+
+        if ( !list_empty(&m_due) ) count += this->fire(&m_due, now, handler);
+
+        while ( m_current < target ) {
+            if ( m_count == 0 ) {
+                m_current = target;
+                break;
+            }
+
+            // 跳过第0层的空槽，直到下一个非空槽或下一次层间迁移
+            int64_t boundary = (m_current | Slot_Mask) + 1;
+            int from = (int)((m_current + 1) & Slot_Mask);
+            int idx = (from == 0) ? -1 : this->find_slot(0, from);
+            int64_t next = (idx >= 0) ? (boundary - Level_Slots + idx) : boundary;
+            if ( next > target ) {
+                m_current = target;
+                break;
+            }
+            m_current = next;
+
+            if ( (m_current & Slot_Mask) == 0 ) {
+                // 高层先迁移，迁移下来的节点可能落入低层当前槽
+                int top = 1;
+                while ( top < Levels - 1 && ((m_current >> (Level_Bits * top)) & Slot_Mask) == 0 ) ++top;
+                for(int level = top; level >= 1; --level ) this->cascade(level);
+            }
+
+            int cur = (int)(m_current & Slot_Mask);
+            if ( !list_empty(&m_slots[0][cur]) ) {
+                this->clear_bit(0, cur);
+                count += this->fire(&m_slots[0][cur], now, handler);
+            }
+            if ( !list_empty(&m_due) ) count += this->fire(&m_due, now, handler);
+        }
+        return count;
+    } // end of Timing_Wheel::expire
+
+} // end of namespace everest
+
+#endif // INCLUDE_EVEREST_TIMER_QUEUE_H
@@ -1,4 +1,5 @@
 #include <everest/application.h>
+#include <stdlib.h>
 #include <string.h>
 #include <iostream>
 
@@ -36,7 +37,10 @@ namespace everest
         } // end for 
     } // end of Application()
     
-    Application :: ~Application () {}
+    Application :: ~Application () 
+    {
+        delete m_ctx;
+    }
     
     void Application::run(PFN_MAIN proc) 
     {
@@ -50,6 +54,41 @@ namespace everest
         , m_rsignals(0)
     {}
     
-    ApplicationContext :: ~ApplicationContext() {}
+    const char * const ApplicationContext::Group_IO         = "io";
+    const char * const ApplicationContext::Group_Worker     = "worker";
+    const char * const ApplicationContext::Group_Background = "background";
+    
+    ApplicationContext :: ~ApplicationContext() 
+    {
+        std::map<String, Thread_Group *>::iterator it = m_thread_groups.begin();
+        for(; it != m_thread_groups.end(); ++it ) delete it->second;     // 等待已启动的线程结束
+        m_thread_groups.clear();
+    }
+    
+    Thread_Group & ApplicationContext::thread_group(const char * name)
+    {
+        std::map<String, Thread_Group *>::iterator it = m_thread_groups.find(name);
+        if ( it != m_thread_groups.end() ) return *it->second;
+        
+        String prefix(name);
+        String threads_str = m_props.get((prefix + "-threads").c_str());
+        String cpus_str    = m_props.get((prefix + "-cpus").c_str());
+        
+        size_t threads = threads_str.empty() ? 0 : (size_t)atol(threads_str.c_str());
+        std::vector<int> cpus;
+        if ( !cpus_str.empty() && !parse_cpu_list(cpus_str.c_str(), cpus) ) {
+            EVEREST_LOG_ERROR("ApplicationContext::thread_group, bad cpu list --%s-cpus=%s", name, cpus_str.c_str());
+            cpus.clear();
+        }
+        if ( threads == 0 && cpus.empty() && prefix != Group_IO && prefix != Group_Worker ) {
+            threads = 1;
+        }
+        
+        Thread_Group * p_group = new Thread_Group(prefix, threads, cpus);
+        m_thread_groups[prefix] = p_group;
+        EVEREST_LOG_INFO("ApplicationContext::thread_group, %s, threads %lu, cpus %lu", 
+            name, p_group->size(), cpus.size());
+        return *p_group;
+    }
     
 } // end of namespace everest 
\ No newline at end of file
@@ -0,0 +1,198 @@
+#include <everest/rpc/RPC_Server.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+/**
+ * 大消息吞吐测试: 客户端经回环地址逐个发送1MB到max_mb(默认1024MB)的消息，每次大小乘4，
+ * 服务端收完整个消息后回一个只有消息头的应答。统计发送到收到应答的耗时和吞吐。
+ * 用法: bulk_bench [max_mb] [batch_kb] > /dev/null
+ * batch_kb为每次sendmsg合并的字节数上限(默认使用proactor的默认值)。
+ * 消息体由多个Chunk_Size的缓存组成，两端的缓存都重复指向同一块内存，只测试传输本身。
+ */
+
+namespace rpc = everest::rpc;
+
+#define BULK_BENCH_ENDPOINT   "127.0.0.1:9991"
+
+static const size_t Chunk_Size = 4 * 1024 * 1024;
+static const size_t Header_Length = rpc::RPC_Message::Header_Length;
+
+static int64_t now_ns()
+{
+    struct timespec ts;
+    ::clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// 消息头之后追加覆盖body_size字节的缓存，都指向chunk
+static void push_body(everest::Mutable_Buffer_Sequence &seq, char *chunk, size_t body_size, bool filled)
+{
+    while ( body_size > 0 ) {
+        size_t n = body_size < Chunk_Size ? body_size : Chunk_Size;
+        everest::Mutable_Byte_Buffer buf(chunk, n);
+        if ( filled ) buf.size(n);
+        seq.push_back(buf);
+        body_size -= n;
+    }
+}
+
+std::atomic<bool> server_running(true);
+std::atomic<bool> server_ready(false);
+
+class Bulk_Receiver
+{
+private:
+    char *                           m_header;
+    char *                           m_chunk;
+    char *                           m_ack_data;
+    everest::Mutable_Buffer_Sequence m_recv_seq;
+    everest::Mutable_Buffer_Sequence m_ack_seq;
+
+public:
+    Bulk_Receiver() : m_header(new char[Header_Length]), m_chunk(new char[Chunk_Size]), m_ack_data(new char[Header_Length]) {
+        m_ack_seq.push_back(everest::Mutable_Byte_Buffer(m_ack_data, Header_Length));
+        rpc::RPC_Message ack(m_ack_seq);
+        ack.init_header();
+        ack.update_header();
+    }
+
+    ~Bulk_Receiver() {
+        delete[] m_header;
+        delete[] m_chunk;
+        delete[] m_ack_data;
+    }
+
+    rpc::RPC_Message recv_message() {
+        m_recv_seq.clear();
+        m_recv_seq.push_back(everest::Mutable_Byte_Buffer(m_header, Header_Length));
+        return rpc::RPC_Message(m_recv_seq);
+    }
+
+    rpc::RPC_Message ack_message() { return rpc::RPC_Message(m_ack_seq); }
+
+    // 收到消息头后按长度追加消息体缓存
+    int on_receive(rpc::RPC_Message &msg) {
+        everest::Mutable_Buffer_Sequence & buffers = msg.buffers();
+        if ( buffers.size() == Header_Length && msg.size() > Header_Length ) {
+            push_body(buffers, m_chunk, msg.size() - Header_Length, false);
+            return rpc::RPC_Constants::Continue;
+        }
+        return rpc::RPC_Constants::Ok;
+    }
+}; // end of class Bulk_Receiver
+
+void run_server()
+{
+    rpc::RPC_Service<> server;
+    Bulk_Receiver receiver;
+
+    server.set_accept_handler([&server, &receiver](rpc::RPC_SocketListener *p_listener, rpc::RPC_SocketChannel *p_channel, int ec) {
+        if ( ec != rpc::RPC_Constants::Ok ) return rpc::RPC_Constants::Fail;
+        if ( !server.add_channel(p_channel) ) return rpc::RPC_Constants::Fail;
+        return server.post_receive(p_channel, receiver.recv_message(), -1) ? rpc::RPC_Constants::Ok : rpc::RPC_Constants::Fail;
+    });
+    server.set_recv_handler([&server, &receiver](rpc::RPC_SocketChannel *p_channel, rpc::RPC_Message &msg, int ec) {
+        if ( ec != rpc::RPC_Constants::Ok ) return rpc::RPC_Constants::Fail;
+        int r = receiver.on_receive(msg);
+        if ( r != rpc::RPC_Constants::Ok ) return r;
+        server.post_send(p_channel, receiver.ack_message(), -1);
+        server.post_receive(p_channel, receiver.recv_message(), -1);
+        return rpc::RPC_Constants::Ok;
+    });
+    server.set_send_handler([](rpc::RPC_SocketChannel *p_channel, rpc::RPC_Message &msg, int ec) {
+        return rpc::RPC_Constants::Ok;
+    });
+
+    rpc::RPC_Service<>::ListenerPtr p_listener = server.open_listener(BULK_BENCH_ENDPOINT);
+    if ( !p_listener || !server.post_accept(p_listener, -1) ) {
+        fprintf(stderr, "bulk_bench: open listener failed\n");
+        exit(1);
+    }
+    server_ready.store(true);
+    while ( server_running.load() ) server.run_once();
+}
+
+int main(int argc, char **argv)
+{
+    size_t max_mb   = (argc > 1) ? (size_t)atol(argv[1]) : 1024;
+    size_t batch_kb = (argc > 2) ? (size_t)atol(argv[2]) : 0;
+
+    std::thread server_thread(run_server);
+    while ( !server_ready.load() ) std::this_thread::yield();
+
+    rpc::RPC_Service<> client;
+    if ( batch_kb > 0 ) client.set_send_batch_bytes(batch_kb * 1024);
+
+    char * header = new char[Header_Length];
+    char * chunk  = new char[Chunk_Size];
+    char * ack    = new char[Header_Length];
+    memset(chunk, 'x', Chunk_Size);
+    everest::Mutable_Buffer_Sequence send_seq;
+    everest::Mutable_Buffer_Sequence ack_seq;
+
+    rpc::RPC_SocketChannel * channel = nullptr;
+    bool acked  = false;
+    bool failed = false;
+
+    client.set_conn_handler([&](rpc::RPC_SocketChannel *p_channel, int ec) {
+        if ( ec != rpc::RPC_Constants::Ok ) failed = true;
+        else channel = p_channel;
+        return ec == rpc::RPC_Constants::Ok ? rpc::RPC_Constants::Ok : rpc::RPC_Constants::Fail;
+    });
+    client.set_recv_handler([&](rpc::RPC_SocketChannel *p_channel, rpc::RPC_Message &msg, int ec) {
+        if ( ec != rpc::RPC_Constants::Ok ) failed = true;
+        else acked = true;
+        return ec == rpc::RPC_Constants::Ok ? rpc::RPC_Constants::Ok : rpc::RPC_Constants::Fail;
+    });
+    client.set_send_handler([&](rpc::RPC_SocketChannel *p_channel, rpc::RPC_Message &msg, int ec) {
+        if ( ec != rpc::RPC_Constants::Ok ) failed = true;
+        return rpc::RPC_Constants::Ok;
+    });
+
+    if ( !client.open_channel(BULK_BENCH_ENDPOINT, 3000) ) {
+        fprintf(stderr, "bulk_bench: open channel failed\n");
+        return 1;
+    }
+    while ( channel == nullptr && !failed ) client.run_once();
+
+    for(size_t mb = 1; mb <= max_mb && !failed; mb *= 4 ) {
+        size_t body_size = mb * 1024 * 1024 - Header_Length;
+        send_seq.clear();
+        send_seq.push_back(everest::Mutable_Byte_Buffer(header, Header_Length));
+        rpc::RPC_Message msg(send_seq);
+        msg.init_header();
+        push_body(send_seq, chunk, body_size, true);
+        msg.update_header();
+
+        ack_seq.clear();
+        ack_seq.push_back(everest::Mutable_Byte_Buffer(ack, Header_Length));
+
+        acked = false;
+        uint64_t start_syscalls = client.syscall_count();
+        int64_t start = now_ns();
+        client.post_send(channel, msg, -1);
+        client.post_receive(channel, rpc::RPC_Message(ack_seq), -1);
+        while ( !acked && !failed ) client.run_once();
+        int64_t elapsed = now_ns() - start;
+
+        fprintf(stderr, "bulk_bench: %5lu MB, %9.2f ms, %8.1f MB/s, client syscalls %lu\n",
+            mb, elapsed / 1e6, mb * 1e9 / elapsed, client.syscall_count() - start_syscalls);
+    }
+
+    server_running.store(false);
+    server_thread.join();
+    delete[] header;
+    delete[] chunk;
+    delete[] ack;
+
+    if ( failed ) {
+        fprintf(stderr, "bulk_bench: transfer failed\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,91 @@
+#include <everest/rpc/RPC_Server.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/**
+ * 接收回调的分派开销: 同一个handler分别经过
+ *   service  默认策略的RPC_Service: proactor的std::function -> RecvHandler包装 -> service的std::function
+ *   proactor 直接设置到RPC_Proactor的std::function
+ *   static   自定义回调策略，proactor直接调用，可以内联
+ * 只测量proactor调用接收回调的一步，不包括收发
+ * 用法: dispatch_bench [count]
+ */
+
+namespace rpc = everest::rpc;
+
+static int64_t now_ns()
+{
+    struct timespec ts;
+    ::clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// 每个回调读取消息长度并计数，相当于最简单的应用handler
+struct CountRecvHandler
+{
+    uint64_t * p_count;
+
+    int operator()(rpc::RPC_SocketChannel *p_channel, rpc::RPC_Message &msg, int ec) {
+        if ( msg.size() > 0 ) ++*p_count;
+        return rpc::RPC_Constants::Ok;
+    }
+};
+
+struct Bench_Handlers
+{
+    uint64_t count;
+
+    Bench_Handlers() : count(0) {}
+
+    int on_accept(rpc::RPC_SocketListener *, rpc::RPC_SocketChannel *, int ec) { return rpc::RPC_Constants::Ok; }
+    int on_connect(rpc::RPC_SocketChannel *, int ec) { return rpc::RPC_Constants::Ok; }
+    int on_send(rpc::RPC_SocketChannel *, rpc::RPC_Message &, int ec) { return rpc::RPC_Constants::Ok; }
+    int on_receive(rpc::RPC_SocketChannel *p_channel, rpc::RPC_Message &msg, int ec) {
+        if ( msg.size() > 0 ) ++count;
+        return rpc::RPC_Constants::Ok;
+    }
+};
+
+template<class Handlers>
+double run_bench(const char * name, Handlers &handlers, uint64_t &count, size_t n)
+{
+    char data[rpc::RPC_Message::Header_Length];
+    everest::Mutable_Buffer_Sequence seq;
+    seq.push_back(everest::Mutable_Byte_Buffer(data, sizeof(data)));
+    rpc::RPC_Message msg(seq);
+    msg.init_header();
+    msg.update_header();
+    rpc::RPC_SocketChannel channel;
+
+    int64_t t0 = now_ns();
+    for(size_t i = 0; i < n; ++i ) {
+        handlers.on_receive(&channel, msg, rpc::RPC_Constants::Ok);
+        asm volatile("" : : "r"(&msg) : "memory");    // 每次都重新读取消息，避免整个循环被合并
+    }
+    int64_t t1 = now_ns();
+
+    double ns = (double)(t1 - t0) / n;
+    printf("%-10s count %lu, %.2f ns/message\n", name, count, ns);
+    return ns;
+}
+
+int main(int argc, char **argv)
+{
+    size_t n = (argc > 1) ? (size_t)atol(argv[1]) : 20000000;
+
+    uint64_t service_count = 0;
+    rpc::RPC_Service<> service;
+    service.set_recv_handler(CountRecvHandler{ &service_count });
+    run_bench("service", service.handlers(), service_count, n);
+
+    uint64_t proactor_count = 0;
+    rpc::RPC_Proactor<> proactor;
+    proactor.set_recv_handler(CountRecvHandler{ &proactor_count });
+    run_bench("proactor", proactor.handlers(), proactor_count, n);
+
+    rpc::RPC_Service<rpc::RPC_TcpSocketService_Impl, Bench_Handlers> static_service;
+    Bench_Handlers & handlers = static_service.handlers();
+    run_bench("static", handlers, handlers.count, n);
+    return 0;
+}
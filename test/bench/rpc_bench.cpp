@@ -0,0 +1,247 @@
+#include <everest/rpc/RPC_Server.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+/**
+ * RPC消息往返性能测试: 客户端与服务端各一个线程，逐条请求-应答，统计每条消息的平均耗时
+ * 和往返延迟的p50/p99(从一批请求投递到收到各应答)。两端都用run()阻塞运行。
+ * 用法: rpc_bench [count] [depth] [options] > /dev/null
+ * depth为客户端每批连续发送的请求数(默认1，逐条往返)，服务端对每个请求应答；
+ * options以逗号分隔:
+ *   flush  服务端使用flush模式，同一轮产生的应答合并发送
+ *   ahead  两端使用64KB预读缓存，一次接收多个消息
+ *   busy   两端使用低延迟模式，阻塞前自旋最多50us，channel设置SO_BUSY_POLL
+ *          (单核机器上自旋会占用对端线程的时间，延迟反而变大)
+ *   queued 两端关闭直接发送，post_send经任务队列和可写事件发送
+ * 日志输出到stdout，结果输出到stderr。不同的编译选项对比日志开销:
+ *   rpc_bench_printf  同步输出TRACE日志，等同于原来的printf
+ *   rpc_bench_async   TRACE日志写入线程缓冲，后台线程输出
+ *   rpc_bench         NDEBUG发布版本，TRACE/DEBUG编译期去除
+ *   rpc_bench_et      NDEBUG发布版本，使用边沿触发epoll
+ *   rpc_bench_uring   NDEBUG发布版本，使用io_uring proactor
+ * 同时输出两端proactor线程平均每次往返的系统调用次数和省去的epoll_ctl次数。
+ */
+
+namespace rpc = everest::rpc;
+
+#define RPC_BENCH_ENDPOINT   "127.0.0.1:9995"
+
+static const size_t Buffer_Size = 1024;
+static const size_t Body_Size   = 64;
+
+static int64_t now_ns()
+{
+    struct timespec ts;
+    ::clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/**
+ * 一端的收发缓存，发送消息预先生成并轮流重复使用(同一消息发送完成前不能再次投递)，
+ * 接收缓存每次收完后复位
+ */
+class Bench_Peer
+{
+private:
+    char *                         m_send_data;
+    char *                         m_recv_data;
+    std::vector<everest::Mutable_Buffer_Sequence *> m_send_seqs;
+    size_t                         m_send_index;
+    everest::Mutable_Buffer_Sequence m_recv_seq;
+
+public:
+    Bench_Peer(size_t depth) 
+        : m_send_data(new char[Buffer_Size * depth]), m_recv_data(new char[Buffer_Size]), m_send_index(0) 
+    {
+        memset(m_send_data, 'x', Buffer_Size * depth);
+        for(size_t i = 0; i < depth; ++i ) {
+            everest::Mutable_Buffer_Sequence * seq = new everest::Mutable_Buffer_Sequence();
+            seq->push_back(everest::Mutable_Byte_Buffer(m_send_data + Buffer_Size * i, Buffer_Size));
+            rpc::RPC_Message msg(*seq);
+            msg.init_header();
+            seq->front().size(rpc::RPC_Message::Header_Length + Body_Size);
+            msg.update_header();
+            m_send_seqs.push_back(seq);
+        }
+    }
+
+    ~Bench_Peer() {
+        for(size_t i = 0; i < m_send_seqs.size(); ++i ) delete m_send_seqs[i];
+        delete[] m_send_data;
+        delete[] m_recv_data;
+    }
+
+    rpc::RPC_Message send_message() { 
+        everest::Mutable_Buffer_Sequence * seq = m_send_seqs[m_send_index];
+        m_send_index = (m_send_index + 1) % m_send_seqs.size();
+        return rpc::RPC_Message(*seq); 
+    }
+
+    rpc::RPC_Message recv_message() {
+        m_recv_seq.clear();
+        everest::Mutable_Byte_Buffer buf(m_recv_data, Buffer_Size);
+        buf.limit(rpc::RPC_Message::Header_Length);
+        m_recv_seq.push_back(buf);
+        return rpc::RPC_Message(m_recv_seq);
+    }
+
+    // 只收到消息头时追加消息体缓存，返回Continue；收完整返回Ok
+    int on_receive(rpc::RPC_Message &msg) {
+        everest::Mutable_Buffer_Sequence & buffers = msg.buffers();
+        size_t msg_size = msg.size();
+        size_t buf_size = buffers.size();
+        if ( buf_size < msg_size ) {
+            if ( msg_size > Buffer_Size ) return rpc::RPC_Constants::Fail;
+            buffers.push_back(everest::Mutable_Byte_Buffer(m_recv_data + buf_size, msg_size - buf_size));
+            return rpc::RPC_Constants::Continue;
+        }
+        return rpc::RPC_Constants::Ok;
+    }
+}; // end of class Bench_Peer
+
+std::atomic<bool> server_ready(false);
+std::atomic<uint64_t> server_syscalls(0);
+std::atomic<uint64_t> server_ctl_saved(0);
+std::atomic<rpc::RPC_Service<> *> server_ptr(nullptr);
+
+static const size_t Read_Ahead_Size = 64 * 1024;
+static const int    Busy_Poll_Us    = 50;
+
+void run_server(size_t depth, bool flush, bool ahead, bool busy, bool queued)
+{
+    rpc::RPC_Service<> server;
+    Bench_Peer peer(depth);
+    server.set_flush_mode(flush);
+    server.set_direct_write(!queued);
+    if ( ahead ) server.set_read_ahead(Read_Ahead_Size);
+    if ( busy ) server.set_busy_poll(Busy_Poll_Us, Busy_Poll_Us);
+
+    server.set_accept_handler([&server, &peer](rpc::RPC_SocketListener *p_listener, rpc::RPC_SocketChannel *p_channel, int ec) {
+        if ( ec != rpc::RPC_Constants::Ok ) return rpc::RPC_Constants::Fail;
+        if ( !server.add_channel(p_channel) ) return rpc::RPC_Constants::Fail;
+        return server.post_receive(p_channel, peer.recv_message(), -1) ? rpc::RPC_Constants::Ok : rpc::RPC_Constants::Fail;
+    });
+    server.set_recv_handler([&server, &peer](rpc::RPC_SocketChannel *p_channel, rpc::RPC_Message &msg, int ec) {
+        if ( ec != rpc::RPC_Constants::Ok ) return rpc::RPC_Constants::Fail;
+        int r = peer.on_receive(msg);
+        if ( r != rpc::RPC_Constants::Ok ) return r;
+        server.post_send(p_channel, peer.send_message(), -1);
+        server.post_receive(p_channel, peer.recv_message(), -1);
+        return rpc::RPC_Constants::Ok;
+    });
+    server.set_send_handler([](rpc::RPC_SocketChannel *p_channel, rpc::RPC_Message &msg, int ec) {
+        return rpc::RPC_Constants::Ok;
+    });
+
+    rpc::RPC_Service<>::ListenerPtr p_listener = server.open_listener(RPC_BENCH_ENDPOINT);
+    if ( !p_listener || !server.post_accept(p_listener, -1) ) {
+        fprintf(stderr, "rpc_bench: open listener failed\n");
+        exit(1);
+    }
+    server_ptr.store(&server);
+    server_ready.store(true);
+    server.run();
+    server_syscalls.store(server.syscall_count());   // 包含建立连接，相对往返次数可忽略
+    server_ctl_saved.store(server.ctl_saved());
+}
+
+int main(int argc, char **argv)
+{
+    size_t count = (argc > 1) ? (size_t)atol(argv[1]) : 20000;
+    size_t depth = (argc > 2) ? (size_t)atol(argv[2]) : 1;
+    bool   flush = (argc > 3) && strstr(argv[3], "flush") != nullptr;
+    bool   ahead = (argc > 3) && strstr(argv[3], "ahead") != nullptr;
+    bool   busy  = (argc > 3) && strstr(argv[3], "busy") != nullptr;
+    bool   queued = (argc > 3) && strstr(argv[3], "queued") != nullptr;
+    if ( depth == 0 ) depth = 1;
+    count = (count + depth - 1) / depth * depth;
+
+    std::thread server_thread(run_server, depth, flush, ahead, busy, queued);
+    while ( !server_ready.load() ) std::this_thread::yield();
+
+    rpc::RPC_Service<> client;
+    Bench_Peer peer(depth);
+    if ( ahead ) client.set_read_ahead(Read_Ahead_Size);
+    if ( busy ) client.set_busy_poll(Busy_Poll_Us, Busy_Poll_Us);
+    client.set_direct_write(!queued);
+    size_t  completed = 0;
+    int64_t start = 0;
+    int64_t batch_start = 0;
+    std::vector<int64_t> latencies;
+    latencies.reserve(count);
+    uint64_t start_syscalls = 0;
+    uint64_t start_ctl_saved = 0;
+    bool    failed = false;
+
+    client.set_conn_handler([&](rpc::RPC_SocketChannel *p_channel, int ec) {
+        if ( ec != rpc::RPC_Constants::Ok ) {
+            failed = true;
+            client.stop();
+            return rpc::RPC_Constants::Fail;
+        }
+        start = now_ns();
+        batch_start = start;
+        start_syscalls = client.syscall_count();
+        start_ctl_saved = client.ctl_saved();
+        for(size_t i = 0; i < depth; ++i ) client.post_send(p_channel, peer.send_message(), -1);
+        client.post_receive(p_channel, peer.recv_message(), -1);
+        return rpc::RPC_Constants::Ok;
+    });
+    client.set_recv_handler([&](rpc::RPC_SocketChannel *p_channel, rpc::RPC_Message &msg, int ec) {
+        if ( ec != rpc::RPC_Constants::Ok ) {
+            failed = true;
+            client.stop();
+            return rpc::RPC_Constants::Fail;
+        }
+        int r = peer.on_receive(msg);
+        if ( r != rpc::RPC_Constants::Ok ) return r;
+        int64_t now = now_ns();
+        latencies.push_back(now - batch_start);
+        if ( ++completed < count ) {
+            // 一批应答全部收到后再发送下一批
+            if ( completed % depth == 0 ) {
+                batch_start = now;
+                for(size_t i = 0; i < depth; ++i ) client.post_send(p_channel, peer.send_message(), -1);
+            }
+            client.post_receive(p_channel, peer.recv_message(), -1);
+        } else {
+            client.stop();
+        }
+        return rpc::RPC_Constants::Ok;
+    });
+    client.set_send_handler([](rpc::RPC_SocketChannel *p_channel, rpc::RPC_Message &msg, int ec) {
+        return rpc::RPC_Constants::Ok;
+    });
+
+    if ( !client.open_channel(RPC_BENCH_ENDPOINT, 3000) ) {
+        fprintf(stderr, "rpc_bench: open channel failed\n");
+        return 1;
+    }
+    client.run();
+    int64_t elapsed = now_ns() - start;
+    uint64_t client_syscalls = client.syscall_count() - start_syscalls;
+    uint64_t client_ctl_saved = client.ctl_saved() - start_ctl_saved;
+
+    server_ptr.load()->stop();
+    server_thread.join();
+
+    if ( failed ) {
+        fprintf(stderr, "rpc_bench: exchange failed after %lu round trips\n", completed);
+        return 1;
+    }
+    std::sort(latencies.begin(), latencies.end());
+    fprintf(stderr, "rpc_bench: depth %lu%s%s%s%s, %lu round trips, %.2f us/round trip, %.2f us/message, p50 %.2f us, p99 %.2f us, "
+        "syscalls/round trip client %.2f server %.2f, epoll_ctl saved/round trip client %.2f server %.2f\n",
+        depth, flush ? " flush" : "", ahead ? " ahead" : "", busy ? " busy" : "", queued ? " queued" : "", completed, 
+        elapsed / 1000.0 / completed, elapsed / 1000.0 / completed / 2,
+        latencies[completed / 2] / 1000.0, latencies[completed * 99 / 100] / 1000.0,
+        (double)client_syscalls / completed, (double)server_syscalls.load() / completed,
+        (double)client_ctl_saved / completed, (double)server_ctl_saved.load() / completed);
+    return 0;
+}
@@ -0,0 +1,78 @@
+#include <everest/timer_queue.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <vector>
+#include <algorithm>
+
+/**
+ * 定时队列性能测试: 插入、取消一半、推进时间使其余全部到期
+ * 用法: timer_bench [count] [max_timeout_ms]
+ */
+
+static int64_t now_ns()
+{
+    struct timespec ts;
+    ::clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+struct CountHandler
+{
+    size_t count;
+    void operator()(everest::Timer_Node *) { ++count; }
+};
+
+template<class Queue>
+int run_bench(const char * name, size_t count, int64_t max_timeout_ms)
+{
+    const int64_t start = 1000000000LL;  // 起始时间(us)
+    std::vector<everest::Timer_Node> nodes(count);
+    std::vector<size_t> cancel_order(count);
+
+    srand(12345);
+    for(size_t i = 0; i < count; ++i ) {
+        int64_t timeout_us = 1000 + (int64_t)(rand() % (max_timeout_ms * 1000));
+        nodes[i].expire_time(start + timeout_us);
+        cancel_order[i] = i;
+    }
+    std::random_shuffle(cancel_order.begin(), cancel_order.end());
+
+    Queue queue(start);
+
+    int64_t t0 = now_ns();
+    for(size_t i = 0; i < count; ++i ) queue.add(&nodes[i]);
+    int64_t t1 = now_ns();
+    for(size_t i = 0; i < count / 2; ++i ) queue.cancel(&nodes[cancel_order[i]]);
+    int64_t t2 = now_ns();
+
+    CountHandler handler = { 0 };
+    int64_t end = start + max_timeout_ms * 1000 + 1000;
+    for(int64_t now = start; now <= end; now += 1000 ) queue.expire(now, handler);
+    int64_t t3 = now_ns();
+
+    size_t expected = count - count / 2;
+    printf("%-10s count %lu, insert %.1f ns/op, cancel %.1f ns/op, expire %.1f ns/op (%lu fired), total %.1f ms\n",
+        name, count,
+        (double)(t1 - t0) / count,
+        (double)(t2 - t1) / (count / 2),
+        (double)(t3 - t2) / (handler.count ? handler.count : 1), handler.count,
+        (double)(t3 - t0) / 1000000.0);
+
+    if ( handler.count != expected || !queue.empty() ) {
+        printf("[ERROR] %s, fired %lu, expected %lu, remain %lu\n", name, handler.count, expected, queue.size());
+        return -1;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    size_t  count = argc > 1 ? (size_t)atol(argv[1]) : 2000000;
+    int64_t max_timeout_ms = argc > 2 ? atol(argv[2]) : 60000;
+
+    int ret = 0;
+    ret |= run_bench<everest::Multimap_Timer_Queue>("multimap", count, max_timeout_ms);
+    ret |= run_bench<everest::Timing_Wheel>("wheel", count, max_timeout_ms);
+    return ret;
+}
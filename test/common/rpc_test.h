@@ -0,0 +1,229 @@
+#ifndef TEST_COMMON_RPC_TEST_H
+#define TEST_COMMON_RPC_TEST_H
+
+#pragma once
+
+#include <everest/rpc/RPC_Server.h>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// 各RPC测试程序共用的检查宏、测试缓冲区和handler，每个测试程序只有一个源文件包含
+
+namespace rpc = everest::rpc;
+
+#define CHECK( x ) \
+    do {\
+        if ( !(x) ) return -1; \
+    } while (0)
+
+// 测试消息的缓冲区，由缓冲池持有直到进程退出；服务组的各线程可同时申请
+class Test_Buffers
+{
+private:
+    std::mutex                                   m_mutex;
+    std::deque<std::vector<char> >               m_data;
+    std::deque<everest::Mutable_Buffer_Sequence> m_seqs;
+
+public:
+    everest::Mutable_Byte_Buffer buffer(size_t size) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_data.emplace_back(size);
+        return everest::Mutable_Byte_Buffer(m_data.back().data(), size);
+    }
+
+    // 只有一个长度为size的缓冲区的消息
+    rpc::RPC_Message message(size_t size) {
+        everest::Mutable_Byte_Buffer buf = this->buffer(size);
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_seqs.emplace_back();
+        m_seqs.back().push_back(buf);
+        return rpc::RPC_Message(m_seqs.back());
+    }
+};
+
+static Test_Buffers test_buffers;
+
+// 接受连接加入服务；recv_size非0时投递一个该长度的接收，然后调用on_accepted做各测试自己的处理
+class AcceptReceiveHandler
+{
+public:
+    typedef std::function<bool (rpc::RPC_Service<>&, rpc::RPC_SocketChannel*)> Accepted;
+
+private:
+    rpc::RPC_Service<> &m_service;
+    size_t              m_recv_size;
+    Accepted            m_on_accepted;
+
+public:
+    AcceptReceiveHandler(rpc::RPC_Service<> &service, size_t recv_size, const Accepted &on_accepted = Accepted())
+        : m_service(service), m_recv_size(recv_size), m_on_accepted(on_accepted) {}
+
+    int operator()(rpc::RPC_SocketListener *p_listener, rpc::RPC_SocketChannel * p_channel, int ec)
+    {
+        if ( ec != rpc::RPC_Constants::Ok ) return rpc::RPC_Constants::Fail;
+        if ( !m_service.add_channel(p_channel) ) return rpc::RPC_Constants::Fail;
+        if ( m_recv_size > 0 && !m_service.post_receive(p_channel, test_buffers.message(m_recv_size), -1) ) {
+            return rpc::RPC_Constants::Fail;
+        }
+        if ( m_on_accepted && !m_on_accepted(m_service, p_channel) ) return rpc::RPC_Constants::Fail;
+        return rpc::RPC_Constants::Ok;
+    }
+};
+
+static std::atomic<int> connected_count(0);
+
+// 客户端连接成功时计数
+class ClientConnectHandler
+{
+public:
+    ClientConnectHandler(rpc::RPC_Service<> &service) {}
+
+    int operator()(rpc::RPC_SocketChannel *p_channel, int ec) {
+        if ( ec == rpc::RPC_Constants::Ok ) connected_count.fetch_add(1);
+        return rpc::RPC_Constants::Ok;
+    }
+};
+
+// 长度为size的完整消息，消息体第一个字节为index
+inline rpc::RPC_Message pressure_message(size_t size, int index)
+{
+    rpc::RPC_Message msg = test_buffers.message(size);
+    msg.init_header();
+    msg.buffers().front().size(size);
+    msg.buffers().front()[rpc::RPC_Message::Header_Length] = (char)index;
+    msg.update_header();
+    return msg;
+}
+
+// 不关心发送结果的send handler
+class PressureSendHandler
+{
+public:
+    PressureSendHandler(rpc::RPC_Service<> &service) {}
+
+    int operator()(rpc::RPC_SocketChannel *p_channel, rpc::RPC_Message &msg, int ec) {
+        return rpc::RPC_Constants::Ok;
+    }
+};
+
+// 带序号请求的流水线测试: 服务端按请求ID原样应答，客户端检查应答顺序
+static const size_t Seq_Message_Size = rpc::RPC_Message::Header_Length + 8;
+
+static std::mutex seq_server_mutex;
+static std::unordered_map<rpc::RPC_Service<> *, int> seq_server_handled;   // 各服务处理的消息数
+static std::vector<rpc::RPC_SocketChannel *> seq_server_channels;
+
+inline AcceptReceiveHandler seq_accept_handler(rpc::RPC_Service<> &service)
+{
+    return AcceptReceiveHandler(service, Seq_Message_Size, [](rpc::RPC_Service<> &, rpc::RPC_SocketChannel *p_channel) {
+        std::lock_guard<std::mutex> lock(seq_server_mutex);
+        seq_server_channels.push_back(p_channel);
+        return true;
+    });
+}
+
+// 以请求ID原样应答，由处理它的服务计数
+class SeqEchoHandler
+{
+private:
+    rpc::RPC_Service<> &m_service;
+
+public:
+    SeqEchoHandler(rpc::RPC_Service<> &service) : m_service(service) {}
+
+    int operator()(rpc::RPC_SocketChannel *p_channel, rpc::RPC_Message &msg, int ec) {
+        if ( ec != rpc::RPC_Constants::Ok ) return rpc::RPC_Constants::Fail;
+        {
+            std::lock_guard<std::mutex> lock(seq_server_mutex);
+            ++seq_server_handled[&m_service];
+        }
+        rpc::RPC_Message reply = pressure_message(Seq_Message_Size, 0);
+        reply.request_id(msg.request_id());
+        m_service.post_send(p_channel, reply, -1);
+        m_service.post_receive(p_channel, test_buffers.message(Seq_Message_Size), -1);
+        return rpc::RPC_Constants::Ok;
+    }
+};
+
+inline int seq_handled(rpc::RPC_Service<> &service)
+{
+    std::lock_guard<std::mutex> lock(seq_server_mutex);
+    return seq_server_handled[&service];
+}
+
+/**
+ * 客户端在每个channel上以固定窗口流水线发送带序号的请求，检查应答按序号到达
+ */
+class Seq_Client
+{
+private:
+    struct Stream
+    {
+        uint64_t sent;
+        uint64_t received;
+        char     data[Seq_Message_Size];
+        everest::Mutable_Buffer_Sequence seq;
+    };
+
+    rpc::RPC_Service<> &m_service;
+    std::unordered_map<rpc::RPC_SocketChannel *, Stream *> m_streams;
+    size_t   m_channels;
+    uint64_t m_total;      // 每个channel的请求数
+    size_t   m_window;
+
+public:
+    int      connected;
+    uint64_t received;
+    uint64_t disorder;
+
+    Seq_Client(rpc::RPC_Service<> &service, size_t channels, uint64_t total, size_t window)
+        : m_service(service), m_channels(channels), m_total(total), m_window(window), connected(0), received(0), disorder(0)
+    {
+        m_service.set_conn_handler([this](rpc::RPC_SocketChannel *p_channel, int ec) {
+            if ( ec != rpc::RPC_Constants::Ok ) return rpc::RPC_Constants::Fail;
+            ++connected;
+            Stream * p_stream = new Stream();
+            p_stream->sent = p_stream->received = 0;
+            m_streams[p_channel] = p_stream;
+            for(size_t i = 0; i < m_window; ++i ) this->send_next(p_channel, p_stream);
+            this->post_recv(p_channel, p_stream);
+            return rpc::RPC_Constants::Ok;
+        });
+        m_service.set_recv_handler([this](rpc::RPC_SocketChannel *p_channel, rpc::RPC_Message &msg, int ec) {
+            if ( ec != rpc::RPC_Constants::Ok ) return rpc::RPC_Constants::Fail;
+            Stream * p_stream = m_streams[p_channel];
+            if ( msg.request_id() != ++p_stream->received ) ++disorder;
+            ++received;
+            this->send_next(p_channel, p_stream);
+            if ( p_stream->received < m_total ) this->post_recv(p_channel, p_stream);
+            return rpc::RPC_Constants::Ok;
+        });
+        m_service.set_send_handler(PressureSendHandler(m_service));
+    }
+
+    ~Seq_Client() {
+        for(auto it = m_streams.begin(); it != m_streams.end(); ++it ) delete it->second;
+    }
+
+    bool done() const { return received == m_total * m_channels; }
+
+private:
+    void send_next(rpc::RPC_SocketChannel *p_channel, Stream * p_stream) {
+        if ( p_stream->sent >= m_total ) return;
+        rpc::RPC_Message request = pressure_message(Seq_Message_Size, 0);
+        request.request_id(++p_stream->sent);
+        m_service.post_send(p_channel, request, -1);
+    }
+
+    void post_recv(rpc::RPC_SocketChannel *p_channel, Stream * p_stream) {
+        p_stream->seq.clear();
+        p_stream->seq.push_back(everest::Mutable_Byte_Buffer(p_stream->data, Seq_Message_Size));
+        m_service.post_receive(p_channel, rpc::RPC_Message(p_stream->seq), -1);
+    }
+};
+
+#endif // TEST_COMMON_RPC_TEST_H
@@ -25,7 +25,9 @@ int client_result = 0;
 pthread_t server_tid = 0;
 pthread_t client_tid = 0;
 
+#ifndef RPC_LOCAL_ENDPOINT
 #define RPC_LOCAL_ENDPOINT   "127.0.0.1:9999"
+#endif
 
 int main(int argc, char **argv)
 {
@@ -136,6 +138,10 @@ public:
     ServerRecvHandler(rpc::RPC_Service<> &service) : m_service(service) {}
     
     int operator()(rpc::RPC_SocketChannel *p_channel, rpc::RPC_Message &msg, int ec) {
+        if ( ec != rpc::RPC_Constants::Ok ) {
+            printf("[ERROR] Test ServerRecvHandler, receive failed, %d\n", ec);
+            return rpc::RPC_Constants::Fail;
+        }
         auto & buffers = msg.buffers();
         size_t buf_size = buffers.size();
         size_t msg_size = msg.size();
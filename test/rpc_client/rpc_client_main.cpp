@@ -0,0 +1,315 @@
+#include <everest/rpc/RPC_Client.h>
+#include <everest/rpc/RPC_ChannelPool.h>
+#include "../common/rpc_test.h"
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <unistd.h>
+
+#define RPC_MUX_ENDPOINT      "127.0.0.1:9985"
+#define RPC_POOL_ENDPOINT     "127.0.0.1:9984"
+#define RPC_MALFORMED_ENDPOINT "127.0.0.1:9972"
+
+static const int    Mux_Calls        = 256;
+static const int    Mux_Batch        = 32;
+static const int    Mux_Drop         = 77;     // 服务端不应答该调用，客户端超时
+static const size_t Mux_Request_Size = 64;
+
+int  mux_server_count = 0;
+char mux_server_data[Mux_Calls][Mux_Request_Size];
+everest::Mutable_Buffer_Sequence mux_server_seqs[Mux_Calls];
+
+static rpc::RPC_Message mux_server_recv_message()
+{
+    everest::Mutable_Buffer_Sequence & seq = mux_server_seqs[mux_server_count];
+    seq.push_back(everest::Mutable_Byte_Buffer(mux_server_data[mux_server_count], Mux_Request_Size));
+    return rpc::RPC_Message(seq);
+}
+
+// 应答复制请求ID，消息体为请求的序号，长度随序号变化
+static rpc::RPC_Message mux_reply(rpc::RPC_Message &request)
+{
+    int index = request.buffers().front().data<int>(rpc::RPC_Message::Header_Length);
+    size_t size = rpc::RPC_Message::Header_Length + sizeof(int) + index % 50;
+    rpc::RPC_Message reply = test_buffers.message(size);
+    reply.init_header();
+    reply.buffers().front().size(size);
+    reply.buffers().front().data<int>(rpc::RPC_Message::Header_Length) = index;
+    reply.update_header();
+    reply.request_id(request.request_id());
+    reply.type(rpc::RPC_Message::Type_Reply);
+    return reply;
+}
+
+// 每收到Mux_Batch个请求后逆序应答
+class MuxServerRecvHandler
+{
+private:
+    rpc::RPC_Service<> &m_service;
+
+public:
+    MuxServerRecvHandler(rpc::RPC_Service<> &service) : m_service(service) {}
+
+    int operator()(rpc::RPC_SocketChannel *p_channel, rpc::RPC_Message &msg, int ec) {
+        if ( ec != rpc::RPC_Constants::Ok ) return rpc::RPC_Constants::Fail;
+        if ( msg.type() != rpc::RPC_Message::Type_Request || msg.request_id() == 0 ) return rpc::RPC_Constants::Fail;
+        if ( ++mux_server_count % Mux_Batch == 0 ) {
+            for(int i = mux_server_count - 1; i >= mux_server_count - Mux_Batch; --i ) {
+                rpc::RPC_Message request(mux_server_seqs[i]);
+                if ( request.buffers().front().data<int>(rpc::RPC_Message::Header_Length) == Mux_Drop ) continue;
+                m_service.post_send(p_channel, mux_reply(request), -1);
+            }
+        }
+        if ( mux_server_count < Mux_Calls ) m_service.post_receive(p_channel, mux_server_recv_message(), -1);
+        return rpc::RPC_Constants::Ok;
+    }
+};
+
+int  mux_completed = 0;
+int  mux_timeouts = 0;
+int  mux_mismatched = 0;
+int  mux_last_index = -1;
+bool mux_out_of_order = false;
+
+// 一个channel上同时发起全部调用，应答乱序到达，按请求ID回调到各自的调用者
+int test_request_multiplexing()
+{
+    rpc::RPC_Service<> server;
+    server.set_accept_handler(AcceptReceiveHandler(server, 0, [](rpc::RPC_Service<> &service, rpc::RPC_SocketChannel *p_channel) {
+        return service.post_receive(p_channel, mux_server_recv_message(), -1);     // 应答时按序号取回请求
+    }));
+    server.set_recv_handler(MuxServerRecvHandler(server));
+    server.set_send_handler(PressureSendHandler(server));
+    rpc::RPC_Service<>::ListenerPtr p_listener = server.open_listener(RPC_MUX_ENDPOINT);
+    CHECK( p_listener != nullptr );
+    CHECK( server.post_accept(p_listener, -1) );
+    std::thread loop([&server]() { server.run(); });
+
+    rpc::RPC_Service<> client;
+    rpc::RPC_Client<> mux(client);
+    rpc::RPC_SocketChannel * channel = nullptr;
+    client.set_conn_handler([&mux, &channel](rpc::RPC_SocketChannel *p_channel, int ec) {
+        if ( ec != rpc::RPC_Constants::Ok || !mux.attach(p_channel) ) return rpc::RPC_Constants::Fail;
+        channel = p_channel;
+        for(int i = 0; i < Mux_Calls; ++i ) {
+            rpc::RPC_Message request = pressure_message(Mux_Request_Size, 0);
+            request.buffers().front().data<int>(rpc::RPC_Message::Header_Length) = i;
+            uint64_t id = mux.call(p_channel, request, [i](int ec, rpc::RPC_Message &reply) {
+                if ( ec == rpc::RPC_Constants::Timeout && i == Mux_Drop ) { ++mux_timeouts; return; }
+                if ( ec != rpc::RPC_Constants::Ok || reply.type() != rpc::RPC_Message::Type_Reply
+                    || reply.size() != rpc::RPC_Message::Header_Length + sizeof(int) + i % 50 ) { ++mux_mismatched; return; }
+                everest::Mutable_Buffer_Sequence::Iterator it = reply.buffers().begin();
+                ++it;
+                if ( it->data<int>(0) != i ) { ++mux_mismatched; return; }
+                if ( i < mux_last_index ) mux_out_of_order = true;
+                mux_last_index = i;
+                ++mux_completed;
+            }, i == Mux_Drop ? 50 : 5000);
+            if ( id != (uint64_t)i + 1 ) return rpc::RPC_Constants::Fail;
+        }
+        return rpc::RPC_Constants::Ok;
+    });
+    CHECK( client.open_channel(RPC_MUX_ENDPOINT, 3000) );
+
+    int64_t start = everest::DateTime::get_timestamp();
+    while ( (mux_completed + mux_timeouts + mux_mismatched < Mux_Calls) && everest::DateTime::get_timestamp() - start < 5000000 ) {
+        client.run_once(10);
+        mux.expire(everest::DateTime::get_timestamp());
+    }
+    server.stop();
+    loop.join();
+
+    printf("[INFO] Test request multiplexing, completed %d, timeouts %d, mismatched %d, out of order %d, late %lu\n",
+        mux_completed, mux_timeouts, mux_mismatched, (int)mux_out_of_order, mux.late_replies());
+    CHECK( channel != nullptr );
+    CHECK( mux_completed == Mux_Calls - 1 );
+    CHECK( mux_timeouts == 1 );
+    CHECK( mux_mismatched == 0 );
+    CHECK( mux_out_of_order );
+    CHECK( mux.pending(channel) == 0 );
+    return 0;
+}
+
+// 应答的长度字段小于消息头: 调用以Fail结束，error handler回调一次，channel不再接收
+int test_malformed_reply()
+{
+    rpc::RPC_Service<> server;
+    server.set_accept_handler(AcceptReceiveHandler(server, Mux_Request_Size));
+    server.set_recv_handler([&server](rpc::RPC_SocketChannel *p_channel, rpc::RPC_Message &msg, int ec) {
+        if ( ec != rpc::RPC_Constants::Ok ) return rpc::RPC_Constants::Fail;
+        rpc::RPC_Message reply = test_buffers.message(rpc::RPC_Message::Header_Length);
+        reply.init_header();
+        reply.request_id(msg.request_id());
+        reply.type(rpc::RPC_Message::Type_Reply);
+        reply.buffers().front().data<uint32_t>(rpc::RPC_Message::Idx_Length) = 8;
+        server.post_send(p_channel, reply, -1);
+        return rpc::RPC_Constants::Ok;
+    });
+    server.set_send_handler(PressureSendHandler(server));
+    rpc::RPC_Service<>::ListenerPtr p_listener = server.open_listener(RPC_MALFORMED_ENDPOINT);
+    CHECK( p_listener != nullptr );
+    CHECK( server.post_accept(p_listener, -1) );
+
+    rpc::RPC_Service<> client;
+    rpc::RPC_Client<> caller(client);
+    rpc::RPC_SocketChannel * channel = nullptr;
+    int call_ec = 0, errors = 0, error_ec = 0;
+    caller.set_error_handler([&errors, &error_ec](rpc::RPC_SocketChannel *p_channel, int ec) {
+        ++errors;
+        error_ec = ec;
+    });
+    client.set_conn_handler([&](rpc::RPC_SocketChannel *p_channel, int ec) {
+        if ( ec != rpc::RPC_Constants::Ok || !caller.attach(p_channel) ) return rpc::RPC_Constants::Fail;
+        channel = p_channel;
+        uint64_t id = caller.call(p_channel, pressure_message(Mux_Request_Size, 0), [&call_ec](int ec, rpc::RPC_Message &reply) {
+            call_ec = ec;
+        }, 3000);
+        return id != 0 ? rpc::RPC_Constants::Ok : rpc::RPC_Constants::Fail;
+    });
+    CHECK( client.open_channel(RPC_MALFORMED_ENDPOINT, 3000) );
+
+    int64_t start = everest::DateTime::get_timestamp();
+    while ( call_ec == 0 && everest::DateTime::get_timestamp() - start < 3000000 ) {
+        client.run_once(10);
+        server.run_once(0);
+    }
+    printf("[INFO] Test malformed reply, call ec %d, errors %d, error ec %d\n", call_ec, errors, error_ec);
+    CHECK( channel != nullptr );
+    CHECK( call_ec == rpc::RPC_Constants::Fail );
+    CHECK( errors == 1 && error_ec == rpc::RPC_Constants::Fail );
+    CHECK( caller.pending(channel) == 0 );
+    return 0;
+}
+
+static const size_t Pool_Channels     = 4;
+static const int    Pool_Direct_Calls = 40;     // 先直接压在一个channel上的调用数
+static const int    Pool_Calls        = 400;
+static const size_t Pool_Request_Size = 32;
+
+std::mutex pool_server_mutex;
+std::vector<rpc::RPC_SocketChannel *> pool_server_channels;          // 按接受顺序
+std::unordered_map<rpc::RPC_SocketChannel *, int> pool_server_counts;
+
+// 每个请求立即应答，按channel计数
+class PoolServerRecvHandler
+{
+private:
+    rpc::RPC_Service<> &m_service;
+
+public:
+    PoolServerRecvHandler(rpc::RPC_Service<> &service) : m_service(service) {}
+
+    int operator()(rpc::RPC_SocketChannel *p_channel, rpc::RPC_Message &msg, int ec) {
+        if ( ec != rpc::RPC_Constants::Ok ) return rpc::RPC_Constants::Fail;
+        {
+            std::lock_guard<std::mutex> lock(pool_server_mutex);
+            ++pool_server_counts[p_channel];
+        }
+        rpc::RPC_Message reply = pressure_message(rpc::RPC_Message::Header_Length + 8, 0);
+        reply.request_id(msg.request_id());
+        reply.type(rpc::RPC_Message::Type_Reply);
+        m_service.post_send(p_channel, reply, -1);
+        m_service.post_receive(p_channel, test_buffers.message(Pool_Request_Size), -1);
+        return rpc::RPC_Constants::Ok;
+    }
+};
+
+int pool_completed = 0;
+int pool_failed = 0;
+
+static void pool_callback(int ec, rpc::RPC_Message &reply)
+{
+    if ( ec == rpc::RPC_Constants::Ok && reply.type() == rpc::RPC_Message::Type_Reply ) ++pool_completed;
+    else ++pool_failed;
+}
+
+// 运行客户端直到条件满足或超时，重连由池的定时器驱动
+template<class Cond>
+static bool pool_run_until(rpc::RPC_Service<> &client, const Cond &cond)
+{
+    int64_t start = everest::DateTime::get_timestamp();
+    while ( !cond() && everest::DateTime::get_timestamp() - start < 5000000 ) {
+        client.run_once(10);
+    }
+    return cond();
+}
+
+// 连接池预先建立连接，调用分到未完成调用最少的channel；服务端关闭一个连接后池在后台重连
+int test_channel_pool()
+{
+    rpc::RPC_Service<> server;
+    server.set_accept_handler(AcceptReceiveHandler(server, Pool_Request_Size, [](rpc::RPC_Service<> &, rpc::RPC_SocketChannel *p_channel) {
+        std::lock_guard<std::mutex> lock(pool_server_mutex);
+        pool_server_channels.push_back(p_channel);
+        return true;
+    }));
+    server.set_recv_handler(PoolServerRecvHandler(server));
+    server.set_send_handler(PressureSendHandler(server));
+    rpc::RPC_Service<>::ListenerPtr p_listener = server.open_listener(RPC_POOL_ENDPOINT);
+    CHECK( p_listener != nullptr );
+    CHECK( server.post_accept(p_listener, -1) );
+    std::thread loop([&server]() { server.run(); });
+
+    rpc::RPC_Service<> client;
+    rpc::RPC_ChannelPool<> pool(client);
+    int ep = pool.add_endpoint(RPC_POOL_ENDPOINT, Pool_Channels);
+    bool warmed = pool_run_until(client, [&pool, ep]() { return pool.ready(ep) == Pool_Channels; });
+    printf("[INFO] Test channel pool, warmed %d, ready %lu\n", (int)warmed, pool.ready(ep));
+    CHECK( warmed );
+
+    // 一个channel已有较多未完成调用时，之后的调用先分给其它channel，最终各channel相同
+    rpc::RPC_SocketChannel * p_busy = pool.select(ep);
+    CHECK( p_busy != nullptr );
+    for(int i = 0; i < Pool_Direct_Calls; ++i ) {
+        CHECK( pool.client().call(p_busy, pressure_message(Pool_Request_Size, i), pool_callback, 3000) != 0 );
+    }
+    for(int i = 0; i < Pool_Calls; ++i ) {
+        CHECK( pool.call(ep, pressure_message(Pool_Request_Size, i), pool_callback, 3000) != 0 );
+    }
+    int total = Pool_Direct_Calls + Pool_Calls;
+    pool_run_until(client, [total]() { return pool_completed + pool_failed == total; });
+
+    std::vector<int> counts;
+    rpc::RPC_SocketChannel * p_victim = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(pool_server_mutex);
+        for(auto it = pool_server_counts.begin(); it != pool_server_counts.end(); ++it ) counts.push_back(it->second);
+        if ( !pool_server_channels.empty() ) p_victim = pool_server_channels[0];
+    }
+    printf("[INFO] Test channel pool, completed %d, failed %d, server channels %lu\n",
+        pool_completed, pool_failed, counts.size());
+    CHECK( pool_completed == total );
+    CHECK( counts.size() == Pool_Channels );
+    for(size_t i = 0; i < counts.size(); ++i ) CHECK( counts[i] == total / (int)Pool_Channels );
+
+    // 服务端关闭一个连接，客户端发现后关闭该channel并按退避时间重连
+    CHECK( p_victim != nullptr );
+    CHECK( server.close_channel(p_victim) );
+    bool lost = pool_run_until(client, [&pool, ep]() { return pool.ready(ep) < Pool_Channels; });
+    bool recovered = pool_run_until(client, [&pool, ep]() { return pool.ready(ep) == Pool_Channels; });
+    printf("[INFO] Test channel pool, lost %d, recovered %d, reconnects %lu\n", (int)lost, (int)recovered, pool.reconnects());
+    CHECK( lost && recovered );
+    CHECK( pool.reconnects() == 1 );
+
+    for(int i = 0; i < Pool_Calls; ++i ) {
+        CHECK( pool.call(ep, pressure_message(Pool_Request_Size, i), pool_callback, 3000) != 0 );
+    }
+    total += Pool_Calls;
+    pool_run_until(client, [total]() { return pool_completed + pool_failed == total; });
+    server.stop();
+    loop.join();
+
+    printf("[INFO] Test channel pool, completed %d, failed %d\n", pool_completed, pool_failed);
+    CHECK( pool_completed == total );
+    CHECK( pool_failed == 0 );
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    CHECK( 0 == test_request_multiplexing() );
+    CHECK( 0 == test_malformed_reply() );
+    CHECK( 0 == test_channel_pool() );
+    return 0;
+}
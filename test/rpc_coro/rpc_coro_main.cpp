@@ -0,0 +1,173 @@
+#include <everest/rpc/RPC_Coroutine.h>
+#include <string.h>
+#include <atomic>
+#include <thread>
+#include <unistd.h>
+
+namespace rpc = everest::rpc;
+
+#define CHECK( x ) \
+    do {\
+        if ( !(x) ) return -1; \
+    } while (0)
+
+#define RPC_CORO_ENDPOINT "127.0.0.1:9986"
+
+typedef rpc::RPC_CoService<> CoService;
+
+static const size_t Header_Length = rpc::RPC_Message::Header_Length;
+static const size_t Max_Body      = 256;
+static const int    Coro_Channels = 2;
+static const int    Coro_Requests = 100;
+
+std::atomic<int>  server_echoed(0);
+std::atomic<int>  server_closed(0);
+std::atomic<int>  client_done(0);
+std::atomic<bool> client_ok(true);
+std::atomic<int>  client_timeout_ec(rpc::RPC_Constants::Ok);
+
+// 先接收消息头，消息更长时追加消息体缓存后继续接收同一消息
+static int append_body(everest::Mutable_Buffer_Sequence &seq, rpc::RPC_Message &msg, char *body)
+{
+    size_t msg_size = msg.size();
+    if ( msg_size > Header_Length + Max_Body ) return rpc::RPC_Constants::Fail;
+    seq.push_back(everest::Mutable_Byte_Buffer(body, msg_size - Header_Length));
+    return rpc::RPC_Constants::Ok;
+}
+
+// 回显收到的每个消息，对端关闭或出错时结束
+rpc::RPC_Coroutine echo(CoService &co, rpc::RPC_SocketChannel *p_channel)
+{
+    char header[Header_Length];
+    char body[Max_Body];
+    everest::Mutable_Buffer_Sequence seq;
+    for(;;) {
+        seq.clear();
+        seq.push_back(everest::Mutable_Byte_Buffer(header, Header_Length));
+        rpc::RPC_Message msg(seq);
+        int ec = co_await co.receive(p_channel, msg);
+        if ( ec == rpc::RPC_Constants::Continue ) {
+            if ( append_body(seq, msg, body) != rpc::RPC_Constants::Ok ) break;
+            ec = co_await co.receive(p_channel, msg);
+        }
+        if ( ec != rpc::RPC_Constants::Ok ) break;
+        if ( co_await co.send(p_channel, msg) != rpc::RPC_Constants::Ok ) break;
+        server_echoed.fetch_add(1);
+    }
+    co.release(p_channel);
+    server_closed.fetch_add(1);
+}
+
+rpc::RPC_Coroutine serve(CoService &co, rpc::RPC_SocketListener *p_listener)
+{
+    for(int i = 0; i < Coro_Channels; ++i ) {
+        CoService::Accept_Result r = co_await co.accept(p_listener);
+        if ( r.ec != rpc::RPC_Constants::Ok ) co_return;
+        echo(co, r.channel);
+    }
+}
+
+// 发送不同长度的请求并校验回显，最后等待一个不会到达的应答，应以Timeout结束
+rpc::RPC_Coroutine request(CoService &co, rpc::RPC_SocketChannel *p_channel, int id)
+{
+    char send_data[Header_Length + Max_Body];
+    char header[Header_Length];
+    char body[Max_Body];
+    everest::Mutable_Buffer_Sequence send_seq;
+    everest::Mutable_Buffer_Sequence recv_seq;
+    for(int i = 0; i < Coro_Requests; ++i ) {
+        size_t body_size = (i * 7 + id) % Max_Body;
+        send_seq.clear();
+        send_seq.push_back(everest::Mutable_Byte_Buffer(send_data, Header_Length + body_size));
+        rpc::RPC_Message req(send_seq);
+        req.init_header();
+        send_seq.front().size(Header_Length + body_size);
+        memset(send_data + Header_Length, (char)(i + id), body_size);
+        req.update_header();
+        if ( co_await co.send(p_channel, req) != rpc::RPC_Constants::Ok ) break;
+
+        recv_seq.clear();
+        recv_seq.push_back(everest::Mutable_Byte_Buffer(header, Header_Length));
+        rpc::RPC_Message resp(recv_seq);
+        int ec = co_await co.receive(p_channel, resp, 3000);
+        if ( ec == rpc::RPC_Constants::Continue ) {
+            if ( append_body(recv_seq, resp, body) != rpc::RPC_Constants::Ok ) break;
+            ec = co_await co.receive(p_channel, resp, 3000);
+        }
+        if ( ec != rpc::RPC_Constants::Ok || resp.size() != Header_Length + body_size ) break;
+        if ( body_size > 0 && (body[0] != (char)(i + id) || body[body_size - 1] != (char)(i + id)) ) break;
+        if ( i + 1 == Coro_Requests ) {
+            recv_seq.clear();
+            recv_seq.push_back(everest::Mutable_Byte_Buffer(header, Header_Length));
+            client_timeout_ec.store(co_await co.receive(p_channel, rpc::RPC_Message(recv_seq), 50));
+            client_done.fetch_add(1);
+            co_return;
+        }
+    }
+    client_ok.store(false);
+    client_done.fetch_add(1);
+}
+
+// 帧从线程局部的池中分配，结束的协程帧被下一个协程复用
+rpc::RPC_Coroutine noop(int *p_count)
+{
+    ++*p_count;
+    co_return;
+}
+
+int test_frame_pool()
+{
+    uint64_t allocated = rpc::RPC_FramePool::allocated();
+    uint64_t reused = rpc::RPC_FramePool::reused();
+    int count = 0;
+    for(int i = 0; i < 10; ++i ) noop(&count);
+    printf("[INFO] Test frame pool, allocated %lu, reused %lu\n",
+        rpc::RPC_FramePool::allocated() - allocated, rpc::RPC_FramePool::reused() - reused);
+    CHECK( count == 10 );
+    CHECK( rpc::RPC_FramePool::allocated() - allocated == 10 );
+    CHECK( rpc::RPC_FramePool::reused() - reused >= 9 );
+    return 0;
+}
+
+int test_coroutine_echo()
+{
+    rpc::RPC_Service<> server;
+    CoService server_co(server);
+    rpc::RPC_Service<>::ListenerPtr p_listener = server.open_listener(RPC_CORO_ENDPOINT);
+    CHECK( p_listener != nullptr );
+    serve(server_co, p_listener);
+    std::thread loop([&server]() { server.run(); });
+
+    rpc::RPC_Service<> client;
+    CoService client_co(client);
+    std::atomic<int> next_id(0);
+    client.set_conn_handler([&client_co, &next_id](rpc::RPC_SocketChannel *p_channel, int ec) {
+        if ( ec != rpc::RPC_Constants::Ok ) return rpc::RPC_Constants::Fail;
+        request(client_co, p_channel, next_id.fetch_add(1));
+        return rpc::RPC_Constants::Ok;
+    });
+    for(int i = 0; i < Coro_Channels; ++i ) CHECK( client.open_channel(RPC_CORO_ENDPOINT, 3000) );
+
+    int64_t start = everest::DateTime::get_timestamp();
+    while ( client_done.load() < Coro_Channels && everest::DateTime::get_timestamp() - start < 5000000 ) {
+        client.run_once(10);
+    }
+    uint64_t allocated = rpc::RPC_FramePool::allocated();
+    server.stop();
+    loop.join();
+
+    printf("[INFO] Test coroutine echo, done %d, ok %d, echoed %d, timeout ec %d, client frames %lu\n",
+        client_done.load(), (int)client_ok.load(), server_echoed.load(), client_timeout_ec.load(), allocated);
+    CHECK( client_done.load() == Coro_Channels );
+    CHECK( client_ok.load() );
+    CHECK( server_echoed.load() == Coro_Channels * Coro_Requests );
+    CHECK( client_timeout_ec.load() == rpc::RPC_Constants::Timeout );
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    CHECK( 0 == test_frame_pool() );
+    CHECK( 0 == test_coroutine_echo() );
+    return 0;
+}
@@ -0,0 +1,249 @@
+#include <everest/rpc/RPC_Server.h>
+#include <everest/executor.h>
+#include "../common/rpc_test.h"
+#include <atomic>
+#include <thread>
+#include <unistd.h>
+
+#define RPC_EXECUTOR_ENDPOINT "127.0.0.1:9987"
+#define RPC_JOB_CLOSE_ENDPOINT "127.0.0.1:9971"
+#define RPC_FAIL_ENDPOINT      "127.0.0.1:9970"
+#define RPC_JOB_FAIL_ENDPOINT  "127.0.0.1:9969"
+
+static const int    Executor_Heavy_Ms     = 200;
+static const size_t Executor_Message_Size = 64;
+static const char   Executor_Light        = 0;
+static const char   Executor_Heavy        = 1;
+
+std::atomic<bool>    executor_heavy_started(false);
+std::atomic<int64_t> executor_light_done(0);     // 客户端收到应答的时间
+std::atomic<int64_t> executor_heavy_done(0);
+std::atomic<int>     executor_connected(0);
+rpc::RPC_SocketChannel * executor_channels[2];
+
+static rpc::RPC_Message executor_message(char kind)
+{
+    rpc::RPC_Message msg = test_buffers.message(Executor_Message_Size);
+    msg.init_header();
+    msg.buffers().front().size(Executor_Message_Size);
+    msg.buffers().front()[rpc::RPC_Message::Header_Length] = kind;
+    msg.update_header();
+    return msg;
+}
+
+static char executor_kind(rpc::RPC_Message &msg)
+{
+    return msg.buffers().front()[rpc::RPC_Message::Header_Length];
+}
+
+// 耗时请求在执行器的工作线程中处理，应答经post_send交给proactor线程
+class ExecutorServerRecvHandler
+{
+private:
+    rpc::RPC_Service<> &m_service;
+
+public:
+    ExecutorServerRecvHandler(rpc::RPC_Service<> &service) : m_service(service) {}
+
+    int operator()(rpc::RPC_SocketChannel *p_channel, rpc::RPC_Message &msg, int ec) {
+        if ( ec != rpc::RPC_Constants::Ok ) return rpc::RPC_Constants::Fail;
+        char kind = executor_kind(msg);
+        if ( kind == Executor_Heavy ) {
+            executor_heavy_started.store(true);
+            ::usleep(Executor_Heavy_Ms * 1000);
+        }
+        m_service.post_send(p_channel, executor_message(kind), -1);
+        m_service.post_receive(p_channel, test_buffers.message(Executor_Message_Size), -1);
+        return rpc::RPC_Constants::Ok;
+    }
+};
+
+class ExecutorConnectHandler
+{
+private:
+    rpc::RPC_Service<> &m_service;
+
+public:
+    ExecutorConnectHandler(rpc::RPC_Service<> &service) : m_service(service) {}
+
+    int operator()(rpc::RPC_SocketChannel *p_channel, int ec) {
+        if ( ec != rpc::RPC_Constants::Ok ) return rpc::RPC_Constants::Fail;
+        if ( !m_service.post_receive(p_channel, test_buffers.message(Executor_Message_Size), -1) ) return rpc::RPC_Constants::Fail;
+        executor_channels[executor_connected.fetch_add(1)] = p_channel;
+        return rpc::RPC_Constants::Ok;
+    }
+};
+
+class ExecutorClientRecvHandler
+{
+public:
+    ExecutorClientRecvHandler(rpc::RPC_Service<> &service) {}
+
+    int operator()(rpc::RPC_SocketChannel *p_channel, rpc::RPC_Message &msg, int ec) {
+        if ( ec != rpc::RPC_Constants::Ok ) return rpc::RPC_Constants::Fail;
+        int64_t now = everest::DateTime::get_timestamp();
+        if ( executor_kind(msg) == Executor_Heavy ) executor_heavy_done.store(now);
+        else executor_light_done.store(now);
+        return rpc::RPC_Constants::Ok;
+    }
+};
+
+// 一个连接上的耗时请求交给执行器后，另一个连接上的请求仍在proactor线程及时处理
+int test_recv_executor()
+{
+    everest::Work_Stealing_Executor executor(2);
+    rpc::RPC_Service<> server;
+    server.set_recv_executor(&executor);
+    server.set_recv_dispatch([](rpc::RPC_SocketChannel *p_channel, rpc::RPC_Message &msg) {
+        return executor_kind(msg) == Executor_Heavy;
+    });
+    server.set_accept_handler(AcceptReceiveHandler(server, Executor_Message_Size));
+    server.set_recv_handler(ExecutorServerRecvHandler(server));
+    server.set_send_handler(PressureSendHandler(server));
+    rpc::RPC_Service<>::ListenerPtr p_listener = server.open_listener(RPC_EXECUTOR_ENDPOINT);
+    CHECK( p_listener != nullptr );
+    CHECK( server.post_accept(p_listener, -1) );
+    std::thread loop([&server]() { server.run(); });
+
+    rpc::RPC_Service<> client;
+    client.set_conn_handler(ExecutorConnectHandler(client));
+    client.set_recv_handler(ExecutorClientRecvHandler(client));
+    client.set_send_handler(PressureSendHandler(client));
+    CHECK( client.open_channel(RPC_EXECUTOR_ENDPOINT, 3000) );
+    CHECK( client.open_channel(RPC_EXECUTOR_ENDPOINT, 3000) );
+
+    int64_t start = everest::DateTime::get_timestamp();
+    while ( executor_connected.load() < 2 && everest::DateTime::get_timestamp() - start < 2000000 ) client.run_once(10);
+    CHECK( executor_connected.load() == 2 );
+
+    CHECK( client.post_send(executor_channels[0], executor_message(Executor_Heavy), -1) );
+    while ( !executor_heavy_started.load() && everest::DateTime::get_timestamp() - start < 2000000 ) client.run_once(1);
+    CHECK( executor_heavy_started.load() );
+
+    int64_t light_start = everest::DateTime::get_timestamp();
+    CHECK( client.post_send(executor_channels[1], executor_message(Executor_Light), -1) );
+    while ( executor_heavy_done.load() == 0 && everest::DateTime::get_timestamp() - start < 5000000 ) client.run_once(10);
+    server.stop();
+    loop.join();
+    executor.stop();
+
+    int64_t light_latency = executor_light_done.load() - light_start;
+    printf("[INFO] Test recv executor, light latency %ld us, heavy done after %ld us, executed %lu\n",
+        light_latency, executor_heavy_done.load() - light_start, executor.executed());
+    CHECK( executor_light_done.load() > 0 && executor_heavy_done.load() > 0 );
+    CHECK( executor_light_done.load() < executor_heavy_done.load() );
+    CHECK( light_latency < Executor_Heavy_Ms * 1000 / 2 );
+    CHECK( executor.executed() == 1 );
+    return 0;
+}
+
+// 客户端连接后发送一个请求并等待接收，返回接收结果，超时返回Ok
+static int executor_client_result(rpc::RPC_Service<> &client, const char * endpoint, int wait_ms, 
+    const std::function<void ()> &poll = std::function<void ()>())
+{
+    std::atomic<int> recv_ec(rpc::RPC_Constants::Ok);
+    std::atomic<bool> recv_done(false);
+    client.set_conn_handler([&client](rpc::RPC_SocketChannel *p_channel, int ec) {
+        if ( ec != rpc::RPC_Constants::Ok ) return rpc::RPC_Constants::Fail;
+        client.post_send(p_channel, executor_message(Executor_Heavy), -1);
+        return client.post_receive(p_channel, test_buffers.message(Executor_Message_Size), -1) ? rpc::RPC_Constants::Ok : rpc::RPC_Constants::Fail;
+    });
+    client.set_send_handler(PressureSendHandler(client));
+    client.set_recv_handler([&recv_ec, &recv_done](rpc::RPC_SocketChannel *p_channel, rpc::RPC_Message &msg, int ec) {
+        recv_ec.store(ec);
+        recv_done.store(true);
+        return rpc::RPC_Constants::Ok;
+    });
+    if ( !client.open_channel(endpoint, 3000) ) return rpc::RPC_Constants::Ok;
+    int64_t start = everest::DateTime::get_timestamp();
+    while ( !recv_done.load() && everest::DateTime::get_timestamp() - start < (int64_t)wait_ms * 1000 ) {
+        client.run_once(10);
+        if ( poll ) poll();
+    }
+    return recv_ec.load();
+}
+
+// 工作线程中的handler执行时关闭channel: handler结束前channel不删除(连接不关闭)，结束后删除
+int test_executor_close()
+{
+    everest::Work_Stealing_Executor executor(1);
+    std::atomic<rpc::RPC_SocketChannel *> server_channel(nullptr);
+    std::atomic<bool> started(false), release(false), connected(false);
+    rpc::RPC_Service<> server;
+    server.set_recv_executor(&executor);
+    server.set_accept_handler(AcceptReceiveHandler(server, Executor_Message_Size, [&server_channel](rpc::RPC_Service<> &, rpc::RPC_SocketChannel *p_channel) {
+        server_channel.store(p_channel);
+        return true;
+    }));
+    server.set_recv_handler([&](rpc::RPC_SocketChannel *p_channel, rpc::RPC_Message &msg, int ec) {
+        if ( ec != rpc::RPC_Constants::Ok ) return rpc::RPC_Constants::Fail;
+        started.store(true);
+        while ( !release.load() ) ::usleep(1000);
+        connected.store(p_channel->state() == rpc::RPC_Constants::State_Connected);    // channel仍然有效
+        return rpc::RPC_Constants::Ok;
+    });
+    rpc::RPC_Service<>::ListenerPtr p_listener = server.open_listener(RPC_JOB_CLOSE_ENDPOINT);
+    CHECK( p_listener != nullptr );
+    CHECK( server.post_accept(p_listener, -1) );
+    std::thread loop([&server]() { server.run(); });
+
+    int64_t closed_at = 0;
+    bool early_eof = false;
+    rpc::RPC_Service<> client;
+    int ec = executor_client_result(client, RPC_JOB_CLOSE_ENDPOINT, 3000, [&]() {
+        int64_t now = everest::DateTime::get_timestamp();
+        if ( closed_at == 0 && started.load() ) {
+            server.close_channel(server_channel.load());
+            closed_at = now;
+        } else if ( closed_at > 0 && !release.load() && now - closed_at > 100000 ) {
+            release.store(true);    // 关闭后100ms内连接未断开，放行handler
+        }
+    });
+    early_eof = !release.load();
+    server.stop();
+    loop.join();
+    executor.stop();
+
+    printf("[INFO] Test executor close, recv ec %d, early eof %d, connected %d\n", ec, early_eof, connected.load());
+    CHECK( closed_at > 0 );
+    CHECK( !early_eof );
+    CHECK( connected.load() );
+    CHECK( ec == rpc::RPC_Constants::Fail );        // handler结束后channel删除，客户端收到EOF
+    return 0;
+}
+
+// handler对收到的请求返回Fail: 无论是否交给执行器，连接都被abort，客户端的接收以Fail结束
+int test_handler_fail(const char * endpoint, bool with_executor)
+{
+    everest::Work_Stealing_Executor executor(1);
+    rpc::RPC_Service<> server;
+    if ( with_executor ) server.set_recv_executor(&executor);
+    server.set_accept_handler(AcceptReceiveHandler(server, Executor_Message_Size));
+    server.set_recv_handler([](rpc::RPC_SocketChannel *p_channel, rpc::RPC_Message &msg, int ec) {
+        return rpc::RPC_Constants::Fail;
+    });
+    rpc::RPC_Service<>::ListenerPtr p_listener = server.open_listener(endpoint);
+    CHECK( p_listener != nullptr );
+    CHECK( server.post_accept(p_listener, -1) );
+    std::thread loop([&server]() { server.run(); });
+
+    rpc::RPC_Service<> client;
+    int ec = executor_client_result(client, endpoint, 2000);
+    server.stop();
+    loop.join();
+    executor.stop();
+
+    printf("[INFO] Test handler fail, executor %d, recv ec %d, executed %lu\n", with_executor, ec, executor.executed());
+    CHECK( ec == rpc::RPC_Constants::Fail );
+    CHECK( executor.executed() == (with_executor ? 1u : 0u) );
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    CHECK( 0 == test_recv_executor() );
+    CHECK( 0 == test_executor_close() );
+    CHECK( 0 == test_handler_fail(RPC_FAIL_ENDPOINT, false) );
+    CHECK( 0 == test_handler_fail(RPC_JOB_FAIL_ENDPOINT, true) );
+    return 0;
+}
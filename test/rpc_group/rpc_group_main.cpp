@@ -0,0 +1,383 @@
+#include <everest/rpc/RPC_ServiceGroup.h>
+#include <everest/rpc/RPC_Partition.h>
+#include <everest/thread_group.h>
+#include "../common/rpc_test.h"
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+#define RPC_GROUP_ENDPOINT   "127.0.0.1:9998"
+#define RPC_POST_ENDPOINT    "127.0.0.1:9997"
+#define RPC_MIGRATE_ENDPOINT  "127.0.0.1:9981"
+#define RPC_BALANCE_ENDPOINT  "127.0.0.1:9980"
+#define RPC_STEER_ENDPOINT    "127.0.0.1:9978"
+#define RPC_PARTITION_ENDPOINT "127.0.0.1:9977"
+
+static const int Group_Threads = 2;
+static const int Client_Channels = 8;
+
+std::atomic<int> accepted_count(0);
+
+class GroupAcceptHandler
+{
+private:
+    rpc::RPC_Service<> &m_service;
+
+public:
+    GroupAcceptHandler(rpc::RPC_Service<> &service)
+        : m_service(service) {}
+
+    int operator()(rpc::RPC_SocketListener *p_listener, rpc::RPC_SocketChannel * p_channel, int ec)
+    {
+        if ( ec != rpc::RPC_Constants::Ok ) return rpc::RPC_Constants::Fail;
+
+        // 新连接留在接受它的线程上
+        bool isok = m_service.add_channel(p_channel);
+        if ( !isok ) return rpc::RPC_Constants::Fail;
+
+        printf("[INFO] Test GroupAcceptHandler, service %p, channel %p\n", &m_service, p_channel);
+        accepted_count.fetch_add(1);
+        return rpc::RPC_Constants::Ok;
+    }
+};
+
+int test_service_group()
+{
+    rpc::RPC_ServiceGroup<> group(Group_Threads);
+    CHECK( group.size() == Group_Threads );
+
+    group.set_accept_handler<GroupAcceptHandler>();
+    CHECK( group.open_listener(RPC_GROUP_ENDPOINT, -1) );
+    CHECK( group.start() );
+
+    rpc::RPC_Service<> client;
+    client.set_conn_handler(ClientConnectHandler(client));
+    for(int i = 0; i < Client_Channels; ++i ) {
+        CHECK( client.open_channel(RPC_GROUP_ENDPOINT, 3000) );
+    }
+
+    for(int i = 0; i < 300; ++i ) {
+        if ( accepted_count.load() == Client_Channels && connected_count.load() == Client_Channels ) break;
+        if ( client.run_once() == 0 ) ::usleep(10000);
+    }
+    group.stop();
+
+    printf("[INFO] Test service group, accepted %d, connected %d\n", accepted_count.load(), connected_count.load());
+    CHECK( accepted_count.load() == Client_Channels );
+    CHECK( connected_count.load() == Client_Channels );
+    return 0;
+}
+
+std::atomic<rpc::RPC_SocketChannel *> post_channel(nullptr);
+std::atomic<int64_t> post_sent_time(0);
+
+class PostSendHandler
+{
+public:
+    PostSendHandler(rpc::RPC_Service<> &service) {}
+
+    int operator()(rpc::RPC_SocketChannel *p_channel, rpc::RPC_Message &msg, int ec) {
+        post_sent_time.store(everest::DateTime::get_timestamp());
+        return rpc::RPC_Constants::Ok;
+    }
+};
+
+// 其它线程投递的发送任务应立即唤醒阻塞在poller上的proactor
+int test_cross_thread_post()
+{
+    rpc::RPC_Service<> server;
+    server.set_accept_handler(AcceptReceiveHandler(server, 0, [](rpc::RPC_Service<> &, rpc::RPC_SocketChannel *p_channel) {
+        post_channel.store(p_channel);
+        return true;
+    }));
+    server.set_send_handler(PostSendHandler(server));
+    rpc::RPC_Service<>::ListenerPtr p_listener = server.open_listener(RPC_POST_ENDPOINT);
+    CHECK( p_listener != nullptr );
+    CHECK( server.post_accept(p_listener, -1) );
+    
+    std::atomic<bool> running(true);
+    std::thread loop([&server, &running]() {
+        while ( running.load() ) server.run_once();
+    });
+    
+    rpc::RPC_Service<> client;
+    connected_count.store(0);
+    client.set_conn_handler(ClientConnectHandler(client));
+    CHECK( client.open_channel(RPC_POST_ENDPOINT, 3000) );
+    for(int i = 0; i < 300 && (connected_count.load() == 0 || post_channel.load() == nullptr); ++i ) {
+        if ( client.run_once() == 0 ) ::usleep(10000);
+    }
+    CHECK( post_channel.load() != nullptr );
+    
+    int64_t max_latency = 0;
+    for(int i = 0; i < 3; ++i ) {
+        rpc::RPC_Message msg = test_buffers.message(64);
+        msg.init_header();
+        msg.update_header();
+        
+        ::usleep(20000);     // 确保proactor已阻塞在poller上
+        post_sent_time.store(0);
+        int64_t start = everest::DateTime::get_timestamp();
+        CHECK( server.post_send(post_channel.load(), msg, -1) );
+        for(int n = 0; n < 10000 && post_sent_time.load() == 0; ++n ) ::usleep(100);
+        int64_t latency = post_sent_time.load() - start;
+        printf("[INFO] Test cross thread post, latency %ld us\n", latency);
+        if ( post_sent_time.load() == 0 || latency > max_latency ) max_latency = post_sent_time.load() ? latency : INT64_MAX;
+    }
+    running.store(false);
+    loop.join();
+    
+    // 不唤醒时需等待整个Max_Wait_Time
+    CHECK( max_latency < rpc::RPC_Constants::Max_Wait_Time * 1000 / 2 );
+    return 0;
+}
+
+static const uint64_t Migrate_Requests = 3000;
+
+// 流水线请求进行中把服务端channel迁移到另一个线程，应答不丢失、不乱序
+int test_channel_migration()
+{
+    seq_server_channels.clear();
+    rpc::RPC_Service<> server_a;
+    rpc::RPC_Service<> server_b;
+    server_a.set_accept_handler(seq_accept_handler(server_a));
+    server_a.set_recv_handler(SeqEchoHandler(server_a));
+    server_a.set_send_handler(PressureSendHandler(server_a));
+    server_a.set_read_ahead(4096);
+    server_b.set_recv_handler(SeqEchoHandler(server_b));
+    server_b.set_send_handler(PressureSendHandler(server_b));
+    server_b.set_read_ahead(4096);
+    rpc::RPC_Service<>::ListenerPtr p_listener = server_a.open_listener(RPC_MIGRATE_ENDPOINT);
+    CHECK( p_listener != nullptr );
+    CHECK( server_a.post_accept(p_listener, -1) );
+    std::thread loop_a([&server_a]() { server_a.run(); });
+    std::thread loop_b([&server_b]() { server_b.run(); });
+
+    rpc::RPC_Service<> client;
+    Seq_Client seq_client(client, 1, Migrate_Requests, 16);
+    CHECK( client.open_channel(RPC_MIGRATE_ENDPOINT, 3000) );
+
+    bool migrated = false;
+    int64_t start = everest::DateTime::get_timestamp();
+    while ( !seq_client.done() && everest::DateTime::get_timestamp() - start < 10000000 ) {
+        client.run_once(10);
+        if ( !migrated && seq_client.received >= Migrate_Requests / 3 ) {
+            rpc::RPC_SocketChannel * p_channel = nullptr;
+            {
+                std::lock_guard<std::mutex> lock(seq_server_mutex);
+                if ( !seq_server_channels.empty() ) p_channel = seq_server_channels[0];
+            }
+            CHECK( p_channel != nullptr );
+            CHECK( server_a.migrate_channel(p_channel, server_b) );
+            migrated = true;
+        }
+    }
+    server_a.stop();
+    server_b.stop();
+    loop_a.join();
+    loop_b.join();
+
+    int handled_a = seq_handled(server_a);
+    int handled_b = seq_handled(server_b);
+    printf("[INFO] Test channel migration, received %lu, disorder %lu, handled a %d, b %d\n",
+        seq_client.received, seq_client.disorder, handled_a, handled_b);
+    CHECK( seq_client.done() && seq_client.disorder == 0 );
+    CHECK( handled_a + handled_b == (int)Migrate_Requests );
+#ifndef EVEREST_RPC_USE_IO_URING
+    CHECK( handled_a > 0 && handled_b > 0 );     // io_uring proactor不支持迁移，channel留在原线程
+#endif
+    return 0;
+}
+
+static const int      Balance_Channels = 4;
+static const uint64_t Balance_Requests = 20000;
+
+// 全部连接由服务组的第一个线程接受，均衡器把部分channel迁移到空闲的线程
+int test_group_balancer()
+{
+    seq_server_channels.clear();
+    rpc::RPC_ServiceGroup<> group(2);
+    group.set_recv_handler<SeqEchoHandler>();
+    group.set_send_handler<PressureSendHandler>();
+    group.service(0).set_accept_handler(seq_accept_handler(group.service(0)));
+    rpc::RPC_Service<>::ListenerPtr p_listener = group.service(0).open_listener(RPC_BALANCE_ENDPOINT);
+    CHECK( p_listener != nullptr );
+    CHECK( group.service(0).post_accept(p_listener, -1) );
+    group.enable_balancer(50, 0.2);
+    CHECK( group.start() );
+
+    rpc::RPC_Service<> client;
+    Seq_Client seq_client(client, Balance_Channels, Balance_Requests, 8);
+    for(int i = 0; i < Balance_Channels; ++i ) CHECK( client.open_channel(RPC_BALANCE_ENDPOINT, 3000) );
+    int64_t start = everest::DateTime::get_timestamp();
+    while ( !seq_client.done() && everest::DateTime::get_timestamp() - start < 20000000 ) {
+        client.run_once(10);
+    }
+    group.stop();
+
+    int handled_0 = seq_handled(group.service(0));
+    int handled_1 = seq_handled(group.service(1));
+    printf("[INFO] Test group balancer, received %lu, disorder %lu, migrations %lu, handled %d / %d\n",
+        seq_client.received, seq_client.disorder, group.migrations(), handled_0, handled_1);
+    CHECK( seq_client.done() && seq_client.disorder == 0 );
+#ifndef EVEREST_RPC_USE_IO_URING
+    CHECK( group.migrations() > 0 && handled_1 > 0 );
+#endif
+    return 0;
+}
+
+static const int Steer_Channels = 32;
+
+struct Steer_Record
+{
+    rpc::RPC_Service<> * p_service;
+    int                  cpu;
+};
+
+std::mutex steer_mutex;
+std::vector<Steer_Record> steer_records;
+
+// cpu亲和的监听器: 每个线程绑定一个可用cpu，某cpu收到的连接交给绑定该cpu的线程，
+// 其它cpu收到的按cpu取模分配；线程多于cpu时拒绝打开
+int test_cpu_steering()
+{
+    steer_records.clear();
+    rpc::RPC_ServiceGroup<> unpinned(2);
+    CHECK( !unpinned.open_listener(RPC_STEER_ENDPOINT, -1, true) );     // 线程未绑定cpu
+
+    // 每个线程绑定进程可用的一个cpu
+    std::vector<int> cpus;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CHECK( ::sched_getaffinity(0, sizeof(set), &set) == 0 );
+    for(int cpu = 0; cpu < CPU_SETSIZE; ++cpu ) {
+        if ( CPU_ISSET(cpu, &set) ) cpus.push_back(cpu);
+    }
+
+    // 线程多于cpu时循环复用cpu，后面的线程收不到连接，拒绝打开
+    everest::Thread_Group shared("steer_shared", cpus.size() + 1, cpus);
+    rpc::RPC_ServiceGroup<> oversized(shared);
+    CHECK( !oversized.open_listener(RPC_STEER_ENDPOINT, -1, true) );
+
+    everest::Thread_Group threads("steer", cpus.size(), cpus);
+    rpc::RPC_ServiceGroup<> group(threads);
+    for(size_t i = 0; i < group.size(); ++i ) {
+        // 记录接受连接的服务和内核收到该连接的cpu
+        group.service(i).set_accept_handler(AcceptReceiveHandler(group.service(i), 0, [](rpc::RPC_Service<> &service, rpc::RPC_SocketChannel *p_channel) {
+            std::lock_guard<std::mutex> lock(steer_mutex);
+            steer_records.push_back(Steer_Record{ &service, p_channel->get_socket().incoming_cpu() });
+            return true;
+        }));
+    }
+    CHECK( group.open_listener(RPC_STEER_ENDPOINT, -1, true) );
+    CHECK( group.start() );
+
+    rpc::RPC_Service<> client;
+    int connected = 0;
+    client.set_conn_handler([&connected](rpc::RPC_SocketChannel *p_channel, int ec) {
+        if ( ec == rpc::RPC_Constants::Ok ) ++connected;
+        return rpc::RPC_Constants::Ok;
+    });
+    for(int i = 0; i < Steer_Channels; ++i ) CHECK( client.open_channel(RPC_STEER_ENDPOINT, 3000) );
+    int64_t start = everest::DateTime::get_timestamp();
+    for(;;) {
+        client.run_once(10);
+        std::lock_guard<std::mutex> lock(steer_mutex);
+        if ( (int)steer_records.size() >= Steer_Channels ) break;
+        if ( everest::DateTime::get_timestamp() - start > 5000000 ) break;
+    }
+    group.stop();
+
+    int misplaced = 0;
+    int first = 0;
+    for(size_t i = 0; i < steer_records.size(); ++i ) {
+        // 绑定的cpu对应该线程，其它cpu按过滤程序取模
+        size_t expected = std::find(cpus.begin(), cpus.end(), steer_records[i].cpu) - cpus.begin();
+        if ( expected == cpus.size() ) expected = (size_t)steer_records[i].cpu % cpus.size();
+        if ( steer_records[i].p_service != &group.service(expected) ) ++misplaced;
+        if ( steer_records[i].p_service == &group.service(0) ) ++first;
+    }
+    printf("[INFO] Test cpu steering, connected %d, accepted %lu, first %d, misplaced %d, local %lu / %lu\n",
+        connected, steer_records.size(), first, misplaced, group.local_accepts(), group.tracked_accepts());
+    CHECK( (int)steer_records.size() == Steer_Channels && misplaced == 0 );
+    CHECK( group.tracked_accepts() == (uint64_t)Steer_Channels );
+    CHECK( group.local_accepts() <= group.tracked_accepts() );
+    return 0;
+}
+
+static const int      Partition_Channels = 2;
+static const uint64_t Partition_Requests = 3000;
+
+// 分片状态只由所属线程访问，不加锁
+struct Partition_Shard
+{
+    std::thread::id owner;
+    uint64_t        handled;
+    uint64_t        foreign;    // 不在所属线程处理的次数
+};
+
+// 连接都由第一个线程接受，key(请求ID)为奇数的请求转给第二个线程处理，应答交回第一个线程发送
+int test_partition()
+{
+    rpc::RPC_ServiceGroup<> group(2);
+    rpc::RPC_Partition<> partition(group, 8);     // 小邮箱，流水线请求会溢出暂存
+    Partition_Shard shards[2];
+    for(int i = 0; i < 2; ++i ) shards[i].handled = shards[i].foreign = 0;
+
+    partition.set_shard_handler([&shards](size_t shard, rpc::RPC_Message &request, rpc::RPC_Message &reply) {
+        Partition_Shard &state = shards[shard];
+        if ( state.handled++ == 0 ) state.owner = std::this_thread::get_id();
+        else if ( state.owner != std::this_thread::get_id() ) ++state.foreign;
+        reply = pressure_message(Seq_Message_Size, 0);
+        reply.request_id(request.request_id());
+        return true;
+    });
+    for(size_t i = 0; i < group.size(); ++i ) {
+        rpc::RPC_Service<> &service = group.service(i);
+        service.set_recv_handler([&service, &partition](rpc::RPC_SocketChannel *p_channel, rpc::RPC_Message &msg, int ec) {
+            if ( ec != rpc::RPC_Constants::Ok ) return rpc::RPC_Constants::Fail;
+            if ( !partition.route(p_channel, msg) ) return rpc::RPC_Constants::Fail;
+            service.post_receive(p_channel, test_buffers.message(Seq_Message_Size), -1);    // 新的缓冲区，转发的请求仍在使用原缓冲区
+            return rpc::RPC_Constants::Ok;
+        });
+    }
+    group.set_send_handler<PressureSendHandler>();
+    group.service(0).set_accept_handler(seq_accept_handler(group.service(0)));
+    rpc::RPC_Service<>::ListenerPtr p_listener = group.service(0).open_listener(RPC_PARTITION_ENDPOINT);
+    CHECK( p_listener != nullptr );
+    CHECK( group.service(0).post_accept(p_listener, -1) );
+    CHECK( group.start() );
+
+    rpc::RPC_Service<> client;
+    Seq_Client seq_client(client, Partition_Channels, Partition_Requests, 32);
+    for(int i = 0; i < Partition_Channels; ++i ) CHECK( client.open_channel(RPC_PARTITION_ENDPOINT, 3000) );
+    int64_t start = everest::DateTime::get_timestamp();
+    while ( !seq_client.done() && everest::DateTime::get_timestamp() - start < 10000000 ) {
+        client.run_once(10);
+    }
+    group.stop();
+
+    uint64_t total = Partition_Channels * Partition_Requests;
+    printf("[INFO] Test partition, received %lu, handled %lu / %lu, forwarded %lu, overflowed %lu\n",
+        seq_client.received, shards[0].handled, shards[1].handled, partition.forwarded(), partition.overflowed());
+    CHECK( seq_client.done() );
+    CHECK( partition.handled() == total && shards[0].handled + shards[1].handled == total );
+    CHECK( shards[0].handled == total / 2 && shards[1].handled == total / 2 );
+    CHECK( shards[0].foreign == 0 && shards[1].foreign == 0 );
+    CHECK( partition.forwarded() == total / 2 );
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    CHECK( 0 == test_service_group() );
+    CHECK( 0 == test_cross_thread_post() );
+    CHECK( 0 == test_channel_migration() );
+    CHECK( 0 == test_group_balancer() );
+    CHECK( 0 == test_cpu_steering() );
+    CHECK( 0 == test_partition() );
+    return 0;
+}
@@ -0,0 +1,309 @@
+#include <everest/rpc/RPC_Server.h>
+#include <everest/rpc/RPC_Client.h>
+#include "../common/rpc_test.h"
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#define RPC_STORM_ENDPOINT    "127.0.0.1:9983"
+#define RPC_STATIC_ENDPOINT   "127.0.0.1:9982"
+#define RPC_BACKOFF_ENDPOINT  "127.0.0.1:9973"
+#define RPC_CLOSE_LISTENER_ENDPOINT "127.0.0.1:9968"
+
+// 没有任务时run_for阻塞等待而不空转，stop()从其它线程唤醒run()；
+// 忙轮询模式下先自旋，自旋落空后仍然阻塞
+int test_run_loop()
+{
+    rpc::RPC_Service<> service;
+    int64_t start = everest::DateTime::get_timestamp();
+    service.run_for(300);
+    int64_t elapsed = everest::DateTime::get_timestamp() - start;
+    uint64_t idle_syscalls = service.syscall_count();
+    printf("[INFO] Test run loop, run_for 300 ms, elapsed %ld us, syscalls %lu\n", elapsed, idle_syscalls);
+    CHECK( elapsed >= 300000 && elapsed < 1000000 );
+    CHECK( idle_syscalls < 20 );
+
+    std::thread loop([&service]() { service.run(); });
+    usleep(50000);
+    start = everest::DateTime::get_timestamp();
+    service.stop();
+    loop.join();
+    elapsed = everest::DateTime::get_timestamp() - start;
+    printf("[INFO] Test run loop, stopped in %ld us\n", elapsed);
+    CHECK( service.stopped() );
+    CHECK( elapsed < 50000 );
+
+    service.restart();
+    service.set_busy_poll(1000);
+    service.run_for(100);
+    printf("[INFO] Test run loop, busy poll hits %lu, misses %lu\n", service.busy_poll_hits(), service.busy_poll_misses());
+    CHECK( service.busy_poll_misses() > 0 );
+    return 0;
+}
+
+static const int    Storm_Channels = 200;
+static const size_t Storm_Budget   = 64;
+
+int storm_accepted = 0;
+int storm_blocking = 0;     // 接受后仍为阻塞模式的连接数
+
+// 大量连接已在监听队列中，每次可读事件接受一批，少数几轮即可全部接受
+int test_accept_storm()
+{
+    rpc::RPC_Service<> server;
+    server.set_accept_handler(AcceptReceiveHandler(server, 0, [](rpc::RPC_Service<> &, rpc::RPC_SocketChannel *p_channel) {
+        ++storm_accepted;
+        if ( (::fcntl(p_channel->get_socket().handle(), F_GETFL) & O_NONBLOCK) == 0 ) ++storm_blocking;
+        return true;
+    }));
+    server.set_accept_budget(Storm_Budget);
+    rpc::RPC_Service<>::ListenerPtr p_listener = server.open_listener(RPC_STORM_ENDPOINT);
+    CHECK( p_listener != nullptr );
+
+    // 内核在监听队列中完成握手，服务端尚未接受时客户端已连接
+    rpc::RPC_Service<> client;
+    int connected = 0;
+    client.set_conn_handler([&connected](rpc::RPC_SocketChannel *p_channel, int ec) {
+        if ( ec == rpc::RPC_Constants::Ok ) ++connected;
+        return rpc::RPC_Constants::Ok;
+    });
+    for(int i = 0; i < Storm_Channels; ++i ) CHECK( client.open_channel(RPC_STORM_ENDPOINT, 3000) );
+    int64_t start = everest::DateTime::get_timestamp();
+    while ( connected < Storm_Channels && everest::DateTime::get_timestamp() - start < 5000000 ) {
+        client.run_once(10);
+    }
+    CHECK( connected == Storm_Channels );
+
+    CHECK( server.post_accept(p_listener, -1) );
+    uint64_t syscalls = server.syscall_count();
+    int rounds = 0;
+    start = everest::DateTime::get_timestamp();
+    while ( storm_accepted < Storm_Channels && everest::DateTime::get_timestamp() - start < 5000000 ) {
+        if ( server.run_once(10) > 0 ) ++rounds;
+    }
+    syscalls = server.syscall_count() - syscalls;
+    printf("[INFO] Test accept storm, accepted %d, blocking %d, rounds %d, syscalls %lu\n",
+        storm_accepted, storm_blocking, rounds, syscalls);
+    CHECK( storm_accepted == Storm_Channels );
+    CHECK( storm_blocking == 0 );
+    CHECK( rounds <= Storm_Channels / (int)Storm_Budget + 2 );
+    return 0;
+}
+
+// 文件描述符用完时accept一直失败: 监听器暂停一段时间再重试，而不是每轮都重试(水平触发下空转)；
+// 恢复后接受监听队列中的连接
+int test_accept_backoff()
+{
+    int accepted = 0;
+    rpc::RPC_Service<> server;
+    server.set_accept_handler([&server, &accepted](rpc::RPC_SocketListener *p_listener, rpc::RPC_SocketChannel *p_channel, int ec) {
+        if ( ec != rpc::RPC_Constants::Ok || !server.add_channel(p_channel) ) return rpc::RPC_Constants::Fail;
+        ++accepted;
+        return rpc::RPC_Constants::Ok;
+    });
+    rpc::RPC_Service<>::ListenerPtr p_listener = server.open_listener(RPC_BACKOFF_ENDPOINT);
+    CHECK( p_listener != nullptr );
+
+    rpc::RPC_Service<> client;
+    int connected = 0;
+    client.set_conn_handler([&connected](rpc::RPC_SocketChannel *p_channel, int ec) {
+        if ( ec == rpc::RPC_Constants::Ok ) ++connected;
+        return rpc::RPC_Constants::Ok;
+    });
+    CHECK( client.open_channel(RPC_BACKOFF_ENDPOINT, 3000) );
+    int64_t start = everest::DateTime::get_timestamp();
+    while ( connected == 0 && everest::DateTime::get_timestamp() - start < 3000000 ) client.run_once(10);
+    CHECK( connected == 1 );
+
+    // 软限制降到下一个可用的描述符，之后的accept返回EMFILE
+    struct rlimit saved, limited;
+    CHECK( ::getrlimit(RLIMIT_NOFILE, &saved) == 0 );
+    int next_fd = ::dup(0);
+    CHECK( next_fd >= 0 );
+    ::close(next_fd);
+    limited = saved;
+    limited.rlim_cur = next_fd;
+    CHECK( ::setrlimit(RLIMIT_NOFILE, &limited) == 0 );
+
+    CHECK( server.post_accept(p_listener, -1) );
+    uint64_t syscalls = server.syscall_count();
+    start = everest::DateTime::get_timestamp();
+    while ( everest::DateTime::get_timestamp() - start < 300000 ) server.run_once(50);
+    syscalls = server.syscall_count() - syscalls;
+    int accepted_limited = accepted;
+    CHECK( ::setrlimit(RLIMIT_NOFILE, &saved) == 0 );
+
+    start = everest::DateTime::get_timestamp();
+    while ( accepted == 0 && everest::DateTime::get_timestamp() - start < 3000000 ) server.run_once(10);
+    printf("[INFO] Test accept backoff, syscalls %lu while limited, accepted %d / %d\n", syscalls, accepted_limited, accepted);
+    CHECK( accepted_limited == 0 );
+    CHECK( syscalls < 100 );
+    CHECK( accepted == 1 );
+    return 0;
+}
+
+static const int    Static_Calls        = 200;
+static const size_t Static_Request_Size = 32;
+
+// 自定义回调策略: proactor直接调用，应答每个请求
+struct Static_Echo_Handlers
+{
+    rpc::RPC_Service<rpc::RPC_TcpSocketService_Impl, Static_Echo_Handlers> * p_service;
+    int accepted;
+    int received;
+    int sent;
+
+    Static_Echo_Handlers() : p_service(nullptr), accepted(0), received(0), sent(0) {}
+
+    int on_accept(rpc::RPC_SocketListener *p_listener, rpc::RPC_SocketChannel *p_channel, int ec);
+    int on_connect(rpc::RPC_SocketChannel *p_channel, int ec) { return rpc::RPC_Constants::Ok; }
+    int on_send(rpc::RPC_SocketChannel *p_channel, rpc::RPC_Message &msg, int ec);
+    int on_receive(rpc::RPC_SocketChannel *p_channel, rpc::RPC_Message &msg, int ec);
+};
+
+typedef rpc::RPC_Service<rpc::RPC_TcpSocketService_Impl, Static_Echo_Handlers> Static_Service;
+
+int Static_Echo_Handlers::on_accept(rpc::RPC_SocketListener *p_listener, rpc::RPC_SocketChannel *p_channel, int ec)
+{
+    if ( ec != rpc::RPC_Constants::Ok ) return rpc::RPC_Constants::Fail;
+    ++accepted;
+    if ( !p_service->add_channel(p_channel) ) return rpc::RPC_Constants::Fail;
+    return p_service->post_receive(p_channel, test_buffers.message(Static_Request_Size), -1) ? rpc::RPC_Constants::Ok : rpc::RPC_Constants::Fail;
+}
+
+int Static_Echo_Handlers::on_send(rpc::RPC_SocketChannel *p_channel, rpc::RPC_Message &msg, int ec)
+{
+    if ( ec == rpc::RPC_Constants::Ok ) ++sent;
+    return rpc::RPC_Constants::Ok;
+}
+
+int Static_Echo_Handlers::on_receive(rpc::RPC_SocketChannel *p_channel, rpc::RPC_Message &msg, int ec)
+{
+    if ( ec != rpc::RPC_Constants::Ok ) return rpc::RPC_Constants::Fail;
+    ++received;
+    rpc::RPC_Message reply = pressure_message(rpc::RPC_Message::Header_Length + 8, 0);
+    reply.request_id(msg.request_id());
+    reply.type(rpc::RPC_Message::Type_Reply);
+    p_service->post_send(p_channel, reply, -1);
+    p_service->post_receive(p_channel, test_buffers.message(Static_Request_Size), -1);
+    return rpc::RPC_Constants::Ok;
+}
+
+// 服务端使用静态回调策略，客户端使用默认策略，两者互通
+int test_static_handlers()
+{
+    Static_Service server;
+    server.handlers().p_service = &server;
+    Static_Service::ListenerPtr p_listener = server.open_listener(RPC_STATIC_ENDPOINT);
+    CHECK( p_listener != nullptr );
+    CHECK( server.post_accept(p_listener, -1) );
+    std::thread loop([&server]() { server.run(); });
+
+    rpc::RPC_Service<> client;
+    rpc::RPC_Client<> caller(client);
+    rpc::RPC_SocketChannel * p_channel = nullptr;
+    client.set_conn_handler([&caller, &p_channel](rpc::RPC_SocketChannel *p_ch, int ec) {
+        if ( ec == rpc::RPC_Constants::Ok && caller.attach(p_ch) ) p_channel = p_ch;
+        return rpc::RPC_Constants::Ok;
+    });
+    CHECK( client.open_channel(RPC_STATIC_ENDPOINT, 3000) );
+    int64_t start = everest::DateTime::get_timestamp();
+    while ( p_channel == nullptr && everest::DateTime::get_timestamp() - start < 5000000 ) client.run_once(10);
+    CHECK( p_channel != nullptr );
+
+    int completed = 0;
+    int failed = 0;
+    for(int i = 0; i < Static_Calls; ++i ) {
+        uint64_t id = caller.call(p_channel, pressure_message(Static_Request_Size, i), [&completed, &failed](int ec, rpc::RPC_Message &reply) {
+            if ( ec == rpc::RPC_Constants::Ok && reply.type() == rpc::RPC_Message::Type_Reply ) ++completed;
+            else ++failed;
+        }, 3000);
+        CHECK( id != 0 );
+    }
+    start = everest::DateTime::get_timestamp();
+    while ( completed + failed < Static_Calls && everest::DateTime::get_timestamp() - start < 5000000 ) client.run_once(10);
+    server.stop();
+    loop.join();
+
+    const Static_Echo_Handlers & handlers = server.handlers();
+    printf("[INFO] Test static handlers, completed %d, failed %d, server accepted %d, received %d, sent %d\n",
+        completed, failed, handlers.accepted, handlers.received, handlers.sent);
+    CHECK( completed == Static_Calls && failed == 0 );
+    CHECK( handlers.accepted == 1 );
+    CHECK( handlers.received == Static_Calls );
+    CHECK( handlers.sent == Static_Calls );
+    return 0;
+}
+
+// 定时器在proactor线程按us精度回调，不提前；周期定时器可在回调中取消自身，取消的定时器不回调
+int test_user_timers()
+{
+    rpc::RPC_Service<> service;
+    int64_t start = everest::DateTime::get_monotonic_timestamp();
+    int64_t target = start + 1500;
+    int64_t fired_at = 0;
+    uint64_t once = service.schedule_at(target, [&fired_at]() { fired_at = everest::DateTime::get_monotonic_timestamp(); });
+
+    // 周期定时器按固定速率，第k次不早于start+k*周期；某次被推迟时与下一次的间隔可以小于周期
+    int ticks = 0;
+    int early_ticks = 0;
+    uint64_t every = 0;
+    every = service.schedule_every(2000, [&]() {
+        int64_t now = everest::DateTime::get_monotonic_timestamp();
+        if ( now < start + (int64_t)(ticks + 1) * 2000 ) ++early_ticks;
+        if ( ++ticks == 5 ) service.cancel_timer(every);
+    });
+
+    bool cancelled_fired = false;
+    uint64_t cancelled = service.schedule_after(1000, [&cancelled_fired]() { cancelled_fired = true; });
+    CHECK( service.cancel_timer(cancelled) );
+
+    // 回调中增加的定时器
+    bool nested_fired = false;
+    service.schedule_after(3000, [&service, &nested_fired]() {
+        service.schedule_after(500, [&nested_fired]() { nested_fired = true; });
+    });
+    CHECK( service.timer_count() == 3 );
+
+    while ( (ticks < 5 || !nested_fired) && everest::DateTime::get_monotonic_timestamp() - start < 2000000 ) {
+        service.run_once();
+    }
+    printf("[INFO] Test user timers, late %ld us, ticks %d, early ticks %d, fired %lu, syscalls %lu\n",
+        fired_at - target, ticks, early_ticks, service.timers_fired(), service.syscall_count());
+    CHECK( fired_at >= target );
+    CHECK( ticks == 5 && early_ticks == 0 );
+    CHECK( nested_fired && !cancelled_fired );
+    CHECK( !service.cancel_timer(once) && !service.cancel_timer(every) );
+    CHECK( service.timer_count() == 0 );
+    CHECK( service.timers_fired() == 8 );
+    return 0;
+}
+
+// 关闭监听器后端口可重新独占绑定；关闭前投递、未取出的accept任务被丢弃
+int test_close_listener()
+{
+    rpc::RPC_Service<> service;
+    rpc::RPC_Service<>::ListenerPtr p_listener = service.open_listener(RPC_CLOSE_LISTENER_ENDPOINT);
+    CHECK( p_listener != nullptr );
+    CHECK( service.post_accept(p_listener, -1) );
+    CHECK( service.close_listener(p_listener) );
+    service.run_once(0);
+
+    p_listener = service.open_listener(RPC_CLOSE_LISTENER_ENDPOINT);
+    CHECK( p_listener != nullptr );
+    CHECK( service.close_listener(p_listener) );
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    CHECK( 0 == test_run_loop() );
+    CHECK( 0 == test_accept_storm() );
+    CHECK( 0 == test_accept_backoff() );
+    CHECK( 0 == test_static_handlers() );
+    CHECK( 0 == test_user_timers() );
+    CHECK( 0 == test_close_listener() );
+    return 0;
+}
@@ -0,0 +1,595 @@
+#include <everest/rpc/RPC_Server.h>
+#include "../common/rpc_test.h"
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+#define RPC_TIMEOUT_ENDPOINT "127.0.0.1:9996"
+#define RPC_BATCH_ENDPOINT   "127.0.0.1:9992"
+#define RPC_LARGE_ENDPOINT   "127.0.0.1:9990"
+#define RPC_AHEAD_ENDPOINT   "127.0.0.1:9989"
+#define RPC_PRESSURE_ENDPOINT "127.0.0.1:9988"
+#define RPC_BUDGET_ENDPOINT   "127.0.0.1:9979"
+#define RPC_DIRECT_ENDPOINT   "127.0.0.1:9976"
+#define RPC_QUEUED_ENDPOINT   "127.0.0.1:9975"
+#define RPC_PARTIAL_ENDPOINT  "127.0.0.1:9974"
+
+std::atomic<int> timeout_ec(rpc::RPC_Constants::Ok);
+
+class TimeoutRecvHandler
+{
+public:
+    TimeoutRecvHandler(rpc::RPC_Service<> &service) {}
+
+    int operator()(rpc::RPC_SocketChannel *p_channel, rpc::RPC_Message &msg, int ec) {
+        timeout_ec.store(ec);
+        return rpc::RPC_Constants::Ok;
+    }
+};
+
+// 客户端连接后不发送数据，服务端的接收任务应以Timeout错误码结束
+int test_receive_timeout()
+{
+    rpc::RPC_Service<> server;
+    server.set_accept_handler(AcceptReceiveHandler(server, 0, [](rpc::RPC_Service<> &service, rpc::RPC_SocketChannel *p_channel) {
+        return service.post_receive(p_channel, test_buffers.message(64), 50);
+    }));
+    server.set_recv_handler(TimeoutRecvHandler(server));
+    rpc::RPC_Service<>::ListenerPtr p_listener = server.open_listener(RPC_TIMEOUT_ENDPOINT);
+    CHECK( p_listener != nullptr );
+    CHECK( server.post_accept(p_listener, -1) );
+
+    rpc::RPC_Service<> client;
+    client.set_conn_handler(ClientConnectHandler(client));
+    CHECK( client.open_channel(RPC_TIMEOUT_ENDPOINT, 3000) );
+
+    int64_t start = everest::DateTime::get_timestamp();
+    while ( timeout_ec.load() == rpc::RPC_Constants::Ok ) {
+        if ( everest::DateTime::get_timestamp() - start > 2000000 ) break;
+        client.run_once();
+        server.run_once();
+    }
+    int64_t elapsed = everest::DateTime::get_timestamp() - start;
+    printf("[INFO] Test receive timeout, ec %d, elapsed %ld us\n", timeout_ec.load(), elapsed);
+    CHECK( timeout_ec.load() == rpc::RPC_Constants::Timeout );
+    CHECK( elapsed >= 50000 );
+    return 0;
+}
+
+static const int    Batch_Messages = 16;
+static const size_t Batch_Message_Size = 64;
+
+std::atomic<int> batch_sent(0);
+std::atomic<int> batch_received(0);
+std::atomic<bool> batch_in_order(true);
+
+class BatchSendHandler
+{
+public:
+    BatchSendHandler(rpc::RPC_Service<> &service) {}
+
+    int operator()(rpc::RPC_SocketChannel *p_channel, rpc::RPC_Message &msg, int ec) {
+        if ( ec == rpc::RPC_Constants::Ok ) batch_sent.fetch_add(1);
+        return rpc::RPC_Constants::Ok;
+    }
+};
+
+class BatchConnectHandler
+{
+private:
+    rpc::RPC_Service<> &m_service;
+
+public:
+    BatchConnectHandler(rpc::RPC_Service<> &service) : m_service(service) {}
+
+    int operator()(rpc::RPC_SocketChannel *p_channel, int ec) {
+        if ( ec != rpc::RPC_Constants::Ok ) return rpc::RPC_Constants::Fail;
+        return m_service.post_receive(p_channel, test_buffers.message(Batch_Message_Size), -1) ? rpc::RPC_Constants::Ok : rpc::RPC_Constants::Fail;
+    }
+};
+
+class BatchRecvHandler
+{
+private:
+    rpc::RPC_Service<> &m_service;
+
+public:
+    BatchRecvHandler(rpc::RPC_Service<> &service) : m_service(service) {}
+
+    int operator()(rpc::RPC_SocketChannel *p_channel, rpc::RPC_Message &msg, int ec) {
+        if ( ec != rpc::RPC_Constants::Ok ) return rpc::RPC_Constants::Fail;
+        int index = batch_received.fetch_add(1);
+        if ( msg.size() != Batch_Message_Size || msg.buffers().front()[rpc::RPC_Message::Header_Length] != (char)index ) {
+            batch_in_order.store(false);
+        }
+        if ( index + 1 < Batch_Messages ) m_service.post_receive(p_channel, test_buffers.message(Batch_Message_Size), -1);
+        return rpc::RPC_Constants::Ok;
+    }
+};
+
+// flush模式下连续投递的多个消息合并发送，每个消息都应回调一次并按顺序到达；
+// read_ahead非0时客户端一次接收多个消息，从预读缓存交付
+int test_coalesced_send(const char * endpoint, size_t read_ahead)
+{
+    batch_sent.store(0);
+    batch_received.store(0);
+    batch_in_order.store(true);
+    
+    rpc::RPC_Service<> server;
+    server.set_flush_mode(true);
+    // 连接建立后一次投递多个消息，由同一次flush合并发送
+    server.set_accept_handler(AcceptReceiveHandler(server, 0, [](rpc::RPC_Service<> &service, rpc::RPC_SocketChannel *p_channel) {
+        for(int i = 0; i < Batch_Messages; ++i ) {
+            rpc::RPC_Message msg = test_buffers.message(Batch_Message_Size);
+            msg.init_header();
+            msg.buffers().front().size(Batch_Message_Size);
+            msg.buffers().front()[rpc::RPC_Message::Header_Length] = (char)i;
+            msg.update_header();
+            if ( !service.post_send(p_channel, msg, -1) ) return false;
+        }
+        return true;
+    }));
+    server.set_send_handler(BatchSendHandler(server));
+    rpc::RPC_Service<>::ListenerPtr p_listener = server.open_listener(endpoint);
+    CHECK( p_listener != nullptr );
+    CHECK( server.post_accept(p_listener, -1) );
+
+    rpc::RPC_Service<> client;
+    client.set_read_ahead(read_ahead);
+    client.set_conn_handler(BatchConnectHandler(client));
+    client.set_recv_handler(BatchRecvHandler(client));
+    CHECK( client.open_channel(endpoint, 3000) );
+
+    int64_t start = everest::DateTime::get_timestamp();
+    while ( batch_received.load() < Batch_Messages || batch_sent.load() < Batch_Messages ) {
+        if ( everest::DateTime::get_timestamp() - start > 2000000 ) break;
+        client.run_once();
+        server.run_once();
+    }
+    printf("[INFO] Test coalesced send, read ahead %lu, sent %d, received %d\n", 
+        read_ahead, batch_sent.load(), batch_received.load());
+    CHECK( batch_sent.load() == Batch_Messages );
+    CHECK( batch_received.load() == Batch_Messages );
+    CHECK( batch_in_order.load() );
+    return 0;
+}
+
+static const size_t Large_Body_Size = 8 * 1024 * 1024;
+
+std::atomic<int> large_sent(0);
+std::atomic<int> large_received(0);     // 1 内容正确，-1 内容错误
+
+class LargeRecvHandler
+{
+public:
+    LargeRecvHandler(rpc::RPC_Service<> &service) {}
+
+    // 先收消息头，再按长度分配一个消息体缓存继续接收，收完后检查内容
+    int operator()(rpc::RPC_SocketChannel *p_channel, rpc::RPC_Message &msg, int ec) {
+        if ( ec != rpc::RPC_Constants::Ok ) return rpc::RPC_Constants::Fail;
+        everest::Mutable_Buffer_Sequence & buffers = msg.buffers();
+        size_t body_size = msg.size() - rpc::RPC_Message::Header_Length;
+        if ( buffers.size() == rpc::RPC_Message::Header_Length ) {
+            buffers.push_back(test_buffers.buffer(body_size));
+            return rpc::RPC_Constants::Continue;
+        }
+        everest::Mutable_Byte_Buffer & body = *(++buffers.begin());
+        bool isok = (body_size == Large_Body_Size);
+        for(size_t i = 0; isok && i < body_size; ++i ) {
+            if ( body[i] != (char)(i % 251) ) isok = false;
+        }
+        large_received.store(isok ? 1 : -1);
+        return rpc::RPC_Constants::Ok;
+    }
+};
+
+class LargeSendHandler
+{
+public:
+    LargeSendHandler(rpc::RPC_Service<> &service) {}
+
+    int operator()(rpc::RPC_SocketChannel *p_channel, rpc::RPC_Message &msg, int ec) {
+        if ( ec == rpc::RPC_Constants::Ok ) large_sent.fetch_add(1);
+        return rpc::RPC_Constants::Ok;
+    }
+};
+
+// 连接建立后发送一个消息体分成两个缓存的大消息，发送端和接收端的缓存划分不同
+class LargeConnectHandler
+{
+private:
+    rpc::RPC_Service<> &m_service;
+
+public:
+    LargeConnectHandler(rpc::RPC_Service<> &service) : m_service(service) {}
+
+    int operator()(rpc::RPC_SocketChannel *p_channel, int ec) {
+        if ( ec != rpc::RPC_Constants::Ok ) return rpc::RPC_Constants::Fail;
+
+        size_t half = Large_Body_Size / 2 + 1;
+        rpc::RPC_Message msg = test_buffers.message(rpc::RPC_Message::Header_Length);
+        msg.init_header();
+        everest::Mutable_Byte_Buffer part1 = test_buffers.buffer(half);
+        everest::Mutable_Byte_Buffer part2 = test_buffers.buffer(Large_Body_Size - half);
+        part1.size(half);
+        part2.size(Large_Body_Size - half);
+        for(size_t i = 0; i < Large_Body_Size; ++i ) {
+            if ( i < half ) part1[i] = (char)(i % 251);
+            else part2[i - half] = (char)(i % 251);
+        }
+        msg.buffers().push_back(part1);
+        msg.buffers().push_back(part2);
+        msg.update_header();
+        return m_service.post_send(p_channel, msg, -1) ? rpc::RPC_Constants::Ok : rpc::RPC_Constants::Fail;
+    }
+};
+
+// 超过socket缓存的消息分多次sendmsg发送，从缓存的position继续，发完才回调一次
+int test_large_message()
+{
+    rpc::RPC_Service<> server;
+    server.set_read_ahead(64 * 1024);       // 消息体的前一部分经预读缓存复制，其余直接收到消息体缓存
+    server.set_accept_handler(AcceptReceiveHandler(server, rpc::RPC_Message::Header_Length));
+    server.set_recv_handler(LargeRecvHandler(server));
+    rpc::RPC_Service<>::ListenerPtr p_listener = server.open_listener(RPC_LARGE_ENDPOINT);
+    CHECK( p_listener != nullptr );
+    CHECK( server.post_accept(p_listener, -1) );
+
+    rpc::RPC_Service<> client;
+    client.set_send_batch_bytes(64 * 1024);
+    client.set_conn_handler(LargeConnectHandler(client));
+    client.set_send_handler(LargeSendHandler(client));
+    CHECK( client.open_channel(RPC_LARGE_ENDPOINT, 3000) );
+
+    int64_t start = everest::DateTime::get_timestamp();
+    while ( large_received.load() == 0 || large_sent.load() == 0 ) {
+        if ( everest::DateTime::get_timestamp() - start > 5000000 ) break;
+        client.run_once();
+        server.run_once();
+    }
+    printf("[INFO] Test large message, sent %d, received %d\n", large_sent.load(), large_received.load());
+    CHECK( large_sent.load() == 1 );
+    CHECK( large_received.load() == 1 );
+    return 0;
+}
+
+static const size_t Partial_Body_Size = 32 * 1024 * 1024;    // 超过两端socket缓存之和
+
+// 服务端先不接收，客户端的大消息只发出一部分后超时: 超时回调后排在其后的消息以Fail结束，
+// 连接被关闭，服务端之后收到消息的前一部分和EOF，而不是错位的下一个消息
+int test_partial_timeout()
+{
+    std::vector<char> header(rpc::RPC_Message::Header_Length);
+    std::vector<char> body(Partial_Body_Size);
+    std::vector<char> small(rpc::RPC_Message::Header_Length);
+    std::vector<char> recv_header(rpc::RPC_Message::Header_Length);
+    std::vector<char> recv_body(Partial_Body_Size);
+    everest::Mutable_Buffer_Sequence large_seq, small_seq, recv_seq;
+
+    rpc::RPC_SocketChannel * p_accepted = nullptr;
+    int recv_ok = 0, recv_failed = 0;
+    rpc::RPC_Service<> server;
+    server.set_accept_handler([&server, &p_accepted](rpc::RPC_SocketListener *p_listener, rpc::RPC_SocketChannel *p_channel, int ec) {
+        if ( ec != rpc::RPC_Constants::Ok || !server.add_channel(p_channel) ) return rpc::RPC_Constants::Fail;
+        p_accepted = p_channel;
+        return rpc::RPC_Constants::Ok;
+    });
+    server.set_recv_handler([&recv_body, &recv_ok, &recv_failed](rpc::RPC_SocketChannel *p_channel, rpc::RPC_Message &msg, int ec) {
+        if ( ec != rpc::RPC_Constants::Ok ) {
+            ++recv_failed;
+            return rpc::RPC_Constants::Fail;
+        }
+        everest::Mutable_Buffer_Sequence & buffers = msg.buffers();
+        if ( buffers.size() == rpc::RPC_Message::Header_Length ) {
+            buffers.push_back(everest::Mutable_Byte_Buffer(&recv_body[0], msg.size() - rpc::RPC_Message::Header_Length));
+            return rpc::RPC_Constants::Continue;
+        }
+        ++recv_ok;
+        return rpc::RPC_Constants::Ok;
+    });
+    rpc::RPC_Service<>::ListenerPtr p_listener = server.open_listener(RPC_PARTIAL_ENDPOINT);
+    CHECK( p_listener != nullptr );
+    CHECK( server.post_accept(p_listener, -1) );
+
+    std::vector<int> sent_ec;
+    rpc::RPC_Service<> client;
+    client.set_conn_handler([&](rpc::RPC_SocketChannel *p_channel, int ec) {
+        if ( ec != rpc::RPC_Constants::Ok ) return rpc::RPC_Constants::Fail;
+        large_seq.push_back(everest::Mutable_Byte_Buffer(&header[0], header.size()));
+        rpc::RPC_Message large(large_seq);
+        large.init_header();
+        everest::Mutable_Byte_Buffer part(&body[0], body.size());
+        part.size(body.size());
+        large_seq.push_back(part);
+        large.update_header();
+        small_seq.push_back(everest::Mutable_Byte_Buffer(&small[0], small.size()));
+        rpc::RPC_Message next(small_seq);
+        next.init_header();
+        next.update_header();
+        client.post_send(p_channel, large, 200);
+        client.post_send(p_channel, next, -1);
+        return rpc::RPC_Constants::Ok;
+    });
+    client.set_send_handler([&sent_ec](rpc::RPC_SocketChannel *p_channel, rpc::RPC_Message &msg, int ec) {
+        sent_ec.push_back(ec);
+        return rpc::RPC_Constants::Ok;
+    });
+    CHECK( client.open_channel(RPC_PARTIAL_ENDPOINT, 3000) );
+
+    int64_t start = everest::DateTime::get_timestamp();
+    while ( sent_ec.size() < 2 && everest::DateTime::get_timestamp() - start < 3000000 ) {
+        client.run_once(10);
+        server.run_once(0);
+    }
+    CHECK( p_accepted != nullptr );
+    recv_seq.push_back(everest::Mutable_Byte_Buffer(&recv_header[0], recv_header.size()));
+    CHECK( server.post_receive(p_accepted, rpc::RPC_Message(recv_seq), -1) );
+    while ( recv_ok + recv_failed == 0 && everest::DateTime::get_timestamp() - start < 6000000 ) {
+        client.run_once(0);
+        server.run_once(10);
+    }
+    printf("[INFO] Test partial timeout, send ec %d %d, received %d, failed %d\n",
+        sent_ec.size() > 0 ? sent_ec[0] : 0, sent_ec.size() > 1 ? sent_ec[1] : 0, recv_ok, recv_failed);
+    CHECK( sent_ec.size() == 2 );
+    CHECK( sent_ec[0] == rpc::RPC_Constants::Timeout );
+    CHECK( sent_ec[1] == rpc::RPC_Constants::Fail );
+    CHECK( recv_ok == 0 && recv_failed == 1 );
+    return 0;
+}
+
+static const size_t Pressure_Message_Size = 16 * 1024;
+static const size_t Pressure_Low_Mark     = 64 * 1024;
+static const size_t Pressure_High_Mark    = 256 * 1024;
+static const size_t Pressure_Request_Size = 64;
+static const int    Pressure_Rounds       = 2;
+
+std::atomic<int>  pressure_posted(0);      // post_send接受的消息数
+std::atomic<int>  pressure_rejected(0);    // post_send因高水位返回false的次数
+std::atomic<int>  pressure_drained(0);
+std::atomic<int>  pressure_received(0);
+std::atomic<bool> pressure_in_order(true);
+std::atomic<bool> pressure_request(false); // 服务端收到了客户端的请求
+
+// 连续投递消息直到post_send报告背压
+static void post_until_full(rpc::RPC_Service<> &service, rpc::RPC_SocketChannel *p_channel)
+{
+    for(;;) {
+        rpc::RPC_Message msg = pressure_message(Pressure_Message_Size, pressure_posted.load());
+        if ( !service.post_send(p_channel, msg, -1) ) {
+            pressure_rejected.fetch_add(1);
+            return;
+        }
+        pressure_posted.fetch_add(1);
+    }
+}
+
+// 降到低水位后再投递一轮
+class PressureDrainHandler
+{
+private:
+    rpc::RPC_Service<> &m_service;
+
+public:
+    PressureDrainHandler(rpc::RPC_Service<> &service) : m_service(service) {}
+
+    void operator()(rpc::RPC_SocketChannel *p_channel) {
+        if ( pressure_drained.fetch_add(1) + 1 < Pressure_Rounds ) post_until_full(m_service, p_channel);
+    }
+};
+
+class PressureServerRecvHandler
+{
+public:
+    PressureServerRecvHandler(rpc::RPC_Service<> &service) {}
+
+    int operator()(rpc::RPC_SocketChannel *p_channel, rpc::RPC_Message &msg, int ec) {
+        if ( ec != rpc::RPC_Constants::Ok ) return rpc::RPC_Constants::Fail;
+        pressure_request.store(msg.size() == Pressure_Request_Size);
+        return rpc::RPC_Constants::Ok;
+    }
+};
+
+class PressureConnectHandler
+{
+private:
+    rpc::RPC_Service<> &m_service;
+
+public:
+    PressureConnectHandler(rpc::RPC_Service<> &service) : m_service(service) {}
+
+    int operator()(rpc::RPC_SocketChannel *p_channel, int ec) {
+        if ( ec != rpc::RPC_Constants::Ok ) return rpc::RPC_Constants::Fail;
+        if ( !m_service.post_send(p_channel, pressure_message(Pressure_Request_Size, 0), -1) ) return rpc::RPC_Constants::Fail;
+        return m_service.post_receive(p_channel, test_buffers.message(Pressure_Message_Size), -1) ? rpc::RPC_Constants::Ok : rpc::RPC_Constants::Fail;
+    }
+};
+
+class PressureClientRecvHandler
+{
+private:
+    rpc::RPC_Service<> &m_service;
+
+public:
+    PressureClientRecvHandler(rpc::RPC_Service<> &service) : m_service(service) {}
+
+    int operator()(rpc::RPC_SocketChannel *p_channel, rpc::RPC_Message &msg, int ec) {
+        if ( ec != rpc::RPC_Constants::Ok ) return rpc::RPC_Constants::Fail;
+        int index = pressure_received.fetch_add(1);
+        if ( msg.size() != Pressure_Message_Size || msg.buffers().front()[rpc::RPC_Message::Header_Length] != (char)index ) {
+            pressure_in_order.store(false);
+        }
+        m_service.post_receive(p_channel, test_buffers.message(Pressure_Message_Size), -1);
+        return rpc::RPC_Constants::Ok;
+    }
+};
+
+// 服务端连续投递到高水位，post_send返回false并暂停读取；发送到低水位后drain handler
+// 再投递一轮。客户端应按顺序收到全部被接受的消息，服务端最终也收到客户端的请求
+int test_send_backpressure()
+{
+    rpc::RPC_Service<> server;
+    server.set_send_watermarks(Pressure_Low_Mark, Pressure_High_Mark);
+    server.set_notsent_lowat(Pressure_Message_Size);
+    server.set_accept_handler(AcceptReceiveHandler(server, Pressure_Request_Size, [](rpc::RPC_Service<> &service, rpc::RPC_SocketChannel *p_channel) {
+        post_until_full(service, p_channel);
+        return true;
+    }));
+    server.set_drain_handler(PressureDrainHandler(server));
+    server.set_recv_handler(PressureServerRecvHandler(server));
+    server.set_send_handler(PressureSendHandler(server));
+    rpc::RPC_Service<>::ListenerPtr p_listener = server.open_listener(RPC_PRESSURE_ENDPOINT);
+    CHECK( p_listener != nullptr );
+    CHECK( server.post_accept(p_listener, -1) );
+
+    rpc::RPC_Service<> client;
+    client.set_conn_handler(PressureConnectHandler(client));
+    client.set_recv_handler(PressureClientRecvHandler(client));
+    client.set_send_handler(PressureSendHandler(client));
+    CHECK( client.open_channel(RPC_PRESSURE_ENDPOINT, 3000) );
+
+    int64_t start = everest::DateTime::get_timestamp();
+    while ( pressure_drained.load() < Pressure_Rounds || pressure_received.load() < pressure_posted.load() 
+        || !pressure_request.load() ) 
+    {
+        if ( everest::DateTime::get_timestamp() - start > 5000000 ) break;
+        client.run_once();
+        server.run_once();
+    }
+    printf("[INFO] Test send backpressure, posted %d, rejected %d, drained %d, received %d, paused %lu times %lu us\n", 
+        pressure_posted.load(), pressure_rejected.load(), pressure_drained.load(), pressure_received.load(),
+        server.backpressure_count(), server.backpressure_time_us());
+    CHECK( pressure_posted.load() >= (int)(Pressure_High_Mark / Pressure_Message_Size) );
+    CHECK( pressure_rejected.load() == Pressure_Rounds );
+    CHECK( pressure_drained.load() == Pressure_Rounds );
+    // 第二轮被拒绝的消息加入写队列前，之前的消息可能已发出一部分，不一定再次暂停读取
+    CHECK( server.backpressure_count() >= 1 && server.backpressure_count() <= (uint64_t)Pressure_Rounds );
+    CHECK( pressure_received.load() == pressure_posted.load() );
+    CHECK( pressure_in_order.load() );
+    CHECK( pressure_request.load() );
+    return 0;
+}
+
+static const int      Budget_Channels = 3;
+static const uint64_t Budget_Requests = 5000;
+
+// 服务端每个连接每轮最多接收8个消息，大窗口流水线的连接轮流处理，应答不丢失、不乱序
+int test_read_budget()
+{
+    seq_server_channels.clear();
+    seq_server_handled.clear();
+    rpc::RPC_Service<> server;
+    server.set_accept_handler(seq_accept_handler(server));
+    server.set_recv_handler(SeqEchoHandler(server));
+    server.set_send_handler(PressureSendHandler(server));
+    server.set_read_ahead(4096);
+    server.set_read_budget(4096, 8);
+    rpc::RPC_Service<>::ListenerPtr p_listener = server.open_listener(RPC_BUDGET_ENDPOINT);
+    CHECK( p_listener != nullptr );
+    CHECK( server.post_accept(p_listener, -1) );
+    std::thread loop([&server]() { server.run(); });
+
+    rpc::RPC_Service<> client;
+    Seq_Client seq_client(client, Budget_Channels, Budget_Requests, 256);
+    for(int i = 0; i < Budget_Channels; ++i ) CHECK( client.open_channel(RPC_BUDGET_ENDPOINT, 3000) );
+    int64_t start = everest::DateTime::get_timestamp();
+    while ( !seq_client.done() && everest::DateTime::get_timestamp() - start < 10000000 ) {
+        client.run_once(10);
+    }
+    server.stop();
+    loop.join();
+
+    printf("[INFO] Test read budget, received %lu, disorder %lu, handled %d, deferred %lu\n",
+        seq_client.received, seq_client.disorder, seq_handled(server), server.deferred_count());
+    CHECK( seq_client.done() && seq_client.disorder == 0 );
+    CHECK( seq_handled(server) == (int)(Budget_Channels * Budget_Requests) );
+#ifndef EVEREST_RPC_USE_IO_URING
+    CHECK( server.deferred_count() > 0 );     // io_uring每个请求一个完成事件，不使用接收预算
+#endif
+    return 0;
+}
+
+static const uint64_t Direct_Requests = 500;
+
+struct Direct_Result
+{
+    uint64_t sent;            // 服务端send handler回调次数
+    uint64_t reentrant;       // 在post_send返回前回调的次数
+    uint64_t direct_writes;
+    uint64_t syscalls;        // 服务端proactor线程的系统调用次数
+};
+
+// 逐条请求-应答，统计服务端应答的发送方式
+static int direct_ping_pong(const char * endpoint, bool direct, Direct_Result &result)
+{
+    result.sent = result.reentrant = 0;
+    bool in_post = false;
+    rpc::RPC_Service<> server;
+    server.set_direct_write(direct);
+    server.set_accept_handler(seq_accept_handler(server));
+    server.set_recv_handler([&server, &in_post](rpc::RPC_SocketChannel *p_channel, rpc::RPC_Message &msg, int ec) {
+        if ( ec != rpc::RPC_Constants::Ok ) return rpc::RPC_Constants::Fail;
+        rpc::RPC_Message reply = pressure_message(Seq_Message_Size, 0);
+        reply.request_id(msg.request_id());
+        in_post = true;
+        server.post_send(p_channel, reply, -1);
+        in_post = false;
+        server.post_receive(p_channel, test_buffers.message(Seq_Message_Size), -1);
+        return rpc::RPC_Constants::Ok;
+    });
+    server.set_send_handler([&result, &in_post](rpc::RPC_SocketChannel *p_channel, rpc::RPC_Message &msg, int ec) {
+        if ( ec == rpc::RPC_Constants::Ok ) ++result.sent;
+        if ( in_post ) ++result.reentrant;
+        return rpc::RPC_Constants::Ok;
+    });
+    rpc::RPC_Service<>::ListenerPtr p_listener = server.open_listener(endpoint);
+    CHECK( p_listener != nullptr );
+    CHECK( server.post_accept(p_listener, -1) );
+    std::thread loop([&server]() { server.run(); });
+
+    rpc::RPC_Service<> client;
+    Seq_Client seq_client(client, 1, Direct_Requests, 1);
+    CHECK( client.open_channel(endpoint, 3000) );
+    int64_t start = everest::DateTime::get_timestamp();
+    while ( !seq_client.done() && everest::DateTime::get_timestamp() - start < 10000000 ) {
+        client.run_once(10);
+    }
+    server.stop();
+    loop.join();
+    result.direct_writes = server.direct_writes();
+    result.syscalls = server.syscall_count();
+    CHECK( seq_client.done() && seq_client.disorder == 0 );
+    return 0;
+}
+
+// proactor线程post_send时写队列为空则直接sendmsg，send handler不在post_send中回调；
+// 关闭后经任务队列和可写事件发送，系统调用更多
+int test_direct_write()
+{
+    Direct_Result direct, queued;
+    CHECK( 0 == direct_ping_pong(RPC_DIRECT_ENDPOINT, true, direct) );
+    CHECK( 0 == direct_ping_pong(RPC_QUEUED_ENDPOINT, false, queued) );
+    printf("[INFO] Test direct write, direct %lu of %lu, syscalls %lu, queued syscalls %lu\n",
+        direct.direct_writes, direct.sent, direct.syscalls, queued.syscalls);
+    CHECK( direct.sent == Direct_Requests && queued.sent == Direct_Requests );
+    CHECK( direct.reentrant == 0 && queued.reentrant == 0 );
+    CHECK( queued.direct_writes == 0 );
+#ifndef EVEREST_RPC_USE_IO_URING
+    CHECK( direct.direct_writes > 0 );     // 上一个应答尚未回调时下一个应答排在其后；io_uring的写任务在下次提交时发出
+    CHECK( direct.syscalls < queued.syscalls );
+#endif
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    CHECK( 0 == test_receive_timeout() );
+    CHECK( 0 == test_coalesced_send(RPC_BATCH_ENDPOINT, 0) );
+    CHECK( 0 == test_coalesced_send(RPC_AHEAD_ENDPOINT, 4096) );
+    CHECK( 0 == test_large_message() );
+    CHECK( 0 == test_partial_timeout() );
+    CHECK( 0 == test_send_backpressure() );
+    CHECK( 0 == test_read_budget() );
+    CHECK( 0 == test_direct_write() );
+    return 0;
+}
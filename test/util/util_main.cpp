@@ -0,0 +1,217 @@
+#include <everest/mpsc_queue.h>
+#include <everest/spsc_queue.h>
+#include <everest/executor.h>
+#include <everest/open_hash_map.h>
+#include <everest/thread_group.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <unistd.h>
+
+#define CHECK( x ) \
+    do {\
+        if ( !(x) ) return -1; \
+    } while (0)
+
+int test_mpsc_queue()
+{
+    const int producers = 4;
+    const int count = 100000;
+    everest::MPSC_Queue<int> queue;
+    
+    std::vector<std::thread> threads;
+    for(int i = 0; i < producers; ++i ) {
+        threads.push_back(std::thread([&queue, count]() {
+            for(int n = 1; n <= count; ++n ) queue.push(n);
+        }));
+    }
+    
+    int64_t sum = 0;
+    int popped = 0;
+    while ( popped < producers * count ) {
+        int v;
+        if ( queue.pop(v) ) {
+            sum += v;
+            ++popped;
+        }
+    }
+    for(size_t i = 0; i < threads.size(); ++i ) threads[i].join();
+    
+    CHECK( queue.empty() );
+    CHECK( sum == (int64_t)producers * count * (count + 1) / 2 );
+    return 0;
+}
+
+// 任务在工作线程中继续提交子任务(进入本线程队列)，空闲的线程应窃取执行，全部任务执行一次
+int test_work_stealing_executor()
+{
+    const int Parents = 64;
+    const int Children = 16;
+    std::atomic<int> count(0);
+    std::atomic<int> in_worker(0);
+    uint64_t steals = 0;
+    {
+        everest::Work_Stealing_Executor executor(2);
+        CHECK( executor.size() == 2 );
+        CHECK( !executor.in_worker() );
+        for(int i = 0; i < Parents; ++i ) {
+            CHECK( executor.submit([&executor, &count, &in_worker]() {
+                if ( executor.in_worker() ) in_worker.fetch_add(1);
+                for(int j = 0; j < Children; ++j ) {
+                    executor.submit([&count]() { ::usleep(100); count.fetch_add(1); });
+                }
+                count.fetch_add(1);
+            }) );
+        }
+        executor.stop();
+        CHECK( !executor.submit([]() {}) );
+        steals = executor.steals();
+        printf("[INFO] Test work stealing executor, executed %lu, steals %lu\n", executor.executed(), steals);
+        CHECK( executor.executed() == (uint64_t)(Parents * (Children + 1)) );
+    }
+    CHECK( count.load() == Parents * (Children + 1) );
+    CHECK( in_worker.load() == Parents );
+
+    // 提交子任务的线程一直阻塞，子任务只能被另一个线程窃取执行
+    std::atomic<int> stolen(0);
+    everest::Work_Stealing_Executor executor(2);
+    executor.submit([&executor, &stolen]() {
+        for(int j = 0; j < Children; ++j ) executor.submit([&stolen]() { stolen.fetch_add(1); });
+        for(int n = 0; n < 1000 && stolen.load() < Children; ++n ) ::usleep(1000);
+    });
+    executor.stop();
+    printf("[INFO] Test work stealing executor, blocked owner, steals %lu\n", executor.steals());
+    CHECK( stolen.load() == Children );
+    CHECK( executor.steals() == (uint64_t)Children );
+    return 0;
+}
+
+// 随机插入删除，与std::unordered_map比较，删除后移元素后查找仍然正确
+int test_open_hash_map()
+{
+    everest::Open_Hash_Map<int> map(4);
+    std::unordered_map<uint64_t, int> ref;
+    uint64_t seed = 12345;
+    for(int i = 0; i < 20000; ++i ) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        uint64_t key = (seed >> 33) % 512 + 1;
+        if ( (seed >> 20) % 3 == 0 ) {
+            int value = 0;
+            bool found = map.take(key, value);
+            CHECK( found == (ref.count(key) > 0) );
+            if ( found ) {
+                CHECK( value == ref[key] );
+                ref.erase(key);
+            }
+        } else {
+            CHECK( map.insert(key, i) == (ref.count(key) == 0) );
+            if ( !ref.count(key) ) ref[key] = i;
+        }
+        CHECK( map.size() == ref.size() );
+    }
+    for(uint64_t key = 1; key <= 512; ++key ) {
+        int * p = map.find(key);
+        CHECK( (p != nullptr) == (ref.count(key) > 0) );
+        if ( p ) CHECK( *p == ref[key] );
+    }
+    printf("[INFO] Test open hash map, size %lu, capacity %lu\n", map.size(), map.capacity());
+    return 0;
+}
+
+// cpu列表解析、按cgroup配额计算可用cpu数，线程组的线程按序号命名并绑定cpu
+int test_thread_group()
+{
+    std::vector<int> cpus;
+    CHECK( everest::parse_cpu_list("0-3,8,10-11", cpus) );
+    CHECK( cpus.size() == 7 && cpus[3] == 3 && cpus[4] == 8 && cpus[6] == 11 );
+    cpus.clear();
+    CHECK( !everest::parse_cpu_list("3-1", cpus) && !everest::parse_cpu_list("0,x", cpus) );
+
+    size_t available = everest::available_cpus();
+    long online = ::sysconf(_SC_NPROCESSORS_ONLN);
+    printf("[INFO] Test thread group, available cpus %lu, online %ld, cgroup quota %.2f\n", 
+        available, online, everest::cgroup_cpu_quota());
+    CHECK( available >= 1 && (long)available <= online );
+
+    std::vector<int> first(1, 0);
+    everest::Thread_Group group("tg-test", 2, first);
+    CHECK( group.size() == 2 && group.cpu(1) == 0 );
+    std::mutex mutex;
+    std::vector<std::string> names;
+    std::atomic<int> pinned(0);
+    CHECK( group.start([&](size_t idx) {
+        char name[16] = { 0 };
+        ::pthread_getname_np(::pthread_self(), name, sizeof(name));
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        if ( ::pthread_getaffinity_np(::pthread_self(), sizeof(set), &set) == 0 
+            && CPU_COUNT(&set) == 1 && CPU_ISSET(0, &set) ) ++pinned;
+        std::lock_guard<std::mutex> lock(mutex);
+        names.push_back(name);
+    }) );
+    CHECK( !group.start([](size_t) {}) );
+    group.join();
+    std::sort(names.begin(), names.end());
+    CHECK( names.size() == 2 && names[0] == "tg-test-0" && names[1] == "tg-test-1" );
+    CHECK( pinned.load() == 2 );
+
+    everest::Thread_Group workers("tg-worker", 2);
+    everest::Work_Stealing_Executor executor(workers);
+    CHECK( executor.size() == 2 );
+    std::atomic<int> named(0);
+    for(int i = 0; i < 8; ++i ) {
+        executor.submit([&named]() {
+            char name[16] = { 0 };
+            ::pthread_getname_np(::pthread_self(), name, sizeof(name));
+            if ( strncmp(name, "tg-worker-", 10) == 0 ) ++named;
+        });
+    }
+    executor.stop();
+    CHECK( named.load() == 8 );
+    return 0;
+}
+
+// 单生产者单消费者队列: 满时push失败，跨线程按序传递
+int test_spsc_queue()
+{
+    everest::SPSC_Queue<int> small(3);
+    CHECK( small.capacity() == 4 && small.empty() );
+    for(int i = 0; i < 4; ++i ) CHECK( small.push(i) );
+    CHECK( !small.push(4) );
+    int value = -1;
+    CHECK( small.pop(value) && value == 0 );
+    CHECK( small.push(4) );
+
+    everest::SPSC_Queue<uint64_t> queue(64);
+    const uint64_t total = 200000;
+    std::thread producer([&queue, total]() {
+        for(uint64_t i = 1; i <= total; ++i ) {
+            while ( !queue.push(i) ) std::this_thread::yield();
+        }
+    });
+    uint64_t expected = 1, disorder = 0, got = 0;
+    while ( expected <= total ) {
+        if ( !queue.pop(got) ) { std::this_thread::yield(); continue; }
+        if ( got != expected ) ++disorder;
+        ++expected;
+    }
+    producer.join();
+    CHECK( disorder == 0 && queue.empty() );
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    CHECK( 0 == test_mpsc_queue() );
+    CHECK( 0 == test_work_stealing_executor() );
+    CHECK( 0 == test_open_hash_map() );
+    CHECK( 0 == test_thread_group() );
+    CHECK( 0 == test_spsc_queue() );
+    return 0;
+}